@@ -0,0 +1,252 @@
+#include "agent.h"
+#include "messages.h"
+#include "utf8.h"
+#include <cstring>
+#include <iostream>
+#include <streambuf>
+#include <string_view>
+
+namespace WUpdater {
+
+    namespace {
+
+        // Message types on the agent socket
+        const uint8_t kRequest = 1;     // Client -> daemon: encoded AgentRequest
+        const uint8_t kOutput = 2;      // Daemon -> client: UTF-8 text for stdout
+        const uint8_t kExit = 3;        // Daemon -> client: int32 exit code, last message
+        const uint8_t kErrorOutput = 4; // Daemon -> client: UTF-8 text for stderr
+
+        const uint32_t kProtocolVersion = 1;
+        const size_t kMaxMessageSize = 16 * 1024 * 1024;
+
+        // How often the accept loop checks the stop flag
+        const unsigned kAcceptPollMs = 250;
+
+        // A client has this long to send its request; one that goes quiet is dropped
+        const unsigned kClientIdleMs = 10000;
+
+        void putUint32(std::string& out, uint32_t value) {
+            char bytes[sizeof(value)];
+            std::memcpy(bytes, &value, sizeof(value));
+            out.append(bytes, sizeof(bytes));
+        }
+
+        void putString(std::string& out, std::string_view text) {
+            putUint32(out, static_cast<uint32_t>(text.size()));
+            out.append(text.data(), text.size());
+        }
+
+        bool getUint32(std::string_view& in, uint32_t& value) {
+            if (in.size() < sizeof(value)) {
+                return false;
+            }
+            std::memcpy(&value, in.data(), sizeof(value));
+            in.remove_prefix(sizeof(value));
+            return true;
+        }
+
+        bool getString(std::string_view& in, std::string& text) {
+            uint32_t length = 0;
+            if (!getUint32(in, length) || in.size() < length) {
+                return false;
+            }
+            text.assign(in.data(), length);
+            in.remove_prefix(length);
+            return true;
+        }
+
+        std::string encodeRequest(const AgentRequest& request) {
+            std::string out;
+            putUint32(out, kProtocolVersion);
+            putUint32(out, static_cast<uint32_t>(request.arguments.size()));
+            for (const std::string& argument : request.arguments) {
+                putString(out, argument);
+            }
+            putUint32(out, static_cast<uint32_t>(request.criteria.size()));
+            for (const std::wstring& query : request.criteria) {
+                putString(out, toUtf8(query));
+            }
+            return out;
+        }
+
+        bool decodeRequest(std::string_view in, AgentRequest& request) {
+            uint32_t version = 0;
+            uint32_t count = 0;
+            std::string text;
+            if (!getUint32(in, version) || version != kProtocolVersion || !getUint32(in, count)) {
+                return false;
+            }
+            for (uint32_t i = 0; i < count; i++) {
+                if (!getString(in, text)) {
+                    return false;
+                }
+                request.arguments.push_back(text);
+            }
+            if (!getUint32(in, count)) {
+                return false;
+            }
+            for (uint32_t i = 0; i < count; i++) {
+                if (!getString(in, text)) {
+                    return false;
+                }
+                request.criteria.push_back(fromUtf8(text));
+            }
+            return in.empty();
+        }
+
+        std::string encodeText(std::wstring_view text) {
+            return toUtf8(text);
+        }
+
+        // Narrow console text is already UTF-8 (or ASCII)
+        std::string encodeText(std::string_view text) {
+            return std::string(text);
+        }
+
+        /**
+         * @brief Stream buffer forwarding console output to a client.
+         *
+         * Text is sent as one message of the given type per flush (or per
+         * full buffer). After the client goes away, output is dropped so the
+         * request can finish.
+         */
+        template <typename CharT>
+        class SocketOutputBuffer : public std::basic_streambuf<CharT> {
+        public:
+            typedef typename std::basic_streambuf<CharT>::int_type int_type;
+            typedef typename std::basic_streambuf<CharT>::traits_type traits_type;
+
+            SocketOutputBuffer(LocalSocket& socket, uint8_t type) : socket_(socket), type_(type), connected_(true) {
+                this->setp(buffer_, buffer_ + kBufferSize);
+            }
+
+            ~SocketOutputBuffer() override { sync(); }
+
+        protected:
+            int_type overflow(int_type c) override {
+                sync();
+                if (!traits_type::eq_int_type(c, traits_type::eof())) {
+                    *this->pptr() = traits_type::to_char_type(c);
+                    this->pbump(1);
+                }
+                return traits_type::not_eof(c);
+            }
+
+            int sync() override {
+                if (this->pptr() > this->pbase()) {
+                    if (connected_) {
+                        std::basic_string_view<CharT> text(this->pbase(), static_cast<size_t>(this->pptr() - this->pbase()));
+                        connected_ = socket_.send(type_, encodeText(text));
+                    }
+                    this->setp(buffer_, buffer_ + kBufferSize);
+                }
+                return 0;
+            }
+
+        private:
+            static const size_t kBufferSize = 4096;
+
+            LocalSocket& socket_;
+            uint8_t type_;
+            bool connected_;
+            CharT buffer_[kBufferSize];
+        };
+
+        // Points a stream at another buffer for the lifetime of the object
+        template <typename CharT>
+        class ScopedRedirect {
+        public:
+            ScopedRedirect(std::basic_ostream<CharT>& stream, std::basic_streambuf<CharT>* buffer)
+                : stream_(stream), previous_(stream.rdbuf(buffer)) {}
+
+            ~ScopedRedirect() {
+                stream_.flush();
+                stream_.rdbuf(previous_);
+            }
+
+            ScopedRedirect(const ScopedRedirect&) = delete;
+            ScopedRedirect& operator=(const ScopedRedirect&) = delete;
+
+        private:
+            std::basic_ostream<CharT>& stream_;
+            std::basic_streambuf<CharT>* previous_;
+        };
+
+    } // namespace
+
+    AgentServer::AgentServer(const std::string& socketPath) : socketPath_(socketPath) {}
+
+    bool AgentServer::start() {
+        return listener_.listen(socketPath_);
+    }
+
+    void AgentServer::run(const Handler& handler, const std::atomic<bool>& stop) {
+        while (!stop) {
+            LocalSocket client;
+            if (listener_.accept(client, kAcceptPollMs) && client.setReceiveTimeout(kClientIdleMs)) {
+                serve(client, handler);
+            }
+        }
+        listener_.close();
+    }
+
+    void AgentServer::serve(LocalSocket& client, const Handler& handler) {
+        uint8_t type = 0;
+        std::string payload;
+        AgentRequest request;
+        if (!client.receive(type, payload, kMaxMessageSize) || type != kRequest ||
+            !decodeRequest(payload, request)) {
+            return;
+        }
+
+        int exitCode = 1;
+        {
+            // Route stdout and stderr to the client while the request runs,
+            // so records and messages stay apart on its side as well
+            SocketOutputBuffer<wchar_t> output(client, kOutput);
+            SocketOutputBuffer<wchar_t> errors(client, kErrorOutput);
+            SocketOutputBuffer<char> narrowErrors(client, kErrorOutput);
+            ScopedRedirect<wchar_t> outputRedirect(std::wcout, &output);
+            ScopedRedirect<wchar_t> errorRedirect(std::wcerr, &errors);
+            ScopedRedirect<char> narrowErrorRedirect(std::cerr, &narrowErrors);
+            try {
+                exitCode = handler(request);
+            } catch (std::exception& e) {
+                std::wcout << L"[!] Exception: " << e.what() << std::endl;
+            } catch (...) {
+                std::wcout << L"[!] Unknown error occurred" << std::endl;
+            }
+        }
+
+        std::string code;
+        putUint32(code, static_cast<uint32_t>(static_cast<int32_t>(exitCode)));
+        client.send(kExit, code);
+    }
+
+    int runAgentRequest(const std::string& socketPath, const AgentRequest& request) {
+        LocalSocket socket;
+        if (!socket.connect(socketPath) || !socket.send(kRequest, encodeRequest(request))) {
+            std::wcout << Messages::Errors::agentUnavailable(socketPath) << std::endl;
+            return -1;
+        }
+
+        uint8_t type = 0;
+        std::string payload;
+        while (socket.receive(type, payload, kMaxMessageSize)) {
+            if (type == kOutput) {
+                std::wcout << fromUtf8(payload) << std::flush;
+            } else if (type == kErrorOutput) {
+                std::wcerr << fromUtf8(payload) << std::flush;
+            } else if (type == kExit) {
+                std::string_view in(payload);
+                uint32_t code = 1;
+                getUint32(in, code);
+                return static_cast<int32_t>(code);
+            }
+        }
+
+        std::wcout << Messages::Errors::agentDisconnected() << std::endl;
+        return 1;
+    }
+
+} // namespace WUpdater
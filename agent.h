@@ -0,0 +1,52 @@
+#pragma once
+
+#include "local_socket.h"
+#include <atomic>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace WUpdater {
+
+    // One request sent by a thin client to the agent daemon
+    struct AgentRequest {
+        std::vector<std::string> arguments;     // Command line options, as the client received them
+        std::vector<std::wstring> criteria;     // Queries the client read from its criteria file
+    };
+
+    /**
+     * @brief Daemon side of the agent: serves thin clients on a local socket.
+     *
+     * Requests run one at a time on the thread calling run(), so the backend
+     * and its COM apartment stay on that thread for the daemon's lifetime.
+     * Everything written to std::wcout, std::wcerr and std::cerr while a
+     * request runs is streamed back to its client as it is flushed, keeping
+     * stdout and stderr apart, followed by the handler's exit code.
+     * A client that disconnects does not cancel its request.
+     */
+    class AgentServer {
+    public:
+        typedef std::function<int(const AgentRequest& request)> Handler;
+
+        explicit AgentServer(const std::string& socketPath);
+
+        // Start listening; fails if the path is in use by a live daemon
+        bool start();
+
+        // Serve requests until stop is raised
+        void run(const Handler& handler, const std::atomic<bool>& stop);
+
+    private:
+        std::string socketPath_;
+        LocalSocket listener_;
+
+        void serve(LocalSocket& client, const Handler& handler);
+    };
+
+    /**
+     * @brief Send a request to the daemon at socketPath and print its output
+     * @return The request's exit code, or -1 if no daemon answered
+     */
+    int runAgentRequest(const std::string& socketPath, const AgentRequest& request);
+
+} // namespace WUpdater
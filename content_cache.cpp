@@ -0,0 +1,402 @@
+#include "content_cache.h"
+#include "logger.h"
+#include "utf8.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace WUpdater {
+
+    namespace {
+
+        const char kMagic[4] = { 'W', 'U', 'C', 'M' };
+        const uint32_t kVersion = 1;
+
+        struct ManifestHeader {
+            char magic[4];
+            uint32_t version;
+            uint32_t recordSize;
+            uint32_t reserved;
+        };
+        static_assert(sizeof(ManifestHeader) == 16, "manifest header layout changed");
+
+        // One payload file of one update. fileCount records with fileIndex
+        // 0 .. fileCount-1 make up an update.
+        struct ManifestRecord {
+            char updateId[36];                  // ASCII, lower case
+            int32_t revision;
+            uint8_t sha256[32];
+            int64_t size;
+            int32_t bundle;
+            uint16_t fileIndex;
+            uint16_t fileCount;
+            uint16_t nameLength;                // UTF-8 bytes
+            char name[166];
+        };
+        static_assert(sizeof(ManifestRecord) == 256, "manifest record layout changed");
+
+        // FIPS 180-4 SHA-256
+        class Sha256 {
+        public:
+            Sha256() : length_(0), buffered_(0) {
+                static const uint32_t kInitial[8] = {
+                    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+                };
+                std::memcpy(state_, kInitial, sizeof(state_));
+            }
+
+            void update(const uint8_t* data, size_t size) {
+                length_ += size;
+                while (size > 0) {
+                    size_t take = (std::min)(size, sizeof(buffer_) - buffered_);
+                    std::memcpy(buffer_ + buffered_, data, take);
+                    buffered_ += take;
+                    data += take;
+                    size -= take;
+                    if (buffered_ == sizeof(buffer_)) {
+                        compress(buffer_);
+                        buffered_ = 0;
+                    }
+                }
+            }
+
+            void finish(uint8_t digest[32]) {
+                const uint64_t bits = length_ * 8;
+                const uint8_t pad = 0x80;
+                update(&pad, 1);
+                const uint8_t zero = 0;
+                while (buffered_ != 56) {
+                    update(&zero, 1);
+                }
+                uint8_t tail[8];
+                for (int i = 0; i < 8; i++) {
+                    tail[i] = static_cast<uint8_t>(bits >> (56 - 8 * i));
+                }
+                update(tail, 8);
+                for (int i = 0; i < 8; i++) {
+                    for (int j = 0; j < 4; j++) {
+                        digest[i * 4 + j] = static_cast<uint8_t>(state_[i] >> (24 - 8 * j));
+                    }
+                }
+            }
+
+        private:
+            uint32_t state_[8];
+            uint64_t length_;
+            uint8_t buffer_[64];
+            size_t buffered_;
+
+            static uint32_t rotate(uint32_t value, int bits) { return (value >> bits) | (value << (32 - bits)); }
+
+            void compress(const uint8_t block[64]) {
+                static const uint32_t kRounds[64] = {
+                    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+                    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+                    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+                    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+                    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+                    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+                    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+                    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+                };
+
+                uint32_t w[64];
+                for (int i = 0; i < 16; i++) {
+                    w[i] = (uint32_t(block[i * 4]) << 24) | (uint32_t(block[i * 4 + 1]) << 16) |
+                           (uint32_t(block[i * 4 + 2]) << 8) | uint32_t(block[i * 4 + 3]);
+                }
+                for (int i = 16; i < 64; i++) {
+                    uint32_t s0 = rotate(w[i - 15], 7) ^ rotate(w[i - 15], 18) ^ (w[i - 15] >> 3);
+                    uint32_t s1 = rotate(w[i - 2], 17) ^ rotate(w[i - 2], 19) ^ (w[i - 2] >> 10);
+                    w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+                }
+
+                uint32_t a = state_[0], b = state_[1], c = state_[2], d = state_[3];
+                uint32_t e = state_[4], f = state_[5], g = state_[6], h = state_[7];
+                for (int i = 0; i < 64; i++) {
+                    uint32_t s1 = rotate(e, 6) ^ rotate(e, 11) ^ rotate(e, 25);
+                    uint32_t choose = (e & f) ^ (~e & g);
+                    uint32_t t1 = h + s1 + choose + kRounds[i] + w[i];
+                    uint32_t s0 = rotate(a, 2) ^ rotate(a, 13) ^ rotate(a, 22);
+                    uint32_t majority = (a & b) ^ (a & c) ^ (b & c);
+                    uint32_t t2 = s0 + majority;
+                    h = g;
+                    g = f;
+                    f = e;
+                    e = d + t1;
+                    d = c;
+                    c = b;
+                    b = a;
+                    a = t1 + t2;
+                }
+                state_[0] += a;
+                state_[1] += b;
+                state_[2] += c;
+                state_[3] += d;
+                state_[4] += e;
+                state_[5] += f;
+                state_[6] += g;
+                state_[7] += h;
+            }
+        };
+
+        bool hashFile(const std::string& path, uint8_t digest[32], int64_t& size) {
+            std::ifstream in(path, std::ios::binary);
+            if (!in.is_open()) {
+                return false;
+            }
+            Sha256 sha;
+            std::vector<char> buffer(1 << 16);
+            size = 0;
+            while (in) {
+                in.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+                std::streamsize got = in.gcount();
+                sha.update(reinterpret_cast<const uint8_t*>(buffer.data()), static_cast<size_t>(got));
+                size += got;
+            }
+            sha.finish(digest);
+            return true;
+        }
+
+        std::string toHex(const uint8_t* bytes, size_t size) {
+            static const char kDigits[] = "0123456789abcdef";
+            std::string hex(size * 2, '0');
+            for (size_t i = 0; i < size; i++) {
+                hex[i * 2] = kDigits[bytes[i] >> 4];
+                hex[i * 2 + 1] = kDigits[bytes[i] & 15];
+            }
+            return hex;
+        }
+
+        std::wstring recordKey(std::wstring_view updateId, int32_t revision) {
+            std::wstring key(updateId);
+            for (wchar_t& c : key) {
+                c = (c >= L'A' && c <= L'Z') ? static_cast<wchar_t>(c - L'A' + L'a') : c;
+            }
+            return key + L"#" + std::to_wstring(revision);
+        }
+
+        // A payload name must stay a single file name inside its content directory
+        bool isPlainFileName(const std::string& name) {
+            return !name.empty() && name != "." && name != ".." &&
+                   name.find_first_of("/\\:") == std::string::npos;
+        }
+
+    } // namespace
+
+    ContentCache::ContentCache(const std::string& directory)
+        : directory_(directory),
+          manifestPath_((std::filesystem::path(directory) / "manifest.wcm").string()),
+          indexedRecords_(0) {}
+
+    bool ContentCache::open(std::string& error) {
+        std::error_code ec;
+        std::filesystem::create_directories(std::filesystem::path(directory_) / "content", ec);
+        if (ec) {
+            error = "cannot create " + directory_ + ": " + ec.message();
+            return false;
+        }
+
+        // Two hosts creating the manifest at the same moment both write the
+        // same header; the atomic replace keeps one of them intact
+        if (!std::filesystem::exists(manifestPath_, ec) || std::filesystem::file_size(manifestPath_, ec) == 0) {
+            ManifestHeader header = {};
+            std::memcpy(header.magic, kMagic, sizeof(kMagic));
+            header.version = kVersion;
+            header.recordSize = sizeof(ManifestRecord);
+            if (!writeFileAtomically(manifestPath_, &header, sizeof(header))) {
+                error = "cannot create " + manifestPath_;
+                return false;
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!reload()) {
+            error = manifestPath_ + " is not a content cache manifest";
+            return false;
+        }
+        return true;
+    }
+
+    bool ContentCache::reload() {
+        manifest_.close();
+        if (!manifest_.open(manifestPath_) || manifest_.size() < sizeof(ManifestHeader)) {
+            return false;
+        }
+        const ManifestHeader* header = reinterpret_cast<const ManifestHeader*>(manifest_.data());
+        if (std::memcmp(header->magic, kMagic, sizeof(kMagic)) != 0 || header->version != kVersion ||
+            header->recordSize != sizeof(ManifestRecord)) {
+            return false;
+        }
+
+        // Records never change once written, so only the new ones are indexed
+        const size_t count = (manifest_.size() - sizeof(ManifestHeader)) / sizeof(ManifestRecord);
+        const ManifestRecord* records = reinterpret_cast<const ManifestRecord*>(manifest_.data() + sizeof(ManifestHeader));
+        for (; indexedRecords_ < count; indexedRecords_++) {
+            const ManifestRecord& record = records[indexedRecords_];
+            std::wstring updateId(record.updateId, record.updateId + sizeof(record.updateId));
+            index_[recordKey(updateId, record.revision)].push_back(indexedRecords_);
+        }
+        return true;
+    }
+
+    bool ContentCache::collect(std::wstring_view updateId, int32_t revision, std::vector<Entry>& entries) const {
+        entries.clear();
+        auto found = index_.find(recordKey(updateId, revision));
+        if (found == index_.end()) {
+            return false;
+        }
+
+        // Concurrent exporters may have recorded the same update twice; the
+        // first record of each file wins, the content is identical anyway
+        const ManifestRecord* records = reinterpret_cast<const ManifestRecord*>(manifest_.data() + sizeof(ManifestHeader));
+        const size_t fileCount = records[found->second.front()].fileCount;
+        entries.resize(fileCount);
+        std::vector<bool> present(fileCount, false);
+        size_t missing = fileCount;
+        for (size_t recordIndex : found->second) {
+            const ManifestRecord& record = records[recordIndex];
+            if (record.fileCount != fileCount || record.fileIndex >= fileCount || present[record.fileIndex]) {
+                continue;
+            }
+
+            // Other hosts write the manifest; a name that would leave the content directory is skipped
+            std::string name(record.name, (std::min)(static_cast<size_t>(record.nameLength), sizeof(record.name)));
+            if (!isPlainFileName(name)) {
+                continue;
+            }
+            Entry& entry = entries[record.fileIndex];
+            entry.file.name = fromUtf8(name);
+            entry.file.bundle = record.bundle;
+            entry.size = record.size;
+            std::memcpy(entry.sha256, record.sha256, sizeof(entry.sha256));
+            entry.path = (std::filesystem::path(directory_) / "content" / toHex(record.sha256, sizeof(record.sha256)) / name).string();
+            present[record.fileIndex] = true;
+            missing--;
+        }
+        return fileCount > 0 && missing == 0;
+    }
+
+    bool ContentCache::contains(std::wstring_view updateId, int32_t revision) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<Entry> entries;
+        return collect(updateId, revision, entries);
+    }
+
+    bool ContentCache::append(const void* records, size_t size) {
+        std::FILE* file = std::fopen(manifestPath_.c_str(), "ab");
+        if (file == nullptr) {
+            return false;
+        }
+        bool written = std::fwrite(records, 1, size, file) == size;
+        written = std::fclose(file) == 0 && written;
+        return written;
+    }
+
+    HRESULT ContentCache::exportUpdate(UpdateBackend& backend, const UpdateHandle& handle,
+                                       std::wstring_view updateId, int32_t revision) {
+        static std::atomic<uint64_t> sequence(0);
+
+        std::vector<ContentFile> files;
+        HRESULT hr = backend.getContentFiles(handle, files);
+        if (FAILED(hr)) {
+            return hr;
+        }
+        if (files.empty() || files.size() > UINT16_MAX || updateId.size() != sizeof(ManifestRecord::updateId)) {
+            return WU_E_NOT_SUPPORTED;
+        }
+
+        const std::string lowerId = toUtf8(recordKey(updateId, revision).substr(0, updateId.size()));
+        std::vector<ManifestRecord> records(files.size());
+        const std::filesystem::path content = std::filesystem::path(directory_) / "content";
+        for (size_t i = 0; i < files.size(); i++) {
+            std::string name = toUtf8(files[i].name);
+            if (!isPlainFileName(name) || name.size() > sizeof(ManifestRecord::name)) {
+                return E_INVALIDARG;
+            }
+
+            // Fetch under a temporary name, then move it to its content address
+            char temporary[64];
+            std::snprintf(temporary, sizeof(temporary), ".fetch-%llx-%llu",
+                          static_cast<unsigned long long>(std::chrono::steady_clock::now().time_since_epoch().count()),
+                          static_cast<unsigned long long>(sequence.fetch_add(1)));
+            const std::string fetchPath = (content / temporary).string();
+            hr = backend.fetchContentFile(files[i], fetchPath);
+
+            ManifestRecord& record = records[i];
+            std::memset(&record, 0, sizeof(record));
+            std::error_code ec;
+            if (FAILED(hr) || !hashFile(fetchPath, record.sha256, record.size)) {
+                std::filesystem::remove(fetchPath, ec);
+                return FAILED(hr) ? hr : E_FAIL;
+            }
+
+            const std::filesystem::path directory = content / toHex(record.sha256, sizeof(record.sha256));
+            const std::filesystem::path target = directory / name;
+            std::filesystem::create_directories(directory, ec);
+            if (std::filesystem::exists(target, ec)) {
+                std::filesystem::remove(fetchPath, ec);
+            } else {
+                std::filesystem::rename(fetchPath, target, ec);
+                if (ec) {
+                    std::filesystem::remove(fetchPath, ec);
+                    return E_FAIL;
+                }
+            }
+
+            std::memcpy(record.updateId, lowerId.data(), sizeof(record.updateId));
+            record.revision = revision;
+            record.bundle = files[i].bundle;
+            record.fileIndex = static_cast<uint16_t>(i);
+            record.fileCount = static_cast<uint16_t>(files.size());
+            record.nameLength = static_cast<uint16_t>(name.size());
+            std::memcpy(record.name, name.data(), name.size());
+        }
+
+        // All files are in place; the records of one update go out in one write
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!append(records.data(), records.size() * sizeof(ManifestRecord))) {
+            return E_FAIL;
+        }
+        reload();
+        return S_OK;
+    }
+
+    HRESULT ContentCache::importUpdate(UpdateBackend& backend, const UpdateHandle& handle,
+                                       std::wstring_view updateId, int32_t revision) {
+        std::vector<Entry> entries;
+        {
+            // Pick up what other hosts exported since the manifest was mapped
+            std::lock_guard<std::mutex> lock(mutex_);
+            reload();
+            if (!collect(updateId, revision, entries)) {
+                return S_FALSE;
+            }
+        }
+
+        std::vector<ContentFile> files;
+        std::vector<std::string> paths;
+        for (const Entry& entry : entries) {
+            std::error_code ec;
+            if (static_cast<int64_t>(std::filesystem::file_size(entry.path, ec)) != entry.size || ec) {
+                return S_FALSE;
+            }
+
+            // A truncated or damaged copy on the share must not reach the agent
+            uint8_t digest[32];
+            int64_t size = 0;
+            if (!hashFile(entry.path, digest, size) || size != entry.size ||
+                std::memcmp(digest, entry.sha256, sizeof(digest)) != 0) {
+                logText(LogLevel::WARN, L"Content cache: {s} does not match its recorded digest", fromUtf8(entry.path));
+                return S_FALSE;
+            }
+            files.push_back(entry.file);
+            paths.push_back(entry.path);
+        }
+        return backend.copyToCache(handle, files, paths);
+    }
+
+} // namespace WUpdater
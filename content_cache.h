@@ -0,0 +1,74 @@
+#pragma once
+
+#include "mapped_file.h"
+#include "update_backend.h"
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace WUpdater {
+
+    /**
+     * @brief Payload files shared between hosts in a directory, by content hash.
+     *
+     * Layout of the directory:
+     *   manifest.wcm                 header, then fixed 256-byte records
+     *   content/<sha256>/<name>      one payload file under its original name
+     *
+     * One host exports: it fetches the payload files of updates not yet in
+     * the directory from their source, stores each under its SHA-256, and
+     * appends one record per file. Records of an update are appended only
+     * after all its files are in place, so readers never see a record whose
+     * file is missing. Other hosts import: they map the manifest, look the
+     * update up by UpdateID and revision, and hand the files to the agent
+     * with copyToCache() instead of downloading them.
+     *
+     * The manifest is only ever appended to; a torn record at the end, from
+     * a writer that died mid-write, is ignored. Lookups go through an index
+     * built when the manifest is opened or reloaded.
+     */
+    class ContentCache {
+    public:
+        explicit ContentCache(const std::string& directory);
+
+        // Create the directory and manifest if needed and map the manifest
+        bool open(std::string& error);
+
+        const std::string& directory() const { return directory_; }
+
+        // True if every file of the update is recorded in the manifest
+        bool contains(std::wstring_view updateId, int32_t revision) const;
+
+        // Fetch the update's payload files into the directory and record them
+        HRESULT exportUpdate(UpdateBackend& backend, const UpdateHandle& handle,
+                             std::wstring_view updateId, int32_t revision);
+
+        // Place the update's recorded files into the agent's download cache;
+        // S_FALSE if a file is missing or no longer matches its recorded digest
+        HRESULT importUpdate(UpdateBackend& backend, const UpdateHandle& handle,
+                             std::wstring_view updateId, int32_t revision);
+
+    private:
+        struct Entry {
+            ContentFile file;
+            std::string path;                   // Where the file is stored in the directory
+            int64_t size;
+            uint8_t sha256[32];                 // Recorded digest, checked before import
+        };
+
+        std::string directory_;
+        std::string manifestPath_;
+        mutable std::mutex mutex_;
+        MappedFile manifest_;
+        size_t indexedRecords_;
+        std::unordered_map<std::wstring, std::vector<size_t>> index_;   // "UpdateID#revision" -> records
+
+        bool reload();
+        bool collect(std::wstring_view updateId, int32_t revision, std::vector<Entry>& entries) const;
+        bool append(const void* records, size_t size);
+    };
+
+} // namespace WUpdater
@@ -0,0 +1,774 @@
+#include "criteria.h"
+#include "messages.h"
+#include "utf8.h"
+#include <algorithm>
+#include <cwctype>
+#include <fstream>
+#include <iostream>
+
+namespace WUpdater {
+
+    // Get search criteria from file: one query per line, blank lines and '#' comments skipped
+    std::vector<std::wstring> getCriteriaFromFile(const std::string& filePath) {
+        std::vector<std::wstring> criteria;
+        std::string line;
+        std::ifstream file(filePath);
+
+        if (!file.is_open()) {
+            std::wcout << Messages::Errors::criteriaFileNotFound(filePath) << std::endl;
+            return criteria;
+        }
+
+        std::wcout << Messages::Info::criteriaLoaded();
+        bool firstLine = true;
+        while (std::getline(file, line)) {
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            // Criteria files are UTF-8; a byte order mark is not part of the first query
+            if (firstLine && line.compare(0, 3, "\xEF\xBB\xBF") == 0) {
+                line.erase(0, 3);
+            }
+            firstLine = false;
+            size_t first = line.find_first_not_of(" \t");
+            if (first == std::string::npos || line[first] == '#') {
+                continue;
+            }
+            std::wstring query = fromUtf8(std::string_view(line).substr(first));
+            std::wcout << (criteria.empty() ? L"" : L"                 ") << query << L'\n';
+            criteria.push_back(query);
+        }
+        file.close();
+
+        if (criteria.empty()) {
+            std::wcout << Messages::Errors::criteriaFileEmpty() << std::endl;
+        }
+
+        return criteria;
+    }
+
+    namespace {
+
+        // Deepest nesting of parentheses the client-side program evaluates
+        const size_t kMaxDepth = 32;
+
+        enum class ValueKind : uint8_t {
+            FLAG,           // 0 or 1
+            CHOICE,         // One of a fixed set of quoted names
+            GUID,           // Quoted GUID
+            INTEGER,        // Unquoted number
+            PATTERN,        // Quoted regular expression
+            KB_LIST,        // Number, or quoted comma separated numbers (KB prefix optional)
+            SIZE,           // Bytes, optionally with a K/M/G suffix
+            DATE,           // Quoted YYYY-MM-DD
+            SEVERITY_LIST   // Quoted comma separated MSRC severities
+        };
+
+        const unsigned kEqual = 1 << static_cast<int>(CriteriaOperator::EQUAL);
+        const unsigned kNotEqual = 1 << static_cast<int>(CriteriaOperator::NOT_EQUAL);
+        const unsigned kContains = 1 << static_cast<int>(CriteriaOperator::CONTAINS);
+
+        const wchar_t* const kTypes[] = { L"Software", L"Driver", nullptr };
+        const wchar_t* const kDeploymentActions[] = { L"Installation", L"Uninstallation", L"OptionalInstallation", nullptr };
+        const wchar_t* const kSeverities[] = { L"Unspecified", L"Low", L"Moderate", L"Important", L"Critical", nullptr };
+
+        struct AttributeSpec {
+            const wchar_t* name;
+            CriteriaAttribute attribute;
+            ValueKind kind;
+            unsigned operators;
+            const wchar_t* const* choices;
+        };
+
+        // Indexed by CriteriaAttribute
+        const AttributeSpec kAttributes[] = {
+            { L"Type", CriteriaAttribute::TYPE, ValueKind::CHOICE, kEqual | kNotEqual, kTypes },
+            { L"DeploymentAction", CriteriaAttribute::DEPLOYMENT_ACTION, ValueKind::CHOICE, kEqual, kDeploymentActions },
+            { L"IsAssigned", CriteriaAttribute::IS_ASSIGNED, ValueKind::FLAG, kEqual | kNotEqual, nullptr },
+            { L"BrowseOnly", CriteriaAttribute::BROWSE_ONLY, ValueKind::FLAG, kEqual | kNotEqual, nullptr },
+            { L"AutoSelectOnWebSites", CriteriaAttribute::AUTO_SELECT_ON_WEB_SITES, ValueKind::FLAG, kEqual | kNotEqual, nullptr },
+            { L"IsInstalled", CriteriaAttribute::IS_INSTALLED, ValueKind::FLAG, kEqual | kNotEqual, nullptr },
+            { L"IsHidden", CriteriaAttribute::IS_HIDDEN, ValueKind::FLAG, kEqual | kNotEqual, nullptr },
+            { L"IsPresent", CriteriaAttribute::IS_PRESENT, ValueKind::FLAG, kEqual | kNotEqual, nullptr },
+            { L"RebootRequired", CriteriaAttribute::REBOOT_REQUIRED, ValueKind::FLAG, kEqual | kNotEqual, nullptr },
+            { L"UpdateID", CriteriaAttribute::UPDATE_ID, ValueKind::GUID, kEqual | kNotEqual, nullptr },
+            { L"RevisionNumber", CriteriaAttribute::REVISION_NUMBER, ValueKind::INTEGER, kEqual, nullptr },
+            { L"CategoryIDs", CriteriaAttribute::CATEGORY_IDS, ValueKind::GUID, kContains, nullptr },
+            { L"TitleMatches", CriteriaAttribute::TITLE_MATCHES, ValueKind::PATTERN, kEqual | kNotEqual, nullptr },
+            { L"KB", CriteriaAttribute::KB, ValueKind::KB_LIST, kEqual | kNotEqual, nullptr },
+            { L"MaxSize", CriteriaAttribute::MAX_SIZE, ValueKind::SIZE, kEqual, nullptr },
+            { L"ReleasedAfter", CriteriaAttribute::RELEASED_AFTER, ValueKind::DATE, kEqual, nullptr },
+            { L"ReleasedBefore", CriteriaAttribute::RELEASED_BEFORE, ValueKind::DATE, kEqual, nullptr },
+            { L"Severity", CriteriaAttribute::SEVERITY, ValueKind::SEVERITY_LIST, kEqual | kNotEqual, kSeverities }
+        };
+
+        const AttributeSpec& specOf(CriteriaAttribute attribute) {
+            return kAttributes[static_cast<size_t>(attribute)];
+        }
+
+        bool equalsIgnoreCase(std::wstring_view a, std::wstring_view b) {
+            if (a.size() != b.size()) {
+                return false;
+            }
+            for (size_t i = 0; i < a.size(); i++) {
+                if (std::towlower(a[i]) != std::towlower(b[i])) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        std::wstring_view trim(std::wstring_view text) {
+            while (!text.empty() && std::iswspace(text.front())) {
+                text.remove_prefix(1);
+            }
+            while (!text.empty() && std::iswspace(text.back())) {
+                text.remove_suffix(1);
+            }
+            return text;
+        }
+
+        // Split a quoted list on commas, trimming each item
+        std::vector<std::wstring_view> splitList(std::wstring_view text) {
+            std::vector<std::wstring_view> items;
+            size_t start = 0;
+            while (start <= text.size()) {
+                size_t comma = text.find(L',', start);
+                if (comma == std::wstring_view::npos) {
+                    comma = text.size();
+                }
+                items.push_back(trim(text.substr(start, comma - start)));
+                start = comma + 1;
+            }
+            return items;
+        }
+
+        bool parseInteger(std::wstring_view text, uint64_t& value) {
+            if (text.empty() || text.size() > 18) {
+                return false;
+            }
+            value = 0;
+            for (wchar_t c : text) {
+                if (c < L'0' || c > L'9') {
+                    return false;
+                }
+                value = value * 10 + static_cast<uint64_t>(c - L'0');
+            }
+            return true;
+        }
+
+        bool isGuid(std::wstring_view text) {
+            static const size_t kDashes[] = { 8, 13, 18, 23 };
+            if (text.size() != 36) {
+                return false;
+            }
+            for (size_t i = 0; i < text.size(); i++) {
+                bool dash = std::find(std::begin(kDashes), std::end(kDashes), i) != std::end(kDashes);
+                if (dash ? text[i] != L'-' : !std::iswxdigit(text[i])) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        bool parseKb(std::wstring_view text, uint32_t& kb) {
+            if (text.size() > 2 && equalsIgnoreCase(text.substr(0, 2), L"KB")) {
+                text.remove_prefix(2);
+            }
+            uint64_t value = 0;
+            if (!parseInteger(text, value) || value == 0 || value > UINT32_MAX) {
+                return false;
+            }
+            kb = static_cast<uint32_t>(value);
+            return true;
+        }
+
+        bool parseSize(std::wstring_view text, int64_t& bytes) {
+            static const struct { const wchar_t* suffix; int64_t scale; } kSuffixes[] = {
+                { L"KB", 1024LL }, { L"MB", 1024LL * 1024 }, { L"GB", 1024LL * 1024 * 1024 },
+                { L"K", 1024LL }, { L"M", 1024LL * 1024 }, { L"G", 1024LL * 1024 * 1024 }
+            };
+            int64_t scale = 1;
+            for (const auto& entry : kSuffixes) {
+                std::wstring_view suffix(entry.suffix);
+                if (text.size() > suffix.size() && equalsIgnoreCase(text.substr(text.size() - suffix.size()), suffix)) {
+                    text.remove_suffix(suffix.size());
+                    scale = entry.scale;
+                    break;
+                }
+            }
+            uint64_t value = 0;
+            if (!parseInteger(trim(text), value) || value > static_cast<uint64_t>(INT64_MAX / scale)) {
+                return false;
+            }
+            bytes = static_cast<int64_t>(value) * scale;
+            return true;
+        }
+
+        long long daysFromCivil(long long year, unsigned month, unsigned day) {
+            year -= month <= 2 ? 1 : 0;
+            long long era = (year >= 0 ? year : year - 399) / 400;
+            long long yearOfEra = year - era * 400;
+            long long dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+            long long dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+            return era * 146097 + dayOfEra - 719468;
+        }
+
+        // YYYY-MM-DD as an OLE automation day number (days since 1899-12-30)
+        bool parseDate(std::wstring_view text, int64_t& oleDay) {
+            uint64_t year = 0, month = 0, day = 0;
+            if (text.size() != 10 || text[4] != L'-' || text[7] != L'-' ||
+                !parseInteger(text.substr(0, 4), year) || !parseInteger(text.substr(5, 2), month) ||
+                !parseInteger(text.substr(8, 2), day) || month < 1 || month > 12 || day < 1 || day > 31) {
+                return false;
+            }
+            oleDay = daysFromCivil(static_cast<long long>(year), static_cast<unsigned>(month), static_cast<unsigned>(day)) + 25569;
+            return true;
+        }
+
+        bool parseSeverities(std::wstring_view text, int64_t& mask) {
+            mask = 0;
+            for (std::wstring_view item : splitList(text)) {
+                size_t i = 0;
+                while (kSeverities[i] != nullptr && !equalsIgnoreCase(item, kSeverities[i])) {
+                    i++;
+                }
+                if (kSeverities[i] == nullptr) {
+                    return false;
+                }
+                mask |= int64_t(1) << i;
+            }
+            return true;
+        }
+
+        struct Token {
+            enum class Kind : uint8_t { WORD, NUMBER, STRING, EQUAL, NOT_EQUAL, OPEN, CLOSE, END };
+            Kind kind = Kind::END;
+            std::wstring text;
+            size_t position = 0;
+        };
+
+        class Parser {
+        public:
+            Parser(const std::wstring& query, CriteriaError& error) : query_(query), error_(error), pos_(0) {}
+
+            bool parse(CriteriaNode& root) {
+                if (!advance()) {
+                    return false;
+                }
+                if (token_.kind == Token::Kind::END) {
+                    return fail(0, L"the query is empty");
+                }
+                if (!parseOr(root, 0)) {
+                    return false;
+                }
+                if (token_.kind != Token::Kind::END) {
+                    return fail(token_.position, token_.kind == Token::Kind::CLOSE
+                                                     ? L"')' without a matching '('"
+                                                     : L"expected 'and' or 'or' before '" + token_.text + L"'");
+                }
+                return true;
+            }
+
+        private:
+            const std::wstring& query_;
+            CriteriaError& error_;
+            size_t pos_;
+            Token token_;
+
+            bool fail(size_t position, const std::wstring& message) {
+                error_.position = position;
+                error_.message = message;
+                return false;
+            }
+
+            bool isKeyword(const wchar_t* keyword) const {
+                return token_.kind == Token::Kind::WORD && equalsIgnoreCase(token_.text, keyword);
+            }
+
+            // Read the next token into token_
+            bool advance() {
+                while (pos_ < query_.size() && std::iswspace(query_[pos_])) {
+                    pos_++;
+                }
+                token_ = Token();
+                token_.position = pos_;
+                if (pos_ >= query_.size()) {
+                    return true;
+                }
+
+                wchar_t c = query_[pos_];
+                if (c == L'(' || c == L')') {
+                    token_.kind = c == L'(' ? Token::Kind::OPEN : Token::Kind::CLOSE;
+                    token_.text.assign(1, c);
+                    pos_++;
+                } else if (c == L'=') {
+                    token_.kind = Token::Kind::EQUAL;
+                    token_.text = L"=";
+                    pos_++;
+                } else if (c == L'!' && pos_ + 1 < query_.size() && query_[pos_ + 1] == L'=') {
+                    token_.kind = Token::Kind::NOT_EQUAL;
+                    token_.text = L"!=";
+                    pos_ += 2;
+                } else if (c == L'\'') {
+                    size_t close = query_.find(L'\'', pos_ + 1);
+                    if (close == std::wstring::npos) {
+                        return fail(pos_, L"unterminated string");
+                    }
+                    token_.kind = Token::Kind::STRING;
+                    token_.text = query_.substr(pos_ + 1, close - pos_ - 1);
+                    pos_ = close + 1;
+                } else if (std::iswdigit(c)) {
+                    size_t end = pos_;
+                    while (end < query_.size() && std::iswalnum(query_[end])) {
+                        end++;
+                    }
+                    token_.kind = Token::Kind::NUMBER;
+                    token_.text = query_.substr(pos_, end - pos_);
+                    pos_ = end;
+                } else if (std::iswalpha(c)) {
+                    size_t end = pos_;
+                    while (end < query_.size() && std::iswalnum(query_[end])) {
+                        end++;
+                    }
+                    token_.kind = Token::Kind::WORD;
+                    token_.text = query_.substr(pos_, end - pos_);
+                    pos_ = end;
+                } else {
+                    return fail(pos_, std::wstring(L"unexpected character '") + c + L"'");
+                }
+                return true;
+            }
+
+            bool parseOr(CriteriaNode& node, size_t depth) {
+                if (!parseAnd(node, depth)) {
+                    return false;
+                }
+                if (!isKeyword(L"or")) {
+                    return true;
+                }
+
+                CriteriaNode either;
+                either.kind = CriteriaNode::Kind::OR;
+                either.position = node.position;
+                either.children.push_back(std::move(node));
+                while (isKeyword(L"or")) {
+                    if (!advance()) {
+                        return false;
+                    }
+                    either.children.emplace_back();
+                    if (!parseAnd(either.children.back(), depth)) {
+                        return false;
+                    }
+                }
+                node = std::move(either);
+                return true;
+            }
+
+            bool parseAnd(CriteriaNode& node, size_t depth) {
+                if (!parseFactor(node, depth)) {
+                    return false;
+                }
+                if (!isKeyword(L"and")) {
+                    return true;
+                }
+
+                CriteriaNode both;
+                both.kind = CriteriaNode::Kind::AND;
+                both.position = node.position;
+                both.children.push_back(std::move(node));
+                while (isKeyword(L"and")) {
+                    if (!advance()) {
+                        return false;
+                    }
+                    both.children.emplace_back();
+                    if (!parseFactor(both.children.back(), depth)) {
+                        return false;
+                    }
+                }
+                node = std::move(both);
+                return true;
+            }
+
+            bool parseFactor(CriteriaNode& node, size_t depth) {
+                if (token_.kind == Token::Kind::OPEN) {
+                    size_t open = token_.position;
+                    if (depth + 1 >= kMaxDepth) {
+                        return fail(open, L"parentheses are nested too deeply");
+                    }
+                    if (!advance() || !parseOr(node, depth + 1)) {
+                        return false;
+                    }
+                    if (token_.kind != Token::Kind::CLOSE) {
+                        return fail(open, L"'(' is never closed");
+                    }
+                    return advance();
+                }
+                return parseTerm(node);
+            }
+
+            bool parseTerm(CriteriaNode& node) {
+                if (token_.kind != Token::Kind::WORD || isKeyword(L"and") || isKeyword(L"or")) {
+                    return fail(token_.position, token_.kind == Token::Kind::END ? L"the query ends where a term is expected"
+                                                                                 : L"expected an attribute, found '" + token_.text + L"'");
+                }
+
+                const AttributeSpec* spec = nullptr;
+                for (const AttributeSpec& candidate : kAttributes) {
+                    if (equalsIgnoreCase(token_.text, candidate.name)) {
+                        spec = &candidate;
+                        break;
+                    }
+                }
+                if (spec == nullptr) {
+                    return fail(token_.position, L"unknown attribute '" + token_.text + L"'");
+                }
+                node.kind = CriteriaNode::Kind::TERM;
+                node.position = token_.position;
+                node.attribute = spec->attribute;
+                if (!advance()) {
+                    return false;
+                }
+
+                size_t opPosition = token_.position;
+                if (token_.kind == Token::Kind::EQUAL) {
+                    node.op = CriteriaOperator::EQUAL;
+                } else if (token_.kind == Token::Kind::NOT_EQUAL) {
+                    node.op = CriteriaOperator::NOT_EQUAL;
+                } else if (isKeyword(L"contains")) {
+                    node.op = CriteriaOperator::CONTAINS;
+                } else {
+                    return fail(opPosition, std::wstring(L"expected '=', '!=' or 'contains' after ") + spec->name);
+                }
+                if ((spec->operators & (1u << static_cast<int>(node.op))) == 0) {
+                    static const wchar_t* const kOperators[] = { L"=", L"!=", L"contains" };
+                    return fail(opPosition, std::wstring(spec->name) + L" does not support '" +
+                                            kOperators[static_cast<int>(node.op)] + L"'");
+                }
+                if (!advance()) {
+                    return false;
+                }
+
+                if (token_.kind != Token::Kind::NUMBER && token_.kind != Token::Kind::STRING) {
+                    return fail(token_.position, std::wstring(L"expected a value for ") + spec->name);
+                }
+                node.value = token_.text;
+                node.quoted = token_.kind == Token::Kind::STRING;
+                if (!checkValue(*spec, node, token_.position)) {
+                    return false;
+                }
+                return advance();
+            }
+
+            bool checkValue(const AttributeSpec& spec, CriteriaNode& node, size_t position) {
+                const std::wstring name(spec.name);
+                uint64_t number = 0;
+                int64_t scratch = 0;
+                switch (spec.kind) {
+                    case ValueKind::FLAG:
+                        if (node.quoted || (node.value != L"0" && node.value != L"1")) {
+                            return fail(position, name + L" expects 0 or 1");
+                        }
+                        return true;
+                    case ValueKind::CHOICE:
+                        for (const wchar_t* const* choice = spec.choices; *choice != nullptr; choice++) {
+                            if (node.quoted && equalsIgnoreCase(node.value, *choice)) {
+                                node.value = *choice;
+                                return true;
+                            }
+                        }
+                        {
+                            std::wstring expected;
+                            for (const wchar_t* const* choice = spec.choices; *choice != nullptr; choice++) {
+                                expected += (expected.empty() ? L"'" : L", '") + std::wstring(*choice) + L"'";
+                            }
+                            return fail(position, name + L" expects one of " + expected);
+                        }
+                    case ValueKind::GUID:
+                        if (!node.quoted || !isGuid(node.value)) {
+                            return fail(position, name + L" expects a quoted GUID");
+                        }
+                        return true;
+                    case ValueKind::INTEGER:
+                        if (node.quoted || !parseInteger(node.value, number)) {
+                            return fail(position, name + L" expects a number");
+                        }
+                        return true;
+                    case ValueKind::PATTERN:
+                        if (!node.quoted) {
+                            return fail(position, name + L" expects a quoted regular expression");
+                        }
+                        try {
+                            std::wregex check(node.value, std::regex_constants::ECMAScript);
+                        } catch (const std::regex_error&) {
+                            return fail(position, L"invalid regular expression '" + node.value + L"'");
+                        }
+                        return true;
+                    case ValueKind::KB_LIST:
+                        for (std::wstring_view item : splitList(node.value)) {
+                            uint32_t kb = 0;
+                            if (!parseKb(item, kb)) {
+                                return fail(position, L"KB expects KB article numbers, e.g. 5034441 or '5034441,5034123'");
+                            }
+                        }
+                        return true;
+                    case ValueKind::SIZE:
+                        if (!parseSize(node.value, scratch)) {
+                            return fail(position, L"MaxSize expects a byte count, optionally with K, M or G");
+                        }
+                        return true;
+                    case ValueKind::DATE:
+                        if (!node.quoted || !parseDate(node.value, scratch)) {
+                            return fail(position, name + L" expects a quoted date, e.g. '2024-06-01'");
+                        }
+                        return true;
+                    case ValueKind::SEVERITY_LIST:
+                        if (!node.quoted || !parseSeverities(node.value, scratch)) {
+                            return fail(position, L"Severity expects quoted names: Unspecified, Low, Moderate, Important, Critical");
+                        }
+                        return true;
+                }
+                return true;
+            }
+        };
+
+        bool containsClient(const CriteriaNode& node) {
+            if (node.kind == CriteriaNode::Kind::TERM) {
+                return isClientAttribute(node.attribute);
+            }
+            return std::any_of(node.children.begin(), node.children.end(), containsClient);
+        }
+
+        bool containsServer(const CriteriaNode& node) {
+            if (node.kind == CriteriaNode::Kind::TERM) {
+                return !isClientAttribute(node.attribute);
+            }
+            return std::any_of(node.children.begin(), node.children.end(), containsServer);
+        }
+
+        // The search accepts 'or' only at the top; client-only groups never reach it
+        const CriteriaNode* nestedServerOr(const CriteriaNode& node, bool top) {
+            if (node.kind == CriteriaNode::Kind::TERM) {
+                return nullptr;
+            }
+            if (node.kind == CriteriaNode::Kind::OR && !top && containsServer(node)) {
+                return &node;
+            }
+            for (const CriteriaNode& child : node.children) {
+                const CriteriaNode* found = nestedServerOr(child, top && node.kind == CriteriaNode::Kind::OR);
+                if (found != nullptr) {
+                    return found;
+                }
+            }
+            return nullptr;
+        }
+
+    } // namespace
+
+    bool isClientAttribute(CriteriaAttribute attribute) {
+        return attribute >= CriteriaAttribute::TITLE_MATCHES;
+    }
+
+    bool parseCriteria(const std::wstring& query, CriteriaNode& root, CriteriaError& error) {
+        root = CriteriaNode();
+        Parser parser(query, error);
+        if (!parser.parse(root)) {
+            return false;
+        }
+
+        const CriteriaNode* nested = nestedServerOr(root, true);
+        if (nested != nullptr) {
+            error.position = nested->position;
+            error.message = L"Windows Update accepts 'or' only at the top level of a query";
+            return false;
+        }
+        return true;
+    }
+
+    std::wstring formatCriteria(const CriteriaNode& node) {
+        if (node.kind == CriteriaNode::Kind::TERM) {
+            static const wchar_t* const kOperators[] = { L"=", L"!=", L" contains " };
+            std::wstring text = specOf(node.attribute).name;
+            text += kOperators[static_cast<int>(node.op)];
+            return node.quoted ? text + L"'" + node.value + L"'" : text + node.value;
+        }
+
+        const bool isAnd = node.kind == CriteriaNode::Kind::AND;
+        std::wstring text;
+        for (const CriteriaNode& child : node.children) {
+            if (!text.empty()) {
+                text += isAnd ? L" and " : L" or ";
+            }
+            bool group = child.kind != CriteriaNode::Kind::TERM && child.kind != node.kind;
+            text += group ? L"(" + formatCriteria(child) + L")" : formatCriteria(child);
+        }
+        return text;
+    }
+
+    // Emits the postfix program of a client-side expression
+    class CriteriaCompiler {
+    public:
+        explicit CriteriaCompiler(ClientFilter& filter) : filter_(filter) {}
+
+        void emit(const CriteriaNode& node) {
+            if (node.kind != CriteriaNode::Kind::TERM) {
+                // Binary steps keep the evaluation stack as shallow as the nesting
+                const ClientFilter::Opcode op = node.kind == CriteriaNode::Kind::AND ? ClientFilter::Opcode::AND
+                                                                                     : ClientFilter::Opcode::OR;
+                for (size_t i = 0; i < node.children.size(); i++) {
+                    emit(node.children[i]);
+                    if (i > 0) {
+                        push(op, 0, 0);
+                    }
+                }
+                return;
+            }
+
+            int64_t value = 0;
+            switch (node.attribute) {
+                case CriteriaAttribute::TITLE_MATCHES:
+                    filter_.patterns_.emplace_back(node.value, std::regex_constants::ECMAScript |
+                                                               std::regex_constants::icase |
+                                                               std::regex_constants::optimize);
+                    push(ClientFilter::Opcode::TITLE_MATCHES, static_cast<uint32_t>(filter_.patterns_.size() - 1), 0);
+                    break;
+                case CriteriaAttribute::KB: {
+                    std::vector<uint32_t> kbs;
+                    for (std::wstring_view item : splitList(node.value)) {
+                        uint32_t kb = 0;
+                        parseKb(item, kb);
+                        kbs.push_back(kb);
+                    }
+                    std::sort(kbs.begin(), kbs.end());
+                    kbs.erase(std::unique(kbs.begin(), kbs.end()), kbs.end());
+                    filter_.kbLists_.push_back(std::move(kbs));
+                    push(ClientFilter::Opcode::KB_IN, static_cast<uint32_t>(filter_.kbLists_.size() - 1), 0);
+                    break;
+                }
+                case CriteriaAttribute::MAX_SIZE:
+                    parseSize(node.value, value);
+                    push(ClientFilter::Opcode::SIZE_AT_MOST, 0, value);
+                    break;
+                case CriteriaAttribute::RELEASED_AFTER:
+                    parseDate(node.value, value);
+                    push(ClientFilter::Opcode::RELEASED_ON_OR_AFTER, 0, value);
+                    break;
+                case CriteriaAttribute::RELEASED_BEFORE:
+                    parseDate(node.value, value);
+                    push(ClientFilter::Opcode::RELEASED_BEFORE, 0, value);
+                    break;
+                case CriteriaAttribute::SEVERITY:
+                    parseSeverities(node.value, value);
+                    push(ClientFilter::Opcode::SEVERITY_IN, 0, value);
+                    break;
+                default:
+                    break;
+            }
+            if (node.op == CriteriaOperator::NOT_EQUAL) {
+                push(ClientFilter::Opcode::NOT, 0, 0);
+            }
+        }
+
+    private:
+        ClientFilter& filter_;
+
+        void push(ClientFilter::Opcode op, uint32_t operand, int64_t value) {
+            filter_.program_.push_back(ClientFilter::Instruction{ op, operand, value });
+        }
+    };
+
+    bool compileCriteria(const std::wstring& query, CompiledCriteria& compiled, CriteriaError& error) {
+        compiled = CompiledCriteria();
+        CriteriaNode root;
+        if (!parseCriteria(query, root, error)) {
+            return false;
+        }
+        if (!containsClient(root)) {
+            compiled.server = query;
+            return true;
+        }
+
+        // Every top-level 'and' operand goes to one side as a whole
+        std::vector<const CriteriaNode*> operands;
+        if (root.kind == CriteriaNode::Kind::AND) {
+            for (const CriteriaNode& child : root.children) {
+                operands.push_back(&child);
+            }
+        } else {
+            operands.push_back(&root);
+        }
+
+        CriteriaNode server;
+        server.kind = CriteriaNode::Kind::AND;
+        CriteriaNode client;
+        client.kind = CriteriaNode::Kind::AND;
+        for (const CriteriaNode* operand : operands) {
+            bool hasServer = containsServer(*operand);
+            if (hasServer && containsClient(*operand)) {
+                error.position = operand->position;
+                error.message = L"client-side terms (TitleMatches, KB, MaxSize, ReleasedAfter, ReleasedBefore, Severity) "
+                                L"cannot share an 'or' with Windows Update terms";
+                return false;
+            }
+            (hasServer ? server : client).children.push_back(*operand);
+        }
+        if (server.children.empty()) {
+            error.position = 0;
+            error.message = L"the query needs at least one Windows Update term, e.g. IsInstalled=0";
+            return false;
+        }
+
+        compiled.server = formatCriteria(server.children.size() == 1 ? server.children[0] : server);
+        CriteriaCompiler compiler(compiled.filter);
+        compiler.emit(client.children.size() == 1 ? client.children[0] : client);
+        return true;
+    }
+
+    bool ClientFilter::matches(const UpdateTable& table, size_t row) const {
+        bool stack[kMaxDepth + 1];
+        size_t top = 0;
+        for (const Instruction& instruction : program_) {
+            switch (instruction.op) {
+                case Opcode::TITLE_MATCHES: {
+                    std::wstring_view title = table.title(row);
+                    stack[top++] = std::regex_search(title.begin(), title.end(), patterns_[instruction.operand]);
+                    break;
+                }
+                case Opcode::KB_IN: {
+                    const std::vector<uint32_t>& kbs = kbLists_[instruction.operand];
+                    bool found = false;
+                    for (size_t i = 0; i < table.kbCount(row) && !found; i++) {
+                        found = std::binary_search(kbs.begin(), kbs.end(), table.kbArticleId(row, i));
+                    }
+                    stack[top++] = found;
+                    break;
+                }
+                case Opcode::SIZE_AT_MOST:
+                    stack[top++] = table.maxDownloadSize(row) <= instruction.value;
+                    break;
+                case Opcode::RELEASED_ON_OR_AFTER:
+                    stack[top++] = static_cast<int64_t>(table.releaseDate(row)) >= instruction.value;
+                    break;
+                case Opcode::RELEASED_BEFORE:
+                    stack[top++] = static_cast<int64_t>(table.releaseDate(row)) < instruction.value;
+                    break;
+                case Opcode::SEVERITY_IN:
+                    stack[top++] = ((instruction.value >> static_cast<int>(table.severity(row))) & 1) != 0;
+                    break;
+                case Opcode::NOT:
+                    stack[top - 1] = !stack[top - 1];
+                    break;
+                case Opcode::AND:
+                    top--;
+                    stack[top - 1] = stack[top - 1] && stack[top];
+                    break;
+                case Opcode::OR:
+                    top--;
+                    stack[top - 1] = stack[top - 1] || stack[top];
+                    break;
+            }
+        }
+        return top == 0 || stack[0];
+    }
+
+} // namespace WUpdater
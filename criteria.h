@@ -0,0 +1,142 @@
+#pragma once
+
+#include "update_table.h"
+#include <cstdint>
+#include <regex>
+#include <string>
+#include <vector>
+
+namespace WUpdater {
+
+    // Read search criteria from a file: one query per line, blank lines and
+    // '#' comments skipped. The queries are echoed to std::wcout.
+    std::vector<std::wstring> getCriteriaFromFile(const std::string& filePath);
+
+    // Attributes a criteria term can test. The first group is evaluated by
+    // Windows Update; the second by WUpdaterCMD over the update metadata.
+    enum class CriteriaAttribute : uint8_t {
+        TYPE,
+        DEPLOYMENT_ACTION,
+        IS_ASSIGNED,
+        BROWSE_ONLY,
+        AUTO_SELECT_ON_WEB_SITES,
+        IS_INSTALLED,
+        IS_HIDDEN,
+        IS_PRESENT,
+        REBOOT_REQUIRED,
+        UPDATE_ID,
+        REVISION_NUMBER,
+        CATEGORY_IDS,
+        TITLE_MATCHES,                      // Client-side from here on
+        KB,
+        MAX_SIZE,
+        RELEASED_AFTER,
+        RELEASED_BEFORE,
+        SEVERITY
+    };
+
+    enum class CriteriaOperator : uint8_t {
+        EQUAL,
+        NOT_EQUAL,
+        CONTAINS
+    };
+
+    // Node of a parsed criteria expression
+    struct CriteriaNode {
+        enum class Kind : uint8_t { TERM, AND, OR };
+
+        Kind kind = Kind::TERM;
+        size_t position = 0;                // Offset of the node's first character in the query
+
+        // TERM
+        CriteriaAttribute attribute = CriteriaAttribute::TYPE;
+        CriteriaOperator op = CriteriaOperator::EQUAL;
+        std::wstring value;                 // Without quotes
+        bool quoted = false;
+
+        // AND / OR, two or more operands
+        std::vector<CriteriaNode> children;
+    };
+
+    // Where and why a query was rejected
+    struct CriteriaError {
+        size_t position = 0;
+        std::wstring message;
+    };
+
+    /**
+     * @brief Parse one query of the Windows Update criteria language
+     *
+     * Checks what the Windows Update Agent would reject: unknown attributes,
+     * operators an attribute does not support, malformed values, unbalanced
+     * parentheses and 'or' below the top level. Attribute names and the
+     * and/or keywords are case-insensitive.
+     *
+     * @return true and the expression in root, or false and the first problem in error
+     */
+    bool parseCriteria(const std::wstring& query, CriteriaNode& root, CriteriaError& error);
+
+    // True if the attribute is evaluated by WUpdaterCMD rather than by the search
+    bool isClientAttribute(CriteriaAttribute attribute);
+
+    // Render an expression back into criteria text with canonical spelling
+    std::wstring formatCriteria(const CriteriaNode& node);
+
+    /**
+     * @brief Client-side part of a query, compiled for evaluation per update.
+     *
+     * The expression is flattened into a postfix program over the metadata
+     * columns of an UpdateTable. Regular expressions are built once, KB lists
+     * are sorted for binary search, dates are day numbers and severity sets
+     * are bit masks, so evaluating a row allocates nothing.
+     */
+    class ClientFilter {
+    public:
+        bool empty() const { return program_.empty(); }
+
+        bool matches(const UpdateTable& table, size_t row) const;
+
+    private:
+        friend class CriteriaCompiler;
+
+        enum class Opcode : uint8_t {
+            TITLE_MATCHES,                  // operand: pattern index
+            KB_IN,                          // operand: KB list index
+            SIZE_AT_MOST,                   // value: bytes
+            RELEASED_ON_OR_AFTER,           // value: OLE day number
+            RELEASED_BEFORE,                // value: OLE day number
+            SEVERITY_IN,                    // value: bit mask of Severity values
+            NOT,
+            AND,                            // Combine the top two results
+            OR
+        };
+
+        struct Instruction {
+            Opcode op;
+            uint32_t operand;
+            int64_t value;
+        };
+
+        std::vector<Instruction> program_;
+        std::vector<std::wregex> patterns_;
+        std::vector<std::vector<uint32_t>> kbLists_;
+    };
+
+    // A query split into what the search evaluates and what is filtered locally
+    struct CompiledCriteria {
+        std::wstring server;                // Passed to the backend search
+        ClientFilter filter;                // Applied to the metadata of every update found
+    };
+
+    /**
+     * @brief Validate a query and split it into its server and client parts
+     *
+     * Client-side terms (TitleMatches, KB, MaxSize, ReleasedAfter,
+     * ReleasedBefore, Severity) must be top-level 'and' operands, alone or
+     * grouped among themselves, since the search cannot tell which branch of
+     * an 'or' an update matched. A query without client terms is passed to
+     * the search unchanged.
+     */
+    bool compileCriteria(const std::wstring& query, CompiledCriteria& compiled, CriteriaError& error);
+
+} // namespace WUpdater
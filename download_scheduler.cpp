@@ -0,0 +1,182 @@
+#include "download_scheduler.h"
+#include "worker_pool.h"
+#include <algorithm>
+#include <functional>
+#include <numeric>
+#include <queue>
+
+namespace WUpdater {
+
+    std::vector<DownloadLane> planDownloadLanes(const std::vector<int64_t>& sizes, unsigned maxLanes) {
+        const size_t count = sizes.size();
+        const size_t laneCount = (std::min)(static_cast<size_t>(maxLanes > 0 ? maxLanes : 1), count);
+        std::vector<DownloadLane> lanes(laneCount);
+        if (laneCount <= 1) {
+            if (laneCount == 1) {
+                lanes[0].positions.resize(count);
+                std::iota(lanes[0].positions.begin(), lanes[0].positions.end(), 0);
+                lanes[0].bytes = std::accumulate(sizes.begin(), sizes.end(), int64_t(0));
+            }
+            return lanes;
+        }
+
+        std::vector<size_t> order(count);
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sizes[a] > sizes[b]; });
+
+        // Large updates take a lane each
+        int64_t remaining = std::accumulate(sizes.begin(), sizes.end(), int64_t(0));
+        size_t next = 0;
+        size_t dedicated = 0;
+        while (laneCount - dedicated > 1 && count - next > 1 &&
+               sizes[order[next]] * static_cast<int64_t>(laneCount - dedicated) >= remaining) {
+            lanes[dedicated].positions.push_back(order[next]);
+            lanes[dedicated].bytes = sizes[order[next]];
+            remaining -= sizes[order[next]];
+            dedicated++;
+            next++;
+        }
+
+        // The rest go, largest first, to the lane with the fewest bytes
+        typedef std::pair<int64_t, size_t> Load;
+        std::priority_queue<Load, std::vector<Load>, std::greater<Load>> lightest;
+        for (size_t lane = dedicated; lane < laneCount; lane++) {
+            lightest.push(Load(0, lane));
+        }
+        for (; next < count; next++) {
+            Load load = lightest.top();
+            lightest.pop();
+            lanes[load.second].positions.push_back(order[next]);
+            lanes[load.second].bytes += sizes[order[next]];
+            lightest.push(Load(lanes[load.second].bytes, load.second));
+        }
+
+        for (DownloadLane& lane : lanes) {
+            std::reverse(lane.positions.begin(), lane.positions.end());
+        }
+        lanes.erase(std::remove_if(lanes.begin(), lanes.end(),
+                                   [](const DownloadLane& lane) { return lane.positions.empty(); }),
+                    lanes.end());
+        return lanes;
+    }
+
+    class ShardedDownloadObserver::Lane : public DownloadObserver {
+    public:
+        Lane(ShardedDownloadObserver& owner, size_t index, const std::vector<size_t>& positions)
+            : owner_(owner), index_(index), positions_(positions) {}
+
+        void onProgress(const DownloadProgress& progress) override {
+            owner_.report(index_, progress);
+        }
+
+        void onUpdateDownloaded(size_t position, const UpdateOutcome& outcome) override {
+            if (position < positions_.size()) {
+                owner_.finish(positions_[position], outcome);
+            }
+        }
+
+        bool cancelRequested() override {
+            return owner_.next_ != nullptr && owner_.next_->cancelRequested();
+        }
+
+    private:
+        ShardedDownloadObserver& owner_;
+        size_t index_;
+        const std::vector<size_t>& positions_;
+    };
+
+    ShardedDownloadObserver::ShardedDownloadObserver(const std::vector<DownloadLane>& lanes, DownloadObserver* next)
+        : next_(next), progress_(lanes.size()), updateCount_(0), finished_(0) {
+        for (size_t i = 0; i < lanes.size(); i++) {
+            lanes_.emplace_back(new Lane(*this, i, lanes[i].positions));
+            progress_[i].totalBytesTotal = lanes[i].bytes;
+            updateCount_ += lanes[i].positions.size();
+        }
+    }
+
+    ShardedDownloadObserver::~ShardedDownloadObserver() = default;
+
+    DownloadObserver* ShardedDownloadObserver::lane(size_t index) {
+        return lanes_[index].get();
+    }
+
+    void ShardedDownloadObserver::report(size_t lane, const DownloadProgress& progress) {
+        if (next_ == nullptr) {
+            return;
+        }
+
+        DownloadProgress total;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            progress_[lane] = progress;
+            for (const DownloadProgress& part : progress_) {
+                total.totalBytesDone += part.totalBytesDone;
+                total.totalBytesTotal += part.totalBytesTotal;
+            }
+            total.updateCount = updateCount_;
+            total.currentUpdate = (std::min)(finished_, updateCount_ > 0 ? updateCount_ - 1 : 0);
+        }
+        total.currentBytesDone = progress.currentBytesDone;
+        total.currentBytesTotal = progress.currentBytesTotal;
+        if (total.totalBytesTotal > 0) {
+            total.percentComplete = static_cast<unsigned>(total.totalBytesDone * 100 / total.totalBytesTotal);
+        }
+        next_->onProgress(total);
+    }
+
+    void ShardedDownloadObserver::finish(size_t position, const UpdateOutcome& outcome) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            finished_++;
+        }
+        if (next_ != nullptr) {
+            next_->onUpdateDownloaded(position, outcome);
+        }
+    }
+
+    HRESULT downloadInLanes(UpdateBackend& backend, const std::vector<UpdateHandle>& updates,
+                            const std::vector<DownloadLane>& lanes, std::vector<UpdateOutcome>& outcomes,
+                            DownloadObserver* observer) {
+        outcomes.assign(updates.size(), UpdateOutcome());
+        ShardedDownloadObserver sharded(lanes, observer);
+        std::vector<HRESULT> results(lanes.size(), S_OK);
+
+        WorkerPool pool(static_cast<unsigned>(lanes.size()));
+        pool.run(lanes.size(), [&](size_t index) {
+            const DownloadLane& lane = lanes[index];
+            std::vector<UpdateHandle> handles;
+            handles.reserve(lane.positions.size());
+            for (size_t position : lane.positions) {
+                handles.push_back(updates[position]);
+            }
+
+            std::vector<UpdateOutcome> laneOutcomes;
+            HRESULT hr = E_FAIL;
+            try {
+                hr = backend.download(handles, laneOutcomes, sharded.lane(index));
+            } catch (...) {
+                hr = E_FAIL;
+            }
+            results[index] = hr;
+
+            // Lanes write disjoint positions
+            laneOutcomes.resize(handles.size());
+            for (size_t i = 0; i < handles.size(); i++) {
+                UpdateOutcome outcome = laneOutcomes[i];
+                if (FAILED(hr) && outcome.result == ResultCode::NOT_STARTED) {
+                    outcome.result = ResultCode::FAILED;
+                    outcome.hresult = hr;
+                }
+                outcomes[lane.positions[i]] = outcome;
+            }
+        });
+
+        for (HRESULT hr : results) {
+            if (SUCCEEDED(hr)) {
+                return S_OK;
+            }
+        }
+        return results.empty() ? S_OK : results[0];
+    }
+
+} // namespace WUpdater
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "update_backend.h"
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace WUpdater {
+
+    // Updates downloaded by one job, in the order the job fetches them
+    struct DownloadLane {
+        std::vector<size_t> positions;          // Positions in the list being downloaded
+        int64_t bytes = 0;
+    };
+
+    /**
+     * @brief Split a download into at most maxLanes concurrent jobs by size.
+     *
+     * An update larger than an even share of the bytes still to place gets a
+     * lane of its own, as long as one lane is left for the rest; the others
+     * are packed longest-first onto the lane with the fewest bytes. Each lane
+     * then fetches its smallest updates first, so short downloads finish
+     * early instead of queueing behind a large one. Empty lanes are dropped.
+     */
+    std::vector<DownloadLane> planDownloadLanes(const std::vector<int64_t>& sizes, unsigned maxLanes);
+
+    /**
+     * @brief Merges the events of concurrent download jobs into one stream.
+     *
+     * lane(i) is the observer for the job of lanes[i]; it maps the job's
+     * positions back to the full list and adds its byte counts to the other
+     * lanes' before reporting to the next observer, so a progress renderer
+     * sees a single download of every update.
+     */
+    class ShardedDownloadObserver {
+    public:
+        ShardedDownloadObserver(const std::vector<DownloadLane>& lanes, DownloadObserver* next);
+        ~ShardedDownloadObserver();
+
+        DownloadObserver* lane(size_t index);
+
+    private:
+        class Lane;
+
+        std::vector<std::unique_ptr<Lane>> lanes_;
+        DownloadObserver* next_;
+        std::mutex mutex_;
+        std::vector<DownloadProgress> progress_;    // Last report of each lane
+        size_t updateCount_;
+        size_t finished_;
+
+        void report(size_t lane, const DownloadProgress& progress);
+        void finish(size_t position, const UpdateOutcome& outcome);
+    };
+
+    /**
+     * @brief Download updates as concurrent jobs, one per lane.
+     *
+     * Each lane runs backend.download() on its own thread, so the backend must
+     * accept concurrent calls; the WUA backend's jobs overlap, but their
+     * per-update result reads take turns on its worker pool. Updates a failed
+     * job never reached take that job's error. Returns S_OK if any job ran,
+     * otherwise the first job's error, matching a single download() call.
+     */
+    HRESULT downloadInLanes(UpdateBackend& backend, const std::vector<UpdateHandle>& updates,
+                            const std::vector<DownloadLane>& lanes, std::vector<UpdateOutcome>& outcomes,
+                            DownloadObserver* observer);
+
+} // namespace WUpdater
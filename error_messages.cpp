@@ -1,199 +1,329 @@
 #include "error_messages.h"
-#include <wuerror.h>
-#include <unordered_map>
+#include <cstddef>
 
 namespace WUpdater {
 namespace ErrorMessages {
 
-    // Error message mapping structure
-    struct ErrorInfo {
-        std::wstring message;
-        std::wstring category;
-        bool recoverable;
-    };
-
-    // Static map of all Windows Update error codes
-    static const std::unordered_map<HRESULT, ErrorInfo> errorMap = {
-        // Success
-        { S_OK, { L"Operation completed successfully", L"Success", true } },
-
-        // Service errors
-        { WU_E_NO_SERVICE, { L"Windows Update Agent was unable to provide the service", L"Service", true } },
-        { WU_E_SERVICE_STOP, { L"Operation did not complete because the service or system was being shut down", L"Service", true } },
-        { WU_E_UNKNOWN_SERVICE, { L"The update service is no longer registered with automatic updates", L"Service", true } },
-
-        // Capacity and limits
-        { WU_E_MAX_CAPACITY_REACHED, { L"The maximum capacity of the service was exceeded", L"Capacity", false } },
-        { WU_E_TOOMANYRANGES, { L"The requested number of byte ranges exceeds the maximum number", L"Capacity", false } },
-
-        // ID and index errors
-        { WU_E_UNKNOWN_ID, { L"Windows Update Agent cannot find an ID", L"Data", false } },
-        { WU_E_INVALIDINDEX, { L"The index to a collection was invalid", L"Data", false } },
-        { WU_E_ITEMNOTFOUND, { L"The key for the item queried could not be found", L"Data", false } },
-
-        // Initialization errors
-        { WU_E_NOT_INITIALIZED, { L"The object could not be initialized", L"Initialization", true } },
-
-        // Range errors
-        { WU_E_RANGEOVERLAP, { L"The update handler requested a byte range overlapping a previously requested range", L"Data", false } },
-
-        // Operation state errors
-        { WU_E_OPERATIONINPROGRESS, { L"Another conflicting operation was in progress. Some operations such as installation cannot be performed twice simultaneously", L"State", true } },
-        { WU_E_COULDNOTCANCEL, { L"Cancellation of the operation was not allowed", L"State", false } },
-        { WU_E_CALL_CANCELLED, { L"Operation was cancelled", L"Cancelled", true } },
-        { WU_E_NOOP, { L"No operation was required", L"State", true } },
-
-        // XML errors
-        { WU_E_XML_MISSINGDATA, { L"Windows Update Agent could not find required information in the update's XML data", L"Data", false } },
-        { WU_E_XML_INVALID, { L"Windows Update Agent found invalid information in the update's XML data", L"Data", false } },
-
-        // Relationship errors
-        { WU_E_CYCLE_DETECTED, { L"Circular update relationships were detected in the metadata", L"Data", false } },
-        { WU_E_TOO_DEEP_RELATION, { L"Update relationships too deep to evaluate were evaluated", L"Data", false } },
-        { WU_E_INVALID_RELATIONSHIP, { L"An invalid update relationship was detected", L"Data", false } },
-
-        // Registry errors
-        { WU_E_REG_VALUE_INVALID, { L"An invalid registry value was read", L"Configuration", false } },
-
-        // Collection errors
-        { WU_E_DUPLICATE_ITEM, { L"Operation tried to add a duplicate item to a list", L"Data", false } },
-
-        // Installation errors
-        { WU_E_INVALID_INSTALL_REQUESTED, { L"Updates that are requested for install are not installable by the caller", L"Installation", false } },
-        { WU_E_INSTALL_NOT_ALLOWED, { L"Operation tried to install while another installation was in progress or the system was pending a mandatory restart", L"Installation", true } },
-        { WU_E_NOT_APPLICABLE, { L"Operation was not performed because there are no applicable updates", L"Installation", true } },
-        { WU_E_EXCLUSIVE_INSTALL_CONFLICT, { L"An exclusive update can't be installed with other updates at the same time", L"Installation", true } },
-
-        // Permission errors
-        { WU_E_NO_USERTOKEN, { L"Operation failed because a required user token is missing", L"Permission", false } },
-        { WU_E_PER_MACHINE_UPDATE_ACCESS_DENIED, { L"Only administrators can perform this operation on per-computer updates", L"Permission", false } },
-        { WU_E_USER_ACCESS_DISABLED, { L"Group Policy settings prevented access to Windows Update", L"Permission", false } },
-
-        // Policy errors
-        { WU_E_POLICY_NOT_SET, { L"A policy value was not set", L"Policy", false } },
-        { WU_E_CALL_CANCELLED_BY_POLICY, { L"Operation did not complete because the DisableWindowsUpdateAccess policy was set", L"Policy", false } },
-
-        // Self-update errors
-        { WU_E_SELFUPDATE_IN_PROGRESS, { L"The operation could not be performed because the Windows Update Agent is self-updating", L"State", true } },
-
-        // Update errors
-        { WU_E_INVALID_UPDATE, { L"An update contains invalid metadata", L"Data", false } },
-        { WU_E_INVALID_UPDATE_TYPE, { L"The type of update is invalid", L"Data", false } },
-
-        // Network errors
-        { WU_E_NO_CONNECTION, { L"Operation did not complete because the network connection was unavailable", L"Network", true } },
-        { WU_E_PT_WINHTTP_NAME_NOT_RESOLVED, { L"The proxy server or target server name cannot be resolved", L"Network", true } },
-
-        // User interaction errors
-        { WU_E_NO_INTERACTIVE_USER, { L"Operation did not complete because there is no logged-on interactive user", L"User", true } },
-
-        // Timeout errors
-        { WU_E_TIME_OUT, { L"Operation did not complete because it timed out", L"Timeout", true } },
-
-        // Bulk operation errors
-        { WU_E_ALL_UPDATES_FAILED, { L"Operation failed for all the updates", L"Installation", false } },
-
-        // License errors
-        { WU_E_EULAS_DECLINED, { L"The license terms for all updates were declined", L"License", false } },
-        { WU_E_EULA_UNAVAILABLE, { L"License terms could not be downloaded", L"License", true } },
-        { WU_E_INVALID_PRODUCT_LICENSE, { L"Search may have missed some updates because there is an unlicensed application on the system", L"License", false } },
-
-        // Update availability
-        { WU_E_NO_UPDATE, { L"There are no updates", L"Data", true } },
-
-        // URL errors
-        { WU_E_URL_TOO_LONG, { L"The URL exceeded the maximum length", L"Data", false } },
-        { WU_E_BAD_FILE_URL, { L"The URL does not point to a file", L"Data", false } },
-
-        // Uninstall errors
-        { WU_E_UNINSTALL_NOT_ALLOWED, { L"The update could not be uninstalled because the request did not originate from a WSUS server", L"Installation", false } },
-
-        // Component errors
-        { WU_E_MISSING_HANDLER, { L"A component required to detect applicable updates was missing", L"Component", false } },
-
-        // Server errors
-        { WU_E_LEGACYSERVER, { L"An operation did not complete because it requires a newer version of server", L"Server", false } },
-
-        // Source errors
-        { WU_E_BIN_SOURCE_ABSENT, { L"A delta-compressed update could not be installed because it required the source", L"Installation", false } },
-        { WU_E_SOURCE_ABSENT, { L"A full-file update could not be installed because it required the source", L"Installation", false } },
-
-        // Access errors
-        { WU_E_WU_DISABLED, { L"Access to an unmanaged server is not allowed", L"Permission", false } },
-
-        // Proxy errors
-        { WU_E_INVALID_PROXY_SERVER, { L"The format of the proxy list was invalid", L"Network", false } },
-
-        // File errors
-        { WU_E_INVALID_FILE, { L"The file is in the wrong format", L"Data", false } },
-
-        // Criteria errors
-        { WU_E_INVALID_CRITERIA, { L"The search criteria string was invalid", L"Data", false } },
-
-        // Download errors
-        { WU_E_DOWNLOAD_FAILED, { L"Update failed to download", L"Network", true } },
-
-        // Processing errors
-        { WU_E_UPDATE_NOT_PROCESSED, { L"The update was not processed", L"Processing", false } },
-
-        // Operation errors
-        { WU_E_INVALID_OPERATION, { L"The object's current state did not allow the operation", L"State", false } },
-        { WU_E_NOT_SUPPORTED, { L"The functionality for the operation is not supported", L"Support", false } },
-
-        // Resync errors
-        { WU_E_TOO_MANY_RESYNC, { L"Agent is asked by server to resync too many times", L"Server", true } },
-
-        // Server core errors
-        { WU_E_NO_SERVER_CORE_SUPPORT, { L"The WUA API method does not run on the server core installation", L"Support", false } },
-
-        // Sysprep errors
-        { WU_E_SYSPREP_IN_PROGRESS, { L"Service is not available while sysprep is running", L"State", true } },
-
-        // UI errors
-        { WU_E_NO_UI_SUPPORT, { L"No support for the WUA user interface", L"Support", false } },
-
-        // Search scope errors
-        { WU_E_UNSUPPORTED_SEARCHSCOPE, { L"A search was attempted with a scope that is not currently supported", L"Data", false } },
+    namespace {
+
+        struct CatalogEntry {
+            HRESULT code;
+            std::wstring_view category;
+            bool recoverable;
+            std::wstring_view message;
+        };
+
+        // Every HRESULT the tool knows by name, sorted by the unsigned value of the
+        // code so lookups can binary-search it. The table is constant-initialized:
+        // no constructors run at startup and lookups never allocate.
+        constexpr CatalogEntry kCatalog[] = {
+            { S_OK, L"Success", true, L"Operation completed successfully" },
+            { E_NOTIMPL, L"Support", false, L"The requested operation is not implemented" },
+            { E_POINTER, L"Internal", false, L"An invalid pointer was passed" },
+            { E_ABORT, L"Cancelled", true, L"Operation was aborted" },
+            { E_FAIL, L"Unknown", false, L"Unspecified failure" },
+            { E_ACCESSDENIED, L"Permission", false, L"Access is denied" },
+            { E_OUTOFMEMORY, L"Resource", true, L"Not enough memory to complete the operation" },
+            { E_INVALIDARG, L"Internal", false, L"One or more arguments are invalid" },
+            { CERT_E_EXPIRED, L"Certificate", false, L"A required certificate is not within its validity period" },
+            { WU_E_NO_SERVICE, L"Service", true, L"Windows Update Agent was unable to provide the service" },
+            { WU_E_MAX_CAPACITY_REACHED, L"Capacity", false, L"The maximum capacity of the service was exceeded" },
+            { WU_E_UNKNOWN_ID, L"Data", false, L"Windows Update Agent cannot find an ID" },
+            { WU_E_NOT_INITIALIZED, L"Initialization", true, L"The object could not be initialized" },
+            { WU_E_RANGEOVERLAP, L"Data", false, L"The update handler requested a byte range overlapping a previously requested range" },
+            { WU_E_TOOMANYRANGES, L"Capacity", false, L"The requested number of byte ranges exceeds the maximum number" },
+            { WU_E_INVALIDINDEX, L"Data", false, L"The index to a collection was invalid" },
+            { WU_E_ITEMNOTFOUND, L"Data", false, L"The key for the item queried could not be found" },
+            { WU_E_OPERATIONINPROGRESS, L"State", true, L"Another conflicting operation was in progress. Some operations such as installation cannot be performed twice simultaneously" },
+            { WU_E_COULDNOTCANCEL, L"State", false, L"Cancellation of the operation was not allowed" },
+            { WU_E_CALL_CANCELLED, L"Cancelled", true, L"Operation was cancelled" },
+            { WU_E_NOOP, L"State", true, L"No operation was required" },
+            { WU_E_XML_MISSINGDATA, L"Data", false, L"Windows Update Agent could not find required information in the update's XML data" },
+            { WU_E_XML_INVALID, L"Data", false, L"Windows Update Agent found invalid information in the update's XML data" },
+            { WU_E_CYCLE_DETECTED, L"Data", false, L"Circular update relationships were detected in the metadata" },
+            { WU_E_TOO_DEEP_RELATION, L"Data", false, L"Update relationships too deep to evaluate were evaluated" },
+            { WU_E_INVALID_RELATIONSHIP, L"Data", false, L"An invalid update relationship was detected" },
+            { WU_E_REG_VALUE_INVALID, L"Configuration", false, L"An invalid registry value was read" },
+            { WU_E_DUPLICATE_ITEM, L"Data", false, L"Operation tried to add a duplicate item to a list" },
+            { WU_E_INVALID_INSTALL_REQUESTED, L"Installation", false, L"Updates that are requested for install are not installable by the caller" },
+            { WU_E_INSTALL_NOT_ALLOWED, L"Installation", true, L"Operation tried to install while another installation was in progress or the system was pending a mandatory restart" },
+            { WU_E_NOT_APPLICABLE, L"Installation", true, L"Operation was not performed because there are no applicable updates" },
+            { WU_E_NO_USERTOKEN, L"Permission", false, L"Operation failed because a required user token is missing" },
+            { WU_E_EXCLUSIVE_INSTALL_CONFLICT, L"Installation", true, L"An exclusive update can't be installed with other updates at the same time" },
+            { WU_E_POLICY_NOT_SET, L"Policy", false, L"A policy value was not set" },
+            { WU_E_SELFUPDATE_IN_PROGRESS, L"State", true, L"The operation could not be performed because the Windows Update Agent is self-updating" },
+            { WU_E_INVALID_UPDATE, L"Data", false, L"An update contains invalid metadata" },
+            { WU_E_SERVICE_STOP, L"Service", true, L"Operation did not complete because the service or system was being shut down" },
+            { WU_E_NO_CONNECTION, L"Network", true, L"Operation did not complete because the network connection was unavailable" },
+            { WU_E_NO_INTERACTIVE_USER, L"User", true, L"Operation did not complete because there is no logged-on interactive user" },
+            { WU_E_TIME_OUT, L"Timeout", true, L"Operation did not complete because it timed out" },
+            { WU_E_ALL_UPDATES_FAILED, L"Installation", false, L"Operation failed for all the updates" },
+            { WU_E_EULAS_DECLINED, L"License", false, L"The license terms for all updates were declined" },
+            { WU_E_NO_UPDATE, L"Data", true, L"There are no updates" },
+            { WU_E_USER_ACCESS_DISABLED, L"Permission", false, L"Group Policy settings prevented access to Windows Update" },
+            { WU_E_INVALID_UPDATE_TYPE, L"Data", false, L"The type of update is invalid" },
+            { WU_E_URL_TOO_LONG, L"Data", false, L"The URL exceeded the maximum length" },
+            { WU_E_UNINSTALL_NOT_ALLOWED, L"Installation", false, L"The update could not be uninstalled because the request did not originate from a WSUS server" },
+            { WU_E_INVALID_PRODUCT_LICENSE, L"License", false, L"Search may have missed some updates because there is an unlicensed application on the system" },
+            { WU_E_MISSING_HANDLER, L"Component", false, L"A component required to detect applicable updates was missing" },
+            { WU_E_LEGACYSERVER, L"Server", false, L"An operation did not complete because it requires a newer version of server" },
+            { WU_E_BIN_SOURCE_ABSENT, L"Installation", false, L"A delta-compressed update could not be installed because it required the source" },
+            { WU_E_SOURCE_ABSENT, L"Installation", false, L"A full-file update could not be installed because it required the source" },
+            { WU_E_WU_DISABLED, L"Permission", false, L"Access to an unmanaged server is not allowed" },
+            { WU_E_CALL_CANCELLED_BY_POLICY, L"Policy", false, L"Operation did not complete because the DisableWindowsUpdateAccess policy was set" },
+            { WU_E_INVALID_PROXY_SERVER, L"Network", false, L"The format of the proxy list was invalid" },
+            { WU_E_INVALID_FILE, L"Data", false, L"The file is in the wrong format" },
+            { WU_E_INVALID_CRITERIA, L"Data", false, L"The search criteria string was invalid" },
+            { WU_E_EULA_UNAVAILABLE, L"License", true, L"License terms could not be downloaded" },
+            { WU_E_DOWNLOAD_FAILED, L"Network", true, L"Update failed to download" },
+            { WU_E_UPDATE_NOT_PROCESSED, L"Processing", false, L"The update was not processed" },
+            { WU_E_INVALID_OPERATION, L"State", false, L"The object's current state did not allow the operation" },
+            { WU_E_NOT_SUPPORTED, L"Support", false, L"The functionality for the operation is not supported" },
+            { WU_E_TOO_MANY_RESYNC, L"Server", true, L"Agent is asked by server to resync too many times" },
+            { WU_E_NO_SERVER_CORE_SUPPORT, L"Support", false, L"The WUA API method does not run on the server core installation" },
+            { WU_E_SYSPREP_IN_PROGRESS, L"State", true, L"Service is not available while sysprep is running" },
+            { WU_E_UNKNOWN_SERVICE, L"Service", true, L"The update service is no longer registered with automatic updates" },
+            { WU_E_NO_UI_SUPPORT, L"Support", false, L"No support for the WUA user interface" },
+            { WU_E_PER_MACHINE_UPDATE_ACCESS_DENIED, L"Permission", false, L"Only administrators can perform this operation on per-computer updates" },
+            { WU_E_UNSUPPORTED_SEARCHSCOPE, L"Data", false, L"A search was attempted with a scope that is not currently supported" },
+            { WU_E_BAD_FILE_URL, L"Data", false, L"The URL does not point to a file" },
+            { WU_E_INVALID_NOTIFICATION_INFO, L"Data", false, L"The featured update notification info returned by the server is invalid" },
+            { WU_E_OUTOFRANGE, L"Data", false, L"The data is out of range" },
+            { WU_E_SETUP_IN_PROGRESS, L"State", true, L"WUA operations are not available while operating system setup is running" },
+            { WU_E_UNEXPECTED, L"Unknown", false, L"An operation failed due to reasons not covered by another error code" },
+            { WU_E_PT_WINHTTP_NAME_NOT_RESOLVED, L"Network", true, L"The proxy server or target server name cannot be resolved" }
+        };
+
+        constexpr size_t kCatalogSize = sizeof(kCatalog) / sizeof(kCatalog[0]);
+
+        constexpr uint32_t key(HRESULT hr) {
+            return static_cast<uint32_t>(hr);
+        }
 
-        // Notification errors
-        { WU_E_INVALID_NOTIFICATION_INFO, { L"The featured update notification info returned by the server is invalid", L"Data", false } },
+        constexpr bool catalogSorted() {
+            for (size_t i = 1; i < kCatalogSize; i++) {
+                if (key(kCatalog[i - 1].code) >= key(kCatalog[i].code)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        static_assert(catalogSorted(), "kCatalog must be sorted by code without duplicates");
+
+        // Most lookups are general Windows Update codes (0x80240000 + n, small n), so
+        // those are indexed directly by n; everything else is binary-searched
+        constexpr uint32_t kDenseBase = 0x80240000u;
+        constexpr size_t kDenseSize = 0x80;
+        constexpr uint8_t kNoEntry = 0xFF;
+        static_assert(kCatalogSize < kNoEntry, "catalog too large for the dense index");
+
+        struct DenseIndex {
+            uint8_t entry[kDenseSize];
+        };
+
+        constexpr DenseIndex buildDenseIndex() {
+            DenseIndex index{};
+            for (size_t n = 0; n < kDenseSize; n++) {
+                index.entry[n] = kNoEntry;
+            }
+            for (size_t i = 0; i < kCatalogSize; i++) {
+                uint32_t offset = key(kCatalog[i].code) - kDenseBase;
+                if (key(kCatalog[i].code) >= kDenseBase && offset < kDenseSize) {
+                    index.entry[offset] = static_cast<uint8_t>(i);
+                }
+            }
+            return index;
+        }
 
-        // Range errors
-        { WU_E_OUTOFRANGE, { L"The data is out of range", L"Data", false } },
+        constexpr DenseIndex kDenseIndex = buildDenseIndex();
 
-        // Setup errors
-        { WU_E_SETUP_IN_PROGRESS, { L"WUA operations are not available while operating system setup is running", L"State", true } },
+        // The catalog's codes in one compact array, which the binary search walks
+        struct CatalogKeys {
+            uint32_t code[kCatalogSize];
+        };
 
-        // Unexpected errors
-        { WU_E_UNEXPECTED, { L"An operation failed due to reasons not covered by another error code", L"Unknown", false } },
+        constexpr CatalogKeys buildCatalogKeys() {
+            CatalogKeys keys{};
+            for (size_t i = 0; i < kCatalogSize; i++) {
+                keys.code[i] = key(kCatalog[i].code);
+            }
+            return keys;
+        }
 
-        // Certificate errors
-        { CERT_E_EXPIRED, { L"A required certificate is not within its validity period", L"Certificate", false } }
-    };
+        constexpr CatalogKeys kCatalogKeys = buildCatalogKeys();
+
+        constexpr const CatalogEntry* findEntry(HRESULT hr) {
+            const uint32_t offset = key(hr) - kDenseBase;
+            if (key(hr) >= kDenseBase && offset < kDenseSize) {
+                uint8_t entry = kDenseIndex.entry[offset];
+                return entry != kNoEntry ? &kCatalog[entry] : nullptr;
+            }
+
+            size_t low = 0;
+            size_t high = kCatalogSize;
+            while (low < high) {
+                size_t middle = low + (high - low) / 2;
+                if (kCatalogKeys.code[middle] < key(hr)) {
+                    low = middle + 1;
+                } else {
+                    high = middle;
+                }
+            }
+            return low < kCatalogSize && kCatalogKeys.code[low] == key(hr) ? &kCatalog[low] : nullptr;
+        }
+        static_assert(findEntry(WU_E_DOWNLOAD_FAILED)->code == WU_E_DOWNLOAD_FAILED && findEntry(E_FAIL)->code == E_FAIL,
+                      "catalog lookup");
+
+        // Facility numbers (winerror.h FACILITY_*)
+        constexpr uint16_t kFacilityNull = 0;
+        constexpr uint16_t kFacilityItf = 4;
+        constexpr uint16_t kFacilityWin32 = 7;
+        constexpr uint16_t kFacilitySecurity = 9;
+        constexpr uint16_t kFacilityCert = 11;
+        constexpr uint16_t kFacilityInternet = 12;
+        constexpr uint16_t kFacilitySetupApi = 15;
+        constexpr uint16_t kFacilityHttp = 25;
+        constexpr uint16_t kFacilityBackgroundCopy = 32;
+        constexpr uint16_t kFacilityWindowsUpdate = 36;
+        constexpr uint16_t kFacilityDeliveryOptimization = 208;
+
+        struct FacilityName {
+            uint16_t facility;
+            std::wstring_view name;
+        };
+
+        constexpr FacilityName kFacilityNames[] = {
+            { kFacilityNull, L"Null" },
+            { kFacilityItf, L"Interface" },
+            { kFacilityWin32, L"Win32" },
+            { kFacilitySecurity, L"Security" },
+            { kFacilityCert, L"Certificate" },
+            { kFacilityInternet, L"Internet" },
+            { kFacilitySetupApi, L"SetupAPI" },
+            { kFacilityHttp, L"HTTP" },
+            { kFacilityBackgroundCopy, L"BITS" },
+            { kFacilityWindowsUpdate, L"WindowsUpdate" },
+            { kFacilityDeliveryOptimization, L"DeliveryOptimization" }
+        };
+
+        // Classification of failure codes missing from the catalog by facility and
+        // code range. The first matching rule wins, so narrow ranges come first.
+        struct RangeRule {
+            uint16_t facility;
+            uint16_t first;
+            uint16_t last;
+            std::wstring_view category;
+            bool recoverable;
+            std::wstring_view message;
+        };
+
+        constexpr RangeRule kRangeRules[] = {
+            // Win32 error codes wrapped in an HRESULT (0x8007xxxx)
+            { kFacilityWin32, 8, 8, L"Resource", true, L"Not enough memory to complete the operation" },
+            { kFacilityWin32, 39, 39, L"Disk", true, L"The disk is full" },
+            { kFacilityWin32, 112, 112, L"Disk", true, L"There is not enough space on the disk" },
+            { kFacilityWin32, 121, 121, L"Timeout", true, L"The operation timed out" },
+            { kFacilityWin32, 1460, 1460, L"Timeout", true, L"The operation timed out" },
+            { kFacilityWin32, 1225, 1236, L"Network", true, L"The network connection was refused, reset or unreachable" },
+            { kFacilityWin32, 1618, 1618, L"Installation", true, L"Another Windows Installer installation is already in progress" },
+            { kFacilityWin32, 1601, 1660, L"Installation", false, L"Windows Installer reported an error" },
+            { kFacilityWin32, 3010, 3018, L"Reboot", true, L"A restart is required to complete the operation" },
+            { kFacilityWin32, 12002, 12002, L"Timeout", true, L"The WinHTTP request timed out" },
+            { kFacilityWin32, 12007, 12007, L"Network", true, L"The proxy server or target server name cannot be resolved" },
+            { kFacilityWin32, 12175, 12175, L"Certificate", false, L"A WinHTTP secure channel (TLS) error occurred" },
+            { kFacilityWin32, 12001, 12192, L"Network", true, L"WinHTTP reported a network error" },
+            { kFacilityWin32, 0, 0xFFFF, L"System", false, L"The operating system reported an error" },
+
+            // Windows Update Agent components (0x8024xxxx), by subsystem
+            { kFacilityWindowsUpdate, 0x1000, 0x1FFF, L"Installation", false, L"Windows Installer error reported by the update agent" },
+            { kFacilityWindowsUpdate, 0x2000, 0x2FFF, L"Installation", false, L"An update handler failed" },
+            { kFacilityWindowsUpdate, 0x3000, 0x3FFF, L"Installation", false, L"Installation results could not be processed" },
+            { kFacilityWindowsUpdate, 0x4000, 0x4FFF, L"Network", true, L"Communication with the update server failed" },
+            { kFacilityWindowsUpdate, 0x5000, 0x5FFF, L"Server", true, L"The update service redirector failed" },
+            { kFacilityWindowsUpdate, 0x6000, 0x6FFF, L"Network", true, L"The download manager failed" },
+            { kFacilityWindowsUpdate, 0x7000, 0x7FFF, L"Data", false, L"An offline scan or update package was invalid" },
+            { kFacilityWindowsUpdate, 0x8000, 0x8FFF, L"Data", false, L"The update agent data store reported an error" },
+            { kFacilityWindowsUpdate, 0x9000, 0x9FFF, L"Data", false, L"Inventory collection failed" },
+            { kFacilityWindowsUpdate, 0xA000, 0xAFFF, L"Service", true, L"Automatic Updates reported an error" },
+            { kFacilityWindowsUpdate, 0xC000, 0xCFFF, L"Driver", false, L"A driver update failed" },
+            { kFacilityWindowsUpdate, 0xD000, 0xDFFF, L"State", true, L"The update agent self-update failed" },
+            { kFacilityWindowsUpdate, 0xE000, 0xEFFF, L"Data", false, L"An update applicability rule could not be evaluated" },
+            { kFacilityWindowsUpdate, 0xF000, 0xFFFF, L"Data", false, L"Update reporting failed" },
+            { kFacilityWindowsUpdate, 0, 0xFFFF, L"Unknown", false, L"The Windows Update Agent reported an error" },
+
+            { kFacilityBackgroundCopy, 0, 0xFFFF, L"Network", true, L"A BITS transfer failed" },
+            { kFacilityDeliveryOptimization, 0, 0xFFFF, L"Network", true, L"A Delivery Optimization download failed" },
+            { kFacilityHttp, 0, 0xFFFF, L"Network", true, L"An HTTP request failed" },
+            { kFacilityInternet, 0, 0xFFFF, L"Network", true, L"An Internet (WinINet/URLMon) request failed" },
+            { kFacilitySecurity, 0, 0xFFFF, L"Certificate", false, L"A security or trust verification error occurred" },
+            { kFacilityCert, 0, 0xFFFF, L"Certificate", false, L"A certificate could not be verified" },
+            { kFacilitySetupApi, 0, 0xFFFF, L"Driver", false, L"Device installation (SetupAPI) failed" },
+            { kFacilityItf, 0, 0xFFFF, L"Unknown", false, L"A COM interface reported an error" },
+            { kFacilityNull, 0, 0xFFFF, L"Unknown", false, L"A COM error occurred" }
+        };
+
+        constexpr std::wstring_view kUnknownMessage = L"Unknown error";
+        constexpr std::wstring_view kUnknownCategory = L"Unknown";
+
+        struct Classification {
+            std::wstring_view message;
+            std::wstring_view category;
+            bool recoverable;
+            bool exact;
+        };
+
+        Classification classify(HRESULT hr) {
+            if (const CatalogEntry* entry = findEntry(hr)) {
+                return { entry->message, entry->category, entry->recoverable, true };
+            }
+
+            // Only failures are classified; unknown success codes stay unknown
+            if (FAILED(hr)) {
+                const uint32_t bits = static_cast<uint32_t>(hr);
+                const uint16_t facility = static_cast<uint16_t>((bits >> 16) & 0x1FFF);
+                const uint16_t code = static_cast<uint16_t>(bits & 0xFFFF);
+                for (const RangeRule& rule : kRangeRules) {
+                    if (rule.facility == facility && code >= rule.first && code <= rule.last) {
+                        return { rule.message, rule.category, rule.recoverable, false };
+                    }
+                }
+            }
+            return { kUnknownMessage, kUnknownCategory, false, false };
+        }
 
-    std::wstring getErrorMessage(HRESULT hr) {
-        auto it = errorMap.find(hr);
-        if (it != errorMap.end()) {
-            return it->second.message;
+    } // namespace
+
+    ErrorDescription describeError(HRESULT hr) {
+        const uint32_t bits = static_cast<uint32_t>(hr);
+        const Classification classification = classify(hr);
+
+        ErrorDescription description;
+        description.message = classification.message;
+        description.category = classification.category;
+        description.facility = static_cast<uint16_t>((bits >> 16) & 0x1FFF);
+        description.code = static_cast<uint16_t>(bits & 0xFFFF);
+        description.recoverable = classification.recoverable;
+        description.exact = classification.exact;
+        for (const FacilityName& facility : kFacilityNames) {
+            if (facility.facility == description.facility) {
+                description.facilityName = facility.name;
+                break;
+            }
         }
-        return L"Unknown error";
+        return description;
     }
 
-    std::wstring getErrorCategory(HRESULT hr) {
-        auto it = errorMap.find(hr);
-        if (it != errorMap.end()) {
-            return it->second.category;
-        }
-        return L"Unknown";
+    std::wstring_view getErrorMessage(HRESULT hr) {
+        return classify(hr).message;
+    }
+
+    std::wstring_view getErrorCategory(HRESULT hr) {
+        return classify(hr).category;
     }
 
     bool isRecoverableError(HRESULT hr) {
-        auto it = errorMap.find(hr);
-        if (it != errorMap.end()) {
-            return it->second.recoverable;
-        }
-        return false;
+        return classify(hr).recoverable;
     }
 
 } // namespace ErrorMessages
-} // namespace WUpdater
\ No newline at end of file
+} // namespace WUpdater
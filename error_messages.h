@@ -1,24 +1,50 @@
 #pragma once
 
-#include <string>
-#include <wuerror.h>
+#include <cstdint>
+#include <string_view>
+#include "platform.h"
 
 namespace WUpdater {
 namespace ErrorMessages {
 
+    /**
+     * @brief What is known about an HRESULT.
+     *
+     * Codes in the built-in catalog get their documented message. Other
+     * failures are classified by facility and code range (Win32, WinHTTP,
+     * BITS, Windows Update subsystems, ...). The views point into static
+     * tables and stay valid for the life of the program.
+     */
+    struct ErrorDescription {
+        std::wstring_view message;
+        std::wstring_view category;         // e.g. "Network", "Installation", "Unknown"
+        std::wstring_view facilityName;     // e.g. "Win32", "WindowsUpdate"; empty if not recognized
+        uint16_t facility = 0;
+        uint16_t code = 0;
+        bool recoverable = false;
+        bool exact = false;                 // Found in the catalog rather than classified by range
+    };
+
+    /**
+     * @brief Decode an HRESULT without allocating
+     * @param hr Any HRESULT
+     * @return Message, category, facility and code of the error
+     */
+    ErrorDescription describeError(HRESULT hr);
+
     /**
      * @brief Get a human-readable error message for a Windows Update error code
      * @param hr The HRESULT error code from Windows Update API
      * @return A descriptive error message string
      */
-    std::wstring getErrorMessage(HRESULT hr);
+    std::wstring_view getErrorMessage(HRESULT hr);
 
     /**
      * @brief Get a short error category name
      * @param hr The HRESULT error code
      * @return Short category name (e.g., "Network", "Permission", etc.)
      */
-    std::wstring getErrorCategory(HRESULT hr);
+    std::wstring_view getErrorCategory(HRESULT hr);
 
     /**
      * @brief Check if the error is recoverable (can retry)
@@ -28,4 +54,4 @@ namespace ErrorMessages {
     bool isRecoverableError(HRESULT hr);
 
 } // namespace ErrorMessages
-} // namespace WUpdater
\ No newline at end of file
+} // namespace WUpdater
@@ -25,9 +25,14 @@ $ErrorActionPreference = "Stop"
 
 # Configuration
 $WUpdaterPath = ".\build\bin\Release\WUpdaterCMD.exe"
-$MaxRetries = 3
+$MaxRetries = 2
 $RetryDelaySeconds = 30
 
+# Transient failures are retried inside WUpdaterCMD, which re-submits only the
+# failed updates; the script only re-runs it after a failure that outlasted them
+$InProcessRetries = 3
+$RetryBudget = "search=600,download=3600,install=1800"
+
 # Function to write log with timestamp
 function Write-Log {
     param(
@@ -158,21 +163,28 @@ try {
 
             Write-Log "Executing WUpdaterCMD..." "INFO"
 
-            # Run WUpdaterCMD in quiet mode
+            # Run WUpdaterCMD in quiet mode; stdout carries one JSON record per line
             $process = Start-Process -FilePath $WUpdaterPath `
-                -ArgumentList "-c", $CriteriaFile, "--quiet" `
+                -ArgumentList "-c", $CriteriaFile, "--quiet", "--format", "jsonl", `
+                    "--retries", $InProcessRetries, "--retry-delay", ($RetryDelaySeconds * 1000), "--retry-budget", $RetryBudget `
                 -Wait -NoNewWindow -PassThru -RedirectStandardOutput "update-output.txt" -RedirectStandardError "update-error.txt"
 
+            # Parse the records instead of scraping console text
+            $records = @()
+            if (Test-Path "update-output.txt") {
+                $records = Get-Content "update-output.txt" | Where-Object { $_ } | ForEach-Object { $_ | ConvertFrom-Json }
+            }
+            foreach ($record in $records | Where-Object { $_.record -eq "result" -and $_.result -ne "succeeded" }) {
+                Write-Log "$($record.phase) $($record.result): $($record.title) ($($record.hresult))" "WARNING"
+            }
+
             # Check exit code
             if ($process.ExitCode -eq 0) {
                 Write-Log "WUpdaterCMD completed successfully" "SUCCESS"
                 $success = $true
 
-                # Read and log output
-                if (Test-Path "update-output.txt") {
-                    $output = Get-Content "update-output.txt" -Raw
-                    Write-Log "Output: $output" "INFO"
-                }
+                $installed = @($records | Where-Object { $_.record -eq "result" -and $_.phase -eq "install" -and $_.result -eq "succeeded" })
+                Write-Log "Installed $($installed.Count) update(s)" "INFO"
 
             } else {
                 Write-Log "WUpdaterCMD exited with code: $($process.ExitCode)" "ERROR"
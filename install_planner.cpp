@@ -0,0 +1,72 @@
+#include "install_planner.h"
+#include <algorithm>
+
+namespace WUpdater {
+
+    namespace {
+
+        // Never < can request < always
+        int rebootRank(RebootBehavior reboot) {
+            switch (reboot) {
+                case RebootBehavior::ALWAYS: return 2;
+                case RebootBehavior::CAN_REQUEST: return 1;
+                default: return 0;
+            }
+        }
+
+    } // namespace
+
+    InstallPlan planInstallBatches(const std::vector<InstallTraits>& updates) {
+        InstallPlan plan;
+        InstallBatch shared;
+        std::vector<InstallBatch> exclusive;
+        for (size_t i = 0; i < updates.size(); i++) {
+            if (updates[i].impact == InstallImpact::EXCLUSIVE) {
+                InstallBatch batch;
+                batch.positions.push_back(i);
+                batch.exclusive = true;
+                batch.reboot = updates[i].reboot;
+                exclusive.push_back(batch);
+                continue;
+            }
+            shared.positions.push_back(i);
+            if (rebootRank(updates[i].reboot) > rebootRank(shared.reboot)) {
+                shared.reboot = updates[i].reboot;
+            }
+        }
+
+        // Only one batch may leave a restart pending
+        InstallBatch last;
+        bool haveLast = false;
+        if (!shared.positions.empty() && shared.reboot == RebootBehavior::ALWAYS) {
+            last = std::move(shared);
+            shared.positions.clear();
+            haveLast = true;
+        }
+        for (InstallBatch& batch : exclusive) {
+            if (batch.reboot != RebootBehavior::ALWAYS) {
+                plan.batches.push_back(std::move(batch));
+            } else if (!haveLast) {
+                last = std::move(batch);
+                haveLast = true;
+            } else {
+                plan.deferred.push_back(batch.positions.front());
+            }
+        }
+        if (!shared.positions.empty()) {
+            plan.batches.push_back(std::move(shared));
+        }
+
+        std::stable_sort(plan.batches.begin(), plan.batches.end(), [](const InstallBatch& a, const InstallBatch& b) {
+            if (rebootRank(a.reboot) != rebootRank(b.reboot)) {
+                return rebootRank(a.reboot) < rebootRank(b.reboot);
+            }
+            return a.exclusive && !b.exclusive;
+        });
+        if (haveLast) {
+            plan.batches.push_back(std::move(last));
+        }
+        return plan;
+    }
+
+} // namespace WUpdater
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "update_backend.h"
+#include <vector>
+
+namespace WUpdater {
+
+    // What the planner needs to know about one update
+    struct InstallTraits {
+        InstallImpact impact = InstallImpact::NORMAL;
+        RebootBehavior reboot = RebootBehavior::NEVER;
+    };
+
+    // Updates installed by one installer call
+    struct InstallBatch {
+        std::vector<size_t> positions;          // Positions in the list being planned
+        bool exclusive = false;
+        RebootBehavior reboot = RebootBehavior::NEVER;  // Strongest behavior among the updates
+    };
+
+    struct InstallPlan {
+        std::vector<InstallBatch> batches;      // In the order they are to run
+        std::vector<size_t> deferred;           // Cannot be installed before a restart
+    };
+
+    /**
+     * @brief Split updates into the fewest installer calls the agent accepts.
+     *
+     * An update that requires exclusive handling must be installed on its
+     * own, so each gets a batch; everything else shares one batch. An update
+     * that always reboots leaves a restart pending, after which the agent
+     * refuses further installs, so at most one batch containing such updates
+     * runs and it runs last. The shared batch takes that slot when it has
+     * any, since it installs the most updates; exclusive updates that always
+     * reboot and miss the slot are deferred to the next run.
+     *
+     * The other batches run in order of their reboot behavior, those that
+     * never reboot first, so updates that may ask for a restart are installed
+     * together at the end and one restart covers them. Within the same
+     * behavior exclusive updates go first: they are typically servicing
+     * stack updates the others depend on. Positions keep list order.
+     */
+    InstallPlan planInstallBatches(const std::vector<InstallTraits>& updates);
+
+} // namespace WUpdater
@@ -0,0 +1,263 @@
+#ifdef _WIN32
+// winsock2.h must come before anything that pulls in windows.h
+#include <winsock2.h>
+#include <afunix.h>
+#else
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "local_socket.h"
+#include <cstdio>
+#include <cstring>
+#include <utility>
+
+namespace WUpdater {
+
+    namespace {
+
+#ifdef _WIN32
+        typedef SOCKET NativeSocket;
+        const intptr_t kInvalid = static_cast<intptr_t>(INVALID_SOCKET);
+
+        void closeNative(intptr_t handle) { closesocket(static_cast<SOCKET>(handle)); }
+
+        bool startWinsock() {
+            static const bool started = [] {
+                WSADATA data;
+                return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+            }();
+            return started;
+        }
+#else
+        typedef int NativeSocket;
+        const intptr_t kInvalid = -1;
+
+        void closeNative(intptr_t handle) { ::close(static_cast<int>(handle)); }
+
+        bool startWinsock() { return true; }
+#endif
+
+#ifdef MSG_NOSIGNAL
+        const int kSendFlags = MSG_NOSIGNAL;
+#else
+        const int kSendFlags = 0;
+#endif
+
+        // Frame header: payload length, then message type
+        const size_t kHeaderSize = 5;
+
+        NativeSocket native(intptr_t handle) { return static_cast<NativeSocket>(handle); }
+
+        bool makeAddress(const std::string& path, sockaddr_un& address) {
+            std::memset(&address, 0, sizeof(address));
+            address.sun_family = AF_UNIX;
+            if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+                return false;
+            }
+            std::memcpy(address.sun_path, path.c_str(), path.size());
+            return true;
+        }
+
+        intptr_t openSocket() {
+            if (!startWinsock()) {
+                return kInvalid;
+            }
+            return static_cast<intptr_t>(::socket(AF_UNIX, SOCK_STREAM, 0));
+        }
+
+    } // namespace
+
+    LocalSocket::LocalSocket() : handle_(kInvalid) {}
+
+    LocalSocket::~LocalSocket() {
+        close();
+    }
+
+    LocalSocket::LocalSocket(LocalSocket&& other) noexcept
+        : handle_(other.handle_), boundPath_(std::move(other.boundPath_)) {
+        other.handle_ = kInvalid;
+        other.boundPath_.clear();
+    }
+
+    LocalSocket& LocalSocket::operator=(LocalSocket&& other) noexcept {
+        if (this != &other) {
+            close();
+            handle_ = other.handle_;
+            boundPath_ = std::move(other.boundPath_);
+            other.handle_ = kInvalid;
+            other.boundPath_.clear();
+        }
+        return *this;
+    }
+
+    bool LocalSocket::isOpen() const {
+        return handle_ != kInvalid;
+    }
+
+    void LocalSocket::close() {
+        if (handle_ != kInvalid) {
+            closeNative(handle_);
+            handle_ = kInvalid;
+        }
+        if (!boundPath_.empty()) {
+            std::remove(boundPath_.c_str());
+            boundPath_.clear();
+        }
+    }
+
+    bool LocalSocket::listen(const std::string& path) {
+        close();
+
+        sockaddr_un address;
+        if (!makeAddress(path, address)) {
+            return false;
+        }
+
+        // A socket file nobody answers on is left over from a dead daemon
+        LocalSocket probe;
+        if (probe.connect(path)) {
+            return false;
+        }
+        std::remove(path.c_str());
+
+        handle_ = openSocket();
+        if (handle_ == kInvalid) {
+            return false;
+        }
+
+#ifndef _WIN32
+        // Create the file owner-only: whoever connects can install updates
+        mode_t previous = ::umask(0077);
+#endif
+        bool bound = ::bind(native(handle_), reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0;
+#ifndef _WIN32
+        ::umask(previous);
+#endif
+        if (!bound || ::listen(native(handle_), 8) != 0) {
+            close();
+            return false;
+        }
+
+        boundPath_ = path;
+        return true;
+    }
+
+    bool LocalSocket::accept(LocalSocket& client, unsigned timeoutMs) {
+        if (handle_ == kInvalid) {
+            return false;
+        }
+
+        fd_set readable;
+        FD_ZERO(&readable);
+        FD_SET(native(handle_), &readable);
+        timeval timeout;
+        timeout.tv_sec = static_cast<long>(timeoutMs / 1000);
+        timeout.tv_usec = static_cast<long>((timeoutMs % 1000) * 1000);
+        if (::select(static_cast<int>(handle_ + 1), &readable, nullptr, nullptr, &timeout) <= 0) {
+            return false;
+        }
+
+        intptr_t accepted = static_cast<intptr_t>(::accept(native(handle_), nullptr, nullptr));
+        if (accepted == kInvalid) {
+            return false;
+        }
+
+        client.close();
+        client.handle_ = accepted;
+        return true;
+    }
+
+    bool LocalSocket::connect(const std::string& path) {
+        close();
+
+        sockaddr_un address;
+        if (!makeAddress(path, address)) {
+            return false;
+        }
+
+        handle_ = openSocket();
+        if (handle_ == kInvalid) {
+            return false;
+        }
+        if (::connect(native(handle_), reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    bool LocalSocket::sendAll(const char* data, size_t size) {
+        while (size > 0) {
+            int chunk = size > 65536 ? 65536 : static_cast<int>(size);
+            int sent = static_cast<int>(::send(native(handle_), data, chunk, kSendFlags));
+            if (sent <= 0) {
+                return false;
+            }
+            data += sent;
+            size -= static_cast<size_t>(sent);
+        }
+        return true;
+    }
+
+    bool LocalSocket::receiveAll(char* data, size_t size) {
+        while (size > 0) {
+            int chunk = size > 65536 ? 65536 : static_cast<int>(size);
+            int received = static_cast<int>(::recv(native(handle_), data, chunk, 0));
+            if (received <= 0) {
+                return false;
+            }
+            data += received;
+            size -= static_cast<size_t>(received);
+        }
+        return true;
+    }
+
+    bool LocalSocket::setReceiveTimeout(unsigned timeoutMs) {
+        if (handle_ == kInvalid) {
+            return false;
+        }
+#ifdef _WIN32
+        DWORD timeout = timeoutMs;
+#else
+        timeval timeout;
+        timeout.tv_sec = static_cast<long>(timeoutMs / 1000);
+        timeout.tv_usec = static_cast<long>((timeoutMs % 1000) * 1000);
+#endif
+        return ::setsockopt(native(handle_), SOL_SOCKET, SO_RCVTIMEO,
+                            reinterpret_cast<const char*>(&timeout), sizeof(timeout)) == 0;
+    }
+
+    bool LocalSocket::send(uint8_t type, const std::string& payload) {
+        if (handle_ == kInvalid || payload.size() > UINT32_MAX) {
+            return false;
+        }
+
+        char header[kHeaderSize];
+        uint32_t length = static_cast<uint32_t>(payload.size());
+        std::memcpy(header, &length, sizeof(length));
+        header[4] = static_cast<char>(type);
+        return sendAll(header, sizeof(header)) && sendAll(payload.data(), payload.size());
+    }
+
+    bool LocalSocket::receive(uint8_t& type, std::string& payload, size_t maxSize) {
+        char header[kHeaderSize];
+        if (handle_ == kInvalid || !receiveAll(header, sizeof(header))) {
+            return false;
+        }
+
+        uint32_t length = 0;
+        std::memcpy(&length, header, sizeof(length));
+        if (length > maxSize) {
+            return false;
+        }
+
+        type = static_cast<uint8_t>(header[4]);
+        payload.resize(length);
+        return length == 0 || receiveAll(&payload[0], length);
+    }
+
+} // namespace WUpdater
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace WUpdater {
+
+    /**
+     * @brief Stream socket bound to a path on the local machine (AF_UNIX).
+     *
+     * Used on both POSIX and Windows 10+ (afunix.h). Messages are framed as
+     * a 32-bit length, a one byte type and the payload, so a receiver always
+     * gets whole messages. Only the owner may connect to a listening socket
+     * on POSIX; the file is created with mode 0600.
+     */
+    class LocalSocket {
+    public:
+        LocalSocket();
+        ~LocalSocket();
+
+        // Move only
+        LocalSocket(LocalSocket&& other) noexcept;
+        LocalSocket& operator=(LocalSocket&& other) noexcept;
+        LocalSocket(const LocalSocket&) = delete;
+        LocalSocket& operator=(const LocalSocket&) = delete;
+
+        // Bind and listen at path. Fails if another process is serving it;
+        // a stale socket file left by a dead process is replaced.
+        bool listen(const std::string& path);
+
+        // Wait up to timeoutMs for a connection; false on timeout or error
+        bool accept(LocalSocket& client, unsigned timeoutMs);
+
+        bool connect(const std::string& path);
+
+        bool send(uint8_t type, const std::string& payload);
+
+        // Receive one message; fails on disconnect or a payload above maxSize
+        bool receive(uint8_t& type, std::string& payload, size_t maxSize);
+
+        // Make receive() fail once the peer has sent nothing for timeoutMs
+        bool setReceiveTimeout(unsigned timeoutMs);
+
+        void close();
+        bool isOpen() const;
+
+    private:
+        intptr_t handle_;
+        std::string boundPath_;     // Removed again by close() when listening
+
+        bool sendAll(const char* data, size_t size);
+        bool receiveAll(char* data, size_t size);
+    };
+
+} // namespace WUpdater
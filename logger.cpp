@@ -0,0 +1,262 @@
+#include "logger.h"
+#include "utf8.h"
+#include <chrono>
+#include <ctime>
+#include <cwchar>
+
+namespace WUpdater {
+
+    namespace {
+
+        // How long the writer sleeps when the ring is empty
+        const unsigned kIdleMs = 20;
+
+        const wchar_t* const kLevelNames[] = { L"DEBUG", L"INFO ", L"WARN ", L"ERROR" };
+
+        uint32_t threadOrdinal() {
+            static std::atomic<uint32_t> next(1);
+            thread_local uint32_t ordinal = next.fetch_add(1, std::memory_order_relaxed);
+            return ordinal;
+        }
+
+    } // namespace
+
+    bool parseLogLevel(const std::string& name, LogLevel& level) {
+        if (name == "debug") {
+            level = LogLevel::DEBUG;
+        } else if (name == "info") {
+            level = LogLevel::INFO;
+        } else if (name == "warn") {
+            level = LogLevel::WARN;
+        } else if (name == "error") {
+            level = LogLevel::ERR;
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    Logger& Logger::instance() {
+        static Logger logger;
+        return logger;
+    }
+
+    Logger::Logger()
+        : ring_(new Slot[kCapacity]), enqueuePos_(0), dequeuePos_(0), dropped_(0), running_(false),
+          minLevel_(static_cast<uint8_t>(LogLevel::INFO)), file_(nullptr), fileBytes_(0),
+          reportedDrops_(0), stopping_(false) {
+        for (size_t i = 0; i < kCapacity; i++) {
+            ring_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    Logger::~Logger() {
+        stop();
+    }
+
+    bool Logger::start(const LogSettings& settings) {
+        stop();
+
+        settings_ = settings;
+        if (!openFile()) {
+            return false;
+        }
+
+        stopping_ = false;
+        minLevel_.store(static_cast<uint8_t>(settings.level), std::memory_order_relaxed);
+        running_.store(true, std::memory_order_release);
+        writer_ = std::thread(&Logger::writerLoop, this);
+        return true;
+    }
+
+    void Logger::stop() {
+        if (!writer_.joinable()) {
+            return;
+        }
+
+        running_.store(false, std::memory_order_release);
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex_);
+            stopping_ = true;
+        }
+        wake_.notify_one();
+        writer_.join();
+
+        if (file_ != nullptr) {
+            std::fclose(file_);
+            file_ = nullptr;
+        }
+    }
+
+    void Logger::write(LogLevel level, const wchar_t* format, std::wstring_view text,
+                       const int64_t* args, size_t count) {
+        // Claim a slot (bounded MPMC ring; only the writer thread consumes)
+        size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+        Slot* slot = nullptr;
+        for (;;) {
+            slot = &ring_[pos & (kCapacity - 1)];
+            size_t sequence = slot->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return;
+            } else {
+                pos = enqueuePos_.load(std::memory_order_relaxed);
+            }
+        }
+
+        Record& record = slot->record;
+        record.timestampUs = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        record.format = format;
+        record.thread = threadOrdinal();
+        record.level = level;
+        record.argCount = static_cast<uint8_t>(count < kMaxArgs ? count : kMaxArgs);
+        for (size_t i = 0; i < record.argCount; i++) {
+            record.args[i] = args[i];
+        }
+        record.textLength = static_cast<uint16_t>(text.size() < kTextLength ? text.size() : kTextLength);
+        std::wmemcpy(record.text, text.data(), record.textLength);
+
+        slot->sequence.store(pos + 1, std::memory_order_release);
+
+        // Wake the writer early in a burst instead of waiting for its idle tick.
+        // notify_one() takes no lock, so the producer still never waits.
+        if ((pos & (kCapacity / 4 - 1)) == kCapacity / 4 - 1) {
+            wake_.notify_one();
+        }
+    }
+
+    bool Logger::pop(Record& record) {
+        Slot& slot = ring_[dequeuePos_ & (kCapacity - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != dequeuePos_ + 1) {
+            return false;
+        }
+        record = slot.record;
+        slot.sequence.store(dequeuePos_ + kCapacity, std::memory_order_release);
+        dequeuePos_++;
+        return true;
+    }
+
+    void Logger::writerLoop() {
+        Record record;
+        std::wstring line;
+        std::string bytes;
+        line.reserve(256);
+        bytes.reserve(64 * 1024);
+
+        for (;;) {
+            // Batch everything queued into one write
+            bytes.clear();
+            while (pop(record)) {
+                format(record, line);
+                bytes += toUtf8(line);
+            }
+
+            uint64_t drops = dropped();
+            if (drops != reportedDrops_) {
+                wchar_t notice[96];
+                std::swprintf(notice, sizeof(notice) / sizeof(notice[0]),
+                              L"%llu log records dropped (ring buffer full)\n",
+                              static_cast<unsigned long long>(drops - reportedDrops_));
+                bytes += toUtf8(notice);
+                reportedDrops_ = drops;
+            }
+
+            if (!bytes.empty()) {
+                append(bytes);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(wakeMutex_);
+            if (stopping_) {
+                break;
+            }
+            wake_.wait_for(lock, std::chrono::milliseconds(kIdleMs));
+        }
+    }
+
+    void Logger::format(const Record& record, std::wstring& line) const {
+        std::time_t seconds = static_cast<std::time_t>(record.timestampUs / 1000000);
+        std::tm utc;
+#ifdef _WIN32
+        gmtime_s(&utc, &seconds);
+#else
+        gmtime_r(&seconds, &utc);
+#endif
+
+        wchar_t prefix[64];
+        std::swprintf(prefix, sizeof(prefix) / sizeof(prefix[0]), L"%04d-%02d-%02dT%02d:%02d:%02d.%06dZ %ls [%u] ",
+                      utc.tm_year + 1900, utc.tm_mon + 1, utc.tm_mday, utc.tm_hour, utc.tm_min, utc.tm_sec,
+                      static_cast<int>(record.timestampUs % 1000000), kLevelNames[static_cast<int>(record.level)],
+                      record.thread);
+        line.assign(prefix);
+
+        size_t nextArg = 0;
+        wchar_t number[24];
+        for (const wchar_t* p = record.format; *p != L'\0'; p++) {
+            if (p[0] == L'{' && p[1] == L'}') {
+                int64_t value = nextArg < record.argCount ? record.args[nextArg++] : 0;
+                std::swprintf(number, sizeof(number) / sizeof(number[0]), L"%lld", static_cast<long long>(value));
+                line += number;
+                p++;
+            } else if (p[0] == L'{' && p[1] == L'x' && p[2] == L'}') {
+                int64_t value = nextArg < record.argCount ? record.args[nextArg++] : 0;
+                std::swprintf(number, sizeof(number) / sizeof(number[0]), L"0x%08X", static_cast<uint32_t>(value));
+                line += number;
+                p += 2;
+            } else if (p[0] == L'{' && p[1] == L's' && p[2] == L'}') {
+                line.append(record.text, record.textLength);
+                p += 2;
+            } else {
+                line += *p;
+            }
+        }
+        line += L'\n';
+    }
+
+    void Logger::append(const std::string& bytes) {
+        if (file_ == nullptr) {
+            return;
+        }
+        std::fwrite(bytes.data(), 1, bytes.size(), file_);
+        std::fflush(file_);
+        fileBytes_ += bytes.size();
+        if (fileBytes_ >= settings_.maxFileBytes) {
+            rotate();
+        }
+    }
+
+    bool Logger::openFile() {
+        file_ = std::fopen(settings_.path.c_str(), "ab");
+        if (file_ == nullptr) {
+            return false;
+        }
+        std::fseek(file_, 0, SEEK_END);
+        long size = std::ftell(file_);
+        fileBytes_ = size > 0 ? static_cast<uint64_t>(size) : 0;
+        return true;
+    }
+
+    void Logger::rotate() {
+        std::fclose(file_);
+        file_ = nullptr;
+
+        // path.N-1 -> path.N, ..., path -> path.1; the oldest file is dropped
+        for (unsigned i = settings_.keptFiles; i > 0; i--) {
+            std::string target = settings_.path + "." + std::to_string(i);
+            std::string source = i > 1 ? settings_.path + "." + std::to_string(i - 1) : settings_.path;
+            std::remove(target.c_str());
+            std::rename(source.c_str(), target.c_str());
+        }
+        if (settings_.keptFiles == 0) {
+            std::remove(settings_.path.c_str());
+        }
+        openFile();
+    }
+
+} // namespace WUpdater
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+namespace WUpdater {
+
+    // Log record severity (ERR because windows.h defines ERROR)
+    enum class LogLevel : uint8_t {
+        DEBUG = 0,
+        INFO = 1,
+        WARN = 2,
+        ERR = 3
+    };
+
+    // Parse "debug", "info", "warn" or "error"
+    bool parseLogLevel(const std::string& name, LogLevel& level);
+
+    struct LogSettings {
+        std::string path;
+        LogLevel level = LogLevel::INFO;
+        uint64_t maxFileBytes = 8 * 1024 * 1024;    // Rotate once the file reaches this size
+        unsigned keptFiles = 3;                     // Rotated files kept as path.1 .. path.N
+    };
+
+    /**
+     * @brief Asynchronous logger writing to a rotating file.
+     *
+     * Producers copy a fixed-size binary record (timestamp, level, thread,
+     * a pointer to a static format string, up to four integers and a short
+     * inline text) into a bounded lock-free ring buffer and return; they
+     * never format, allocate, lock or touch the file, so it is safe to log
+     * from COM callback threads. A background thread formats the records
+     * and appends them to the file. When the ring is full, records are
+     * dropped and counted rather than blocking the producer.
+     *
+     * Format strings use {} for the next integer in decimal, {x} for the
+     * next integer as a 32-bit hex code (HRESULTs) and {s} for the text.
+     * The string must outlive the logger (use literals).
+     */
+    class Logger {
+    public:
+        static Logger& instance();
+
+        ~Logger();
+
+        // Open the file and start the writer thread
+        bool start(const LogSettings& settings);
+
+        // Write out everything queued so far and stop the writer thread
+        void stop();
+
+        bool enabled(LogLevel level) const {
+            return running_.load(std::memory_order_relaxed) &&
+                   static_cast<uint8_t>(level) >= minLevel_.load(std::memory_order_relaxed);
+        }
+
+        void write(LogLevel level, const wchar_t* format, std::wstring_view text,
+                   const int64_t* args, size_t count);
+
+        // Records lost because the ring was full
+        uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+    private:
+        static const size_t kMaxArgs = 4;
+        static const size_t kTextLength = 40;
+        static const size_t kCapacity = 4096;      // Ring slots, a power of two
+
+        struct Record {
+            int64_t timestampUs;                    // Microseconds since the Unix epoch (UTC)
+            const wchar_t* format;
+            int64_t args[kMaxArgs];
+            uint32_t thread;                        // Small per-thread ordinal
+            LogLevel level;
+            uint8_t argCount;
+            uint16_t textLength;
+            wchar_t text[kTextLength];
+        };
+
+        struct Slot {
+            std::atomic<size_t> sequence;
+            Record record;
+        };
+
+        std::unique_ptr<Slot[]> ring_;
+        alignas(64) std::atomic<size_t> enqueuePos_;
+        alignas(64) size_t dequeuePos_;
+        std::atomic<uint64_t> dropped_;
+        std::atomic<bool> running_;
+        std::atomic<uint8_t> minLevel_;
+
+        LogSettings settings_;
+        std::FILE* file_;
+        uint64_t fileBytes_;
+        uint64_t reportedDrops_;
+        std::thread writer_;
+        std::mutex wakeMutex_;
+        std::condition_variable wake_;
+        bool stopping_;
+
+        Logger();
+
+        bool pop(Record& record);
+        void writerLoop();
+        void format(const Record& record, std::wstring& line) const;
+        void append(const std::string& bytes);
+        bool openFile();
+        void rotate();
+    };
+
+    // Log a message with up to four integer arguments
+    inline void logEvent(LogLevel level, const wchar_t* format,
+                         int64_t a = 0, int64_t b = 0, int64_t c = 0, int64_t d = 0) {
+        Logger& logger = Logger::instance();
+        if (logger.enabled(level)) {
+            const int64_t args[] = { a, b, c, d };
+            logger.write(level, format, std::wstring_view(), args, 4);
+        }
+    }
+
+    // Log a message with a short text (truncated to fit the record) and up to two integers
+    inline void logText(LogLevel level, const wchar_t* format, std::wstring_view text,
+                        int64_t a = 0, int64_t b = 0) {
+        Logger& logger = Logger::instance();
+        if (logger.enabled(level)) {
+            const int64_t args[] = { a, b };
+            logger.write(level, format, text, args, 2);
+        }
+    }
+
+} // namespace WUpdater
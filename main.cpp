@@ -1,35 +1,111 @@
-#define _CRT_SECURE_NO_WARNINGS
-#define _WIN32_DCOM
-
 #include "main.h"
 #include <iostream>
 #include <fstream>
 #include <string>
 #include <vector>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <locale>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
 #include <signal.h>
 #include <cstdlib>
 
 using namespace WUpdater;
 
-// Global flag for signal handling
-volatile bool g_interrupted = false;
+namespace {
+
+    // Points a stream at another buffer for the lifetime of the object
+    class StreamRedirect {
+    public:
+        StreamRedirect(std::wostream& stream, std::wstreambuf* target)
+            : stream_(stream), previous_(stream.rdbuf(target)) {}
+        ~StreamRedirect() { stream_.rdbuf(previous_); }
+
+        StreamRedirect(const StreamRedirect&) = delete;
+        StreamRedirect& operator=(const StreamRedirect&) = delete;
+
+    private:
+        std::wostream& stream_;
+        std::wstreambuf* previous_;
+    };
+
+} // namespace
+
+// Global flag for signal handling. The first interrupt aborts the running
+// operation through the cancel flag; a second one exits immediately.
+std::atomic<bool> g_interrupted(false);
 
-// Signal handler implementation
+// Signal handler implementation. Only async-signal-safe calls are allowed
+// here, so the handler never touches the streams; InterruptWatcher reports it.
 void WUpdater::signalHandler(int signal) {
-    if (signal == SIGINT) {
-        std::wcout << L"\n[!] Caught interrupt signal. Exiting..." << std::endl;
-    } else {
-        std::wcout << L"\n[!] Caught signal " << signal << std::endl;
+    if (g_interrupted.exchange(true)) {
+        std::_Exit(1);
     }
-    g_interrupted = true;
-    exit(1);
+
+    // The CRT resets the handler to SIG_DFL before calling it on Windows
+    ::signal(signal, WUpdater::signalHandler);
 }
 
+namespace {
+
+    // Polls the interrupt flag on a thread of its own and reports the first
+    // interrupt, which the signal handler cannot safely print itself
+    class InterruptWatcher {
+    public:
+        InterruptWatcher() : stopping_(false), thread_([this] { watch(); }) {}
+
+        ~InterruptWatcher() {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stopping_ = true;
+            }
+            wake_.notify_all();
+            thread_.join();
+        }
+
+        InterruptWatcher(const InterruptWatcher&) = delete;
+        InterruptWatcher& operator=(const InterruptWatcher&) = delete;
+
+    private:
+        std::mutex mutex_;
+        std::condition_variable wake_;
+        bool stopping_;
+        std::thread thread_;
+
+        void watch() {
+            std::unique_lock<std::mutex> lock(mutex_);
+            while (!stopping_) {
+                if (g_interrupted) {
+                    std::wcout << Messages::Info::interruptReceived() << std::endl;
+                    return;
+                }
+                wake_.wait_for(lock, std::chrono::milliseconds(100));
+            }
+        }
+    };
+
+} // namespace
+
 // Show usage information
 void WUpdater::showUsage(const char* programName) {
     std::cerr << Messages::Help::getUsageMessage(programName);
 }
 
+// Parse a non-negative decimal option value
+static bool parseUnsigned(const char* text, unsigned& value) {
+    char* end = nullptr;
+    unsigned long parsed = std::strtoul(text, &end, 10);
+    if (*text == '\0' || *text == '-' || *end != '\0') {
+        return false;
+    }
+    value = static_cast<unsigned>(parsed);
+    return true;
+}
+
 // Parse command line arguments
 int WUpdater::parseArguments(int argc, char* argv[], CommandLineArgs& params) {
     if (argc < 2) {
@@ -53,6 +129,245 @@ int WUpdater::parseArguments(int argc, char* argv[], CommandLineArgs& params) {
             }
         } else if (arg == "-q" || arg == "--quiet") {
             params.quietMode = true;
+        } else if (arg == "-p" || arg == "--pipeline") {
+            params.pipeline = true;
+        } else if (arg == "-n" || arg == "--dry-run") {
+            params.dryRun = true;
+        } else if (arg == "--diff") {
+            if (i + 1 < argc) {
+                i++;
+                params.diffSnapshotPath = argv[i];
+            } else {
+                std::cerr << "[!] --diff option requires one argument." << std::endl;
+                return -1;
+            }
+        } else if (arg == "--allow-list") {
+            if (i + 1 < argc) {
+                i++;
+                params.allowListPath = argv[i];
+            } else {
+                std::cerr << "[!] --allow-list option requires one argument." << std::endl;
+                return -1;
+            }
+        } else if (arg == "--deny-list") {
+            if (i + 1 < argc) {
+                i++;
+                params.denyListPath = argv[i];
+            } else {
+                std::cerr << "[!] --deny-list option requires one argument." << std::endl;
+                return -1;
+            }
+        } else if (arg == "--format") {
+            if (i + 1 < argc) {
+                i++;
+                if (!parseOutputFormat(argv[i], params.outputFormat)) {
+                    std::cerr << "[!] --format expects text, jsonl or csv." << std::endl;
+                    return -1;
+                }
+            } else {
+                std::cerr << "[!] --format option requires one argument." << std::endl;
+                return -1;
+            }
+        } else if (arg == "--log") {
+            if (i + 1 < argc) {
+                i++;
+                params.logPath = argv[i];
+            } else {
+                std::cerr << "[!] --log option requires one argument." << std::endl;
+                return -1;
+            }
+        } else if (arg == "--log-level") {
+            if (i + 1 < argc) {
+                i++;
+                if (!parseLogLevel(argv[i], params.logLevel)) {
+                    std::cerr << "[!] --log-level expects debug, info, warn or error." << std::endl;
+                    return -1;
+                }
+            } else {
+                std::cerr << "[!] --log-level option requires one argument." << std::endl;
+                return -1;
+            }
+        } else if (arg == "--metrics-textfile") {
+            if (i + 1 < argc) {
+                i++;
+                params.metricsTextfilePath = argv[i];
+            } else {
+                std::cerr << "[!] --metrics-textfile option requires one argument." << std::endl;
+                return -1;
+            }
+        } else if (arg == "--metrics-json") {
+            if (i + 1 < argc) {
+                i++;
+                params.metricsJsonPath = argv[i];
+            } else {
+                std::cerr << "[!] --metrics-json option requires one argument." << std::endl;
+                return -1;
+            }
+        } else if (arg == "--mta") {
+            params.multithreadedApartment = true;
+        } else if (arg == "-t" || arg == "--threads") {
+            if (i + 1 < argc) {
+                i++;
+                if (!parseUnsigned(argv[i], params.workerThreads) || params.workerThreads == 0) {
+                    std::cerr << "[!] --threads expects a positive number." << std::endl;
+                    return -1;
+                }
+            } else {
+                std::cerr << "[!] --threads option requires one argument." << std::endl;
+                return -1;
+            }
+        } else if (arg == "--search-timeout") {
+            if (i + 1 < argc) {
+                i++;
+                if (!parseUnsigned(argv[i], params.searchTimeoutSeconds)) {
+                    std::cerr << "[!] --search-timeout expects a number of seconds." << std::endl;
+                    return -1;
+                }
+            } else {
+                std::cerr << "[!] --search-timeout option requires one argument." << std::endl;
+                return -1;
+            }
+        } else if (arg == "--download-lanes") {
+            if (i + 1 < argc) {
+                i++;
+                if (!parseUnsigned(argv[i], params.downloadLanes) || params.downloadLanes == 0) {
+                    std::cerr << "[!] --download-lanes expects a positive number." << std::endl;
+                    return -1;
+                }
+            } else {
+                std::cerr << "[!] --download-lanes option requires one argument." << std::endl;
+                return -1;
+            }
+        } else if (arg == "--stream") {
+            if (i + 1 < argc) {
+                i++;
+                if (!parseUnsigned(argv[i], params.streamChunk) || params.streamChunk == 0) {
+                    std::cerr << "[!] --stream expects a positive number of updates per chunk." << std::endl;
+                    return -1;
+                }
+            } else {
+                std::cerr << "[!] --stream option requires one argument." << std::endl;
+                return -1;
+            }
+        } else if (arg == "--content-cache") {
+            if (i + 1 < argc) {
+                i++;
+                params.contentCacheDirectory = argv[i];
+            } else {
+                std::cerr << "[!] --content-cache option requires one argument." << std::endl;
+                return -1;
+            }
+        } else if (arg == "--export-content") {
+            params.exportContent = true;
+        } else if (arg == "--window") {
+            if (i + 1 < argc) {
+                i++;
+                if (!parseUnsigned(argv[i], params.windowMinutes) || params.windowMinutes == 0) {
+                    std::cerr << "[!] --window expects a positive number of minutes." << std::endl;
+                    return -1;
+                }
+            } else {
+                std::cerr << "[!] --window option requires one argument." << std::endl;
+                return -1;
+            }
+        } else if (arg == "--timings") {
+            if (i + 1 < argc) {
+                i++;
+                params.timingsPath = argv[i];
+            } else {
+                std::cerr << "[!] --timings option requires one argument." << std::endl;
+                return -1;
+            }
+        } else if (arg == "--journal") {
+            if (i + 1 < argc) {
+                i++;
+                params.journalPath = argv[i];
+            } else {
+                std::cerr << "[!] --journal option requires one argument." << std::endl;
+                return -1;
+            }
+        } else if (arg == "--retries") {
+            if (i + 1 < argc) {
+                i++;
+                if (!parseUnsigned(argv[i], params.retryPolicy.maxRetries)) {
+                    std::cerr << "[!] --retries expects a number of retries." << std::endl;
+                    return -1;
+                }
+            } else {
+                std::cerr << "[!] --retries option requires one argument." << std::endl;
+                return -1;
+            }
+        } else if (arg == "--retry-delay") {
+            if (i + 1 < argc) {
+                i++;
+                if (!parseUnsigned(argv[i], params.retryPolicy.initialDelayMs)) {
+                    std::cerr << "[!] --retry-delay expects a number of milliseconds." << std::endl;
+                    return -1;
+                }
+            } else {
+                std::cerr << "[!] --retry-delay option requires one argument." << std::endl;
+                return -1;
+            }
+        } else if (arg == "--retry-budget") {
+            if (i + 1 < argc) {
+                i++;
+                std::string error;
+                if (!parseRetryBudget(argv[i], params.retryPolicy, error)) {
+                    std::cerr << "[!] Invalid --retry-budget: " << error << std::endl;
+                    return -1;
+                }
+            } else {
+                std::cerr << "[!] --retry-budget option requires one argument." << std::endl;
+                return -1;
+            }
+        } else if (arg == "--cache") {
+            if (i + 1 < argc) {
+                i++;
+                params.cacheDirectory = argv[i];
+            } else {
+                std::cerr << "[!] --cache option requires one argument." << std::endl;
+                return -1;
+            }
+        } else if (arg == "--cache-ttl") {
+            if (i + 1 < argc) {
+                i++;
+                if (!parseUnsigned(argv[i], params.cacheTtlSeconds)) {
+                    std::cerr << "[!] --cache-ttl expects a number of seconds." << std::endl;
+                    return -1;
+                }
+            } else {
+                std::cerr << "[!] --cache-ttl option requires one argument." << std::endl;
+                return -1;
+            }
+        } else if (arg == "--daemon") {
+            if (i + 1 < argc) {
+                i++;
+                params.daemonSocket = argv[i];
+            } else {
+                std::cerr << "[!] --daemon option requires one argument." << std::endl;
+                return -1;
+            }
+        } else if (arg == "--connect") {
+            if (i + 1 < argc) {
+                i++;
+                params.connectSocket = argv[i];
+            } else {
+                std::cerr << "[!] --connect option requires one argument." << std::endl;
+                return -1;
+            }
+        } else if (arg == "--simulate") {
+            if (i + 1 < argc) {
+                i++;
+                std::string error;
+                if (!parseSimulationSpec(argv[i], params.simulation, error)) {
+                    std::cerr << "[!] Invalid --simulate spec: " << error << std::endl;
+                    return -1;
+                }
+                params.simulate = true;
+            } else {
+                std::cerr << "[!] --simulate option requires one argument." << std::endl;
+                return -1;
+            }
         } else {
             std::cerr << "[!] Unknown option: " << arg << std::endl;
             showUsage(argv[0]);
@@ -60,367 +375,519 @@ int WUpdater::parseArguments(int argc, char* argv[], CommandLineArgs& params) {
         }
     }
 
-    if (params.criteriaFilePath.empty()) {
-        std::cerr << "[!] Criteria file path is required. Use -c option." << std::endl;
+    if (!params.daemonSocket.empty() && !params.connectSocket.empty()) {
+        std::cerr << "[!] --daemon and --connect cannot be combined." << std::endl;
         return -1;
     }
 
-    return 0;
-}
-
-// Get search criteria from file
-_bstr_t WUpdater::getCriteriaFromFile(const std::string& filePath) {
-    std::string criteriaStr;
-    std::ifstream file(filePath);
-
-    if (!file.is_open()) {
-        std::wcout << Messages::Errors::criteriaFileNotFound(filePath) << std::endl;
-        return _bstr_t();
+    // A snapshot needs every update's metadata at once
+    if (params.streamChunk > 0 && !params.diffSnapshotPath.empty()) {
+        std::cerr << "[!] --stream and --diff cannot be combined." << std::endl;
+        return -1;
     }
 
-    std::wcout << Messages::Info::criteriaLoaded();
-    while (std::getline(file, criteriaStr)) {
-        std::cout << criteriaStr << '\n';
+    // Deferred updates are carried to the next window by the journal only;
+    // a dry run just shows the plan
+    if (params.windowMinutes > 0 && params.journalPath.empty() && !params.dryRun) {
+        std::cerr << "[!] --window requires --journal FILE to record deferred updates for the next window." << std::endl;
+        return -1;
     }
-    file.close();
 
-    if (criteriaStr.empty()) {
-        std::wcout << Messages::Errors::criteriaFileEmpty() << std::endl;
-        return _bstr_t();
+    // The daemon receives its criteria with each request
+    if (params.criteriaFilePath.empty() && params.daemonSocket.empty()) {
+        std::cerr << "[!] Criteria file path is required. Use -c option." << std::endl;
+        return -1;
     }
 
-    return _bstr_t(criteriaStr.c_str());
-}
-
-// Default progress callback
-void WUpdater::updateProgressCallbackDefault(ProgressPhase phase, UINT progress, void* context) {
-    switch (phase) {
-        case ProgressPhase::BEGIN:
-            std::wcout << L"Progress: Begin " << progress << std::endl;
-            break;
-        case ProgressPhase::SEARCHING:
-            std::wcout << L"Progress: Searching " << progress << std::endl;
-            break;
-        case ProgressPhase::DOWNLOADING:
-            std::wcout << L"Progress: Downloading " << progress << L"%" << std::endl;
-            break;
-        case ProgressPhase::INSTALLING:
-            std::wcout << L"Progress: Installing " << progress << std::endl;
-            break;
-        case ProgressPhase::END:
-            std::wcout << L"Progress: End " << progress << std::endl;
-            break;
-        default:
-            std::wcout << L"Progress: Unknown phase" << std::endl;
-            break;
-    }
+    return 0;
 }
 
-
-
-// Check HRESULT and print error if needed
-int WUpdater::checkHResult(HRESULT hr) {
-    if (FAILED(hr)) {
-        std::wcout << L"[!] Error code: 0x" << std::hex << hr << std::dec << std::endl;
-        std::wcout << L"[!] " << ErrorMessages::getErrorMessage(hr) << std::endl;
-        return -1;
+// Read and validate the criteria file, echoing it to stderr when stdout carries records
+std::vector<std::wstring> WUpdater::readCriteria(const CommandLineArgs& params) {
+    std::wstreambuf* console = params.outputFormat != OutputFormat::TEXT ? std::wcerr.rdbuf() : std::wcout.rdbuf();
+    StreamRedirect redirect(std::wcout, console);
+    std::vector<std::wstring> criteria = getCriteriaFromFile(params.criteriaFilePath);
+
+    // Reject malformed queries before the agent is contacted
+    bool valid = true;
+    for (size_t q = 0; q < criteria.size(); q++) {
+        CompiledCriteria compiled;
+        CriteriaError error;
+        if (!compileCriteria(criteria[q], compiled, error)) {
+            std::wcout << Messages::Errors::invalidCriteria(static_cast<long>(q), error.position, error.message) << std::endl;
+            valid = false;
+        }
     }
-    return 0;
+    return valid ? criteria : std::vector<std::wstring>();
 }
 
-// UpdateManager implementation
-UpdateManager::UpdateManager() : initialized_(false) {
-    updateInfo_.updatesList = nullptr;
-    updateInfo_.item = nullptr;
-    updateInfo_.size = 0;
-    updateInfo_.inCache = VARIANT_FALSE;
-    updateInfo_.releaseDate = 0;
-    updateInfo_.resultCode = orcNotStarted;
+// True if the run would stop at a y/n prompt
+bool WUpdater::requiresConfirmation(const CommandLineArgs& params) {
+    return !params.quietMode && !params.dryRun && params.diffSnapshotPath.empty();
 }
 
-UpdateManager::~UpdateManager() {
-    // Smart pointers will handle cleanup automatically
+// Create the update backend selected on the command line
+std::unique_ptr<UpdateBackend> WUpdater::createBackend(const CommandLineArgs& params) {
+    if (params.simulate) {
+        return std::unique_ptr<UpdateBackend>(new SimulatedBackend(params.simulation));
+    }
+#ifdef _WIN32
+    return std::unique_ptr<UpdateBackend>(new WuaBackend(params.multithreadedApartment ? params.workerThreads : 1));
+#else
+    return nullptr;
+#endif
 }
 
-int UpdateManager::searchForUpdates(const _bstr_t& criteria) {
-    try {
-        // Create update session
-        HRESULT hr = search_.session.CreateInstance(CLSID_UpdateSession);
-        if (checkHResult(hr) != 0) {
-            return -1;
-        }
+// Record the outcome of a run and write every metric to the requested files.
+// The daemon calls this after each request, so its counters cover all of them.
+void WUpdater::writeMetrics(const CommandLineArgs& args, int exitCode, double runSeconds) {
+    if (args.metricsTextfilePath.empty() && args.metricsJsonPath.empty()) {
+        return;
+    }
 
-        // Create update searcher
-        hr = search_.session->CreateUpdateSearcher(&search_.searcher);
-        if (checkHResult(hr) != 0) {
-            return -1;
-        }
+    MetricsRegistry& metrics = MetricsRegistry::instance();
+    metrics.counter("wupdater_runs_total", "Completed runs", { { "result", exitCode == 0 ? "success" : "failure" } }).add();
+    metrics.gauge("wupdater_last_run_exit_code", "Exit code of the last run").set(exitCode);
+    metrics.gauge("wupdater_last_run_duration_seconds", "Wall time of the last run").set(runSeconds);
+    metrics.gauge("wupdater_last_run_timestamp_seconds", "Unix time the last run finished").set(
+        std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count());
 
-        std::wcout << L"\n" << Messages::Progress::searchingUpdates() << std::endl;
-        
-        // Search for updates
-        hr = search_.searcher->Search(criteria, &search_.results);
-        if (checkHResult(hr) != 0) {
-            return -1;
-        }
+    if (!args.metricsTextfilePath.empty() && !metrics.writePrometheus(args.metricsTextfilePath)) {
+        std::wcout << Messages::Errors::metricsWriteFailed(args.metricsTextfilePath) << std::endl;
+    }
+    if (!args.metricsJsonPath.empty() && !metrics.writeJson(args.metricsJsonPath)) {
+        std::wcout << Messages::Errors::metricsWriteFailed(args.metricsJsonPath) << std::endl;
+    }
+}
 
-        // Get the update collection
-        hr = search_.results->get_Updates(&updateInfo_.updatesList);
-        if (checkHResult(hr) != 0) {
-            return -1;
-        }
+// Run one search/report/download/install pass with an initialized backend.
+// warm is the agent daemon's last search, or null when running standalone.
+int WUpdater::runUpdates(UpdateBackend& backend, const CommandLineArgs& args,
+                         const std::vector<std::wstring>& criteria, WarmResults* warm) {
+    // Machine-readable records take over stdout; messages and progress move to stderr
+    std::wostream records(std::wcout.rdbuf());
+    std::unique_ptr<RecordWriter> writer;
+    std::unique_ptr<StreamRedirect> console;
+    if (args.outputFormat != OutputFormat::TEXT) {
+        writer.reset(new RecordWriter(records, args.outputFormat));
+        console.reset(new StreamRedirect(std::wcout, std::wcerr.rdbuf()));
+    }
 
-        // Get the count
-        hr = updateInfo_.updatesList->get_Count(&updateInfo_.size);
-        if (checkHResult(hr) != 0) {
-            return -1;
+    // The maintenance window starts with the run
+    const auto runStarted = std::chrono::steady_clock::now();
+    SizeEstimator sizeEstimator;
+
+    // Recorded timings replace the size-based estimates where there are enough
+    // of them: the median for the expected run time, the 90th percentile for
+    // planning the maintenance window
+    std::unique_ptr<TimingStore> timings;
+    std::unique_ptr<HistoryEstimator> typicalEstimator;
+    std::unique_ptr<HistoryEstimator> slowEstimator;
+    if (!args.timingsPath.empty()) {
+        timings.reset(new TimingStore(args.timingsPath));
+        std::string timingsError;
+        if (!timings->open(timingsError)) {
+            std::wcout << Messages::Errors::timingStoreFailed(timingsError) << std::endl;
+            return 1;
         }
-
-        initialized_ = true;
-        return 0;
-
-    } catch (_com_error& e) {
-        std::wcout << L"[!] COM Error: " << e.ErrorMessage() << std::endl;
-        return -1;
-    } catch (...) {
-        std::wcout << L"[!] Unknown error during search" << std::endl;
-        return -1;
+        typicalEstimator.reset(new HistoryEstimator(*timings, 50, sizeEstimator));
+        slowEstimator.reset(new HistoryEstimator(*timings, 90, sizeEstimator));
     }
-}
 
-void UpdateManager::printResultCode(LONG index, const _bstr_t& name, ResultCode rc, const std::wstring& operation) {
-    std::wcout << index + 1 << L" - " << (const wchar_t*)name << L" | ";
-    
-    if (rc == ResultCode::SUCCEEDED) {
-        std::wcout << L"Successfully " << operation << std::endl;
-    } else {
-        std::wcout << Messages::Results::getResultMessage(static_cast<int>(rc)) << std::endl;
+    // Create update manager
+    UpdateManager manager(backend);
+    manager.setWorkerThreads(args.workerThreads);
+    manager.setMetadataThreads(args.multithreadedApartment ? args.workerThreads : 1);
+    manager.setCancelFlag(&g_interrupted);
+    manager.setRecordWriter(writer.get());
+    manager.setRetryPolicy(args.retryPolicy);
+    manager.setDownloadLanes(args.downloadLanes);
+    manager.setStreaming(args.streamChunk, !args.dryRun);
+    manager.setTimingStore(timings.get());
+    if (args.windowMinutes > 0) {
+        manager.setWindow(std::chrono::minutes(args.windowMinutes), runStarted,
+                          slowEstimator ? static_cast<const DurationEstimator*>(slowEstimator.get()) : &sizeEstimator);
     }
-}
 
-int UpdateManager::printUpdateInfo(IUpdateCollectionPtr toDownloadList) {
-    if (!initialized_ || updateInfo_.updatesList == nullptr) {
-        std::wcout << L"[!] No search has been performed" << std::endl;
-        return -1;
+    // Load the allow-list and deny-list before anything is searched
+    UpdateList allowList;
+    UpdateList denyList;
+    std::string listError;
+    if ((!args.allowListPath.empty() && !allowList.load(args.allowListPath, listError)) ||
+        (!args.denyListPath.empty() && !denyList.load(args.denyListPath, listError))) {
+        std::wcout << Messages::Errors::updateListInvalid(listError) << std::endl;
+        return 1;
     }
-
-    if (updateInfo_.size == 0) {
-        std::wcout << Messages::Status::noUpdatesFound() << std::endl;
-        return -1;
+    manager.setUpdateLists(args.allowListPath.empty() ? nullptr : &allowList,
+                           args.denyListPath.empty() ? nullptr : &denyList);
+
+    // Payloads shared between hosts, staged before anything is downloaded
+    std::unique_ptr<ContentCache> contentCache;
+    if (!args.contentCacheDirectory.empty()) {
+        contentCache.reset(new ContentCache(args.contentCacheDirectory));
+        std::string cacheError;
+        if (!contentCache->open(cacheError)) {
+            std::wcout << Messages::Errors::contentCacheFailed(cacheError) << std::endl;
+            return 1;
+        }
+        manager.setContentCache(contentCache.get(), args.exportContent);
     }
 
-    std::wcout << Messages::Info::updateListHeader() << std::endl;
+    // Identifies the backend and criteria, for --diff snapshots and the run journal
+    std::wstring scope = backend.name();
+    for (const std::wstring& query : criteria) {
+        scope += L"\n" + SearchCache::normalizeCriteria(query);
+    }
 
-    try {
-        for (LONG i = 0; i < updateInfo_.size; i++) {
-            HRESULT hr = updateInfo_.updatesList->get_Item(i, &updateInfo_.item);
-            if (checkHResult(hr) != 0) {
-                continue;
-            }
+    // Reports are not journaled; there is nothing in them to resume
+    std::unique_ptr<RunJournal> journal;
+    if (!args.journalPath.empty() && !args.dryRun && args.diffSnapshotPath.empty()) {
+        journal.reset(new RunJournal(args.journalPath));
+        std::string journalError;
+        if (!journal->open(journalError)) {
+            std::wcout << Messages::Errors::journalFailed(journalError) << std::endl;
+            return 1;
+        }
+        manager.setJournal(journal.get());
+    }
 
-            BSTR titleBstr = nullptr;
-            hr = updateInfo_.item->get_Title(&titleBstr);
-            if (FAILED(hr)) {
-                continue;
+    // An unfinished run picks up its journaled updates, minus those already
+    // installed, instead of searching again
+    bool resuming = false;
+    if (journal && journal->pending(scope)) {
+        UpdateTable remaining;
+        for (const JournalUpdate& update : journal->updates()) {
+            if (!update.installed) {
+                UpdateRecord record;
+                record.updateId = update.updateId;
+                record.revision = update.revision;
+                remaining.append(record);
             }
-            updateInfo_.name = titleBstr;
-            SysFreeString(titleBstr);
+        }
 
-            hr = updateInfo_.item->get_LastDeploymentChangeTime(&updateInfo_.releaseDate);
-            COleDateTime releaseDateTime;
-            releaseDateTime.m_dt = updateInfo_.releaseDate;
+        const long total = static_cast<long>(journal->updates().size());
+        if (remaining.empty()) {
+            journal->record(JournalPhase::COMPLETE);
+        } else if (manager.resolveCachedRecords(remaining) == 0) {
+            logEvent(LogLevel::INFO, L"Resuming journaled run: {} of {} updates left, phase {}",
+                     static_cast<int64_t>(remaining.size()), total, static_cast<int64_t>(journal->lastPhase()));
+            std::wcout << L"\n" << Messages::Info::runResumed(static_cast<long>(remaining.size()), total) << std::endl;
+            resuming = true;
+        } else {
+            std::wcout << Messages::Info::journalStale() << std::endl;
+        }
+    }
 
-            hr = updateInfo_.item->get_IsDownloaded(&updateInfo_.inCache);
-            if (checkHResult(hr) != 0) {
-                continue;
-            }
+    SearchContext searchContext;
+    std::wstring searchKey;
+    if ((warm != nullptr || !args.cacheDirectory.empty()) && SUCCEEDED(backend.getSearchContext(searchContext))) {
+        searchKey = SearchCache::makeKey(backend.name(), searchContext, criteria);
+    }
 
-            std::wcout << i + 1 << L" - " << (const wchar_t*)updateInfo_.name
-                      << L" | Release: " << (LPCTSTR)releaseDateTime.Format(_T("%Y-%m-%d"));
+    // The daemon's last search is reused while nothing has been detected since
+    bool fromCache = resuming;
+    if (!fromCache && warm != nullptr && !searchKey.empty() && warm->key == searchKey) {
+        int64_t age = std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::steady_clock::now() - warm->loadedAt).count();
+        if (age < static_cast<int64_t>(args.cacheTtlSeconds)) {
+            std::wcout << L"\n" << Messages::Info::warmResultsHit(static_cast<long>(warm->table.size()), age) << std::endl;
+            logEvent(LogLevel::INFO, L"Reusing warm search: {} updates, {} s old", static_cast<int64_t>(warm->table.size()), age);
+            manager.adoptRecords(warm->table);
+            fromCache = true;
+        }
+    }
 
-            if (updateInfo_.inCache) {
-                std::wcout << L" | " << Messages::Status::alreadyDownloaded() << std::endl;
+    // Answer from the search cache when it holds a fresh entry for this search
+    std::unique_ptr<SearchCache> cache;
+    if (!args.cacheDirectory.empty() && !searchKey.empty()) {
+        cache.reset(new SearchCache(args.cacheDirectory, args.cacheTtlSeconds));
+
+        UpdateTable cached;
+        int64_t age = 0;
+        if (!fromCache && cache->load(searchKey, cached, age)) {
+            logEvent(LogLevel::INFO, L"Search cache hit: {} updates, {} s old", static_cast<int64_t>(cached.size()), age);
+            std::wcout << L"\n" << Messages::Info::searchCacheHit(static_cast<long>(cached.size()), age) << std::endl;
+            if (args.dryRun || !args.diffSnapshotPath.empty()) {
+                // Reports need no handles, so the agent is not contacted at all
+                manager.useCachedRecords(cached);
+                fromCache = true;
+            } else if (manager.resolveCachedRecords(cached) == 0) {
+                fromCache = true;
             } else {
-                long newIndex;
-                hr = toDownloadList->Add(updateInfo_.item, &newIndex);
-                if (FAILED(hr)) {
-                    std::wcout << L" | Error adding to download list" << std::endl;
-                } else {
-                    std::wcout << L" | " << Messages::Status::toDownload() << std::endl;
-                }
+                std::wcout << Messages::Info::searchCacheStale() << std::endl;
             }
         }
-        return 0;
-
-    } catch (_com_error& e) {
-        std::wcout << L"[!] COM Error: " << e.ErrorMessage() << std::endl;
-        return -1;
-    } catch (...) {
-        std::wcout << L"[!] Unknown error during update info printing" << std::endl;
-        return -1;
     }
-}
 
-int UpdateManager::downloadUpdates(IUpdateCollectionPtr toDownloadList) {
-    try {
-        LONG downloadCount = 0;
-        HRESULT hr = toDownloadList->get_Count(&downloadCount);
-        if (checkHResult(hr) != 0 || downloadCount == 0) {
-            std::wcout << L"No updates to download" << std::endl;
-            return 0;
+    // Search for updates
+    if (!fromCache) {
+        if (warm != nullptr) {
+            // Nothing refers to the previous search any more
+            warm->key.clear();
+            warm->table.clear();
+            backend.releaseSearches();
         }
 
-        // Create downloader
-        IUpdateDownloaderPtr downloader;
-        hr = search_.session->CreateUpdateDownloader(&downloader);
-        if (checkHResult(hr) != 0) {
-            return -1;
+        SearchOptions searchOptions;
+        searchOptions.timeoutSeconds = args.searchTimeoutSeconds;
+        searchOptions.cancel = &g_interrupted;
+        searchOptions.callback = updateProgressCallbackDefault;
+        if (manager.searchForUpdates(criteria, searchOptions) != 0) {
+            return 1;
         }
 
-        hr = downloader->put_Updates(toDownloadList);
-        if (checkHResult(hr) != 0) {
-            return -1;
+        // Streamed runs never hold the whole result, so there is nothing to keep
+        if ((cache || warm != nullptr) && !searchKey.empty() && args.streamChunk == 0 && manager.loadRecords() == 0) {
+            if (cache) {
+                cache->store(searchKey, manager.getTable());
+            }
+            if (warm != nullptr) {
+                warm->key = searchKey;
+                warm->table = manager.getTable();
+                warm->loadedAt = std::chrono::steady_clock::now();
+            }
         }
+    }
 
-        std::wcout << L"\n" << Messages::Progress::downloadingUpdates() << L" (" << downloadCount << L" update(s))" << std::endl;
+    // Report only the delta against the previous run's snapshot
+    if (!args.diffSnapshotPath.empty()) {
+        return manager.printChanges(args.diffSnapshotPath, scope) != 0 ? 1 : 0;
+    }
 
-        // Perform synchronous download
-        IDownloadResultPtr downloadResult;
-        hr = downloader->Download(&downloadResult);
-        if (checkHResult(hr) != 0) {
-            return -1;
-        }
+    // Create download list
+    std::vector<UpdateHandle> toDownloadList;
 
-        // Display results
-        std::wcout << Messages::Info::downloadListHeader() << std::endl;
-        for (LONG i = 0; i < downloadCount; i++) {
-            IUpdatePtr update;
-            hr = toDownloadList->get_Item(i, &update);
-            if (FAILED(hr)) continue;
+    // Print update information
+    if (manager.printUpdateInfo(toDownloadList) != 0) {
+        return 1;
+    }
 
-            BSTR titleBstr = nullptr;
-            hr = update->get_Title(&titleBstr);
-            if (FAILED(hr)) continue;
-            _bstr_t title(titleBstr, false);
+    // Journal the updates before anything is done to them. Those the
+    // maintenance window leaves out keep the run open for the next window.
+    if (journal && !resuming && !journal->begin(scope, manager.getTable())) {
+        std::wcout << Messages::Errors::journalFailed("cannot write " + args.journalPath) << std::endl;
+        return 1;
+    }
 
-            IUpdateDownloadResultPtr updateResult;
-            hr = downloadResult->GetUpdateResult(i, &updateResult);
-            if (FAILED(hr)) continue;
+    // Only take on what is expected to fit in the maintenance window
+    if (manager.applyWindow(toDownloadList) != 0) {
+        return 1;
+    }
+    if (timings && !manager.getTable().empty()) {
+        std::wcout << L"\n" << Messages::Info::runEstimate(manager.estimateSeconds(*typicalEstimator),
+                                                          manager.estimateSeconds(*slowEstimator)) << std::endl;
+    }
 
-            OperationResultCode resultCode;
-            hr = updateResult->get_ResultCode(&resultCode);
-            if (FAILED(hr)) continue;
+    // Check if there are updates to download
+    long downloadCount = static_cast<long>(toDownloadList.size());
 
-            printResultCode(i, title, static_cast<ResultCode>(resultCode), L"downloaded");
+    if (args.dryRun) {
+        // A streamed dry run keeps no rows, only the listed handles
+        long pending = args.streamChunk > 0 ? downloadCount : 0;
+        const UpdateTable& table = manager.getTable();
+        for (size_t row = 0; row < table.size(); row++) {
+            pending += table.isDownloaded(row) ? 0 : 1;
         }
-
+        std::wcout << L"\n" << Messages::Info::dryRunSummary(pending, manager.getUpdateCount()) << std::endl;
         return 0;
-
-    } catch (_com_error& e) {
-        std::wcout << L"[!] COM Error: " << e.ErrorMessage() << std::endl;
-        return -1;
-    } catch (...) {
-        std::wcout << L"[!] Unknown error during download" << std::endl;
-        return -1;
     }
-}
 
-int UpdateManager::installUpdates() {
-    if (!initialized_ || updateInfo_.updatesList == nullptr) {
-        std::wcout << L"[!] No updates to install" << std::endl;
-        return -1;
+    if (downloadCount == 0 && manager.getUpdateCount() == 0) {
+        if (manager.getDeferredCount() > 0) {
+            std::wcout << L"\n" << Messages::Info::windowNothingFits() << std::endl;
+            return 0;
+        }
+        if (journal) {
+            journal->record(JournalPhase::COMPLETE);
+        }
+        std::wcout << L"\n" << Messages::Status::noUpdatesFound() << std::endl;
+        return 0;
     }
 
-    try {
-        // Create installer
-        IUpdateInstallerPtr installer;
-        HRESULT hr = installer.CreateInstance(CLSID_UpdateInstaller);
-        if (checkHResult(hr) != 0) {
-            return -1;
+    // Ask for confirmation (unless quiet mode or already given in the journaled run).
+    // Declining ends the run, so it is not resumed either.
+    auto confirm = [&](const std::wstring& prompt, JournalPhase phase) {
+        if (!args.quietMode && !(resuming && journal->reached(phase))) {
+            std::wcout << L"\n" << prompt << std::flush;
+            char input;
+            std::cin >> input;
+            if (input != 'y' && input != 'Y') {
+                std::wcout << Messages::Info::operationCancelledByUser() << std::endl;
+                if (journal) {
+                    journal->record(JournalPhase::COMPLETE);
+                }
+                return false;
+            }
         }
-
-        hr = installer->put_Updates(updateInfo_.updatesList);
-        if (checkHResult(hr) != 0) {
-            return -1;
+        if (journal) {
+            journal->record(phase);
         }
+        return true;
+    };
 
-        std::wcout << L"\n" << Messages::Progress::installingUpdates() << std::endl;
-
-        // Perform installation
-        IInstallationResultPtr installResult;
-        hr = installer->Install(&installResult);
-        if (checkHResult(hr) != 0) {
-            return -1;
+    // A run that leaves installs for after a restart is resumed by the next one
+    auto finish = [&]() {
+        if (journal && manager.getDeferredCount() == 0) {
+            journal->record(JournalPhase::COMPLETE);
         }
+        std::wcout << L"\n" << Messages::Progress::operationComplete() << std::endl;
+        return 0;
+    };
 
-        // Display results
-        std::wcout << Messages::Info::installListHeader() << std::endl;
-        for (LONG i = 0; i < updateInfo_.size; i++) {
-            IUpdatePtr update;
-            hr = updateInfo_.updatesList->get_Item(i, &update);
-            if (FAILED(hr)) continue;
+    // Ask for download confirmation
+    if (downloadCount > 0 && !confirm(Messages::Prompts::confirmDownload(), JournalPhase::DOWNLOAD_CONFIRMED)) {
+        return 0;
+    }
 
-            BSTR titleBstr = nullptr;
-            hr = update->get_Title(&titleBstr);
-            if (FAILED(hr)) continue;
-            _bstr_t title(titleBstr, false);
+    // Downloads and installs change what a search returns
+    if (cache) {
+        cache->invalidate(searchKey);
+    }
+    if (warm != nullptr) {
+        warm->key.clear();
+    }
 
-            IUpdateInstallationResultPtr updateResult;
-            hr = installResult->GetUpdateResult(i, &updateResult);
-            if (FAILED(hr)) continue;
+    // Updates staged from the content cache are not downloaded again
+    if (manager.prestageContent(toDownloadList) != 0) {
+        return 1;
+    }
 
-            OperationResultCode resultCode;
-            hr = updateResult->get_ResultCode(&resultCode);
-            if (FAILED(hr)) continue;
+    // Installs overlap downloads in pipeline mode, so confirm both up front
+    if (args.pipeline) {
+        if (!confirm(Messages::Prompts::confirmInstall(), JournalPhase::INSTALL_CONFIRMED)) {
+            return 0;
+        }
 
-            printResultCode(i, title, static_cast<ResultCode>(resultCode), L"installed");
+        if (manager.downloadAndInstallUpdates(toDownloadList) != 0) {
+            return 1;
         }
+        return finish();
+    }
+
+    // Download updates
+    if (!toDownloadList.empty()) {
+        if (manager.downloadUpdates(toDownloadList) != 0) {
+            return 1;
+        }
+    }
+    if (journal && !g_interrupted) {
+        journal->record(JournalPhase::DOWNLOADED);
+    }
+
+    // Don't start installing after an interrupted download
+    if (g_interrupted) {
+        std::wcout << Messages::Info::operationCancelledByUser() << std::endl;
+        return 1;
+    }
 
+    // Ask for installation confirmation
+    if (!confirm(Messages::Prompts::confirmInstall(), JournalPhase::INSTALL_CONFIRMED)) {
         return 0;
+    }
 
-    } catch (_com_error& e) {
-        std::wcout << L"[!] COM Error: " << e.ErrorMessage() << std::endl;
-        return -1;
-    } catch (...) {
-        std::wcout << L"[!] Unknown error during installation" << std::endl;
-        return -1;
+    // Install updates
+    if (manager.installUpdates() != 0) {
+        return 1;
     }
+    return finish();
 }
 
-// Download progress callback implementation
-STDMETHODIMP DownloadProgressCallback::Invoke(IDownloadJob* job, IDownloadProgressChangedCallbackArgs* args) {
-    try {
-        IDownloadProgressPtr progress;
-        HRESULT hr = args->get_Progress(&progress);
-        if (FAILED(hr)) {
-            return hr;
+// Serve --connect clients until interrupted. Each request carries the client's
+// options; backend options (--simulate, --mta, -t, --cache), the log and the
+// metrics files are the daemon's own, and requests naming the latter two are refused.
+int WUpdater::runDaemon(UpdateBackend& backend, const CommandLineArgs& args) {
+#ifndef _WIN32
+    // A client that hangs up must not kill the daemon
+    signal(SIGPIPE, SIG_IGN);
+#endif
+
+    AgentServer server(args.daemonSocket);
+    if (!server.start()) {
+        std::wcout << Messages::Errors::agentListenFailed(args.daemonSocket) << std::endl;
+        return 1;
+    }
+    std::wcout << Messages::Info::agentListening(args.daemonSocket) << std::endl;
+
+    WarmResults warm;
+    long served = 0;
+    server.run([&](const AgentRequest& request) {
+        served++;
+        logEvent(LogLevel::INFO, L"Agent request {}: {} options, {} queries", served,
+                 static_cast<int64_t>(request.arguments.size()), static_cast<int64_t>(request.criteria.size()));
+
+        std::vector<std::string> arguments(1, "WUpdaterCMD");
+        arguments.insert(arguments.end(), request.arguments.begin(), request.arguments.end());
+        std::vector<char*> argv;
+        for (std::string& argument : arguments) {
+            argv.push_back(&argument[0]);
+        }
+
+        CommandLineArgs requestArgs;
+        if (parseArguments(static_cast<int>(argv.size()), argv.data(), requestArgs) != 0) {
+            return 1;
+        }
+        if (requiresConfirmation(requestArgs)) {
+            std::wcout << Messages::Errors::agentNeedsQuiet() << std::endl;
+            return 1;
         }
 
-        LONG percent = 0;
-        hr = progress->get_PercentComplete(&percent);
-        if (SUCCEEDED(hr) && callback_) {
-            callback_(ProgressPhase::DOWNLOADING, static_cast<UINT>(percent), context_);
+        // The log and the metrics files belong to the daemon, not to one request
+        for (const std::string& argument : request.arguments) {
+            if (argument == "--log" || argument == "--log-level" || argument == "--metrics-textfile" ||
+                argument == "--metrics-json") {
+                std::wcerr << Messages::Errors::agentOptionNotAccepted(argument) << std::endl;
+                return 1;
+            }
         }
 
-        return S_OK;
-    } catch (...) {
-        return E_FAIL;
-    }
+        requestArgs.workerThreads = args.workerThreads;
+        requestArgs.multithreadedApartment = args.multithreadedApartment;
+        requestArgs.cacheDirectory = args.cacheDirectory;
+        requestArgs.cacheTtlSeconds = args.cacheTtlSeconds;
+
+        const auto started = std::chrono::steady_clock::now();
+        int exitCode = runUpdates(backend, requestArgs, request.criteria, &warm);
+        writeMetrics(args, exitCode, std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count());
+        return exitCode;
+    }, g_interrupted);
+
+    std::wcout << Messages::Info::agentStopped(served) << std::endl;
+    return 0;
 }
 
-// Download completed callback implementation
-STDMETHODIMP DownloadCompletedCallback::Invoke(IDownloadJob* job, IDownloadCompletedCallbackArgs* args) {
-    try {
-        if (callback_) {
-            callback_(ProgressPhase::DOWNLOADING, 100, context_);
+// Forward this invocation to the daemon at --connect. Paths are made absolute
+// because the daemon does not share the client's working directory.
+int WUpdater::runClient(int argc, char* argv[], const CommandLineArgs& args) {
+    if (requiresConfirmation(args)) {
+        std::wcout << Messages::Errors::agentNeedsQuiet() << std::endl;
+        return 1;
+    }
+
+    AgentRequest request;
+    request.criteria = readCriteria(args);
+    if (request.criteria.empty()) {
+        return 1;
+    }
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--connect" && i + 1 < argc) {
+            i++;
+            continue;
         }
-        if (event_) {
-            SetEvent(event_);
+        request.arguments.push_back(arg);
+        if ((arg == "-c" || arg == "--criteria" || arg == "--diff" || arg == "--allow-list" || arg == "--deny-list" ||
+             arg == "--content-cache" || arg == "--journal" || arg == "--timings") &&
+            i + 1 < argc) {
+            i++;
+            std::error_code error;
+            std::filesystem::path absolute = std::filesystem::absolute(argv[i], error);
+            request.arguments.push_back(error ? std::string(argv[i]) : absolute.string());
         }
-        return S_OK;
-    } catch (...) {
-        return E_FAIL;
     }
+
+    int exitCode = runAgentRequest(args.connectSocket, request);
+    return exitCode < 0 ? 1 : exitCode;
 }
 
 // Main function
@@ -428,103 +895,78 @@ int main(int argc, char* argv[]) {
     // Register signal handler
     signal(SIGINT, signalHandler);
 
+    // Let the streams buffer on their own instead of going through stdio per
+    // character; prompts flush explicitly since std::cin is tied to std::cout
+    std::ios::sync_with_stdio(false);
+#ifndef _WIN32
+    // Convert wide output with the environment's character encoding, so non-ASCII
+    // criteria and titles print; numbers keep the classic format records rely on
+    try {
+        const std::locale output(std::locale::classic(), std::locale(""), std::locale::ctype);
+        std::wcout.imbue(output);
+        std::wcerr.imbue(output);
+    } catch (const std::runtime_error&) {
+    }
+#endif
+
     // Parse command line arguments
     CommandLineArgs args;
     if (parseArguments(argc, argv, args) != 0) {
         return 1;
     }
+    InterruptWatcher interruptWatcher;
+
+    // Diagnostics go to a rotating file written by a background thread
+    if (!args.logPath.empty()) {
+        LogSettings settings;
+        settings.path = args.logPath;
+        settings.level = args.logLevel;
+        if (!Logger::instance().start(settings)) {
+            std::wcout << Messages::Errors::logOpenFailed(args.logPath) << std::endl;
+            return 1;
+        }
+        logEvent(LogLevel::INFO, L"Started: {} threads, mta {}", args.workerThreads, args.multithreadedApartment ? 1 : 0);
+    }
+
+    // Thin client: the daemon owns the backend
+    if (!args.connectSocket.empty()) {
+        return runClient(argc, argv, args);
+    }
 
-    // Initialize COM
-    HRESULT hr = CoInitializeEx(nullptr, COINIT_APARTMENTTHREADED);
+    const auto started = std::chrono::steady_clock::now();
+    std::unique_ptr<UpdateBackend> backend = createBackend(args);
+    if (!backend) {
+        std::wcout << Messages::Errors::backendUnavailable() << std::endl;
+        return 1;
+    }
+
+    // Time every backend call when metrics are written
+    if (!args.metricsTextfilePath.empty() || !args.metricsJsonPath.empty()) {
+        backend.reset(new MeteredBackend(std::move(backend)));
+    }
+
+#ifdef _WIN32
+    // Initialize COM. In the MTA, update objects can be used from worker threads
+    // without marshaling, which lets metadata reads run in parallel.
+    HRESULT hr = CoInitializeEx(nullptr, args.multithreadedApartment ? COINIT_MULTITHREADED : COINIT_APARTMENTTHREADED);
     if (FAILED(hr)) {
         std::wcout << Messages::Errors::comInitializationFailed() 
                   << L". Error code: 0x" << std::hex << hr << std::dec << std::endl;
         return 1;
     }
+#endif
 
     int exitCode = 0;
 
     try {
-        // Get search criteria
-        _bstr_t criteria = getCriteriaFromFile(args.criteriaFilePath);
-        if (criteria.length() == 0) {
-            exitCode = 1;
-            goto cleanup;
-        }
-
-        // Create update manager
-        UpdateManager manager;
-
-        // Search for updates
-        if (manager.searchForUpdates(criteria) != 0) {
-            exitCode = 1;
-            goto cleanup;
-        }
-
-        // Create download list
-        IUpdateCollectionPtr toDownloadList;
-        hr = toDownloadList.CreateInstance(CLSID_UpdateCollection);
-        if (checkHResult(hr) != 0) {
-            exitCode = 1;
-            goto cleanup;
-        }
-
-        // Print update information
-        if (manager.printUpdateInfo(toDownloadList) != 0) {
-            exitCode = 1;
-            goto cleanup;
-        }
-
-        // Check if there are updates to download
-        LONG downloadCount = 0;
-        toDownloadList->get_Count(&downloadCount);
-
-        if (downloadCount == 0 && manager.getUpdateCount() == 0) {
-            std::wcout << L"\n" << Messages::Status::noUpdatesFound() << std::endl;
-            goto cleanup;
-        }
-
-        // Ask for download confirmation (unless quiet mode)
-        if (!args.quietMode && downloadCount > 0) {
-            std::wcout << L"\n" << Messages::Prompts::confirmDownload();
-            char input;
-            std::cin >> input;
-            if (input != 'y' && input != 'Y') {
-                std::wcout << Messages::Info::operationCancelledByUser() << std::endl;
-                goto cleanup;
-            }
-        }
-
-        // Download updates
-        if (downloadCount > 0) {
-            if (manager.downloadUpdates(toDownloadList) != 0) {
-                exitCode = 1;
-                goto cleanup;
-            }
-        }
-
-        // Ask for installation confirmation (unless quiet mode)
-        if (!args.quietMode) {
-            std::wcout << L"\n" << Messages::Prompts::confirmInstall();
-            char input;
-            std::cin >> input;
-            if (input != 'y' && input != 'Y') {
-                std::wcout << Messages::Info::operationCancelledByUser() << std::endl;
-                goto cleanup;
-            }
-        }
-
-        // Install updates
-        if (manager.installUpdates() != 0) {
-            exitCode = 1;
-            goto cleanup;
+        if (!args.daemonSocket.empty()) {
+            exitCode = runDaemon(*backend, args);
+        } else {
+            // Get search criteria
+            std::vector<std::wstring> criteria = readCriteria(args);
+            exitCode = criteria.empty() ? 1 : runUpdates(*backend, args, criteria, nullptr);
+            writeMetrics(args, exitCode, std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count());
         }
-
-        std::wcout << L"\n" << Messages::Progress::operationComplete() << std::endl;
-
-    } catch (_com_error& e) {
-        std::wcout << L"[!] COM Error: " << e.ErrorMessage() << std::endl;
-        exitCode = 1;
     } catch (std::exception& e) {
         std::wcout << L"[!] Exception: " << e.what() << std::endl;
         exitCode = 1;
@@ -533,7 +975,11 @@ int main(int argc, char* argv[]) {
         exitCode = 1;
     }
 
-cleanup:
+    backend.reset();
+#ifdef _WIN32
     CoUninitialize();
+#endif
+    logEvent(LogLevel::INFO, L"Finished with exit code {}", exitCode);
+    Logger::instance().stop();
     return exitCode;
-}
\ No newline at end of file
+}
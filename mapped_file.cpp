@@ -0,0 +1,151 @@
+#include "mapped_file.h"
+#include <cstdio>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace WUpdater {
+
+#ifdef _WIN32
+
+    MappedFile::MappedFile()
+        : data_(nullptr), size_(0), open_(false), file_(INVALID_HANDLE_VALUE), mapping_(nullptr) {}
+
+    bool MappedFile::open(const std::string& path) {
+        close();
+
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+                                  OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file, &size)) {
+            CloseHandle(file);
+            return false;
+        }
+
+        file_ = file;
+        size_ = static_cast<size_t>(size.QuadPart);
+        open_ = true;
+        if (size_ == 0) {
+            return true;
+        }
+
+        mapping_ = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping_ == nullptr) {
+            close();
+            return false;
+        }
+
+        data_ = static_cast<const uint8_t*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+        if (data_ == nullptr) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void MappedFile::close() {
+        if (data_ != nullptr) {
+            UnmapViewOfFile(data_);
+        }
+        if (mapping_ != nullptr) {
+            CloseHandle(mapping_);
+        }
+        if (file_ != INVALID_HANDLE_VALUE) {
+            CloseHandle(file_);
+        }
+        data_ = nullptr;
+        mapping_ = nullptr;
+        file_ = INVALID_HANDLE_VALUE;
+        size_ = 0;
+        open_ = false;
+    }
+
+#else
+
+    MappedFile::MappedFile() : data_(nullptr), size_(0), open_(false), fd_(-1) {}
+
+    bool MappedFile::open(const std::string& path) {
+        close();
+
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+            ::close(fd);
+            return false;
+        }
+
+        fd_ = fd;
+        size_ = static_cast<size_t>(info.st_size);
+        open_ = true;
+        if (size_ == 0) {
+            return true;
+        }
+
+        void* data = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+        if (data == MAP_FAILED) {
+            close();
+            return false;
+        }
+        data_ = static_cast<const uint8_t*>(data);
+        return true;
+    }
+
+    void MappedFile::close() {
+        if (data_ != nullptr) {
+            munmap(const_cast<uint8_t*>(data_), size_);
+        }
+        if (fd_ >= 0) {
+            ::close(fd_);
+        }
+        data_ = nullptr;
+        fd_ = -1;
+        size_ = 0;
+        open_ = false;
+    }
+
+#endif
+
+    MappedFile::~MappedFile() {
+        close();
+    }
+
+    bool writeFileAtomically(const std::string& path, const void* data, size_t size) {
+        std::string temporary = path + ".tmp";
+        std::FILE* file = std::fopen(temporary.c_str(), "wb");
+        if (file == nullptr) {
+            return false;
+        }
+
+        bool written = std::fwrite(data, 1, size, file) == size;
+        written = std::fclose(file) == 0 && written;
+        if (!written) {
+            std::remove(temporary.c_str());
+            return false;
+        }
+
+#ifdef _WIN32
+        bool replaced = MoveFileExA(temporary.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+        bool replaced = std::rename(temporary.c_str(), path.c_str()) == 0;
+#endif
+        if (!replaced) {
+            std::remove(temporary.c_str());
+        }
+        return replaced;
+    }
+
+} // namespace WUpdater
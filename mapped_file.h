@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace WUpdater {
+
+    /**
+     * @brief Read-only memory mapping of a whole file.
+     *
+     * Uses CreateFileMapping/MapViewOfFile on Windows and mmap elsewhere.
+     * Empty files open successfully with a null data pointer.
+     */
+    class MappedFile {
+    public:
+        MappedFile();
+        ~MappedFile();
+
+        // Disable copy
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        // Map the file at path; returns false if it cannot be opened or mapped
+        bool open(const std::string& path);
+        void close();
+
+        const uint8_t* data() const { return data_; }
+        size_t size() const { return size_; }
+        bool isOpen() const { return open_; }
+
+    private:
+        const uint8_t* data_;
+        size_t size_;
+        bool open_;
+#ifdef _WIN32
+        void* file_;
+        void* mapping_;
+#else
+        int fd_;
+#endif
+    };
+
+    // Write data to path through a temporary file that replaces the target
+    // in one step, so readers never see a partially written file
+    bool writeFileAtomically(const std::string& path, const void* data, size_t size);
+
+} // namespace WUpdater
@@ -1,4 +1,5 @@
 #include "messages.h"
+#include <cmath>
 #include <sstream>
 #include <iomanip>
 
@@ -13,8 +14,56 @@ namespace Messages {
                 << "Options:\n"
                 << "\t-h, --help\t\tShow this help message\n"
                 << "\t-q, --quiet\t\tRun without asking for confirmation\n"
-                << "\t-c, --criteria PATH\tSpecify the path to file with search criteria\n"
-                << "\t\t\t\ti.e. IsInstalled=0 and Type='Software' and IsHidden=0\n";
+                << "\t-c, --criteria PATH\tSpecify the path to file with search criteria, one query per line\n"
+                << "\t\t\t\ti.e. IsInstalled=0 and Type='Software' and IsHidden=0\n"
+                << "\t-p, --pipeline\t\tInstall each update as soon as its download finishes\n"
+                << "\t-n, --dry-run\t\tList applicable updates and exit without downloading\n"
+                << "\t--diff PATH\t\tReport only what changed since the snapshot in PATH, then update it\n"
+                << "\t--allow-list PATH\tOnly offer updates whose KB or UpdateID is listed in PATH\n"
+                << "\t--deny-list PATH\tNever offer updates whose KB or UpdateID is listed in PATH\n"
+                << "\t--format FMT\t\tOutput format: text (default), jsonl or csv. Records go to\n"
+                << "\t\t\t\tstdout, messages and progress to stderr\n"
+                << "\t--log PATH\t\tWrite diagnostics to PATH (rotated at 8 MiB, 3 kept)\n"
+                << "\t--log-level LEVEL\tdebug, info (default), warn or error\n"
+                << "\t--metrics-textfile PATH\tWrite run metrics to PATH in Prometheus text format\n"
+                << "\t\t\t\t(for the node_exporter textfile collector)\n"
+                << "\t--metrics-json PATH\tWrite run metrics to PATH as JSON\n"
+                << "\t-t, --threads N\t\tRun up to N searches concurrently (default 4)\n"
+                << "\t--mta\t\t\tUse the multithreaded COM apartment and read update\n"
+                << "\t\t\t\tmetadata on the -t worker threads\n"
+                << "\t--search-timeout SEC\tAbort the search if it takes longer than SEC seconds\n"
+                << "\t--stream N\t\tRead update metadata N updates at a time, keeping only\n"
+                << "\t\t\t\tthe listed ones (none with -n); not with --diff\n"
+                << "\t--download-lanes N\tDownload in up to N concurrent jobs, large updates on\n"
+                << "\t\t\t\ttheir own lane and small ones packed together (default 1)\n"
+                << "\t--content-cache DIR\tCopy payloads found in the shared directory DIR into\n"
+                << "\t\t\t\tthe update cache instead of downloading them\n"
+                << "\t--export-content\tFetch payloads missing from --content-cache into it first\n"
+                << "\t--window MIN\t\tOnly take on the updates expected to fit in a maintenance\n"
+                << "\t\t\t\twindow of MIN minutes; the rest are kept in --journal\n"
+                << "\t\t\t\tfor the next run (required unless --dry-run)\n"
+                << "\t--timings FILE\t\tRecord download and install times in FILE and use them\n"
+                << "\t\t\t\tfor the estimated run time and --window planning\n"
+                << "\t--journal FILE\t\tRecord the run in FILE; after a crash or restart the\n"
+                << "\t\t\t\tnext run resumes it without searching again\n"
+                << "\t--retries N\t\tRetry searches, downloads and installs that failed with a\n"
+                << "\t\t\t\ttransient error up to N times, re-submitting only the\n"
+                << "\t\t\t\tfailed queries or updates (default 0)\n"
+                << "\t--retry-delay MS\tWait before the first retry, doubled for each further\n"
+                << "\t\t\t\tone with random jitter (default 10000, at most 5 min)\n"
+                << "\t--retry-budget SEC\tStop retrying a phase once it has run for SEC seconds,\n"
+                << "\t\t\t\ti.e. 1800 or search=120,download=1800,install=900\n"
+                << "\t--cache DIR\t\tKeep search results in DIR and reuse them while fresh\n"
+                << "\t--cache-ttl SEC\t\tHow long cached search results stay fresh (default 900)\n"
+                << "\t--daemon SOCKET\t\tServe requests from --connect clients on a local socket,\n"
+                << "\t\t\t\tkeeping the update session and last search warm\n"
+                << "\t--connect SOCKET\tSend this request to the daemon at SOCKET instead of\n"
+                << "\t\t\t\trunning it here (needs -q, -n or --diff)\n"
+                << "\t--simulate SPEC\t\tUse the in-process simulated backend instead of WUA\n"
+                << "\t\t\t\ti.e. updates=5000,search-ms=200,download-ms=5,install-ms=5,\n"
+                << "\t\t\t\t     fail-rate=0.01,fail-hr=0x80240034,downloaded=0.1,seed=1,\n"
+                << "\t\t\t\t     resolve-ms=20,read-us=200,transient=1,download-mbps=50,\n"
+                << "\t\t\t\t     exclusive=0.01,always-reboot=0.05\n";
             return oss.str();
         }
 
@@ -41,6 +90,35 @@ namespace Messages {
             return L"Installing updates...";
         }
 
+        std::wstring installingBatch(long count, long stillDownloading) {
+            std::wostringstream oss;
+            oss << L"Installing " << count << L" update(s)";
+            if (stillDownloading > 0) {
+                oss << L" while " << stillDownloading << L" still downloading";
+            }
+            oss << L"...";
+            return oss.str();
+        }
+
+        std::wstring installPass(long pass, long passes, long count, bool exclusive, bool mayReboot) {
+            std::wostringstream oss;
+            oss << L"Install pass " << pass << L" of " << passes << L": " << count << L" update(s)";
+            if (exclusive) {
+                oss << L", exclusive";
+            }
+            if (mayReboot) {
+                oss << L", may require a restart";
+            }
+            return oss.str();
+        }
+
+        std::wstring retrying(long count, const std::wstring& what, double delaySeconds, unsigned round, unsigned rounds) {
+            std::wostringstream oss;
+            oss << L"Retrying " << count << L" failed " << what << L" in " << std::fixed << std::setprecision(1) << delaySeconds
+                << L" s (retry " << round << L" of " << rounds << L")...";
+            return oss.str();
+        }
+
         std::wstring operationComplete() {
             return L"Operation completed successfully!";
         }
@@ -73,6 +151,29 @@ namespace Messages {
         std::wstring installationComplete() {
             return L"Installation completed";
         }
+
+        std::wstring changeAdded(int32_t revision) {
+            std::wostringstream oss;
+            oss << L"New (revision " << revision << L")";
+            return oss.str();
+        }
+
+        std::wstring changeRemoved() {
+            return L"No longer applicable";
+        }
+
+        std::wstring changeRevised(int32_t from, int32_t to) {
+            std::wostringstream oss;
+            oss << L"Revision " << from << L" -> " << to;
+            return oss.str();
+        }
+
+        std::wstring changeState(bool isDownloaded, bool isInstalled) {
+            if (isInstalled) {
+                return L"Now installed";
+            }
+            return isDownloaded ? L"Now downloaded" : L"No longer downloaded";
+        }
     }
 
     // Prompt messages
@@ -116,6 +217,131 @@ namespace Messages {
         std::wstring serviceNotRunning() {
             return L"[!] Windows Update service is not running";
         }
+
+        std::wstring backendUnavailable() {
+            return L"[!] The Windows Update Agent is not available in this build. Use --simulate";
+        }
+
+        std::wstring searchTimedOut(unsigned seconds) {
+            std::wostringstream oss;
+            oss << L"[!] Search did not complete within " << seconds << L" seconds and was aborted";
+            return oss.str();
+        }
+
+        std::wstring searchCancelled() {
+            return L"[!] Search was cancelled";
+        }
+
+        std::wstring queryFailed(long index) {
+            std::wostringstream oss;
+            oss << L"[!] Search for criteria line " << index + 1 << L" failed";
+            return oss.str();
+        }
+
+        std::wstring invalidCriteria(long index, size_t column, const std::wstring& message) {
+            std::wostringstream oss;
+            oss << L"[!] Criteria line " << index + 1 << L", column " << column + 1 << L": " << message;
+            return oss.str();
+        }
+
+        std::wstring snapshotWriteFailed(const std::string& path) {
+            std::wostringstream oss;
+            oss << L"[!] Unable to write snapshot file: ";
+            for (char c : path) {
+                oss << static_cast<wchar_t>(c);
+            }
+            return oss.str();
+        }
+
+        std::wstring agentListenFailed(const std::string& path) {
+            std::wostringstream oss;
+            oss << L"[!] Unable to listen on agent socket (in use or not writable): ";
+            for (char c : path) {
+                oss << static_cast<wchar_t>(c);
+            }
+            return oss.str();
+        }
+
+        std::wstring agentUnavailable(const std::string& path) {
+            std::wostringstream oss;
+            oss << L"[!] No agent daemon is answering on ";
+            for (char c : path) {
+                oss << static_cast<wchar_t>(c);
+            }
+            return oss.str();
+        }
+
+        std::wstring agentDisconnected() {
+            return L"[!] The agent daemon closed the connection before the request finished";
+        }
+
+        std::wstring agentNeedsQuiet() {
+            return L"[!] Requests sent to the agent cannot prompt for confirmation. Use -q, -n or --diff";
+        }
+
+        std::wstring agentOptionNotAccepted(const std::string& option) {
+            std::wostringstream oss;
+            oss << L"[!] ";
+            for (char c : option) {
+                oss << static_cast<wchar_t>(c);
+            }
+            oss << L" applies to the whole agent daemon; pass it with --daemon instead of with the request";
+            return oss.str();
+        }
+
+        std::wstring logOpenFailed(const std::string& path) {
+            std::wostringstream oss;
+            oss << L"[!] Unable to open log file: ";
+            for (char c : path) {
+                oss << static_cast<wchar_t>(c);
+            }
+            return oss.str();
+        }
+
+        std::wstring metricsWriteFailed(const std::string& path) {
+            std::wostringstream oss;
+            oss << L"[!] Unable to write metrics file: ";
+            for (char c : path) {
+                oss << static_cast<wchar_t>(c);
+            }
+            return oss.str();
+        }
+
+        std::wstring updateListInvalid(const std::string& error) {
+            std::wostringstream oss;
+            oss << L"[!] Invalid update list: ";
+            for (char c : error) {
+                oss << static_cast<wchar_t>(c);
+            }
+            return oss.str();
+        }
+
+        std::wstring contentCacheFailed(const std::string& error) {
+            std::wostringstream oss;
+            oss << L"[!] Content cache unavailable: ";
+            for (char c : error) {
+                oss << static_cast<wchar_t>(c);
+            }
+            return oss.str();
+        }
+
+        std::wstring journalFailed(const std::string& error) {
+            std::wostringstream oss;
+            oss << L"[!] Run journal unavailable: ";
+            for (char c : error) {
+                oss << static_cast<wchar_t>(c);
+            }
+            return oss.str();
+        }
+
+        std::wstring timingStoreFailed(const std::string& error) {
+            std::wostringstream oss;
+            oss << L"[!] Timing store unavailable: ";
+            for (char c : error) {
+                oss << static_cast<wchar_t>(c);
+            }
+            return oss.str();
+        }
     }
 
     // Operation result messages
@@ -182,6 +408,145 @@ namespace Messages {
         std::wstring operationCancelledByUser() {
             return L"Operation cancelled by user.";
         }
+
+        std::wstring interruptReceived() {
+            return L"\n[!] Caught interrupt signal. Aborting... (interrupt again to exit immediately)";
+        }
+
+        std::wstring searchCacheHit(long count, long long ageSeconds) {
+            std::wostringstream oss;
+            oss << L"Using cached search results (" << count << L" update" << (count != 1 ? L"s" : L"")
+                << L", " << ageSeconds << L"s old)";
+            return oss.str();
+        }
+
+        std::wstring searchCacheStale() {
+            return L"[!] Cached updates are no longer available, searching again";
+        }
+
+        std::wstring dryRunSummary(long toDownload, long toInstall) {
+            std::wostringstream oss;
+            oss << L"Dry run: " << toDownload << L" update(s) would be downloaded and "
+                << toInstall << L" installed";
+            return oss.str();
+        }
+
+        std::wstring changesSince(const std::wstring& date) {
+            return L"\nChanges since the run of " + date + L":";
+        }
+
+        std::wstring noPreviousSnapshot() {
+            return L"\nNo previous snapshot, every update is reported as new:";
+        }
+
+        std::wstring snapshotScopeChanged() {
+            return L"\n[!] The previous snapshot was taken with other criteria, every update is reported as new:";
+        }
+
+        std::wstring changesSummary(long added, long removed, long revised, long stateChanged) {
+            std::wostringstream oss;
+            oss << added << L" new, " << removed << L" no longer applicable, "
+                << revised << L" revised, " << stateChanged << L" changed state";
+            return oss.str();
+        }
+
+        std::wstring agentListening(const std::string& path) {
+            std::wostringstream oss;
+            oss << L"Agent listening on ";
+            for (char c : path) {
+                oss << static_cast<wchar_t>(c);
+            }
+            oss << L" (Ctrl+C to stop)";
+            return oss.str();
+        }
+
+        std::wstring agentStopped(long requests) {
+            std::wostringstream oss;
+            oss << L"Agent stopped after " << requests << L" request" << (requests != 1 ? L"s" : L"");
+            return oss.str();
+        }
+
+        std::wstring warmResultsHit(long count, long long ageSeconds) {
+            std::wostringstream oss;
+            oss << L"Using the agent's last search (" << count << L" update" << (count != 1 ? L"s" : L"")
+                << L", " << ageSeconds << L"s old)";
+            return oss.str();
+        }
+
+        std::wstring pipelineSerial() {
+            return L"Pipelined installs need --mta with this backend; downloading first, then installing";
+        }
+
+        std::wstring clientFilterApplied(long kept, long found) {
+            std::wostringstream oss;
+            oss << L"Client-side criteria kept " << kept << L" of " << found << L" update" << (found != 1 ? L"s" : L"");
+            return oss.str();
+        }
+
+        std::wstring updateListsApplied(long notAllowed, long denied) {
+            std::wostringstream oss;
+            oss << L"Left out " << notAllowed << L" update" << (notAllowed != 1 ? L"s" : L"")
+                << L" not on the allow-list and " << denied << L" on the deny-list";
+            return oss.str();
+        }
+
+        std::wstring contentCacheApplied(long imported, long exported, long remaining) {
+            std::wostringstream oss;
+            oss << L"Content cache: " << imported << L" update" << (imported != 1 ? L"s" : L"") << L" staged from the cache, "
+                << exported << L" exported, " << remaining << L" left to download";
+            return oss.str();
+        }
+
+        std::wstring installDeferred(long count) {
+            std::wostringstream oss;
+            oss << count << L" update(s) can only be installed after a restart; run again once the machine has restarted";
+            return oss.str();
+        }
+
+        std::wstring runResumed(long remaining, long total) {
+            std::wostringstream oss;
+            oss << L"Resuming the interrupted run from its journal: " << remaining << L" of " << total
+                << L" update(s) left, no search needed";
+            return oss.str();
+        }
+
+        std::wstring journalStale() {
+            return L"[!] Journaled updates are no longer available, starting a new run";
+        }
+
+        std::wstring windowPlanned(long selected, long plannedMinutes, long budgetMinutes, long deferred) {
+            std::wostringstream oss;
+            oss << L"Maintenance window: " << selected << L" update(s) planned for about " << plannedMinutes
+                << L" of " << budgetMinutes << L" minute(s) left, " << deferred << L" deferred to the next window";
+            return oss.str();
+        }
+
+        std::wstring windowDeferredHeader() {
+            return L"Deferred to the next window:";
+        }
+
+        std::wstring windowEstimate(long minutes) {
+            std::wostringstream oss;
+            oss << L"About " << minutes << L" min";
+            return oss.str();
+        }
+
+        std::wstring windowNothingFits() {
+            return L"No update fits in what is left of the maintenance window";
+        }
+
+        std::wstring runEstimate(double typicalSeconds, double slowSeconds) {
+            std::wostringstream oss;
+            oss << L"Estimated time: about " << static_cast<long>(std::ceil(typicalSeconds / 60))
+                << L" minute(s), up to " << static_cast<long>(std::ceil(slowSeconds / 60)) << L" for slow runs";
+            return oss.str();
+        }
+
+        std::wstring windowClosed(long count) {
+            std::wostringstream oss;
+            oss << L"The maintenance window has closed; " << count << L" update(s) were not installed and are left for the next window";
+            return oss.str();
+        }
     }
 
 } // namespace Messages
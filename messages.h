@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
 
 namespace WUpdater {
@@ -17,6 +18,9 @@ namespace Messages {
         std::wstring searchingUpdates();
         std::wstring downloadingUpdates();
         std::wstring installingUpdates();
+        std::wstring installingBatch(long count, long stillDownloading);
+        std::wstring installPass(long pass, long passes, long count, bool exclusive, bool mayReboot);
+        std::wstring retrying(long count, const std::wstring& what, double delaySeconds, unsigned round, unsigned rounds);
         std::wstring operationComplete();
     }
 
@@ -28,6 +32,10 @@ namespace Messages {
         std::wstring toDownload();
         std::wstring downloadComplete();
         std::wstring installationComplete();
+        std::wstring changeAdded(int32_t revision);
+        std::wstring changeRemoved();
+        std::wstring changeRevised(int32_t from, int32_t to);
+        std::wstring changeState(bool isDownloaded, bool isInstalled);
     }
 
     // Prompt messages
@@ -44,6 +52,23 @@ namespace Messages {
         std::wstring comInitializationFailed();
         std::wstring insufficientPrivileges();
         std::wstring serviceNotRunning();
+        std::wstring backendUnavailable();
+        std::wstring searchTimedOut(unsigned seconds);
+        std::wstring searchCancelled();
+        std::wstring queryFailed(long index);
+        std::wstring invalidCriteria(long index, size_t column, const std::wstring& message);
+        std::wstring snapshotWriteFailed(const std::string& path);
+        std::wstring agentListenFailed(const std::string& path);
+        std::wstring agentUnavailable(const std::string& path);
+        std::wstring agentDisconnected();
+        std::wstring agentNeedsQuiet();
+        std::wstring agentOptionNotAccepted(const std::string& option);
+        std::wstring logOpenFailed(const std::string& path);
+        std::wstring metricsWriteFailed(const std::string& path);
+        std::wstring updateListInvalid(const std::string& error);
+        std::wstring contentCacheFailed(const std::string& error);
+        std::wstring journalFailed(const std::string& error);
+        std::wstring timingStoreFailed(const std::string& error);
     }
 
     // Operation result messages
@@ -64,6 +89,30 @@ namespace Messages {
         std::wstring installListHeader();
         std::wstring criteriaLoaded();
         std::wstring operationCancelledByUser();
+        std::wstring interruptReceived();
+        std::wstring searchCacheHit(long count, long long ageSeconds);
+        std::wstring searchCacheStale();
+        std::wstring dryRunSummary(long toDownload, long toInstall);
+        std::wstring changesSince(const std::wstring& date);
+        std::wstring noPreviousSnapshot();
+        std::wstring snapshotScopeChanged();
+        std::wstring changesSummary(long added, long removed, long revised, long stateChanged);
+        std::wstring agentListening(const std::string& path);
+        std::wstring agentStopped(long requests);
+        std::wstring warmResultsHit(long count, long long ageSeconds);
+        std::wstring pipelineSerial();
+        std::wstring clientFilterApplied(long kept, long found);
+        std::wstring updateListsApplied(long notAllowed, long denied);
+        std::wstring contentCacheApplied(long imported, long exported, long remaining);
+        std::wstring installDeferred(long count);
+        std::wstring runResumed(long remaining, long total);
+        std::wstring journalStale();
+        std::wstring windowPlanned(long selected, long plannedMinutes, long budgetMinutes, long deferred);
+        std::wstring windowDeferredHeader();
+        std::wstring windowEstimate(long minutes);
+        std::wstring windowNothingFits();
+        std::wstring windowClosed(long count);
+        std::wstring runEstimate(double typicalSeconds, double slowSeconds);
     }
 
 } // namespace Messages
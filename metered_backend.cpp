@@ -0,0 +1,101 @@
+#include "metered_backend.h"
+#include "error_messages.h"
+#include "utf8.h"
+
+namespace WUpdater {
+
+    namespace {
+
+        // Label values of the call label, indexed by MeteredBackend::Call
+        const char* const kCallNames[] = {
+            "search", "find_by_identity", "get_search_context", "get_update", "read_updates",
+            "get_identity", "download", "install", "get_content_files", "fetch_content_file",
+            "copy_to_cache"
+        };
+
+    } // namespace
+
+    MeteredBackend::MeteredBackend(std::unique_ptr<UpdateBackend> inner) : inner_(std::move(inner)) {
+        MetricsRegistry& registry = MetricsRegistry::instance();
+        for (int call = 0; call < CALL_COUNT; call++) {
+            durations_[call] = &registry.histogram("wupdater_backend_call_duration_seconds",
+                                                   "Duration of calls into the update backend",
+                                                   { { "call", kCallNames[call] } });
+        }
+    }
+
+    HRESULT MeteredBackend::record(Call call, HRESULT hr) {
+        if (FAILED(hr)) {
+            MetricsRegistry::instance().counter("wupdater_backend_errors_total", "Failed backend calls by HRESULT", {
+                { "call", kCallNames[call] },
+                { "category", toUtf8(ErrorMessages::getErrorCategory(hr)) },
+                { "hresult", hresultLabel(hr) }
+            }).add();
+        }
+        return hr;
+    }
+
+    HRESULT MeteredBackend::search(const std::wstring& criteria, const SearchOptions& options,
+                                   std::vector<UpdateHandle>& found) {
+        ScopedTimer timer(*durations_[SEARCH]);
+        return record(SEARCH, inner_->search(criteria, options, found));
+    }
+
+    HRESULT MeteredBackend::findByIdentity(const std::vector<std::wstring>& updateIds,
+                                           std::vector<UpdateHandle>& found) {
+        ScopedTimer timer(*durations_[FIND_BY_IDENTITY]);
+        return record(FIND_BY_IDENTITY, inner_->findByIdentity(updateIds, found));
+    }
+
+    HRESULT MeteredBackend::getSearchContext(SearchContext& context) {
+        ScopedTimer timer(*durations_[GET_SEARCH_CONTEXT]);
+        return record(GET_SEARCH_CONTEXT, inner_->getSearchContext(context));
+    }
+
+    HRESULT MeteredBackend::getUpdate(const UpdateHandle& handle, UpdateRecord& updateRecord) {
+        ScopedTimer timer(*durations_[GET_UPDATE]);
+        return record(GET_UPDATE, inner_->getUpdate(handle, updateRecord));
+    }
+
+    HRESULT MeteredBackend::readUpdates(const std::vector<UpdateHandle>& handles, size_t begin, size_t end,
+                                        UpdateTable& table) {
+        ScopedTimer timer(*durations_[READ_UPDATES]);
+        return record(READ_UPDATES, inner_->readUpdates(handles, begin, end, table));
+    }
+
+    HRESULT MeteredBackend::getIdentity(const UpdateHandle& handle, std::wstring& updateId, int32_t& revision) {
+        ScopedTimer timer(*durations_[GET_IDENTITY]);
+        return record(GET_IDENTITY, inner_->getIdentity(handle, updateId, revision));
+    }
+
+    HRESULT MeteredBackend::download(const std::vector<UpdateHandle>& updates,
+                                     std::vector<UpdateOutcome>& outcomes,
+                                     DownloadObserver* observer) {
+        ScopedTimer timer(*durations_[DOWNLOAD]);
+        return record(DOWNLOAD, inner_->download(updates, outcomes, observer));
+    }
+
+    HRESULT MeteredBackend::install(const std::vector<UpdateHandle>& updates,
+                                    std::vector<UpdateOutcome>& outcomes,
+                                    UpdateProgressCallback callback, void* context) {
+        ScopedTimer timer(*durations_[INSTALL]);
+        return record(INSTALL, inner_->install(updates, outcomes, callback, context));
+    }
+
+    HRESULT MeteredBackend::getContentFiles(const UpdateHandle& handle, std::vector<ContentFile>& files) {
+        ScopedTimer timer(*durations_[GET_CONTENT_FILES]);
+        return record(GET_CONTENT_FILES, inner_->getContentFiles(handle, files));
+    }
+
+    HRESULT MeteredBackend::fetchContentFile(const ContentFile& file, const std::string& path) {
+        ScopedTimer timer(*durations_[FETCH_CONTENT_FILE]);
+        return record(FETCH_CONTENT_FILE, inner_->fetchContentFile(file, path));
+    }
+
+    HRESULT MeteredBackend::copyToCache(const UpdateHandle& handle, const std::vector<ContentFile>& files,
+                                        const std::vector<std::string>& paths) {
+        ScopedTimer timer(*durations_[COPY_TO_CACHE]);
+        return record(COPY_TO_CACHE, inner_->copyToCache(handle, files, paths));
+    }
+
+} // namespace WUpdater
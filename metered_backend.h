@@ -0,0 +1,56 @@
+#pragma once
+
+#include "metrics.h"
+#include "update_backend.h"
+#include <memory>
+
+namespace WUpdater {
+
+    /**
+     * @brief Backend decorator timing every call into the wrapped backend.
+     *
+     * Each call is observed in wupdater_backend_call_duration_seconds{call}
+     * and every failed HRESULT is counted in wupdater_backend_errors_total
+     * with its error category. For the WUA backend these are the COM calls
+     * the engine makes (search, property reads, download and install jobs).
+     */
+    class MeteredBackend : public UpdateBackend {
+    public:
+        explicit MeteredBackend(std::unique_ptr<UpdateBackend> inner);
+
+        std::wstring name() const override { return inner_->name(); }
+
+        HRESULT search(const std::wstring& criteria, const SearchOptions& options,
+                       std::vector<UpdateHandle>& found) override;
+        HRESULT findByIdentity(const std::vector<std::wstring>& updateIds,
+                               std::vector<UpdateHandle>& found) override;
+        HRESULT getSearchContext(SearchContext& context) override;
+        void releaseSearches() override { inner_->releaseSearches(); }
+        bool allowsConcurrentCalls() const override { return inner_->allowsConcurrentCalls(); }
+        HRESULT getUpdate(const UpdateHandle& handle, UpdateRecord& record) override;
+        HRESULT readUpdates(const std::vector<UpdateHandle>& handles, size_t begin, size_t end,
+                            UpdateTable& table) override;
+        HRESULT getIdentity(const UpdateHandle& handle, std::wstring& updateId, int32_t& revision) override;
+        HRESULT download(const std::vector<UpdateHandle>& updates,
+                         std::vector<UpdateOutcome>& outcomes,
+                         DownloadObserver* observer) override;
+        HRESULT install(const std::vector<UpdateHandle>& updates,
+                        std::vector<UpdateOutcome>& outcomes,
+                        UpdateProgressCallback callback, void* context) override;
+        HRESULT getContentFiles(const UpdateHandle& handle, std::vector<ContentFile>& files) override;
+        HRESULT fetchContentFile(const ContentFile& file, const std::string& path) override;
+        HRESULT copyToCache(const UpdateHandle& handle, const std::vector<ContentFile>& files,
+                            const std::vector<std::string>& paths) override;
+
+    private:
+        enum Call { SEARCH, FIND_BY_IDENTITY, GET_SEARCH_CONTEXT, GET_UPDATE, READ_UPDATES,
+                    GET_IDENTITY, DOWNLOAD, INSTALL, GET_CONTENT_FILES, FETCH_CONTENT_FILE,
+                    COPY_TO_CACHE, CALL_COUNT };
+
+        std::unique_ptr<UpdateBackend> inner_;
+        Histogram* durations_[CALL_COUNT];
+
+        HRESULT record(Call call, HRESULT hr);
+    };
+
+} // namespace WUpdater
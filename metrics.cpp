@@ -0,0 +1,290 @@
+#include "metrics.h"
+#include "mapped_file.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <stdexcept>
+
+namespace WUpdater {
+
+    namespace {
+
+        const char* const kKindNames[] = { "counter", "gauge", "histogram" };
+
+        void appendNumber(std::string& out, double value) {
+            if (std::isinf(value)) {
+                out += value > 0 ? "+Inf" : "-Inf";
+                return;
+            }
+            char digits[32];
+            int length = std::snprintf(digits, sizeof(digits), "%.15g", value);
+            out.append(digits, length > 0 ? static_cast<size_t>(length) : 0);
+        }
+
+        void appendNumber(std::string& out, uint64_t value) {
+            char digits[24];
+            int length = std::snprintf(digits, sizeof(digits), "%llu", static_cast<unsigned long long>(value));
+            out.append(digits, length > 0 ? static_cast<size_t>(length) : 0);
+        }
+
+        // Label values and JSON strings share the escapes for \, " and newline
+        void appendEscaped(std::string& out, const std::string& text, bool json) {
+            for (char c : text) {
+                if (c == '\\' || c == '"') {
+                    out += '\\';
+                    out += c;
+                } else if (c == '\n') {
+                    out += "\\n";
+                } else if (json && static_cast<unsigned char>(c) < 0x20) {
+                    char escape[8];
+                    std::snprintf(escape, sizeof(escape), "\\u%04x", static_cast<unsigned>(c));
+                    out += escape;
+                } else {
+                    out += c;
+                }
+            }
+        }
+
+        // {name="value",...} with an optional extra label (le for histogram buckets)
+        void appendLabels(std::string& out, const MetricLabels& labels, const char* extraName = nullptr,
+                          const std::string& extraValue = std::string()) {
+            if (labels.empty() && extraName == nullptr) {
+                return;
+            }
+            out += '{';
+            bool first = true;
+            for (const auto& label : labels) {
+                if (!first) {
+                    out += ',';
+                }
+                first = false;
+                out += label.first;
+                out += "=\"";
+                appendEscaped(out, label.second, false);
+                out += '"';
+            }
+            if (extraName != nullptr) {
+                if (!first) {
+                    out += ',';
+                }
+                out += extraName;
+                out += "=\"";
+                out += extraValue;
+                out += '"';
+            }
+            out += '}';
+        }
+
+    } // namespace
+
+    Histogram::Histogram(const std::vector<double>& bounds)
+        : bounds_(bounds), buckets_(new std::atomic<uint64_t>[bounds.size() + 1]) {
+        std::sort(bounds_.begin(), bounds_.end());
+        for (size_t i = 0; i <= bounds_.size(); i++) {
+            buckets_[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void Histogram::observe(double value) {
+        size_t bucket = static_cast<size_t>(std::lower_bound(bounds_.begin(), bounds_.end(), value) - bounds_.begin());
+        buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+
+        double sum = sum_.load(std::memory_order_relaxed);
+        while (!sum_.compare_exchange_weak(sum, sum + value, std::memory_order_relaxed)) {
+        }
+    }
+
+    std::vector<uint64_t> Histogram::cumulativeCounts() const {
+        std::vector<uint64_t> counts(bounds_.size() + 1);
+        uint64_t total = 0;
+        for (size_t i = 0; i < counts.size(); i++) {
+            total += buckets_[i].load(std::memory_order_relaxed);
+            counts[i] = total;
+        }
+        return counts;
+    }
+
+    const std::vector<double>& latencyBuckets() {
+        static const std::vector<double> bounds = {
+            0.0001, 0.0005, 0.001, 0.005, 0.01, 0.05, 0.1, 0.5, 1, 5, 10, 30, 60, 300, 900, 1800, 3600, 7200
+        };
+        return bounds;
+    }
+
+    MetricsRegistry& MetricsRegistry::instance() {
+        static MetricsRegistry registry;
+        return registry;
+    }
+
+    MetricsRegistry::Series& MetricsRegistry::find(const std::string& name, const std::string& help,
+                                                   Kind kind, const MetricLabels& labels) {
+        std::string key;
+        appendLabels(key, labels);
+
+        auto family = families_.find(name);
+        if (family == families_.end()) {
+            family = families_.emplace(name, Family{ kind, help, {} }).first;
+        } else if (family->second.kind != kind) {
+            throw std::logic_error("metric " + name + " is already registered with another type");
+        }
+
+        Series& series = family->second.series[key];
+        series.labels = labels;
+        return series;
+    }
+
+    Counter& MetricsRegistry::counter(const std::string& name, const std::string& help, const MetricLabels& labels) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Series& series = find(name, help, Kind::COUNTER, labels);
+        if (!series.counter) {
+            series.counter.reset(new Counter());
+        }
+        return *series.counter;
+    }
+
+    Gauge& MetricsRegistry::gauge(const std::string& name, const std::string& help, const MetricLabels& labels) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Series& series = find(name, help, Kind::GAUGE, labels);
+        if (!series.gauge) {
+            series.gauge.reset(new Gauge());
+        }
+        return *series.gauge;
+    }
+
+    Histogram& MetricsRegistry::histogram(const std::string& name, const std::string& help,
+                                          const MetricLabels& labels, const std::vector<double>& bounds) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Series& series = find(name, help, Kind::HISTOGRAM, labels);
+        if (!series.histogram) {
+            series.histogram.reset(new Histogram(bounds));
+        }
+        return *series.histogram;
+    }
+
+    std::string MetricsRegistry::toPrometheus() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::string out;
+        for (const auto& family : families_) {
+            const std::string& name = family.first;
+            out += "# HELP " + name + " " + family.second.help + "\n";
+            out += "# TYPE " + name + " " + kKindNames[static_cast<int>(family.second.kind)] + "\n";
+
+            for (const auto& entry : family.second.series) {
+                const Series& series = entry.second;
+                if (series.counter) {
+                    out += name;
+                    appendLabels(out, series.labels);
+                    out += ' ';
+                    appendNumber(out, series.counter->value());
+                    out += '\n';
+                } else if (series.gauge) {
+                    out += name;
+                    appendLabels(out, series.labels);
+                    out += ' ';
+                    appendNumber(out, series.gauge->value());
+                    out += '\n';
+                } else if (series.histogram) {
+                    const Histogram& histogram = *series.histogram;
+                    std::vector<uint64_t> counts = histogram.cumulativeCounts();
+                    for (size_t i = 0; i < counts.size(); i++) {
+                        std::string bound;
+                        appendNumber(bound, i < histogram.bounds().size() ? histogram.bounds()[i] : INFINITY);
+                        out += name + "_bucket";
+                        appendLabels(out, series.labels, "le", bound);
+                        out += ' ';
+                        appendNumber(out, counts[i]);
+                        out += '\n';
+                    }
+                    out += name + "_sum";
+                    appendLabels(out, series.labels);
+                    out += ' ';
+                    appendNumber(out, histogram.sum());
+                    out += '\n';
+                    out += name + "_count";
+                    appendLabels(out, series.labels);
+                    out += ' ';
+                    appendNumber(out, histogram.count());
+                    out += '\n';
+                }
+            }
+        }
+        return out;
+    }
+
+    std::string MetricsRegistry::toJson() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::string out = "{\"metrics\":[";
+        bool firstFamily = true;
+        for (const auto& family : families_) {
+            out += firstFamily ? "\n" : ",\n";
+            firstFamily = false;
+            out += "{\"name\":\"" + family.first + "\",\"type\":\"";
+            out += kKindNames[static_cast<int>(family.second.kind)];
+            out += "\",\"help\":\"";
+            appendEscaped(out, family.second.help, true);
+            out += "\",\"series\":[";
+
+            bool firstSeries = true;
+            for (const auto& entry : family.second.series) {
+                const Series& series = entry.second;
+                out += firstSeries ? "{" : ",{";
+                firstSeries = false;
+
+                out += "\"labels\":{";
+                for (size_t i = 0; i < series.labels.size(); i++) {
+                    out += i > 0 ? ",\"" : "\"";
+                    out += series.labels[i].first + "\":\"";
+                    appendEscaped(out, series.labels[i].second, true);
+                    out += '"';
+                }
+                out += "},";
+
+                if (series.counter) {
+                    out += "\"value\":";
+                    appendNumber(out, series.counter->value());
+                } else if (series.gauge) {
+                    out += "\"value\":";
+                    appendNumber(out, series.gauge->value());
+                } else if (series.histogram) {
+                    const Histogram& histogram = *series.histogram;
+                    std::vector<uint64_t> counts = histogram.cumulativeCounts();
+                    out += "\"count\":";
+                    appendNumber(out, histogram.count());
+                    out += ",\"sum\":";
+                    appendNumber(out, histogram.sum());
+                    out += ",\"buckets\":[";
+                    for (size_t i = 0; i < histogram.bounds().size(); i++) {
+                        out += i > 0 ? ",{\"le\":" : "{\"le\":";
+                        appendNumber(out, histogram.bounds()[i]);
+                        out += ",\"count\":";
+                        appendNumber(out, counts[i]);
+                        out += '}';
+                    }
+                    out += ']';
+                }
+                out += '}';
+            }
+            out += "]}";
+        }
+        out += "\n]}\n";
+        return out;
+    }
+
+    bool MetricsRegistry::writePrometheus(const std::string& path) const {
+        std::string text = toPrometheus();
+        return writeFileAtomically(path, text.data(), text.size());
+    }
+
+    bool MetricsRegistry::writeJson(const std::string& path) const {
+        std::string text = toJson();
+        return writeFileAtomically(path, text.data(), text.size());
+    }
+
+    std::string hresultLabel(int32_t hr) {
+        char text[16];
+        std::snprintf(text, sizeof(text), "0x%08X", static_cast<uint32_t>(hr));
+        return text;
+    }
+
+} // namespace WUpdater
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace WUpdater {
+
+    // Label name/value pairs identifying one series of a metric
+    typedef std::vector<std::pair<std::string, std::string>> MetricLabels;
+
+    // Monotonically increasing count
+    class Counter {
+    public:
+        void add(uint64_t amount = 1) { value_.fetch_add(amount, std::memory_order_relaxed); }
+        uint64_t value() const { return value_.load(std::memory_order_relaxed); }
+
+    private:
+        std::atomic<uint64_t> value_{0};
+    };
+
+    // Value that can go up and down
+    class Gauge {
+    public:
+        void set(double value) { value_.store(value, std::memory_order_relaxed); }
+        double value() const { return value_.load(std::memory_order_relaxed); }
+
+    private:
+        std::atomic<double> value_{0};
+    };
+
+    // Distribution of observed values over fixed upper bounds
+    class Histogram {
+    public:
+        explicit Histogram(const std::vector<double>& bounds);
+
+        void observe(double value);
+
+        const std::vector<double>& bounds() const { return bounds_; }
+
+        // Cumulative count of observations <= bounds()[i]; the last entry is +Inf
+        std::vector<uint64_t> cumulativeCounts() const;
+        uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+        double sum() const { return sum_.load(std::memory_order_relaxed); }
+
+    private:
+        std::vector<double> bounds_;
+        std::unique_ptr<std::atomic<uint64_t>[]> buckets_;     // bounds_.size() + 1, not cumulative
+        std::atomic<uint64_t> count_{0};
+        std::atomic<double> sum_{0};
+    };
+
+    // Bucket bounds in seconds for phase and call latencies (100 us to 2 h)
+    const std::vector<double>& latencyBuckets();
+
+    /**
+     * @brief Process-wide set of named counters, gauges and histograms.
+     *
+     * Looking a series up takes a lock, so hot paths fetch their series once
+     * and keep the reference; updating a series is lock-free. Series live as
+     * long as the registry. The whole registry can be rendered in the
+     * Prometheus text exposition format (for the node_exporter textfile
+     * collector) or as JSON.
+     */
+    class MetricsRegistry {
+    public:
+        static MetricsRegistry& instance();
+
+        // Find or create a series. A name keeps the type it was first created with;
+        // asking for it as another type throws std::logic_error.
+        Counter& counter(const std::string& name, const std::string& help, const MetricLabels& labels = MetricLabels());
+        Gauge& gauge(const std::string& name, const std::string& help, const MetricLabels& labels = MetricLabels());
+        Histogram& histogram(const std::string& name, const std::string& help, const MetricLabels& labels = MetricLabels(),
+                             const std::vector<double>& bounds = latencyBuckets());
+
+        std::string toPrometheus() const;
+        std::string toJson() const;
+
+        // Write the rendered registry through a temporary file, so a collector never reads half a file
+        bool writePrometheus(const std::string& path) const;
+        bool writeJson(const std::string& path) const;
+
+    private:
+        enum class Kind { COUNTER, GAUGE, HISTOGRAM };
+
+        struct Series {
+            MetricLabels labels;
+            std::unique_ptr<Counter> counter;
+            std::unique_ptr<Gauge> gauge;
+            std::unique_ptr<Histogram> histogram;
+        };
+
+        struct Family {
+            Kind kind;
+            std::string help;
+            std::map<std::string, Series> series;      // Keyed by rendered label set
+        };
+
+        mutable std::mutex mutex_;
+        std::map<std::string, Family> families_;
+
+        MetricsRegistry() = default;
+
+        Series& find(const std::string& name, const std::string& help, Kind kind, const MetricLabels& labels);
+    };
+
+    // Observes the time from construction to destruction, in seconds
+    class ScopedTimer {
+    public:
+        explicit ScopedTimer(Histogram& histogram)
+            : histogram_(histogram), started_(std::chrono::steady_clock::now()) {}
+        ~ScopedTimer() {
+            histogram_.observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - started_).count());
+        }
+
+        ScopedTimer(const ScopedTimer&) = delete;
+        ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+    private:
+        Histogram& histogram_;
+        std::chrono::steady_clock::time_point started_;
+    };
+
+    // Format an HRESULT as a label value, e.g. "0x80240022"
+    std::string hresultLabel(int32_t hr);
+
+} // namespace WUpdater
@@ -0,0 +1,107 @@
+#pragma once
+
+// Portable base types shared by the update-engine core.
+//
+// On Windows the real SDK headers are used. Everywhere else the handful of
+// HRESULT helpers and Windows Update error codes the core relies on are
+// defined here with their SDK values, so the core and the simulated backend
+// build unchanged on Linux.
+
+#ifdef _WIN32
+
+#include <windows.h>
+#include <wuerror.h>
+
+#else
+
+#include <cstdint>
+
+typedef int32_t HRESULT;
+
+#define SUCCEEDED(hr) (((HRESULT)(hr)) >= 0)
+#define FAILED(hr) (((HRESULT)(hr)) < 0)
+
+#define HRESULT_CODE(hr) ((hr) & 0xFFFF)
+#define HRESULT_FACILITY(hr) (((hr) >> 16) & 0x1FFF)
+
+#define S_OK ((HRESULT)0x00000000L)
+#define S_FALSE ((HRESULT)0x00000001L)
+#define E_NOTIMPL ((HRESULT)0x80004001L)
+#define E_POINTER ((HRESULT)0x80004003L)
+#define E_ABORT ((HRESULT)0x80004004L)
+#define E_FAIL ((HRESULT)0x80004005L)
+#define E_ACCESSDENIED ((HRESULT)0x80070005L)
+#define E_OUTOFMEMORY ((HRESULT)0x8007000EL)
+#define E_INVALIDARG ((HRESULT)0x80070057L)
+
+#define CERT_E_EXPIRED ((HRESULT)0x800B0101L)
+
+// Windows Update Agent error codes (wuerror.h)
+#define WU_E_NO_SERVICE ((HRESULT)0x80240001L)
+#define WU_E_MAX_CAPACITY_REACHED ((HRESULT)0x80240002L)
+#define WU_E_UNKNOWN_ID ((HRESULT)0x80240003L)
+#define WU_E_NOT_INITIALIZED ((HRESULT)0x80240004L)
+#define WU_E_RANGEOVERLAP ((HRESULT)0x80240005L)
+#define WU_E_TOOMANYRANGES ((HRESULT)0x80240006L)
+#define WU_E_INVALIDINDEX ((HRESULT)0x80240007L)
+#define WU_E_ITEMNOTFOUND ((HRESULT)0x80240008L)
+#define WU_E_OPERATIONINPROGRESS ((HRESULT)0x80240009L)
+#define WU_E_COULDNOTCANCEL ((HRESULT)0x8024000AL)
+#define WU_E_CALL_CANCELLED ((HRESULT)0x8024000BL)
+#define WU_E_NOOP ((HRESULT)0x8024000CL)
+#define WU_E_XML_MISSINGDATA ((HRESULT)0x8024000DL)
+#define WU_E_XML_INVALID ((HRESULT)0x8024000EL)
+#define WU_E_CYCLE_DETECTED ((HRESULT)0x8024000FL)
+#define WU_E_TOO_DEEP_RELATION ((HRESULT)0x80240010L)
+#define WU_E_INVALID_RELATIONSHIP ((HRESULT)0x80240011L)
+#define WU_E_REG_VALUE_INVALID ((HRESULT)0x80240012L)
+#define WU_E_DUPLICATE_ITEM ((HRESULT)0x80240013L)
+#define WU_E_INVALID_INSTALL_REQUESTED ((HRESULT)0x80240014L)
+#define WU_E_INSTALL_NOT_ALLOWED ((HRESULT)0x80240016L)
+#define WU_E_NOT_APPLICABLE ((HRESULT)0x80240017L)
+#define WU_E_NO_USERTOKEN ((HRESULT)0x80240018L)
+#define WU_E_EXCLUSIVE_INSTALL_CONFLICT ((HRESULT)0x80240019L)
+#define WU_E_POLICY_NOT_SET ((HRESULT)0x8024001AL)
+#define WU_E_SELFUPDATE_IN_PROGRESS ((HRESULT)0x8024001BL)
+#define WU_E_INVALID_UPDATE ((HRESULT)0x8024001DL)
+#define WU_E_SERVICE_STOP ((HRESULT)0x8024001EL)
+#define WU_E_NO_CONNECTION ((HRESULT)0x8024001FL)
+#define WU_E_NO_INTERACTIVE_USER ((HRESULT)0x80240020L)
+#define WU_E_TIME_OUT ((HRESULT)0x80240021L)
+#define WU_E_ALL_UPDATES_FAILED ((HRESULT)0x80240022L)
+#define WU_E_EULAS_DECLINED ((HRESULT)0x80240023L)
+#define WU_E_NO_UPDATE ((HRESULT)0x80240024L)
+#define WU_E_USER_ACCESS_DISABLED ((HRESULT)0x80240025L)
+#define WU_E_INVALID_UPDATE_TYPE ((HRESULT)0x80240026L)
+#define WU_E_URL_TOO_LONG ((HRESULT)0x80240027L)
+#define WU_E_UNINSTALL_NOT_ALLOWED ((HRESULT)0x80240028L)
+#define WU_E_INVALID_PRODUCT_LICENSE ((HRESULT)0x80240029L)
+#define WU_E_MISSING_HANDLER ((HRESULT)0x8024002AL)
+#define WU_E_LEGACYSERVER ((HRESULT)0x8024002BL)
+#define WU_E_BIN_SOURCE_ABSENT ((HRESULT)0x8024002CL)
+#define WU_E_SOURCE_ABSENT ((HRESULT)0x8024002DL)
+#define WU_E_WU_DISABLED ((HRESULT)0x8024002EL)
+#define WU_E_CALL_CANCELLED_BY_POLICY ((HRESULT)0x8024002FL)
+#define WU_E_INVALID_PROXY_SERVER ((HRESULT)0x80240030L)
+#define WU_E_INVALID_FILE ((HRESULT)0x80240031L)
+#define WU_E_INVALID_CRITERIA ((HRESULT)0x80240032L)
+#define WU_E_EULA_UNAVAILABLE ((HRESULT)0x80240033L)
+#define WU_E_DOWNLOAD_FAILED ((HRESULT)0x80240034L)
+#define WU_E_UPDATE_NOT_PROCESSED ((HRESULT)0x80240035L)
+#define WU_E_INVALID_OPERATION ((HRESULT)0x80240036L)
+#define WU_E_NOT_SUPPORTED ((HRESULT)0x80240037L)
+#define WU_E_TOO_MANY_RESYNC ((HRESULT)0x80240039L)
+#define WU_E_NO_SERVER_CORE_SUPPORT ((HRESULT)0x80240040L)
+#define WU_E_SYSPREP_IN_PROGRESS ((HRESULT)0x80240041L)
+#define WU_E_UNKNOWN_SERVICE ((HRESULT)0x80240042L)
+#define WU_E_NO_UI_SUPPORT ((HRESULT)0x80240043L)
+#define WU_E_PER_MACHINE_UPDATE_ACCESS_DENIED ((HRESULT)0x80240044L)
+#define WU_E_UNSUPPORTED_SEARCHSCOPE ((HRESULT)0x80240045L)
+#define WU_E_BAD_FILE_URL ((HRESULT)0x80240046L)
+#define WU_E_INVALID_NOTIFICATION_INFO ((HRESULT)0x80240048L)
+#define WU_E_OUTOFRANGE ((HRESULT)0x80240049L)
+#define WU_E_SETUP_IN_PROGRESS ((HRESULT)0x8024004AL)
+#define WU_E_UNEXPECTED ((HRESULT)0x80240FFFL)
+#define WU_E_PT_WINHTTP_NAME_NOT_RESOLVED ((HRESULT)0x8024402CL)
+
+#endif // _WIN32
@@ -0,0 +1,148 @@
+#include "progress_renderer.h"
+#include <cstdio>
+
+namespace WUpdater {
+
+    namespace {
+
+        // Weight of the newest sample in the throughput moving average
+        const double kRateSmoothing = 0.3;
+
+        // Shortest span a throughput sample may cover
+        const std::chrono::milliseconds kMinSampleSpan(250);
+
+        // Format a byte count as "12.3 MB" into the given buffer
+        void formatBytes(wchar_t* buffer, size_t size, double bytes) {
+            static const wchar_t* const units[] = { L"B", L"KB", L"MB", L"GB", L"TB" };
+            int unit = 0;
+            while (bytes >= 1024.0 && unit < 4) {
+                bytes /= 1024.0;
+                unit++;
+            }
+            std::swprintf(buffer, size, unit == 0 ? L"%.0f %ls" : L"%.1f %ls", bytes, units[unit]);
+        }
+
+        // Format seconds as "mm:ss" or "h:mm:ss"
+        void formatDuration(wchar_t* buffer, size_t size, double seconds) {
+            long long total = static_cast<long long>(seconds + 0.5);
+            if (total >= 3600) {
+                std::swprintf(buffer, size, L"%lld:%02lld:%02lld", total / 3600, (total / 60) % 60, total % 60);
+            } else {
+                std::swprintf(buffer, size, L"%02lld:%02lld", total / 60, total % 60);
+            }
+        }
+
+    } // namespace
+
+    DownloadProgressRenderer::DownloadProgressRenderer(std::wostream& out, unsigned intervalMs,
+                                                       DownloadObserver* next,
+                                                       const std::atomic<bool>* cancel)
+        : out_(out), interval_(std::chrono::milliseconds(intervalMs)), next_(next), cancel_(cancel),
+          start_(Clock::now()), lastRender_(start_), lastSample_(start_), lastSampleBytes_(0),
+          rate_(0.0), rendered_(false) {}
+
+    void DownloadProgressRenderer::onProgress(const DownloadProgress& progress) {
+        Clock::time_point now = Clock::now();
+        double rate = 0.0;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            last_ = progress;
+
+            Clock::duration span = now - lastSample_;
+            if (span >= kMinSampleSpan) {
+                double seconds = std::chrono::duration<double>(span).count();
+                double sample = static_cast<double>(progress.totalBytesDone - lastSampleBytes_) / seconds;
+                rate_ = rate_ == 0.0 ? sample : kRateSmoothing * sample + (1.0 - kRateSmoothing) * rate_;
+                lastSample_ = now;
+                lastSampleBytes_ = progress.totalBytesDone;
+            }
+
+            if (now - lastRender_ < interval_) {
+                return;
+            }
+            lastRender_ = now;
+            rendered_ = true;
+            rate = rate_;
+        }
+
+        render(progress, rate, false);
+    }
+
+    void DownloadProgressRenderer::onUpdateDownloaded(size_t position, const UpdateOutcome& outcome) {
+        if (next_ != nullptr) {
+            next_->onUpdateDownloaded(position, outcome);
+        }
+    }
+
+    bool DownloadProgressRenderer::cancelRequested() {
+        if (cancel_ != nullptr && cancel_->load()) {
+            return true;
+        }
+        return next_ != nullptr && next_->cancelRequested();
+    }
+
+    double DownloadProgressRenderer::bytesPerSecond() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return rate_;
+    }
+
+    void DownloadProgressRenderer::finish() {
+        DownloadProgress progress;
+        double average = 0.0;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!rendered_) {
+                // Short downloads finish before the first interval; stay silent
+                return;
+            }
+            progress = last_;
+            double seconds = std::chrono::duration<double>(Clock::now() - start_).count();
+            average = seconds > 0.0 ? static_cast<double>(progress.totalBytesDone) / seconds : 0.0;
+        }
+        render(progress, average, true);
+    }
+
+    void DownloadProgressRenderer::restart() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        start_ = Clock::now();
+        lastRender_ = start_;
+        lastSample_ = start_;
+        lastSampleBytes_ = 0;
+        rate_ = 0.0;
+        rendered_ = false;
+        last_ = DownloadProgress();
+    }
+
+    void DownloadProgressRenderer::render(const DownloadProgress& progress, double rate, bool final) {
+        wchar_t current[16], currentTotal[16], total[16], grandTotal[16], speed[16], eta[16];
+        formatBytes(current, 16, static_cast<double>(progress.currentBytesDone));
+        formatBytes(currentTotal, 16, static_cast<double>(progress.currentBytesTotal));
+        formatBytes(total, 16, static_cast<double>(progress.totalBytesDone));
+        formatBytes(grandTotal, 16, static_cast<double>(progress.totalBytesTotal));
+        formatBytes(speed, 16, rate);
+
+        int64_t remaining = progress.totalBytesTotal - progress.totalBytesDone;
+        if (final || remaining <= 0) {
+            formatDuration(eta, 16, 0.0);
+        } else if (rate > 0.0) {
+            formatDuration(eta, 16, static_cast<double>(remaining) / rate);
+        } else {
+            std::swprintf(eta, 16, L"--:--");
+        }
+
+        wchar_t line[256];
+        if (final) {
+            std::swprintf(line, 256, L"Progress: Downloaded %ls | %ls/s average\n", total, speed);
+        } else {
+            std::swprintf(line, 256,
+                          L"Progress: Downloading %u%% | update %zu/%zu (%ls of %ls) | %ls of %ls | %ls/s | ETA %ls\n",
+                          progress.percentComplete, progress.currentUpdate + 1, progress.updateCount,
+                          current, currentTotal, total, grandTotal, speed, eta);
+        }
+
+        std::lock_guard<std::mutex> lock(outputMutex_);
+        out_ << line;
+        out_.flush();
+    }
+
+} // namespace WUpdater
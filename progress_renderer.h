@@ -0,0 +1,62 @@
+#pragma once
+
+#include "update_backend.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <ostream>
+
+namespace WUpdater {
+
+    /**
+     * @brief Console renderer for download progress with throughput and ETA.
+     *
+     * Progress events may arrive many times per second and on backend threads;
+     * at most one line is written per interval, formatted into a fixed buffer.
+     * Throughput is a moving average of the total byte count, and the ETA is
+     * derived from it. Update completions are forwarded to the next observer.
+     */
+    class DownloadProgressRenderer : public DownloadObserver {
+    public:
+        DownloadProgressRenderer(std::wostream& out, unsigned intervalMs,
+                                 DownloadObserver* next = nullptr,
+                                 const std::atomic<bool>* cancel = nullptr);
+
+        void onProgress(const DownloadProgress& progress) override;
+        void onUpdateDownloaded(size_t position, const UpdateOutcome& outcome) override;
+        bool cancelRequested() override;
+
+        // Write the final summary line
+        void finish();
+
+        // Start measuring a new job on the same stream, e.g. a retry of the failed updates
+        void restart();
+
+        // Serializes the renderer's lines with other writers of the same stream
+        std::mutex& outputMutex() { return outputMutex_; }
+
+        // Bytes per second over the job so far (moving average)
+        double bytesPerSecond() const;
+
+    private:
+        typedef std::chrono::steady_clock Clock;
+
+        std::wostream& out_;
+        Clock::duration interval_;
+        DownloadObserver* next_;
+        const std::atomic<bool>* cancel_;
+
+        mutable std::mutex mutex_;
+        std::mutex outputMutex_;
+        Clock::time_point start_;
+        Clock::time_point lastRender_;
+        Clock::time_point lastSample_;
+        int64_t lastSampleBytes_;
+        double rate_;
+        bool rendered_;
+        DownloadProgress last_;
+
+        void render(const DownloadProgress& progress, double rate, bool final);
+    };
+
+} // namespace WUpdater
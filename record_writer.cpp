@@ -0,0 +1,228 @@
+#include "record_writer.h"
+#include <cwchar>
+
+namespace WUpdater {
+
+    namespace {
+
+        const wchar_t* const kFieldNames[] = {
+            L"record", L"phase", L"index", L"update_id", L"revision", L"title", L"kb", L"size",
+            L"release_date", L"severity", L"downloaded", L"installed", L"change", L"result",
+            L"hresult", L"reboot_required"
+        };
+        static_assert(sizeof(kFieldNames) / sizeof(kFieldNames[0]) == static_cast<size_t>(Field::COUNT),
+                      "every field needs a name");
+
+        const wchar_t kHexDigits[] = L"0123456789abcdef";
+
+    } // namespace
+
+    bool parseOutputFormat(const std::string& name, OutputFormat& format) {
+        if (name == "text") {
+            format = OutputFormat::TEXT;
+        } else if (name == "jsonl") {
+            format = OutputFormat::JSONL;
+        } else if (name == "csv") {
+            format = OutputFormat::CSV;
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    RecordWriter::RecordWriter(std::wostream& out, OutputFormat format, size_t capacity)
+        : out_(out), format_(format), capacity_(capacity), nextField_(0),
+          headerWritten_(false), firstListItem_(true) {
+        // Headroom so a record that crosses the limit does not reallocate
+        buffer_.reserve(capacity_ + capacity_ / 4);
+    }
+
+    RecordWriter::~RecordWriter() {
+        flush();
+    }
+
+    void RecordWriter::putEscaped(std::wstring_view value) {
+        for (wchar_t c : value) {
+            if (format_ == OutputFormat::CSV) {
+                if (c == L'"') {
+                    put(L'"');
+                }
+                put(c);
+                continue;
+            }
+
+            // JSON: short escapes where defined, \uXXXX for control and non-ASCII
+            // characters (UTF-16 code units, split into a surrogate pair if needed)
+            if (c == L'"' || c == L'\\') {
+                put(L'\\');
+                put(c);
+            } else if (c == L'\n') {
+                put(L"\\n");
+            } else if (c == L'\r') {
+                put(L"\\r");
+            } else if (c == L'\t') {
+                put(L"\\t");
+            } else if (c >= 0x20 && c < 0x7F) {
+                put(c);
+            } else {
+                uint32_t code = static_cast<uint32_t>(c);
+                uint32_t units[2] = { code, 0 };
+                int count = 1;
+                if (code >= 0x10000) {
+                    code -= 0x10000;
+                    units[0] = 0xD800 + (code >> 10);
+                    units[1] = 0xDC00 + (code & 0x3FF);
+                    count = 2;
+                }
+                for (int i = 0; i < count; i++) {
+                    put(L"\\u");
+                    for (int shift = 12; shift >= 0; shift -= 4) {
+                        put(kHexDigits[(units[i] >> shift) & 0xF]);
+                    }
+                }
+            }
+        }
+    }
+
+    void RecordWriter::beginRecord(std::wstring_view type, std::wstring_view phase) {
+        if (format_ == OutputFormat::CSV && !headerWritten_) {
+            for (size_t i = 0; i < static_cast<size_t>(Field::COUNT); i++) {
+                if (i > 0) {
+                    put(L',');
+                }
+                put(kFieldNames[i]);
+            }
+            put(L'\n');
+            headerWritten_ = true;
+        }
+
+        nextField_ = 0;
+        if (format_ == OutputFormat::JSONL) {
+            put(L'{');
+        }
+        text(Field::RECORD, type);
+        text(Field::PHASE, phase);
+    }
+
+    void RecordWriter::beginField(Field field, bool quoted) {
+        int column = static_cast<int>(field);
+        if (format_ == OutputFormat::CSV) {
+            // One separator per column, including the skipped ones
+            for (; nextField_ <= column; nextField_++) {
+                if (nextField_ > 0) {
+                    put(L',');
+                }
+            }
+        } else {
+            if (nextField_ > 0) {
+                put(L',');
+            }
+            put(L'"');
+            put(kFieldNames[column]);
+            put(L"\":");
+            nextField_ = column + 1;
+        }
+
+        if (quoted) {
+            put(L'"');
+        }
+    }
+
+    void RecordWriter::endField(bool quoted) {
+        if (quoted) {
+            put(L'"');
+        }
+    }
+
+    void RecordWriter::text(Field field, std::wstring_view value) {
+        beginField(field, true);
+        putEscaped(value);
+        endField(true);
+    }
+
+    void RecordWriter::number(Field field, int64_t value) {
+        wchar_t digits[24];
+        int length = std::swprintf(digits, sizeof(digits) / sizeof(digits[0]), L"%lld", static_cast<long long>(value));
+        beginField(field, false);
+        put(std::wstring_view(digits, length > 0 ? static_cast<size_t>(length) : 0));
+        endField(false);
+    }
+
+    void RecordWriter::boolean(Field field, bool value) {
+        beginField(field, false);
+        put(value ? L"true" : L"false");
+        endField(false);
+    }
+
+    void RecordWriter::hresult(Field field, int32_t value) {
+        wchar_t digits[16];
+        int length = std::swprintf(digits, sizeof(digits) / sizeof(digits[0]), L"0x%08X", static_cast<uint32_t>(value));
+        beginField(field, true);
+        put(std::wstring_view(digits, length > 0 ? static_cast<size_t>(length) : 0));
+        endField(true);
+    }
+
+    void RecordWriter::beginList(Field field) {
+        beginField(field, format_ == OutputFormat::CSV);
+        if (format_ == OutputFormat::JSONL) {
+            put(L'[');
+        }
+        firstListItem_ = true;
+    }
+
+    void RecordWriter::listItem(std::wstring_view prefix, uint32_t value) {
+        if (!firstListItem_) {
+            put(format_ == OutputFormat::CSV ? L';' : L',');
+        }
+        firstListItem_ = false;
+
+        wchar_t digits[16];
+        int length = std::swprintf(digits, sizeof(digits) / sizeof(digits[0]), L"%u", value);
+        if (format_ == OutputFormat::JSONL) {
+            put(L'"');
+        }
+        put(prefix);
+        put(std::wstring_view(digits, length > 0 ? static_cast<size_t>(length) : 0));
+        if (format_ == OutputFormat::JSONL) {
+            put(L'"');
+        }
+    }
+
+    void RecordWriter::endList() {
+        if (format_ == OutputFormat::JSONL) {
+            put(L']');
+        }
+        endField(format_ == OutputFormat::CSV);
+    }
+
+    void RecordWriter::endRecord() {
+        if (format_ == OutputFormat::CSV) {
+            // Fill the remaining empty columns
+            for (; nextField_ < static_cast<int>(Field::COUNT); nextField_++) {
+                if (nextField_ > 0) {
+                    put(L',');
+                }
+            }
+        } else {
+            put(L'}');
+        }
+        put(L'\n');
+
+        if (buffer_.size() >= capacity_) {
+            drain();
+        }
+    }
+
+    void RecordWriter::drain() {
+        if (!buffer_.empty()) {
+            out_.write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+            buffer_.clear();
+        }
+    }
+
+    void RecordWriter::flush() {
+        drain();
+        out_.flush();
+    }
+
+} // namespace WUpdater
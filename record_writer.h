@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace WUpdater {
+
+    enum class OutputFormat {
+        TEXT,       // Human-readable console output
+        JSONL,      // One JSON object per line
+        CSV         // Header line, then one row per record
+    };
+
+    // Parse "text", "jsonl" or "csv"
+    bool parseOutputFormat(const std::string& name, OutputFormat& format);
+
+    // Columns of a record, in output order. A record writes its fields in
+    // this order and may skip any of them.
+    enum class Field {
+        RECORD,             // "update", "result" or "change"
+        PHASE,              // "search", "download", "install" or "diff"
+        INDEX,
+        UPDATE_ID,
+        REVISION,
+        TITLE,
+        KB,
+        SIZE,
+        RELEASE_DATE,
+        SEVERITY,
+        DOWNLOADED,
+        INSTALLED,
+        CHANGE,
+        RESULT,
+        HRESULT,
+        REBOOT_REQUIRED,
+        COUNT
+    };
+
+    /**
+     * @brief Writes update and result records as JSON Lines or CSV.
+     *
+     * Records are formatted straight into one reusable character buffer;
+     * values are escaped in place and numbers go through a stack buffer, so
+     * writing a record does not allocate once the buffer has grown to its
+     * working size. The buffer is handed to the stream when it fills up and
+     * the stream is flushed only by flush(), which callers invoke at phase
+     * boundaries. JSON output escapes everything outside ASCII.
+     */
+    class RecordWriter {
+    public:
+        RecordWriter(std::wostream& out, OutputFormat format, size_t capacity = 64 * 1024);
+        ~RecordWriter();
+
+        // Disable copy
+        RecordWriter(const RecordWriter&) = delete;
+        RecordWriter& operator=(const RecordWriter&) = delete;
+
+        OutputFormat format() const { return format_; }
+
+        void beginRecord(std::wstring_view type, std::wstring_view phase);
+        void text(Field field, std::wstring_view value);
+        void number(Field field, int64_t value);
+        void boolean(Field field, bool value);
+        void hresult(Field field, int32_t value);
+
+        // A list value, e.g. KB articles: JSON array, ';'-separated in CSV
+        void beginList(Field field);
+        void listItem(std::wstring_view prefix, uint32_t value);
+        void endList();
+
+        void endRecord();
+
+        // Hand buffered records to the stream and flush it
+        void flush();
+
+    private:
+        std::wostream& out_;
+        OutputFormat format_;
+        size_t capacity_;
+        std::vector<wchar_t> buffer_;
+        int nextField_;             // First column not written yet in this record
+        bool headerWritten_;
+        bool firstListItem_;
+
+        void put(wchar_t c) { buffer_.push_back(c); }
+        void put(std::wstring_view text) { buffer_.insert(buffer_.end(), text.begin(), text.end()); }
+        void putEscaped(std::wstring_view value);
+        void beginField(Field field, bool quoted);
+        void endField(bool quoted);
+        void drain();
+    };
+
+} // namespace WUpdater
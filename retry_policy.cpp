@@ -0,0 +1,120 @@
+#include "retry_policy.h"
+#include "error_messages.h"
+#include <algorithm>
+#include <cstdlib>
+#include <sstream>
+#include <thread>
+
+namespace WUpdater {
+
+    namespace {
+
+        bool parseSeconds(const std::string& text, unsigned& seconds) {
+            char* end = nullptr;
+            unsigned long value = std::strtoul(text.c_str(), &end, 10);
+            if (text.empty() || text[0] == '-' || *end != '\0') {
+                return false;
+            }
+            seconds = static_cast<unsigned>(value);
+            return true;
+        }
+
+    } // namespace
+
+    bool parseRetryBudget(const std::string& spec, RetryPolicy& policy, std::string& error) {
+        unsigned seconds = 0;
+        if (spec.find('=') == std::string::npos) {
+            if (!parseSeconds(spec, seconds)) {
+                error = "invalid number of seconds '" + spec + "'";
+                return false;
+            }
+            policy.searchBudgetSeconds = seconds;
+            policy.downloadBudgetSeconds = seconds;
+            policy.installBudgetSeconds = seconds;
+            return true;
+        }
+
+        std::istringstream stream(spec);
+        std::string entry;
+        while (std::getline(stream, entry, ',')) {
+            if (entry.empty()) {
+                continue;
+            }
+
+            size_t eq = entry.find('=');
+            std::string phase = entry.substr(0, eq);
+            std::string value = eq == std::string::npos ? std::string() : entry.substr(eq + 1);
+            if (!parseSeconds(value, seconds)) {
+                error = "invalid value for '" + phase + "': '" + value + "'";
+                return false;
+            }
+
+            if (phase == "search") {
+                policy.searchBudgetSeconds = seconds;
+            } else if (phase == "download") {
+                policy.downloadBudgetSeconds = seconds;
+            } else if (phase == "install") {
+                policy.installBudgetSeconds = seconds;
+            } else {
+                error = "unknown phase '" + phase + "'";
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool isRetryable(HRESULT hr) {
+        if (SUCCEEDED(hr) || !ErrorMessages::isRecoverableError(hr)) {
+            return false;
+        }
+        std::wstring_view category = ErrorMessages::getErrorCategory(hr);
+        return category != L"Cancelled" && category != L"Reboot";
+    }
+
+    RetryBackoff::RetryBackoff(const RetryPolicy& policy, unsigned budgetSeconds,
+                               std::chrono::steady_clock::time_point started)
+        : policy_(policy),
+          budget_(budgetSeconds > 0 ? std::chrono::steady_clock::duration(std::chrono::seconds(budgetSeconds))
+                                    : std::chrono::steady_clock::duration::max()),
+          started_(started), round_(0), rng_(std::random_device()()) {}
+
+    bool RetryBackoff::next(std::chrono::milliseconds& delay) {
+        if (round_ >= policy_.maxRetries) {
+            return false;
+        }
+
+        // Equal jitter: a fixed half of the exponential step plus a random half
+        uint64_t step = policy_.initialDelayMs;
+        for (unsigned i = 0; i < round_ && step < policy_.maxDelayMs; i++) {
+            step *= 2;
+        }
+        step = (std::min)(step, static_cast<uint64_t>(policy_.maxDelayMs));
+        std::uniform_int_distribution<uint64_t> jitter(0, step / 2);
+        delay = std::chrono::milliseconds(step - step / 2 + jitter(rng_));
+
+        std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now() - started_;
+        if (elapsed >= budget_ || budget_ - elapsed <= delay) {
+            return false;
+        }
+
+        round_++;
+        return true;
+    }
+
+    bool RetryBackoff::wait(std::chrono::milliseconds delay, const std::atomic<bool>* cancel) {
+        typedef std::chrono::steady_clock Clock;
+        const Clock::time_point done = Clock::now() + delay;
+        while (true) {
+            if (cancel != nullptr && cancel->load()) {
+                return false;
+            }
+            Clock::time_point now = Clock::now();
+            if (now >= done) {
+                return true;
+            }
+            Clock::duration slice = std::chrono::milliseconds(100);
+            std::this_thread::sleep_for((std::min)(slice, done - now));
+        }
+    }
+
+} // namespace WUpdater
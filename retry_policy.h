@@ -0,0 +1,69 @@
+#pragma once
+
+#include "platform.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <string>
+
+namespace WUpdater {
+
+    // How failed searches, downloads and installs are retried within one run
+    struct RetryPolicy {
+        unsigned maxRetries = 0;                // Retry rounds per phase after the first attempt; 0 disables retrying
+        unsigned initialDelayMs = 10000;        // Delay before the first retry, doubled for each further one
+        unsigned maxDelayMs = 300000;           // Cap on the doubled delay
+        unsigned searchBudgetSeconds = 0;       // Wall time each phase may take including retries; 0 is unlimited
+        unsigned downloadBudgetSeconds = 0;
+        unsigned installBudgetSeconds = 0;
+    };
+
+    /**
+     * @brief Parse a retry budget
+     * @param spec Seconds for every phase ("900"), or per phase
+     *        ("search=120,download=1800,install=900"); phases not named keep their budget
+     * @param policy Receives the budgets
+     * @param error Receives a description of the first invalid entry
+     * @return true if the whole spec was valid
+     */
+    bool parseRetryBudget(const std::string& spec, RetryPolicy& policy, std::string& error);
+
+    // True if a failure with this code may succeed when the same work is submitted
+    // again: recoverable per the error catalog, and neither a cancellation nor a
+    // pending restart, which no retry within the run can clear
+    bool isRetryable(HRESULT hr);
+
+    /**
+     * @brief Exponential backoff with jitter for the retry rounds of one phase.
+     *
+     * Round n waits between half and all of initialDelay * 2^(n-1), capped at
+     * maxDelay; the random half keeps a fleet that failed together from
+     * retrying in lockstep. A round is only granted while retries remain and
+     * the wait would still end inside the phase budget, which is measured
+     * from the phase's start.
+     */
+    class RetryBackoff {
+    public:
+        RetryBackoff(const RetryPolicy& policy, unsigned budgetSeconds,
+                     std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now());
+
+        // Pick the wait before the next round; false once the rounds or the budget are used up
+        bool next(std::chrono::milliseconds& delay);
+
+        // Retry rounds granted so far
+        unsigned round() const { return round_; }
+        unsigned maxRounds() const { return policy_.maxRetries; }
+
+        // Sleep in short slices; false if the cancel flag was raised
+        static bool wait(std::chrono::milliseconds delay, const std::atomic<bool>* cancel);
+
+    private:
+        RetryPolicy policy_;
+        std::chrono::steady_clock::duration budget_;
+        std::chrono::steady_clock::time_point started_;
+        unsigned round_;
+        std::mt19937 rng_;
+    };
+
+} // namespace WUpdater
@@ -0,0 +1,394 @@
+#include "run_journal.h"
+#include "logger.h"
+#include "mapped_file.h"
+#include "utf8.h"
+#include <cstring>
+#include <filesystem>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace WUpdater {
+
+    namespace {
+
+        const char kMagic[4] = { 'W', 'U', 'J', 'R' };
+        const uint32_t kVersion = 1;
+
+        // Appended records are written out once this much is buffered, even before a commit
+        const size_t kBufferLimit = 64 * 1024;
+        const uint32_t kMaxPayload = 64u * 1024 * 1024;
+
+        enum RecordType : uint32_t {
+            RECORD_BEGIN = 1,           // Scope; starts a run
+            RECORD_UPDATES = 2,         // Updates the run acts on
+            RECORD_PHASE = 3,
+            RECORD_OUTCOME = 4          // Download or install result of one update
+        };
+
+        struct FileHeader {
+            char magic[4];
+            uint32_t version;
+            uint32_t reserved[2];
+        };
+        static_assert(sizeof(FileHeader) == 16, "journal header layout changed");
+
+        struct RecordHeader {
+            uint32_t length;            // Payload bytes
+            uint32_t crc;               // CRC-32 of type and payload
+            uint32_t type;
+        };
+        static_assert(sizeof(RecordHeader) == 12, "journal record layout changed");
+
+        uint32_t crc32(uint32_t crc, const uint8_t* data, size_t size) {
+            static const struct Table {
+                uint32_t entries[256];
+                Table() {
+                    for (uint32_t i = 0; i < 256; i++) {
+                        uint32_t value = i;
+                        for (int bit = 0; bit < 8; bit++) {
+                            value = (value & 1) ? 0xEDB88320u ^ (value >> 1) : value >> 1;
+                        }
+                        entries[i] = value;
+                    }
+                }
+            } table;
+
+            crc = ~crc;
+            for (size_t i = 0; i < size; i++) {
+                crc = table.entries[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+            }
+            return ~crc;
+        }
+
+        uint32_t recordCrc(uint32_t type, const uint8_t* payload, size_t size) {
+            return crc32(crc32(0, reinterpret_cast<const uint8_t*>(&type), sizeof(type)), payload, size);
+        }
+
+        void putU32(std::vector<uint8_t>& out, uint32_t value) {
+            const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+            out.insert(out.end(), bytes, bytes + sizeof(value));
+        }
+
+        void putText(std::vector<uint8_t>& out, std::wstring_view text) {
+            std::string utf8 = toUtf8(text);
+            putU32(out, static_cast<uint32_t>(utf8.size()));
+            out.insert(out.end(), utf8.begin(), utf8.end());
+        }
+
+        // Bounds-checked reads from one record's payload
+        struct PayloadReader {
+            const uint8_t* data;
+            size_t left;
+
+            bool u32(uint32_t& value) {
+                if (left < sizeof(value)) {
+                    return false;
+                }
+                std::memcpy(&value, data, sizeof(value));
+                data += sizeof(value);
+                left -= sizeof(value);
+                return true;
+            }
+
+            bool i32(int32_t& value) {
+                uint32_t raw = 0;
+                if (!u32(raw)) {
+                    return false;
+                }
+                value = static_cast<int32_t>(raw);
+                return true;
+            }
+
+            bool text(std::wstring& value) {
+                uint32_t length = 0;
+                if (!u32(length) || left < length) {
+                    return false;
+                }
+                value = fromUtf8(std::string_view(reinterpret_cast<const char*>(data), length));
+                data += length;
+                left -= length;
+                return true;
+            }
+        };
+
+        std::wstring identityKey(std::wstring_view updateId, int32_t revision) {
+            return std::wstring(updateId) + L"#" + std::to_wstring(revision);
+        }
+
+    } // namespace
+
+    RunJournal::RunJournal(const std::string& path)
+        : path_(path), file_(nullptr), failed_(false), started_(false), phase_(JournalPhase::STARTED) {}
+
+    RunJournal::~RunJournal() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        commitLocked();
+        if (file_ != nullptr) {
+            std::fclose(file_);
+        }
+    }
+
+    bool RunJournal::open(std::string& error) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        reset();
+
+        // Replay every intact record; the first bad one marks where the journal ends
+        size_t validEnd = 0;
+        size_t fileSize = 0;
+        {
+            MappedFile file;
+            if (file.open(path_) && file.size() > 0) {
+                const uint8_t* data = file.data();
+                fileSize = file.size();
+
+                FileHeader header;
+                if (fileSize < sizeof(header)) {
+                    error = path_ + " is not a run journal";
+                    return false;
+                }
+                std::memcpy(&header, data, sizeof(header));
+                if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion) {
+                    error = path_ + " is not a run journal";
+                    return false;
+                }
+
+                size_t offset = sizeof(header);
+                while (fileSize - offset >= sizeof(RecordHeader)) {
+                    RecordHeader record;
+                    std::memcpy(&record, data + offset, sizeof(record));
+                    const uint8_t* payload = data + offset + sizeof(record);
+                    if (record.length > kMaxPayload || fileSize - offset - sizeof(record) < record.length ||
+                        recordCrc(record.type, payload, record.length) != record.crc ||
+                        !apply(record.type, payload, record.length)) {
+                        break;
+                    }
+                    offset += sizeof(record) + record.length;
+                }
+                validEnd = offset;
+            }
+        }
+
+        if (validEnd < fileSize) {
+            logEvent(LogLevel::WARN, L"Run journal: dropped {} bytes of torn records",
+                     static_cast<int64_t>(fileSize - validEnd));
+            std::error_code truncateError;
+            std::filesystem::resize_file(path_, validEnd, truncateError);
+            if (truncateError) {
+                error = "cannot truncate " + path_ + ": " + truncateError.message();
+                return false;
+            }
+        }
+
+        file_ = std::fopen(path_.c_str(), validEnd == 0 ? "wb" : "ab");
+        if (file_ == nullptr) {
+            error = "cannot open " + path_;
+            return false;
+        }
+        if (validEnd == 0) {
+            FileHeader header = {};
+            std::memcpy(header.magic, kMagic, sizeof(kMagic));
+            header.version = kVersion;
+            const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&header);
+            buffer_.assign(bytes, bytes + sizeof(header));
+            if (!commitLocked()) {
+                error = "cannot write " + path_;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool RunJournal::pending(const std::wstring& scope) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return started_ && phase_ != JournalPhase::COMPLETE && scope_ == scope;
+    }
+
+    bool RunJournal::reached(JournalPhase phase) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return started_ && static_cast<uint32_t>(phase_) >= static_cast<uint32_t>(phase);
+    }
+
+    bool RunJournal::begin(const std::wstring& scope, const UpdateTable& table) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (file_ == nullptr) {
+            return false;
+        }
+
+        // The previous run is finished or abandoned; start the file over
+        std::fclose(file_);
+        file_ = std::fopen(path_.c_str(), "wb");
+        if (file_ == nullptr) {
+            failed_ = true;
+            return false;
+        }
+        reset();
+        failed_ = false;
+
+        FileHeader header = {};
+        std::memcpy(header.magic, kMagic, sizeof(kMagic));
+        header.version = kVersion;
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&header);
+        buffer_.assign(bytes, bytes + sizeof(header));
+
+        std::vector<uint8_t> payload;
+        putText(payload, scope);
+        append(RECORD_BEGIN, payload);
+
+        payload.clear();
+        putU32(payload, static_cast<uint32_t>(table.size()));
+        for (size_t row = 0; row < table.size(); row++) {
+            putU32(payload, static_cast<uint32_t>(table.revision(row)));
+            putText(payload, table.updateId(row));
+        }
+        append(RECORD_UPDATES, payload);
+        return commitLocked();
+    }
+
+    void RunJournal::record(JournalPhase phase) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!started_) {
+            return;
+        }
+        std::vector<uint8_t> payload;
+        putU32(payload, static_cast<uint32_t>(phase));
+        append(RECORD_PHASE, payload);
+        commitLocked();
+    }
+
+    void RunJournal::recordOutcome(ProgressPhase phase, std::wstring_view updateId, int32_t revision,
+                                   const UpdateOutcome& outcome) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!started_) {
+            return;
+        }
+        std::vector<uint8_t> payload;
+        putU32(payload, static_cast<uint32_t>(phase));
+        putU32(payload, static_cast<uint32_t>(revision));
+        putU32(payload, static_cast<uint32_t>(outcome.result));
+        putU32(payload, static_cast<uint32_t>(outcome.hresult));
+        putU32(payload, outcome.rebootRequired ? 1 : 0);
+        putText(payload, updateId);
+        append(RECORD_OUTCOME, payload);
+        if (buffer_.size() >= kBufferLimit) {
+            commitLocked();
+        }
+    }
+
+    bool RunJournal::commit() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return commitLocked();
+    }
+
+    void RunJournal::append(uint32_t type, const std::vector<uint8_t>& payload) {
+        apply(type, payload.data(), payload.size());
+
+        RecordHeader header;
+        header.length = static_cast<uint32_t>(payload.size());
+        header.crc = recordCrc(type, payload.data(), payload.size());
+        header.type = type;
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&header);
+        buffer_.insert(buffer_.end(), bytes, bytes + sizeof(header));
+        buffer_.insert(buffer_.end(), payload.begin(), payload.end());
+    }
+
+    bool RunJournal::apply(uint32_t type, const uint8_t* payload, size_t size) {
+        PayloadReader reader = { payload, size };
+        switch (type) {
+            case RECORD_BEGIN: {
+                std::wstring scope;
+                if (!reader.text(scope)) {
+                    return false;
+                }
+                reset();
+                scope_ = scope;
+                started_ = true;
+                return true;
+            }
+            case RECORD_UPDATES: {
+                uint32_t count = 0;
+                if (!started_ || !reader.u32(count)) {
+                    return false;
+                }
+                for (uint32_t i = 0; i < count; i++) {
+                    JournalUpdate update;
+                    if (!reader.i32(update.revision) || !reader.text(update.updateId)) {
+                        return false;
+                    }
+                    updateIndex_.emplace(identityKey(update.updateId, update.revision), updates_.size());
+                    updates_.push_back(std::move(update));
+                }
+                return true;
+            }
+            case RECORD_PHASE: {
+                uint32_t phase = 0;
+                if (!started_ || !reader.u32(phase) || phase > static_cast<uint32_t>(JournalPhase::COMPLETE)) {
+                    return false;
+                }
+                if (phase > static_cast<uint32_t>(phase_)) {
+                    phase_ = static_cast<JournalPhase>(phase);
+                }
+                return true;
+            }
+            case RECORD_OUTCOME: {
+                uint32_t phase = 0;
+                int32_t revision = 0;
+                uint32_t result = 0;
+                uint32_t hresult = 0;
+                uint32_t reboot = 0;
+                std::wstring updateId;
+                if (!started_ || !reader.u32(phase) || !reader.i32(revision) || !reader.u32(result) ||
+                    !reader.u32(hresult) || !reader.u32(reboot) || !reader.text(updateId)) {
+                    return false;
+                }
+                // An update installed with errors is installed all the same; it is not installed again
+                auto it = updateIndex_.find(identityKey(updateId, revision));
+                if (it != updateIndex_.end() && phase == static_cast<uint32_t>(ProgressPhase::INSTALLING) &&
+                    (result == static_cast<uint32_t>(ResultCode::SUCCEEDED) ||
+                     result == static_cast<uint32_t>(ResultCode::SUCCEEDED_WITH_ERRORS))) {
+                    updates_[it->second].installed = true;
+                }
+                return true;
+            }
+            default:
+                return false;
+        }
+    }
+
+    bool RunJournal::commitLocked() {
+        if (buffer_.empty()) {
+            return true;
+        }
+        if (file_ == nullptr || failed_) {
+            buffer_.clear();
+            return false;
+        }
+
+        bool written = std::fwrite(buffer_.data(), 1, buffer_.size(), file_) == buffer_.size() &&
+                       std::fflush(file_) == 0;
+#ifdef _WIN32
+        written = written && _commit(_fileno(file_)) == 0;
+#else
+        written = written && fsync(fileno(file_)) == 0;
+#endif
+        buffer_.clear();
+        if (!written) {
+            // The run goes on; it just cannot be resumed past this point
+            failed_ = true;
+            logText(LogLevel::WARN, L"Run journal {s}: write failed, no longer recording", fromUtf8(path_));
+        }
+        return written;
+    }
+
+    void RunJournal::reset() {
+        scope_.clear();
+        started_ = false;
+        phase_ = JournalPhase::STARTED;
+        updates_.clear();
+        updateIndex_.clear();
+    }
+
+} // namespace WUpdater
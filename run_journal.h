@@ -0,0 +1,95 @@
+#pragma once
+
+#include "update_backend.h"
+#include "update_table.h"
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace WUpdater {
+
+    // Steps of a run recorded in the journal, in the order they are reached
+    enum class JournalPhase : uint32_t {
+        STARTED = 0,                // Update list recorded
+        DOWNLOAD_CONFIRMED = 1,
+        DOWNLOADED = 2,
+        INSTALL_CONFIRMED = 3,
+        COMPLETE = 4                // Nothing left to resume
+    };
+
+    // One update of the journaled run
+    struct JournalUpdate {
+        std::wstring updateId;
+        int32_t revision = 0;
+        bool installed = false;     // An install outcome of SUCCEEDED or SUCCEEDED_WITH_ERRORS was recorded
+    };
+
+    /**
+     * @brief Write-ahead journal of one run, so an interrupted run can resume.
+     *
+     * The file is a header followed by records of {length, CRC-32, type,
+     * payload}. A run starts by rewriting the file with the scope (backend and
+     * criteria) and the list of updates it acts on; phase transitions and
+     * per-update outcomes are appended as the run goes. Outcomes are buffered
+     * and made durable by commit(), once per result batch, while phases are
+     * committed as soon as they are recorded.
+     *
+     * Opening replays the file. A record torn by a crash or power loss fails
+     * its length or CRC check; it and anything after it are cut off.
+     */
+    class RunJournal {
+    public:
+        explicit RunJournal(const std::string& path);
+        ~RunJournal();
+
+        RunJournal(const RunJournal&) = delete;
+        RunJournal& operator=(const RunJournal&) = delete;
+
+        // Replay the journal, creating it if needed, and open it for appending
+        bool open(std::string& error);
+
+        // True if the journal holds an unfinished run with this scope
+        bool pending(const std::wstring& scope) const;
+
+        bool reached(JournalPhase phase) const;
+        JournalPhase lastPhase() const { return phase_; }
+        const std::vector<JournalUpdate>& updates() const { return updates_; }
+
+        // Start a new run over the updates in table, replacing the previous one
+        bool begin(const std::wstring& scope, const UpdateTable& table);
+
+        // Record a phase transition and commit it
+        void record(JournalPhase phase);
+
+        // Record the result of downloading or installing one update; made
+        // durable by the next commit()
+        void recordOutcome(ProgressPhase phase, std::wstring_view updateId, int32_t revision,
+                           const UpdateOutcome& outcome);
+
+        // Write buffered records and flush them to disk
+        bool commit();
+
+    private:
+        std::string path_;
+        mutable std::mutex mutex_;
+        std::FILE* file_;
+        std::vector<uint8_t> buffer_;           // Appended records not yet written
+        bool failed_;                           // Reported once; later writes are dropped
+
+        std::wstring scope_;
+        bool started_;
+        JournalPhase phase_;
+        std::vector<JournalUpdate> updates_;
+        std::unordered_map<std::wstring, size_t> updateIndex_;  // "UpdateID#revision" -> updates_
+
+        void append(uint32_t type, const std::vector<uint8_t>& payload);
+        bool apply(uint32_t type, const uint8_t* payload, size_t size);
+        bool commitLocked();
+        void reset();
+    };
+
+} // namespace WUpdater
@@ -0,0 +1,261 @@
+#include "search_cache.h"
+#include "mapped_file.h"
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <cwchar>
+#include <filesystem>
+#include <string_view>
+
+namespace WUpdater {
+
+    namespace {
+
+        const char kMagic[4] = { 'W', 'U', 'S', 'C' };
+        const uint32_t kVersion = 4;
+
+        const uint32_t kFlagDownloaded = 1u << 0;
+        const uint32_t kFlagInstalled = 1u << 1;
+        const uint32_t kSeverityShift = 2;      // Bits 2-4 hold the Severity value
+        const uint32_t kSeverityMask = 7u << kSeverityShift;
+        const uint32_t kImpactShift = 5;        // Bits 5-6 hold the InstallImpact value
+        const uint32_t kRebootShift = 7;        // Bits 7-8 hold the RebootBehavior value
+        const uint32_t kClassificationShift = 9;    // Bits 9-12 hold the UpdateClassification value
+
+        // File layout: header, record table, KB article table, string pool.
+        // The string pool holds wchar_t text; the key is stored first.
+        struct FileHeader {
+            char magic[4];
+            uint32_t version;
+            uint32_t charSize;          // sizeof(wchar_t) of the writer
+            uint32_t recordCount;
+            int64_t createdAt;          // Unix time
+            uint32_t keyLength;         // Characters at the start of the string pool
+            uint32_t kbCount;
+            uint64_t recordsOffset;
+            uint64_t kbsOffset;
+            uint64_t stringsOffset;
+            uint64_t fileSize;
+        };
+        static_assert(sizeof(FileHeader) == 64, "cache header layout changed");
+
+        struct FileRecord {
+            int64_t maxDownloadSize;
+            double releaseDate;
+            uint32_t idOffset;          // String offsets and lengths are in characters
+            uint32_t idLength;
+            uint32_t titleOffset;
+            uint32_t titleLength;
+            uint32_t kbOffset;          // Index into the KB article table
+            uint32_t kbCount;
+            int32_t revision;
+            uint32_t flags;
+        };
+        static_assert(sizeof(FileRecord) == 48, "cache record layout changed");
+
+        // FNV-1a over the key's characters; names the entry's file
+        uint64_t hashKey(const std::wstring& key) {
+            uint64_t hash = 14695981039346656037ULL;
+            for (wchar_t c : key) {
+                hash ^= static_cast<uint64_t>(c);
+                hash *= 1099511628211ULL;
+            }
+            return hash;
+        }
+
+        bool isOperator(wchar_t c) {
+            return c == L'=' || c == L'!' || c == L'<' || c == L'>' || c == L'(' || c == L')';
+        }
+
+        bool isSpace(wchar_t c) {
+            return c == L' ' || c == L'\t' || c == L'\r' || c == L'\n';
+        }
+
+        uint32_t appendString(std::vector<wchar_t>& pool, std::wstring_view text) {
+            uint32_t offset = static_cast<uint32_t>(pool.size());
+            pool.insert(pool.end(), text.begin(), text.end());
+            return offset;
+        }
+
+    } // namespace
+
+    SearchCache::SearchCache(const std::string& directory, unsigned ttlSeconds)
+        : directory_(directory), ttlSeconds_(ttlSeconds) {}
+
+    std::wstring SearchCache::normalizeCriteria(const std::wstring& criteria) {
+        std::wstring normalized;
+        normalized.reserve(criteria.size());
+        bool inQuote = false;
+        bool pendingSpace = false;
+
+        for (wchar_t c : criteria) {
+            if (inQuote) {
+                normalized.push_back(c);
+                inQuote = c != L'\'';
+                continue;
+            }
+            if (isSpace(c)) {
+                pendingSpace = true;
+                continue;
+            }
+            if (pendingSpace && !normalized.empty() && !isOperator(normalized.back()) && !isOperator(c)) {
+                normalized.push_back(L' ');
+            }
+            pendingSpace = false;
+            normalized.push_back(c);
+            inQuote = c == L'\'';
+        }
+        return normalized;
+    }
+
+    std::wstring SearchCache::makeKey(const std::wstring& backendName, const SearchContext& context,
+                                      const std::vector<std::wstring>& criteriaList) {
+        wchar_t detection[32];
+        std::swprintf(detection, sizeof(detection) / sizeof(detection[0]), L"%.6f", context.lastDetection);
+
+        std::wstring key = backendName + L"\n" + context.serverSelection + L"\n" + detection;
+        for (const std::wstring& criteria : criteriaList) {
+            key += L"\n" + normalizeCriteria(criteria);
+        }
+        return key;
+    }
+
+    std::string SearchCache::pathFor(const std::wstring& key) const {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.wsc", static_cast<unsigned long long>(hashKey(key)));
+        return (std::filesystem::path(directory_) / name).string();
+    }
+
+    bool SearchCache::load(const std::wstring& key, UpdateTable& table, int64_t& ageSeconds) const {
+        MappedFile file;
+        if (!file.open(pathFor(key)) || file.size() < sizeof(FileHeader)) {
+            return false;
+        }
+
+        const uint8_t* data = file.data();
+        const size_t size = file.size();
+
+        FileHeader header;
+        std::memcpy(&header, data, sizeof(header));
+        if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion ||
+            header.charSize != sizeof(wchar_t) || header.fileSize != size) {
+            return false;
+        }
+
+        // Every table must lie inside the file, in order
+        if (header.recordsOffset < sizeof(FileHeader) ||
+            header.kbsOffset < header.recordsOffset + static_cast<uint64_t>(header.recordCount) * sizeof(FileRecord) ||
+            header.stringsOffset < header.kbsOffset + static_cast<uint64_t>(header.kbCount) * sizeof(uint32_t) ||
+            header.stringsOffset > size || header.stringsOffset % sizeof(wchar_t) != 0) {
+            return false;
+        }
+
+        const wchar_t* strings = reinterpret_cast<const wchar_t*>(data + header.stringsOffset);
+        const uint64_t stringCount = (size - header.stringsOffset) / sizeof(wchar_t);
+        if (header.keyLength > stringCount || key.compare(0, std::wstring::npos, strings, header.keyLength) != 0) {
+            return false;
+        }
+
+        int64_t age = static_cast<int64_t>(std::time(nullptr)) - header.createdAt;
+        if (age < 0 || age >= static_cast<int64_t>(ttlSeconds_)) {
+            return false;
+        }
+
+        UpdateTable loaded;
+        loaded.reserve(header.recordCount);
+        UpdateRecord record;
+        for (uint32_t i = 0; i < header.recordCount; i++) {
+            FileRecord entry;
+            std::memcpy(&entry, data + header.recordsOffset + i * sizeof(FileRecord), sizeof(entry));
+            if (static_cast<uint64_t>(entry.idOffset) + entry.idLength > stringCount ||
+                static_cast<uint64_t>(entry.titleOffset) + entry.titleLength > stringCount ||
+                static_cast<uint64_t>(entry.kbOffset) + entry.kbCount > header.kbCount) {
+                return false;
+            }
+
+            record.updateId.assign(strings + entry.idOffset, entry.idLength);
+            record.revision = entry.revision;
+            record.title.assign(strings + entry.titleOffset, entry.titleLength);
+            record.kbArticleIds.resize(entry.kbCount);
+            if (entry.kbCount > 0) {
+                std::memcpy(record.kbArticleIds.data(),
+                            data + header.kbsOffset + entry.kbOffset * sizeof(uint32_t),
+                            entry.kbCount * sizeof(uint32_t));
+            }
+            record.maxDownloadSize = entry.maxDownloadSize;
+            record.releaseDate = entry.releaseDate;
+            record.isDownloaded = (entry.flags & kFlagDownloaded) != 0;
+            record.isInstalled = (entry.flags & kFlagInstalled) != 0;
+            record.severity = static_cast<Severity>((entry.flags & kSeverityMask) >> kSeverityShift);
+            record.impact = static_cast<InstallImpact>((entry.flags >> kImpactShift) & 3u);
+            record.reboot = static_cast<RebootBehavior>((entry.flags >> kRebootShift) & 3u);
+            record.classification = static_cast<UpdateClassification>((entry.flags >> kClassificationShift) & 15u);
+            loaded.append(record);
+        }
+
+        table = std::move(loaded);
+        ageSeconds = age;
+        return true;
+    }
+
+    bool SearchCache::store(const std::wstring& key, const UpdateTable& updates) const {
+        std::vector<FileRecord> table(updates.size());
+        std::vector<uint32_t> kbs;
+        std::vector<wchar_t> pool;
+        appendString(pool, key);
+
+        for (size_t i = 0; i < updates.size(); i++) {
+            FileRecord& entry = table[i];
+            entry.maxDownloadSize = updates.maxDownloadSize(i);
+            entry.releaseDate = updates.releaseDate(i);
+            entry.idOffset = appendString(pool, updates.updateId(i));
+            entry.idLength = static_cast<uint32_t>(updates.updateId(i).size());
+            entry.titleOffset = appendString(pool, updates.title(i));
+            entry.titleLength = static_cast<uint32_t>(updates.title(i).size());
+            entry.kbOffset = static_cast<uint32_t>(kbs.size());
+            entry.kbCount = static_cast<uint32_t>(updates.kbCount(i));
+            for (size_t k = 0; k < updates.kbCount(i); k++) {
+                kbs.push_back(updates.kbArticleId(i, k));
+            }
+            entry.revision = updates.revision(i);
+            entry.flags = (updates.isDownloaded(i) ? kFlagDownloaded : 0) |
+                          (updates.isInstalled(i) ? kFlagInstalled : 0) |
+                          (static_cast<uint32_t>(updates.severity(i)) << kSeverityShift) |
+                          (static_cast<uint32_t>(updates.impact(i)) << kImpactShift) |
+                          (static_cast<uint32_t>(updates.rebootBehavior(i)) << kRebootShift) |
+                          (static_cast<uint32_t>(updates.classification(i)) << kClassificationShift);
+        }
+
+        FileHeader header;
+        std::memcpy(header.magic, kMagic, sizeof(kMagic));
+        header.version = kVersion;
+        header.charSize = sizeof(wchar_t);
+        header.recordCount = static_cast<uint32_t>(table.size());
+        header.createdAt = static_cast<int64_t>(std::time(nullptr));
+        header.keyLength = static_cast<uint32_t>(key.size());
+        header.kbCount = static_cast<uint32_t>(kbs.size());
+        header.recordsOffset = sizeof(FileHeader);
+        header.kbsOffset = header.recordsOffset + table.size() * sizeof(FileRecord);
+        header.stringsOffset = header.kbsOffset + kbs.size() * sizeof(uint32_t);
+        header.fileSize = header.stringsOffset + pool.size() * sizeof(wchar_t);
+
+        std::vector<uint8_t> buffer(static_cast<size_t>(header.fileSize));
+        std::memcpy(buffer.data(), &header, sizeof(header));
+        if (!table.empty()) {
+            std::memcpy(buffer.data() + header.recordsOffset, table.data(), table.size() * sizeof(FileRecord));
+        }
+        if (!kbs.empty()) {
+            std::memcpy(buffer.data() + header.kbsOffset, kbs.data(), kbs.size() * sizeof(uint32_t));
+        }
+        std::memcpy(buffer.data() + header.stringsOffset, pool.data(), pool.size() * sizeof(wchar_t));
+
+        std::error_code error;
+        std::filesystem::create_directories(directory_, error);
+        return writeFileAtomically(pathFor(key), buffer.data(), buffer.size());
+    }
+
+    void SearchCache::invalidate(const std::wstring& key) const {
+        std::remove(pathFor(key).c_str());
+    }
+
+} // namespace WUpdater
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "update_backend.h"
+#include "update_table.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace WUpdater {
+
+    /**
+     * @brief On-disk cache of search results.
+     *
+     * Each entry is a versioned binary file named after a hash of its key and
+     * read through a memory mapping. The key combines the backend, its search
+     * context (server selection and last detection time) and the normalized
+     * criteria, so a new detection or a different update source never hits an
+     * old entry. Entries older than the TTL are ignored. Cached rows carry
+     * no handles; callers that need to act on updates resolve them again by
+     * UpdateID.
+     */
+    class SearchCache {
+    public:
+        SearchCache(const std::string& directory, unsigned ttlSeconds);
+
+        // Collapse whitespace outside quoted literals and around '=' and parentheses
+        static std::wstring normalizeCriteria(const std::wstring& criteria);
+
+        // Build the key identifying a search
+        static std::wstring makeKey(const std::wstring& backendName, const SearchContext& context,
+                                    const std::vector<std::wstring>& criteriaList);
+
+        // Read a live entry for key; ageSeconds receives how old it is
+        bool load(const std::wstring& key, UpdateTable& table, int64_t& ageSeconds) const;
+
+        // Write (or replace) the entry for key
+        bool store(const std::wstring& key, const UpdateTable& table) const;
+
+        // Drop the entry for key, e.g. once updates are downloaded or installed
+        void invalidate(const std::wstring& key) const;
+
+    private:
+        std::string directory_;
+        unsigned ttlSeconds_;
+
+        std::string pathFor(const std::wstring& key) const;
+    };
+
+} // namespace WUpdater
@@ -0,0 +1,551 @@
+#include "simulated_backend.h"
+#include "logger.h"
+#include "update_table.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstdio>
+#include <cwchar>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <sstream>
+#include <thread>
+
+namespace WUpdater {
+
+    namespace {
+
+        // OLE DATE of 2024-01-01; release dates are spread over the two years after it
+        const double kCatalogEpoch = 45292.0;
+
+        // Largest simulated content file; payload sizes only drive latencies
+        const int64_t kMaxContentBytes = 64 * 1024;
+
+        const wchar_t kContentScheme[] = L"sim://content/";
+
+        void simulateLatency(unsigned milliseconds) {
+            if (milliseconds > 0) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(milliseconds));
+            }
+        }
+
+        // Sleep for the simulated search latency the way an async WUA search is
+        // awaited: in short slices, honouring the timeout, cancel flag and heartbeat
+        HRESULT simulateSearch(unsigned milliseconds, const SearchOptions& options) {
+            typedef std::chrono::steady_clock Clock;
+            const Clock::time_point start = Clock::now();
+            const Clock::time_point done = start + std::chrono::milliseconds(milliseconds);
+            Clock::time_point nextHeartbeat = start + std::chrono::seconds(options.heartbeatSeconds);
+
+            while (true) {
+                Clock::time_point now = Clock::now();
+                if (now >= done) {
+                    return S_OK;
+                }
+                if (options.cancel != nullptr && options.cancel->load()) {
+                    return WU_E_CALL_CANCELLED;
+                }
+                if (options.timeoutSeconds > 0 && now - start >= std::chrono::seconds(options.timeoutSeconds)) {
+                    return WU_E_TIME_OUT;
+                }
+                if (options.callback && options.heartbeatSeconds > 0 && now >= nextHeartbeat) {
+                    unsigned elapsed = static_cast<unsigned>(
+                        std::chrono::duration_cast<std::chrono::seconds>(now - start).count());
+                    options.callback(ProgressPhase::SEARCHING, elapsed, options.context);
+                    nextHeartbeat += std::chrono::seconds(options.heartbeatSeconds);
+                }
+
+                Clock::duration slice = std::chrono::milliseconds(50);
+                std::this_thread::sleep_for(std::min(slice, done - now));
+            }
+        }
+
+        bool parseNumber(const std::string& text, double& value) {
+            char* end = nullptr;
+            value = std::strtod(text.c_str(), &end);
+            return !text.empty() && end != nullptr && *end == '\0';
+        }
+
+    } // namespace
+
+    bool parseSimulationSpec(const std::string& spec, SimulationConfig& config, std::string& error) {
+        std::istringstream stream(spec);
+        std::string entry;
+
+        while (std::getline(stream, entry, ',')) {
+            if (entry.empty()) {
+                continue;
+            }
+
+            size_t eq = entry.find('=');
+            if (eq == std::string::npos) {
+                error = "expected key=value, got '" + entry + "'";
+                return false;
+            }
+
+            std::string key = entry.substr(0, eq);
+            std::string value = entry.substr(eq + 1);
+
+            if (key == "fail-hr") {
+                char* end = nullptr;
+                unsigned long code = std::strtoul(value.c_str(), &end, 0);
+                if (value.empty() || *end != '\0') {
+                    error = "invalid HRESULT '" + value + "'";
+                    return false;
+                }
+                config.failureCode = static_cast<HRESULT>(code);
+                continue;
+            }
+
+            double number = 0;
+            if (!parseNumber(value, number) || number < 0) {
+                error = "invalid value for '" + key + "': '" + value + "'";
+                return false;
+            }
+
+            if (key == "updates") {
+                config.updateCount = static_cast<long>(number);
+            } else if (key == "min-size") {
+                config.minSize = static_cast<int64_t>(number);
+            } else if (key == "max-size") {
+                config.maxSize = static_cast<int64_t>(number);
+            } else if (key == "downloaded") {
+                config.downloadedRatio = number;
+            } else if (key == "search-ms") {
+                config.searchLatencyMs = static_cast<unsigned>(number);
+            } else if (key == "resolve-ms") {
+                config.resolveLatencyMs = static_cast<unsigned>(number);
+            } else if (key == "read-us") {
+                config.readLatencyUs = static_cast<unsigned>(number);
+            } else if (key == "download-ms") {
+                config.downloadLatencyMs = static_cast<unsigned>(number);
+            } else if (key == "download-mbps") {
+                config.downloadMbps = static_cast<unsigned>(number);
+            } else if (key == "install-ms") {
+                config.installLatencyMs = static_cast<unsigned>(number);
+            } else if (key == "fail-rate") {
+                config.failureRate = number;
+            } else if (key == "exclusive") {
+                config.exclusiveRatio = number;
+            } else if (key == "always-reboot") {
+                config.alwaysRebootRatio = number;
+            } else if (key == "transient") {
+                config.transientFailures = static_cast<unsigned>(number);
+            } else if (key == "seed") {
+                config.seed = static_cast<uint32_t>(number);
+            } else {
+                error = "unknown key '" + key + "'";
+                return false;
+            }
+        }
+
+        if (config.updateCount < 0 || config.minSize <= 0 || config.maxSize < config.minSize) {
+            error = "sizes must satisfy 0 < min-size <= max-size";
+            return false;
+        }
+        if (config.downloadedRatio > 1.0 || config.failureRate > 1.0 || config.exclusiveRatio > 1.0 ||
+            config.alwaysRebootRatio > 1.0) {
+            error = "ratios must be between 0 and 1";
+            return false;
+        }
+        return true;
+    }
+
+    SimulatedBackend::SimulatedBackend(const SimulationConfig& config)
+        : config_(config), searchCount_(0), restartPending_(false) {
+        std::mt19937 rng(config_.seed);
+        std::mt19937 installRng(config_.seed ^ 0x9E3779B9u);  // Separate stream keeps older catalogs unchanged
+        std::uniform_real_distribution<double> unit(0.0, 1.0);
+        const double logMin = std::log(static_cast<double>(config_.minSize));
+        const double logMax = std::log(static_cast<double>(config_.maxSize));
+
+        catalog_.reserve(static_cast<size_t>(config_.updateCount));
+        for (long i = 0; i < config_.updateCount; i++) {
+            CatalogEntry entry;
+            // Log-uniform sizes: many small patches, a few very large packages
+            entry.size = static_cast<int64_t>(std::exp(logMin + (logMax - logMin) * unit(rng)));
+            entry.releaseDate = kCatalogEpoch + std::floor(unit(rng) * 730.0);
+            entry.kb = 5000000 + static_cast<uint32_t>(i);
+            entry.driver = (i % 5) == 4;
+            entry.downloaded = unit(rng) < config_.downloadedRatio;
+            entry.installed = false;
+            entry.fails = unit(rng) < config_.failureRate;
+            entry.impact = unit(installRng) < config_.exclusiveRatio ? InstallImpact::EXCLUSIVE : InstallImpact::NORMAL;
+            entry.reboot = unit(installRng) < config_.alwaysRebootRatio ? RebootBehavior::ALWAYS
+                         : (entry.kb % 7) == 0 ? RebootBehavior::CAN_REQUEST : RebootBehavior::NEVER;
+            entry.downloadFailures = 0;
+            entry.installFailures = 0;
+            catalog_.push_back(entry);
+        }
+    }
+
+    bool SimulatedBackend::validHandle(const UpdateHandle& handle) const {
+        return handle.resultSet != 0 && handle.resultSet <= searchCount_ &&
+               handle.index < catalog_.size();
+    }
+
+    std::wstring SimulatedBackend::formatUpdateId(uint32_t index) const {
+        wchar_t buffer[48];
+        std::swprintf(buffer, sizeof(buffer) / sizeof(buffer[0]),
+                      L"%08x-5157-4d00-8000-%012x", config_.seed, index);
+        return buffer;
+    }
+
+    bool SimulatedBackend::parseUpdateId(const std::wstring& updateId, uint32_t& index) const {
+        unsigned seed = 0;
+        unsigned long long value = 0;
+        if (std::swscanf(updateId.c_str(), L"%8x-5157-4d00-8000-%12llx", &seed, &value) != 2 ||
+            seed != config_.seed || value >= catalog_.size()) {
+            return false;
+        }
+        index = static_cast<uint32_t>(value);
+        return true;
+    }
+
+    bool SimulatedBackend::failsNow(bool fails, unsigned& failedAttempts) const {
+        if (!fails || (config_.transientFailures > 0 && failedAttempts >= config_.transientFailures)) {
+            return false;
+        }
+        failedAttempts++;
+        return true;
+    }
+
+    HRESULT SimulatedBackend::search(const std::wstring& criteria, const SearchOptions& options,
+                                     std::vector<UpdateHandle>& found) {
+        HRESULT hr = simulateSearch(config_.searchLatencyMs, options);
+        if (FAILED(hr)) {
+            return hr;
+        }
+
+        bool wantInstalled = criteria.find(L"IsInstalled=1") != std::wstring::npos;
+        bool filterInstalled = wantInstalled || criteria.find(L"IsInstalled=0") != std::wstring::npos;
+        bool wantDriver = criteria.find(L"Type='Driver'") != std::wstring::npos;
+        bool filterType = wantDriver || criteria.find(L"Type='Software'") != std::wstring::npos;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        uint32_t resultSet = ++searchCount_;
+        for (size_t i = 0; i < catalog_.size(); i++) {
+            if (filterInstalled && catalog_[i].installed != wantInstalled) {
+                continue;
+            }
+            if (filterType && catalog_[i].driver != wantDriver) {
+                continue;
+            }
+            UpdateHandle handle;
+            handle.resultSet = resultSet;
+            handle.index = static_cast<uint32_t>(i);
+            found.push_back(handle);
+        }
+        return S_OK;
+    }
+
+    HRESULT SimulatedBackend::findByIdentity(const std::vector<std::wstring>& updateIds,
+                                             std::vector<UpdateHandle>& found) {
+        simulateLatency(config_.resolveLatencyMs);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        uint32_t resultSet = ++searchCount_;
+        for (const std::wstring& updateId : updateIds) {
+            uint32_t index = 0;
+            if (parseUpdateId(updateId, index)) {
+                UpdateHandle handle;
+                handle.resultSet = resultSet;
+                handle.index = index;
+                found.push_back(handle);
+            }
+        }
+        return S_OK;
+    }
+
+    HRESULT SimulatedBackend::getSearchContext(SearchContext& context) {
+        // The catalog is rebuilt from the config on every run, so the config is the source
+        wchar_t buffer[128];
+        std::swprintf(buffer, sizeof(buffer) / sizeof(buffer[0]),
+                      L"simulated:seed=%u,updates=%ld,size=%lld-%lld,downloaded=%g",
+                      config_.seed, config_.updateCount, static_cast<long long>(config_.minSize),
+                      static_cast<long long>(config_.maxSize), config_.downloadedRatio);
+        context.serverSelection = buffer;
+        context.lastDetection = kCatalogEpoch + 730.0;
+        return S_OK;
+    }
+
+    void SimulatedBackend::fillRecord(const UpdateHandle& handle, UpdateRecord& record) const {
+        const CatalogEntry& entry = catalog_[handle.index];
+        wchar_t buffer[96];
+
+        record.handle = handle;
+        record.updateId = formatUpdateId(handle.index);
+        record.revision = 200;
+
+        std::swprintf(buffer, sizeof(buffer) / sizeof(buffer[0]),
+                      entry.driver ? L"Simulated Driver %u (KB%u)" : L"Simulated Update %u for Windows (KB%u)",
+                      handle.index + 1, entry.kb);
+        record.title = buffer;
+
+        record.kbArticleIds.assign(1, entry.kb);
+        record.maxDownloadSize = entry.size;
+        record.releaseDate = entry.releaseDate;
+        record.isDownloaded = entry.downloaded;
+        record.isInstalled = entry.installed;
+        record.severity = entry.driver ? Severity::UNSPECIFIED : static_cast<Severity>(entry.kb % 5);
+        record.impact = entry.impact;
+        record.reboot = entry.reboot;
+        record.classification = entry.driver ? UpdateClassification::DRIVERS
+                              : record.severity != Severity::UNSPECIFIED ? UpdateClassification::SECURITY_UPDATES
+                              : (entry.kb % 3) == 0 ? UpdateClassification::DEFINITION_UPDATES
+                              : UpdateClassification::UPDATES;
+    }
+
+    HRESULT SimulatedBackend::getUpdate(const UpdateHandle& handle, UpdateRecord& record) {
+        if (config_.readLatencyUs > 0) {
+            std::this_thread::sleep_for(std::chrono::microseconds(config_.readLatencyUs));
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!validHandle(handle)) {
+            return WU_E_INVALIDINDEX;
+        }
+        fillRecord(handle, record);
+        return S_OK;
+    }
+
+    HRESULT SimulatedBackend::readUpdates(const std::vector<UpdateHandle>& handles, size_t begin, size_t end,
+                                          UpdateTable& table) {
+        HRESULT result = S_OK;
+        UpdateRecord record;
+
+        for (size_t i = begin; i < end && i < handles.size(); i++) {
+            if (config_.readLatencyUs > 0) {
+                std::this_thread::sleep_for(std::chrono::microseconds(config_.readLatencyUs));
+            }
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!validHandle(handles[i])) {
+                if (SUCCEEDED(result)) {
+                    result = WU_E_INVALIDINDEX;
+                }
+                continue;
+            }
+            fillRecord(handles[i], record);
+            table.append(record);
+        }
+        return result;
+    }
+
+    HRESULT SimulatedBackend::getIdentity(const UpdateHandle& handle, std::wstring& updateId, int32_t& revision) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!validHandle(handle)) {
+            return WU_E_INVALIDINDEX;
+        }
+
+        updateId = formatUpdateId(handle.index);
+        revision = 200;
+        return S_OK;
+    }
+
+    HRESULT SimulatedBackend::download(const std::vector<UpdateHandle>& updates,
+                                       std::vector<UpdateOutcome>& outcomes,
+                                       DownloadObserver* observer) {
+        outcomes.assign(updates.size(), UpdateOutcome());
+
+        DownloadProgress progress;
+        progress.updateCount = updates.size();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (const UpdateHandle& handle : updates) {
+                if (validHandle(handle)) {
+                    progress.totalBytesTotal += catalog_[handle.index].size;
+                }
+            }
+        }
+
+        // Each update's latency is spread over a few progress steps
+        const unsigned kSteps = config_.downloadLatencyMs > 0 || config_.downloadMbps > 0 ? 10 : 1;
+
+        for (size_t i = 0; i < updates.size(); i++) {
+            if (observer && observer->cancelRequested()) {
+                for (size_t j = i; j < updates.size(); j++) {
+                    outcomes[j].result = ResultCode::ABORTED;
+                    outcomes[j].hresult = WU_E_CALL_CANCELLED;
+                }
+                break;
+            }
+
+            int64_t size = 0;
+            bool valid = false;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                valid = validHandle(updates[i]);
+                size = valid ? catalog_[updates[i].index].size : 0;
+            }
+
+            progress.currentUpdate = i;
+            progress.currentBytesTotal = size;
+            progress.currentBytesDone = 0;
+            const int64_t startBytes = progress.totalBytesDone;
+            // Jobs transfer independently, so concurrent jobs add up their rates
+            const unsigned transferMs = config_.downloadMbps > 0
+                ? static_cast<unsigned>(size / (static_cast<int64_t>(config_.downloadMbps) * 1000)) : 0;
+            for (unsigned step = 1; valid && step <= kSteps; step++) {
+                simulateLatency((config_.downloadLatencyMs + transferMs) / kSteps);
+                progress.currentBytesDone = size * step / kSteps;
+                progress.totalBytesDone = startBytes + progress.currentBytesDone;
+                if (progress.totalBytesTotal > 0) {
+                    progress.percentComplete = static_cast<unsigned>(progress.totalBytesDone * 100 / progress.totalBytesTotal);
+                }
+                if (observer) {
+                    observer->onProgress(progress);
+                }
+                logEvent(LogLevel::DEBUG, L"Download progress: update {} of {}, {} of {} bytes",
+                         static_cast<int64_t>(i + 1), static_cast<int64_t>(updates.size()),
+                         progress.totalBytesDone, progress.totalBytesTotal);
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (!valid) {
+                    outcomes[i].result = ResultCode::FAILED;
+                    outcomes[i].hresult = WU_E_INVALIDINDEX;
+                } else if (failsNow(catalog_[updates[i].index].fails, catalog_[updates[i].index].downloadFailures)) {
+                    outcomes[i].result = ResultCode::FAILED;
+                    outcomes[i].hresult = config_.failureCode;
+                } else {
+                    catalog_[updates[i].index].downloaded = true;
+                    outcomes[i].result = ResultCode::SUCCEEDED;
+                }
+            }
+
+            if (observer) {
+                observer->onUpdateDownloaded(i, outcomes[i]);
+            }
+        }
+        return S_OK;
+    }
+
+    HRESULT SimulatedBackend::install(const std::vector<UpdateHandle>& updates,
+                                      std::vector<UpdateOutcome>& outcomes,
+                                      UpdateProgressCallback callback, void* context) {
+        outcomes.assign(updates.size(), UpdateOutcome());
+
+        if (updates.size() > 1) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (const UpdateHandle& handle : updates) {
+                if (validHandle(handle) && catalog_[handle.index].impact == InstallImpact::EXCLUSIVE) {
+                    return WU_E_EXCLUSIVE_INSTALL_CONFLICT;
+                }
+            }
+        }
+
+        bool restartAfter = false;
+        for (size_t i = 0; i < updates.size(); i++) {
+            simulateLatency(config_.installLatencyMs);
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!validHandle(updates[i])) {
+                outcomes[i].result = ResultCode::FAILED;
+                outcomes[i].hresult = WU_E_INVALIDINDEX;
+                continue;
+            }
+
+            CatalogEntry& entry = catalog_[updates[i].index];
+            if (!entry.downloaded || restartPending_) {
+                outcomes[i].result = ResultCode::FAILED;
+                outcomes[i].hresult = WU_E_INSTALL_NOT_ALLOWED;
+            } else if (failsNow(entry.fails, entry.installFailures)) {
+                outcomes[i].result = ResultCode::FAILED;
+                outcomes[i].hresult = config_.failureCode;
+            } else {
+                entry.installed = true;
+                outcomes[i].result = ResultCode::SUCCEEDED;
+                outcomes[i].rebootRequired = entry.reboot != RebootBehavior::NEVER;
+                restartAfter = restartAfter || entry.reboot == RebootBehavior::ALWAYS;
+            }
+
+            if (callback) {
+                callback(ProgressPhase::INSTALLING,
+                         static_cast<unsigned int>((i + 1) * 100 / updates.size()), context);
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        restartPending_ = restartPending_ || restartAfter;
+        return S_OK;
+    }
+
+    std::string SimulatedBackend::contentBytes(uint32_t index) const {
+        std::string bytes(static_cast<size_t>((std::min)(catalog_[index].size, kMaxContentBytes)), '\0');
+        uint32_t state = config_.seed * 2654435761u + index;
+        for (char& byte : bytes) {
+            state = state * 1664525u + 1013904223u;
+            byte = static_cast<char>(state >> 24);
+        }
+        return bytes;
+    }
+
+    HRESULT SimulatedBackend::getContentFiles(const UpdateHandle& handle, std::vector<ContentFile>& files) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!validHandle(handle)) {
+            return WU_E_INVALIDINDEX;
+        }
+
+        ContentFile file;
+        file.name = L"simulated-kb" + std::to_wstring(catalog_[handle.index].kb) + L"-x64.cab";
+        file.url = kContentScheme + std::to_wstring(handle.index) + L"/" + file.name;
+        files.push_back(file);
+        return S_OK;
+    }
+
+    HRESULT SimulatedBackend::fetchContentFile(const ContentFile& file, const std::string& path) {
+        const size_t prefix = sizeof(kContentScheme) / sizeof(kContentScheme[0]) - 1;
+        if (file.url.compare(0, prefix, kContentScheme) != 0) {
+            return E_INVALIDARG;
+        }
+        uint32_t index = static_cast<uint32_t>(std::wcstoul(file.url.c_str() + prefix, nullptr, 10));
+
+        std::string bytes;
+        int64_t size = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (index >= catalog_.size()) {
+                return WU_E_INVALIDINDEX;
+            }
+            if (failsNow(catalog_[index].fails, catalog_[index].downloadFailures)) {
+                return config_.failureCode;
+            }
+            size = catalog_[index].size;
+            bytes = contentBytes(index);
+        }
+
+        // Same time on the wire as a download job would take
+        simulateLatency(config_.downloadLatencyMs +
+                        (config_.downloadMbps > 0 ? static_cast<unsigned>(size / (static_cast<int64_t>(config_.downloadMbps) * 1000)) : 0));
+
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+        return out ? S_OK : E_FAIL;
+    }
+
+    HRESULT SimulatedBackend::copyToCache(const UpdateHandle& handle, const std::vector<ContentFile>& files,
+                                          const std::vector<std::string>& paths) {
+        (void)files;
+        if (paths.size() != 1) {
+            return E_INVALIDARG;
+        }
+
+        std::ifstream in(paths[0], std::ios::binary);
+        std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!validHandle(handle)) {
+            return WU_E_INVALIDINDEX;
+        }
+        if (!in.is_open() || bytes != contentBytes(handle.index)) {
+            return WU_E_DOWNLOAD_FAILED;
+        }
+        catalog_[handle.index].downloaded = true;
+        return S_OK;
+    }
+
+} // namespace WUpdater
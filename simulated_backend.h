@@ -0,0 +1,115 @@
+#pragma once
+
+#include "update_backend.h"
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace WUpdater {
+
+    // Shape of the synthetic catalog and the timings/failures it injects
+    struct SimulationConfig {
+        long updateCount = 100;             // 10 .. 50000 applicable updates
+        int64_t minSize = 64 * 1024;        // Smallest payload in bytes
+        int64_t maxSize = 512 * 1024 * 1024;// Largest payload in bytes
+        double downloadedRatio = 0.1;       // Share of updates already in cache
+        unsigned searchLatencyMs = 0;       // Time one search takes
+        unsigned resolveLatencyMs = 0;      // Time one lookup by UpdateID takes
+        unsigned readLatencyUs = 0;         // Time reading one update's metadata takes (microseconds)
+        unsigned downloadLatencyMs = 0;     // Time each update's download takes
+        unsigned downloadMbps = 0;          // Transfer rate of one download job in MB/s; 0 makes payload size free
+        unsigned installLatencyMs = 0;      // Time each update's install takes
+        double failureRate = 0.0;           // Share of updates whose download/install fails
+        HRESULT failureCode = WU_E_DOWNLOAD_FAILED;
+        unsigned transientFailures = 0;     // Failing updates succeed after this many failed attempts; 0 never
+        double exclusiveRatio = 0.0;        // Share of updates that must be installed on their own
+        double alwaysRebootRatio = 0.0;     // Share of updates that always restart the machine
+        uint32_t seed = 1;
+    };
+
+    /**
+     * @brief Parse a simulation spec of comma separated key=value pairs
+     * @param spec e.g. "updates=5000,search-ms=200,fail-rate=0.01,fail-hr=0x80240034,transient=1"
+     * @param config Receives the parsed values on top of its current ones
+     * @param error Receives a description of the first invalid entry
+     * @return true if the whole spec was valid
+     */
+    bool parseSimulationSpec(const std::string& spec, SimulationConfig& config, std::string& error);
+
+    /**
+     * @brief In-process backend serving a deterministic synthetic catalog.
+     *
+     * Sizes, download state and failures are derived from the seed, so two
+     * runs with the same config see the same catalog. Every fifth entry is a
+     * driver. Searches honour the IsInstalled and Type terms of the criteria
+     * and match everything else. Latencies are real
+     * sleeps, which makes the backend suitable for load and timing tests.
+     * Metadata reads sleep outside the catalog lock, so concurrent readers
+     * overlap the way COM property calls in the MTA do. Each update has one
+     * content file of up to 64 KiB whose bytes derive from its catalog
+     * index; copyToCache() accepts only that exact content.
+     *
+     * Installs follow the agent's rules: a call that includes an exclusive
+     * update alongside others fails with WU_E_EXCLUSIVE_INSTALL_CONFLICT,
+     * and once an update that always reboots is installed, later installs
+     * fail with WU_E_INSTALL_NOT_ALLOWED. Every seventh KB can request a
+     * restart, and does.
+     */
+    class SimulatedBackend : public UpdateBackend {
+    public:
+        explicit SimulatedBackend(const SimulationConfig& config);
+
+        std::wstring name() const override { return L"simulated"; }
+
+        HRESULT search(const std::wstring& criteria, const SearchOptions& options,
+                       std::vector<UpdateHandle>& found) override;
+        HRESULT findByIdentity(const std::vector<std::wstring>& updateIds,
+                               std::vector<UpdateHandle>& found) override;
+        HRESULT getSearchContext(SearchContext& context) override;
+        HRESULT getUpdate(const UpdateHandle& handle, UpdateRecord& record) override;
+        HRESULT readUpdates(const std::vector<UpdateHandle>& handles, size_t begin, size_t end,
+                            UpdateTable& table) override;
+        HRESULT getIdentity(const UpdateHandle& handle, std::wstring& updateId, int32_t& revision) override;
+        HRESULT download(const std::vector<UpdateHandle>& updates,
+                         std::vector<UpdateOutcome>& outcomes,
+                         DownloadObserver* observer) override;
+        HRESULT install(const std::vector<UpdateHandle>& updates,
+                        std::vector<UpdateOutcome>& outcomes,
+                        UpdateProgressCallback callback, void* context) override;
+        HRESULT getContentFiles(const UpdateHandle& handle, std::vector<ContentFile>& files) override;
+        HRESULT fetchContentFile(const ContentFile& file, const std::string& path) override;
+        HRESULT copyToCache(const UpdateHandle& handle, const std::vector<ContentFile>& files,
+                            const std::vector<std::string>& paths) override;
+
+        const SimulationConfig& config() const { return config_; }
+
+    private:
+        struct CatalogEntry {
+            int64_t size;
+            double releaseDate;
+            uint32_t kb;
+            bool driver;
+            bool downloaded;
+            bool installed;
+            bool fails;
+            InstallImpact impact;
+            RebootBehavior reboot;
+            unsigned downloadFailures;      // Failed attempts so far, for transient failures
+            unsigned installFailures;
+        };
+
+        SimulationConfig config_;
+        std::vector<CatalogEntry> catalog_;
+        uint32_t searchCount_;
+        bool restartPending_;                   // An update that always reboots was installed
+        mutable std::mutex mutex_;
+
+        bool validHandle(const UpdateHandle& handle) const;
+        bool failsNow(bool fails, unsigned& failedAttempts) const;     // Counts the attempt if it fails
+        std::wstring formatUpdateId(uint32_t index) const;
+        std::string contentBytes(uint32_t index) const;
+        void fillRecord(const UpdateHandle& handle, UpdateRecord& record) const;
+        bool parseUpdateId(const std::wstring& updateId, uint32_t& index) const;
+    };
+
+} // namespace WUpdater
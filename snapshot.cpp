@@ -0,0 +1,185 @@
+#include "snapshot.h"
+#include "mapped_file.h"
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+
+namespace WUpdater {
+
+    namespace {
+
+        const char kMagic[4] = { 'W', 'U', 'S', 'S' };
+        const uint32_t kVersion = 1;
+
+        const uint32_t kFlagDownloaded = 1u << 0;
+        const uint32_t kFlagInstalled = 1u << 1;
+
+        // File layout: header, entry table, string pool (scope first, then UpdateIDs)
+        struct FileHeader {
+            char magic[4];
+            uint32_t version;
+            uint32_t charSize;          // sizeof(wchar_t) of the writer
+            uint32_t entryCount;
+            int64_t createdAt;
+            uint32_t scopeLength;
+            uint32_t reserved;
+            uint64_t stringsOffset;
+            uint64_t fileSize;
+        };
+        static_assert(sizeof(FileHeader) == 48, "snapshot header layout changed");
+
+        struct FileEntry {
+            uint32_t idOffset;          // In characters, into the string pool
+            uint32_t idLength;
+            int32_t revision;
+            uint32_t flags;
+        };
+        static_assert(sizeof(FileEntry) == 16, "snapshot entry layout changed");
+
+        bool entryLess(const SnapshotEntry& a, const SnapshotEntry& b) {
+            int order = a.updateId.compare(b.updateId);
+            return order < 0 || (order == 0 && a.revision < b.revision);
+        }
+
+    } // namespace
+
+    Snapshot Snapshot::fromTable(const std::wstring& scope, const UpdateTable& table) {
+        Snapshot snapshot;
+        snapshot.scope = scope;
+        snapshot.createdAt = static_cast<int64_t>(std::time(nullptr));
+        snapshot.entries.resize(table.size());
+        for (size_t i = 0; i < table.size(); i++) {
+            SnapshotEntry& entry = snapshot.entries[i];
+            entry.updateId = std::wstring(table.updateId(i));
+            entry.revision = table.revision(i);
+            entry.isDownloaded = table.isDownloaded(i);
+            entry.isInstalled = table.isInstalled(i);
+            entry.source = i;
+        }
+        std::sort(snapshot.entries.begin(), snapshot.entries.end(), entryLess);
+        return snapshot;
+    }
+
+    bool loadSnapshot(const std::string& path, Snapshot& snapshot) {
+        MappedFile file;
+        if (!file.open(path) || file.size() < sizeof(FileHeader)) {
+            return false;
+        }
+
+        const uint8_t* data = file.data();
+        const size_t size = file.size();
+
+        FileHeader header;
+        std::memcpy(&header, data, sizeof(header));
+        if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion ||
+            header.charSize != sizeof(wchar_t) || header.fileSize != size ||
+            header.stringsOffset < sizeof(FileHeader) + static_cast<uint64_t>(header.entryCount) * sizeof(FileEntry) ||
+            header.stringsOffset > size || header.stringsOffset % sizeof(wchar_t) != 0) {
+            return false;
+        }
+
+        const wchar_t* strings = reinterpret_cast<const wchar_t*>(data + header.stringsOffset);
+        const uint64_t stringCount = (size - header.stringsOffset) / sizeof(wchar_t);
+        if (header.scopeLength > stringCount) {
+            return false;
+        }
+
+        Snapshot loaded;
+        loaded.scope.assign(strings, header.scopeLength);
+        loaded.createdAt = header.createdAt;
+        loaded.entries.resize(header.entryCount);
+        for (uint32_t i = 0; i < header.entryCount; i++) {
+            FileEntry record;
+            std::memcpy(&record, data + sizeof(FileHeader) + i * sizeof(FileEntry), sizeof(record));
+            if (static_cast<uint64_t>(record.idOffset) + record.idLength > stringCount) {
+                return false;
+            }
+
+            SnapshotEntry& entry = loaded.entries[i];
+            entry.updateId.assign(strings + record.idOffset, record.idLength);
+            entry.revision = record.revision;
+            entry.isDownloaded = (record.flags & kFlagDownloaded) != 0;
+            entry.isInstalled = (record.flags & kFlagInstalled) != 0;
+            entry.source = i;
+        }
+
+        // Written sorted, but a diff over unsorted input would be silently wrong
+        if (!std::is_sorted(loaded.entries.begin(), loaded.entries.end(), entryLess)) {
+            std::sort(loaded.entries.begin(), loaded.entries.end(), entryLess);
+        }
+
+        snapshot = std::move(loaded);
+        return true;
+    }
+
+    bool saveSnapshot(const std::string& path, const Snapshot& snapshot) {
+        std::vector<FileEntry> table(snapshot.entries.size());
+        std::vector<wchar_t> pool(snapshot.scope.begin(), snapshot.scope.end());
+
+        for (size_t i = 0; i < snapshot.entries.size(); i++) {
+            const SnapshotEntry& entry = snapshot.entries[i];
+            table[i].idOffset = static_cast<uint32_t>(pool.size());
+            table[i].idLength = static_cast<uint32_t>(entry.updateId.size());
+            table[i].revision = entry.revision;
+            table[i].flags = (entry.isDownloaded ? kFlagDownloaded : 0) | (entry.isInstalled ? kFlagInstalled : 0);
+            pool.insert(pool.end(), entry.updateId.begin(), entry.updateId.end());
+        }
+
+        FileHeader header;
+        std::memcpy(header.magic, kMagic, sizeof(kMagic));
+        header.version = kVersion;
+        header.charSize = sizeof(wchar_t);
+        header.entryCount = static_cast<uint32_t>(table.size());
+        header.createdAt = snapshot.createdAt;
+        header.scopeLength = static_cast<uint32_t>(snapshot.scope.size());
+        header.reserved = 0;
+        header.stringsOffset = sizeof(FileHeader) + table.size() * sizeof(FileEntry);
+        header.fileSize = header.stringsOffset + pool.size() * sizeof(wchar_t);
+
+        std::vector<uint8_t> buffer(static_cast<size_t>(header.fileSize));
+        std::memcpy(buffer.data(), &header, sizeof(header));
+        if (!table.empty()) {
+            std::memcpy(buffer.data() + sizeof(FileHeader), table.data(), table.size() * sizeof(FileEntry));
+        }
+        if (!pool.empty()) {
+            std::memcpy(buffer.data() + header.stringsOffset, pool.data(), pool.size() * sizeof(wchar_t));
+        }
+        return writeFileAtomically(path, buffer.data(), buffer.size());
+    }
+
+    std::vector<SnapshotChange> diffSnapshots(const Snapshot& previous, const Snapshot& current) {
+        std::vector<SnapshotChange> changes;
+        const std::vector<SnapshotEntry>& before = previous.entries;
+        const std::vector<SnapshotEntry>& after = current.entries;
+
+        size_t i = 0;
+        size_t j = 0;
+        while (i < before.size() || j < after.size()) {
+            int order = 0;
+            if (i == before.size()) {
+                order = 1;
+            } else if (j == after.size()) {
+                order = -1;
+            } else {
+                order = before[i].updateId.compare(after[j].updateId);
+            }
+
+            if (order < 0) {
+                changes.push_back(SnapshotChange{ ChangeKind::REMOVED, i++, 0 });
+            } else if (order > 0) {
+                changes.push_back(SnapshotChange{ ChangeKind::ADDED, 0, j++ });
+            } else {
+                if (before[i].revision != after[j].revision) {
+                    changes.push_back(SnapshotChange{ ChangeKind::REVISED, i, j });
+                } else if (before[i].isDownloaded != after[j].isDownloaded ||
+                           before[i].isInstalled != after[j].isInstalled) {
+                    changes.push_back(SnapshotChange{ ChangeKind::STATE_CHANGED, i, j });
+                }
+                i++;
+                j++;
+            }
+        }
+        return changes;
+    }
+
+} // namespace WUpdater
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "update_table.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace WUpdater {
+
+    // Identity and state of one update as recorded by a run
+    struct SnapshotEntry {
+        std::wstring updateId;
+        int32_t revision = 0;
+        bool isDownloaded = false;
+        bool isInstalled = false;
+        size_t source = 0;              // Table row it was built from (not persisted)
+    };
+
+    /**
+     * @brief Compact record of the updates one run found.
+     *
+     * Entries are kept sorted by UpdateID (then revision) so two snapshots
+     * can be compared with a single merge pass. The scope identifies the
+     * backend and criteria; snapshots with different scopes are not comparable.
+     */
+    struct Snapshot {
+        std::wstring scope;
+        int64_t createdAt = 0;          // Unix time
+        std::vector<SnapshotEntry> entries;
+
+        static Snapshot fromTable(const std::wstring& scope, const UpdateTable& table);
+    };
+
+    // Read a snapshot written by saveSnapshot; false if missing or unreadable
+    bool loadSnapshot(const std::string& path, Snapshot& snapshot);
+
+    // Replace the snapshot at path
+    bool saveSnapshot(const std::string& path, const Snapshot& snapshot);
+
+    enum class ChangeKind {
+        ADDED,          // Newly applicable
+        REMOVED,        // No longer returned by the search (installed, superseded, expired)
+        REVISED,        // Same UpdateID with a new revision
+        STATE_CHANGED   // Download or install state changed
+    };
+
+    // One difference between two snapshots; indices point into their entries
+    struct SnapshotChange {
+        ChangeKind kind;
+        size_t previous;    // Valid unless ADDED
+        size_t current;     // Valid unless REMOVED
+    };
+
+    // Sorted-merge diff of two snapshots, in UpdateID order
+    std::vector<SnapshotChange> diffSnapshots(const Snapshot& previous, const Snapshot& current);
+
+} // namespace WUpdater
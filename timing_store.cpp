@@ -0,0 +1,256 @@
+#include "timing_store.h"
+#include "logger.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+
+namespace WUpdater {
+
+    namespace {
+
+        const char kMagic[4] = { 'W', 'U', 'T', 'S' };
+        const uint32_t kVersion = 1;
+
+        struct StoreHeader {
+            char magic[4];
+            uint32_t version;
+            uint32_t recordSize;
+            uint32_t reserved;
+        };
+        static_assert(sizeof(StoreHeader) == 16, "timing store header layout changed");
+
+        struct StoreRecord {
+            char updateId[36];          // ASCII GUID, zero-padded
+            int32_t revision;
+            uint32_t kb;
+            int32_t hresult;
+            int64_t size;
+            int64_t recordedAt;         // Unix time
+            uint32_t durationMs;
+            uint8_t phase;
+            uint8_t classification;
+            uint8_t result;
+            uint8_t reserved;
+            uint32_t padding[2];
+        };
+        static_assert(sizeof(StoreRecord) == 80, "timing store record layout changed");
+
+        enum KeyKind : uint64_t {
+            KEY_KB = 0,
+            KEY_CLASSIFICATION = 1
+        };
+
+        uint64_t indexKey(TimingPhase phase, KeyKind kind, uint32_t value) {
+            return (static_cast<uint64_t>(phase) << 40) | (static_cast<uint64_t>(kind) << 32) | value;
+        }
+
+        StoreHeader makeHeader() {
+            StoreHeader header = {};
+            std::memcpy(header.magic, kMagic, sizeof(kMagic));
+            header.version = kVersion;
+            header.recordSize = sizeof(StoreRecord);
+            return header;
+        }
+
+        bool appendBytes(const std::string& path, const void* data, size_t size) {
+            std::FILE* file = std::fopen(path.c_str(), "ab");
+            if (file == nullptr) {
+                return false;
+            }
+            bool written = std::fwrite(data, 1, size, file) == size;
+            written = std::fclose(file) == 0 && written;
+            return written;
+        }
+
+    } // namespace
+
+    TimingStore::TimingStore(const std::string& path) : path_(path), recordCount_(0) {}
+
+    bool TimingStore::open(std::string& error) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::error_code ec;
+        const uintmax_t fileSize = std::filesystem::exists(path_, ec) ? std::filesystem::file_size(path_, ec) : 0;
+        if (fileSize == 0) {
+            const StoreHeader header = makeHeader();
+            if (!writeFileAtomically(path_, &header, sizeof(header))) {
+                error = "cannot create " + path_;
+                return false;
+            }
+        } else if (fileSize > sizeof(StoreHeader) && (fileSize - sizeof(StoreHeader)) % sizeof(StoreRecord) != 0) {
+            // Appends must start on a record boundary
+            const uintmax_t whole = fileSize - (fileSize - sizeof(StoreHeader)) % sizeof(StoreRecord);
+            logEvent(LogLevel::WARN, L"Timing store: dropped {} bytes of a torn record", static_cast<int64_t>(fileSize - whole));
+            std::filesystem::resize_file(path_, whole, ec);
+        }
+
+        if (!reload()) {
+            error = path_ + " is not a timing store";
+            return false;
+        }
+        if (recordCount_ > kCompactThreshold && !compactLocked()) {
+            error = "cannot compact " + path_;
+            return false;
+        }
+        return true;
+    }
+
+    bool TimingStore::compact() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return compactLocked();
+    }
+
+    bool TimingStore::compactLocked() {
+        const size_t before = recordCount_;
+        std::vector<uint8_t> compacted;
+        {
+            // Walk from the newest record back, keeping the first kKeepPerUpdate of each update and phase
+            const StoreRecord* records = reinterpret_cast<const StoreRecord*>(file_.data() + sizeof(StoreHeader));
+            std::unordered_map<std::string, size_t> kept;
+            std::vector<uint8_t> keep(recordCount_, 0);
+            for (size_t i = recordCount_; i-- > 0;) {
+                std::string key(records[i].updateId, sizeof(records[i].updateId));
+                key += static_cast<char>('0' + records[i].phase);
+                if (kept[key]++ < kKeepPerUpdate) {
+                    keep[i] = 1;
+                }
+            }
+
+            const StoreHeader header = makeHeader();
+            const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&header);
+            compacted.assign(bytes, bytes + sizeof(header));
+            for (size_t i = 0; i < recordCount_; i++) {
+                if (keep[i] != 0) {
+                    bytes = reinterpret_cast<const uint8_t*>(&records[i]);
+                    compacted.insert(compacted.end(), bytes, bytes + sizeof(StoreRecord));
+                }
+            }
+        }
+
+        // The mapping has to go before the file can be replaced
+        file_.close();
+        const bool replaced = writeFileAtomically(path_, compacted.data(), compacted.size());
+        if (!reload() || !replaced) {
+            return false;
+        }
+        logEvent(LogLevel::INFO, L"Timing store compacted from {} to {} records",
+                 static_cast<int64_t>(before), static_cast<int64_t>(recordCount_));
+        return true;
+    }
+
+    bool TimingStore::reload() {
+        file_.close();
+        index_.clear();
+        recordCount_ = 0;
+        if (!file_.open(path_) || file_.size() < sizeof(StoreHeader)) {
+            return false;
+        }
+        StoreHeader header;
+        std::memcpy(&header, file_.data(), sizeof(header));
+        if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion ||
+            header.recordSize != sizeof(StoreRecord)) {
+            return false;
+        }
+
+        recordCount_ = (file_.size() - sizeof(StoreHeader)) / sizeof(StoreRecord);
+        const StoreRecord* records = reinterpret_cast<const StoreRecord*>(file_.data() + sizeof(StoreHeader));
+        for (size_t i = 0; i < recordCount_; i++) {
+            const StoreRecord& record = records[i];
+            if (record.result != static_cast<uint8_t>(ResultCode::SUCCEEDED)) {
+                continue;
+            }
+            const TimingPhase phase = static_cast<TimingPhase>(record.phase);
+            if (record.kb != 0) {
+                index_[indexKey(phase, KEY_KB, record.kb)].push_back(static_cast<uint32_t>(i));
+            }
+            if (record.classification != 0) {
+                index_[indexKey(phase, KEY_CLASSIFICATION, record.classification)].push_back(static_cast<uint32_t>(i));
+            }
+        }
+        return true;
+    }
+
+    bool TimingStore::record(const std::vector<TimingSample>& samples) {
+        if (samples.empty()) {
+            return true;
+        }
+
+        std::vector<StoreRecord> records(samples.size());
+        const int64_t now = static_cast<int64_t>(std::time(nullptr));
+        for (size_t i = 0; i < samples.size(); i++) {
+            const TimingSample& sample = samples[i];
+            StoreRecord& record = records[i];
+            std::memset(&record, 0, sizeof(record));
+            for (size_t c = 0; c < sample.updateId.size() && c < sizeof(record.updateId); c++) {
+                record.updateId[c] = static_cast<char>(sample.updateId[c]);
+            }
+            record.revision = sample.revision;
+            record.kb = sample.kb;
+            record.hresult = static_cast<int32_t>(sample.hresult);
+            record.size = sample.size;
+            record.recordedAt = now;
+            record.durationMs = sample.durationMs;
+            record.phase = static_cast<uint8_t>(sample.phase);
+            record.classification = static_cast<uint8_t>(sample.classification);
+            record.result = static_cast<uint8_t>(sample.result);
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        return appendBytes(path_, records.data(), records.size() * sizeof(StoreRecord));
+    }
+
+    bool TimingStore::percentileByKb(uint32_t kb, TimingPhase phase, double percentile, double& seconds,
+                                     size_t minSamples) const {
+        return kb != 0 && this->percentile(indexKey(phase, KEY_KB, kb), percentile, seconds, minSamples);
+    }
+
+    bool TimingStore::percentileByClassification(UpdateClassification classification, TimingPhase phase,
+                                                 double percentile, double& seconds, size_t minSamples) const {
+        return classification != UpdateClassification::UNSPECIFIED &&
+               this->percentile(indexKey(phase, KEY_CLASSIFICATION, static_cast<uint32_t>(classification)),
+                                percentile, seconds, minSamples);
+    }
+
+    bool TimingStore::percentile(uint64_t key, double percentile, double& seconds, size_t minSamples) const {
+        auto found = index_.find(key);
+        if (found == index_.end() || found->second.size() < (std::max)(minSamples, static_cast<size_t>(1))) {
+            return false;
+        }
+
+        const StoreRecord* records = reinterpret_cast<const StoreRecord*>(file_.data() + sizeof(StoreHeader));
+        std::vector<uint32_t> durations;
+        durations.reserve(found->second.size());
+        for (uint32_t i : found->second) {
+            durations.push_back(records[i].durationMs);
+        }
+        std::sort(durations.begin(), durations.end());
+
+        // Linear interpolation between the closest ranks
+        const double rank = (std::min)((std::max)(percentile, 0.0), 100.0) / 100 * (durations.size() - 1);
+        const size_t lower = static_cast<size_t>(std::floor(rank));
+        const size_t upper = (std::min)(lower + 1, durations.size() - 1);
+        const double fraction = rank - static_cast<double>(lower);
+        seconds = (durations[lower] + (static_cast<double>(durations[upper]) - durations[lower]) * fraction) / 1000;
+        return true;
+    }
+
+    DurationEstimate HistoryEstimator::estimate(const UpdateTable& table, size_t row) const {
+        DurationEstimate estimate = fallback_.estimate(table, row);
+        const uint32_t kb = table.kbCount(row) > 0 ? table.kbArticleId(row, 0) : 0;
+        const UpdateClassification classification = table.classification(row);
+
+        double seconds = 0;
+        if (store_.percentileByKb(kb, TimingPhase::DOWNLOAD, percentile_, seconds) ||
+            store_.percentileByClassification(classification, TimingPhase::DOWNLOAD, percentile_, seconds)) {
+            estimate.downloadSeconds = seconds;
+        }
+        if (store_.percentileByKb(kb, TimingPhase::INSTALL, percentile_, seconds) ||
+            store_.percentileByClassification(classification, TimingPhase::INSTALL, percentile_, seconds)) {
+            estimate.installSeconds = seconds;
+        }
+        return estimate;
+    }
+
+} // namespace WUpdater
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "mapped_file.h"
+#include "update_backend.h"
+#include "update_table.h"
+#include "window_scheduler.h"
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace WUpdater {
+
+    enum class TimingPhase {
+        DOWNLOAD = 0,
+        INSTALL = 1
+    };
+
+    // One measured download or install of one update
+    struct TimingSample {
+        std::wstring updateId;
+        int32_t revision = 0;
+        uint32_t kb = 0;                        // First KB article; 0 if the update has none
+        UpdateClassification classification = UpdateClassification::UNSPECIFIED;
+        TimingPhase phase = TimingPhase::DOWNLOAD;
+        int64_t size = 0;                       // MaxDownloadSize
+        uint32_t durationMs = 0;
+        ResultCode result = ResultCode::NOT_STARTED;
+        HRESULT hresult = S_OK;
+    };
+
+    /**
+     * @brief Download and install times recorded on this host, by update.
+     *
+     * The file is a header followed by fixed 80-byte records and is only
+     * appended to, so it can be shared by runs and read through a mapping.
+     * Queries go through an index of the successful samples by KB and by
+     * classification, built when the file is opened. A partial record at the
+     * end, from a writer that died mid-write, is cut off on open.
+     *
+     * Once the file holds more than kCompactThreshold records, opening it
+     * compacts it: only the newest samples of each update and phase are kept,
+     * written to a new file that replaces the old one. Hosts of one class
+     * share a file; different classes should use different files.
+     */
+    class TimingStore {
+    public:
+        static const size_t kCompactThreshold = 100000;
+        static const size_t kKeepPerUpdate = 16;       // Per phase, when compacting
+
+        explicit TimingStore(const std::string& path);
+
+        // Create the file if needed, compact it if it has grown too large, and map it
+        bool open(std::string& error);
+
+        // Append samples to the file; they are queried from the next open on
+        bool record(const std::vector<TimingSample>& samples);
+
+        // Rewrite the file with only the newest kKeepPerUpdate samples of each update and phase
+        bool compact();
+
+        // Records in the mapped file
+        size_t size() const { return recordCount_; }
+
+        // The given percentile (0-100) of successful durations in seconds;
+        // false if fewer than minSamples were recorded
+        bool percentileByKb(uint32_t kb, TimingPhase phase, double percentile, double& seconds,
+                            size_t minSamples = 3) const;
+        bool percentileByClassification(UpdateClassification classification, TimingPhase phase,
+                                        double percentile, double& seconds, size_t minSamples = 3) const;
+
+    private:
+        std::string path_;
+        std::mutex mutex_;                      // Serializes appends from concurrent phases and compaction
+        MappedFile file_;
+        size_t recordCount_;
+        std::unordered_map<uint64_t, std::vector<uint32_t>> index_;    // Phase, key kind and value -> records
+
+        bool reload();
+        bool compactLocked();
+        bool percentile(uint64_t key, double percentile, double& seconds, size_t minSamples) const;
+    };
+
+    /**
+     * @brief Estimates from recorded timings, falling back to another estimator.
+     *
+     * Each phase is estimated from the update's KB if enough samples exist,
+     * otherwise from its classification, otherwise by the fallback.
+     */
+    class HistoryEstimator : public DurationEstimator {
+    public:
+        HistoryEstimator(const TimingStore& store, double percentile, const DurationEstimator& fallback)
+            : store_(store), percentile_(percentile), fallback_(fallback) {}
+
+        DurationEstimate estimate(const UpdateTable& table, size_t row) const override;
+
+    private:
+        const TimingStore& store_;
+        double percentile_;
+        const DurationEstimator& fallback_;
+    };
+
+} // namespace WUpdater
@@ -0,0 +1,23 @@
+#include "update_backend.h"
+#include "update_table.h"
+
+namespace WUpdater {
+
+    HRESULT UpdateBackend::readUpdates(const std::vector<UpdateHandle>& handles, size_t begin, size_t end,
+                                       UpdateTable& table) {
+        HRESULT result = S_OK;
+        UpdateRecord record;
+        for (size_t i = begin; i < end && i < handles.size(); i++) {
+            HRESULT hr = getUpdate(handles[i], record);
+            if (FAILED(hr)) {
+                if (SUCCEEDED(result)) {
+                    result = hr;
+                }
+                continue;
+            }
+            table.append(record);
+        }
+        return result;
+    }
+
+} // namespace WUpdater
@@ -0,0 +1,254 @@
+#pragma once
+
+#include "platform.h"
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace WUpdater {
+
+    // Progress callback phases
+    enum class ProgressPhase {
+        BEGIN = 0,
+        SEARCHING = 1,
+        DOWNLOADING = 2,
+        INSTALLING = 3,
+        END = 4
+    };
+
+    // Operation result codes (same values as the WUA OperationResultCode enum)
+    enum class ResultCode {
+        NOT_STARTED = 0,
+        IN_PROGRESS = 1,
+        SUCCEEDED = 2,
+        SUCCEEDED_WITH_ERRORS = 3,
+        FAILED = 4,
+        ABORTED = 5
+    };
+
+    // MSRC severity rating of an update (IUpdate::MsrcSeverity)
+    enum class Severity {
+        UNSPECIFIED = 0,
+        LOW = 1,
+        MODERATE = 2,
+        IMPORTANT = 3,
+        CRITICAL = 4
+    };
+
+    // How an update's installation affects the system
+    // (same values as the WUA InstallationImpact enum)
+    enum class InstallImpact {
+        NORMAL = 0,
+        MINOR = 1,
+        EXCLUSIVE = 2                   // Must be installed on its own
+    };
+
+    // Whether installing an update restarts the machine
+    // (same values as the WUA InstallationRebootBehavior enum)
+    enum class RebootBehavior {
+        NEVER = 0,
+        ALWAYS = 1,
+        CAN_REQUEST = 2
+    };
+
+    // The agent's UpdateClassification category of an update
+    enum class UpdateClassification {
+        UNSPECIFIED = 0,
+        SECURITY_UPDATES = 1,
+        CRITICAL_UPDATES = 2,
+        DEFINITION_UPDATES = 3,
+        DRIVERS = 4,
+        FEATURE_PACKS = 5,
+        SERVICE_PACKS = 6,
+        TOOLS = 7,
+        UPDATE_ROLLUPS = 8,
+        UPDATES = 9,
+        UPGRADES = 10
+    };
+
+    // Progress callback typedef
+    typedef void (*UpdateProgressCallback)(ProgressPhase phase, unsigned int progress, void* context);
+
+    // Opaque reference to an update found by a backend search.
+    // Only the backend that produced a handle knows how to interpret it.
+    struct UpdateHandle {
+        uint32_t resultSet = 0;
+        uint32_t index = 0;
+    };
+
+    // Portable snapshot of the IUpdate properties the tool works with
+    struct UpdateRecord {
+        UpdateHandle handle;
+        std::wstring updateId;
+        int32_t revision = 0;
+        std::wstring title;
+        std::vector<uint32_t> kbArticleIds;
+        int64_t maxDownloadSize = 0;
+        double releaseDate = 0;         // OLE automation DATE (days since 1899-12-30)
+        bool isDownloaded = false;
+        bool isInstalled = false;
+        Severity severity = Severity::UNSPECIFIED;
+        InstallImpact impact = InstallImpact::NORMAL;
+        RebootBehavior reboot = RebootBehavior::NEVER;
+        UpdateClassification classification = UpdateClassification::UNSPECIFIED;
+    };
+
+    class UpdateTable;
+
+    // Per-update result of a download or install operation
+    struct UpdateOutcome {
+        ResultCode result = ResultCode::NOT_STARTED;
+        HRESULT hresult = S_OK;
+        bool rebootRequired = false;
+    };
+
+    // Byte-level progress of a download job
+    struct DownloadProgress {
+        size_t currentUpdate = 0;           // Position of the update being downloaded
+        size_t updateCount = 0;
+        int64_t currentBytesDone = 0;
+        int64_t currentBytesTotal = 0;
+        int64_t totalBytesDone = 0;
+        int64_t totalBytesTotal = 0;
+        unsigned percentComplete = 0;
+    };
+
+    /**
+     * @brief Receives events from a running download.
+     *
+     * Methods may be called on a backend-owned thread and must not block for
+     * long. Positions refer to the handle list passed to download().
+     */
+    class DownloadObserver {
+    public:
+        virtual ~DownloadObserver() = default;
+
+        // Periodic byte counts for the job
+        virtual void onProgress(const DownloadProgress& progress) { (void)progress; }
+
+        // One update finished downloading (successfully or not)
+        virtual void onUpdateDownloaded(size_t position, const UpdateOutcome& outcome) {
+            (void)position;
+            (void)outcome;
+        }
+
+        // Polled while the job runs; returning true aborts the download
+        virtual bool cancelRequested() { return false; }
+    };
+
+    // One payload file of an update, as the agent would download it
+    struct ContentFile {
+        std::wstring name;                  // File name, e.g. windows10.0-kb5034441-x64_<digest>.cab
+        std::wstring url;                   // Where the agent fetches it from
+        int32_t bundle = -1;                // Index into the update's bundled updates; -1 for the update itself
+    };
+
+    // Limits and feedback for a single search
+    struct SearchOptions {
+        unsigned timeoutSeconds = 0;                // 0 waits for the search indefinitely
+        unsigned heartbeatSeconds = 5;              // Interval of SEARCHING progress reports
+        const std::atomic<bool>* cancel = nullptr;  // Set to abort the search early
+        UpdateProgressCallback callback = nullptr;  // Receives elapsed seconds as progress
+        void* context = nullptr;
+    };
+
+    // Where searches are answered from and when the agent last ran a detection.
+    // Search results are only comparable between runs with the same context.
+    struct SearchContext {
+        std::wstring serverSelection;   // Update source, e.g. "wu", "wsus:https://server"
+        double lastDetection = 0;       // OLE automation DATE of the last successful detection
+    };
+
+    /**
+     * @brief Source of updates the UpdateManager drives.
+     *
+     * The Windows Update Agent backend (wua_backend.h) talks to
+     * IUpdateSession and friends; the simulated backend (simulated_backend.h)
+     * serves a synthetic catalog in-process so the engine can be built and
+     * exercised on any platform.
+     *
+     * Every method returns the HRESULT of the underlying operation. Outcome
+     * vectors are resized to, and ordered like, the handle list passed in.
+     * search() and getIdentity() may be called from several threads at once.
+     */
+    class UpdateBackend {
+    public:
+        virtual ~UpdateBackend() = default;
+
+        // Short backend name for diagnostics (e.g. "wua", "simulated")
+        virtual std::wstring name() const = 0;
+
+        // Run a search and append a handle for every matching update.
+        // Returns WU_E_TIME_OUT when the timeout expires and WU_E_CALL_CANCELLED
+        // when the cancel flag is raised; the search is aborted in both cases.
+        virtual HRESULT search(const std::wstring& criteria, const SearchOptions& options,
+                               std::vector<UpdateHandle>& found) = 0;
+
+        // Look up updates by UpdateID without a full detection. Appends a handle
+        // for every ID the agent still knows; unknown IDs are skipped.
+        virtual HRESULT findByIdentity(const std::vector<std::wstring>& updateIds,
+                                       std::vector<UpdateHandle>& found) = 0;
+
+        // Describe the update source and the last detection time
+        virtual HRESULT getSearchContext(SearchContext& context) = 0;
+
+        // Drop the results of every earlier search; their handles become invalid.
+        // Long-running processes call this so result sets do not pile up.
+        virtual void releaseSearches() {}
+
+        // Whether other threads may call the backend while the calling thread
+        // waits for them. False when the caller owns objects that other threads
+        // reach only through it, such as COM objects in an STA that does not
+        // pump messages while it waits; concurrent phases then run serially.
+        virtual bool allowsConcurrentCalls() const { return true; }
+
+        // Read the metadata of one update found by a previous search
+        virtual HRESULT getUpdate(const UpdateHandle& handle, UpdateRecord& record) = 0;
+
+        // Append the metadata of handles[begin, end) to table in one pass, skipping
+        // updates that cannot be read. Returns the first failure, if any.
+        // The default reads each update with getUpdate().
+        virtual HRESULT readUpdates(const std::vector<UpdateHandle>& handles, size_t begin, size_t end,
+                                    UpdateTable& table);
+
+        // Read only the UpdateIdentity (UpdateID and RevisionNumber) of an update
+        virtual HRESULT getIdentity(const UpdateHandle& handle, std::wstring& updateId, int32_t& revision) = 0;
+
+        // Download the payloads of the given updates, reporting to the observer if one is given
+        virtual HRESULT download(const std::vector<UpdateHandle>& updates,
+                                 std::vector<UpdateOutcome>& outcomes,
+                                 DownloadObserver* observer) = 0;
+
+        // Install the given updates
+        virtual HRESULT install(const std::vector<UpdateHandle>& updates,
+                                std::vector<UpdateOutcome>& outcomes,
+                                UpdateProgressCallback callback, void* context) = 0;
+
+        // List the payload files of an update (IUpdate::DownloadContents of it and its bundled updates)
+        virtual HRESULT getContentFiles(const UpdateHandle& handle, std::vector<ContentFile>& files) {
+            (void)handle;
+            (void)files;
+            return E_NOTIMPL;
+        }
+
+        // Fetch one payload file from its source to path, bypassing the agent's cache
+        virtual HRESULT fetchContentFile(const ContentFile& file, const std::string& path) {
+            (void)file;
+            (void)path;
+            return E_NOTIMPL;
+        }
+
+        // Place payload files already on disk into the agent's download cache
+        // (IUpdate2::CopyToCache); paths[i] holds files[i]. The update then
+        // counts as downloaded.
+        virtual HRESULT copyToCache(const UpdateHandle& handle, const std::vector<ContentFile>& files,
+                                    const std::vector<std::string>& paths) {
+            (void)handle;
+            (void)files;
+            (void)paths;
+            return E_NOTIMPL;
+        }
+    };
+
+} // namespace WUpdater
@@ -0,0 +1,205 @@
+#include "update_list.h"
+#include <fstream>
+
+namespace WUpdater {
+
+    namespace {
+
+        uint64_t mix(uint64_t value) {
+            value ^= value >> 33;
+            value *= 0xFF51AFD7ED558CCDULL;
+            value ^= value >> 33;
+            return value;
+        }
+
+        int hexValue(wchar_t c) {
+            if (c >= L'0' && c <= L'9') {
+                return c - L'0';
+            }
+            if (c >= L'a' && c <= L'f') {
+                return c - L'a' + 10;
+            }
+            if (c >= L'A' && c <= L'F') {
+                return c - L'A' + 10;
+            }
+            return -1;
+        }
+
+        // 8-4-4-4-12 hex digits, optionally in braces
+        template <typename Char>
+        bool parseGuidText(std::basic_string_view<Char> text, uint64_t& high, uint64_t& low) {
+            if (text.size() == 38 && text.front() == '{' && text.back() == '}') {
+                text = text.substr(1, 36);
+            }
+            if (text.size() != 36) {
+                return false;
+            }
+            high = 0;
+            low = 0;
+            unsigned digits = 0;
+            for (size_t i = 0; i < text.size(); i++) {
+                if (i == 8 || i == 13 || i == 18 || i == 23) {
+                    if (text[i] != '-') {
+                        return false;
+                    }
+                    continue;
+                }
+                int value = hexValue(static_cast<wchar_t>(text[i]));
+                if (value < 0) {
+                    return false;
+                }
+                uint64_t& half = digits < 16 ? high : low;
+                half = (half << 4) | static_cast<uint64_t>(value);
+                digits++;
+            }
+            return true;
+        }
+
+        bool parseKb(std::string_view text, uint32_t& kb) {
+            if (text.size() > 2 && (text[0] == 'K' || text[0] == 'k') && (text[1] == 'B' || text[1] == 'b')) {
+                text.remove_prefix(2);
+            }
+            if (text.empty() || text.size() > 10) {
+                return false;
+            }
+            uint64_t value = 0;
+            for (char c : text) {
+                if (c < '0' || c > '9') {
+                    return false;
+                }
+                value = value * 10 + static_cast<uint64_t>(c - '0');
+            }
+            if (value == 0 || value > UINT32_MAX) {
+                return false;
+            }
+            kb = static_cast<uint32_t>(value);
+            return true;
+        }
+
+        // Power of two with room for count keys at half load
+        size_t tableSize(size_t count) {
+            size_t size = 1;
+            while (size < count * 2) {
+                size <<= 1;
+            }
+            return size;
+        }
+
+    } // namespace
+
+    bool UpdateList::parseGuid(std::string_view text, Guid& guid) {
+        return parseGuidText(text, guid.high, guid.low) && (guid.high != 0 || guid.low != 0);
+    }
+
+    bool UpdateList::parseGuid(std::wstring_view text, Guid& guid) {
+        return parseGuidText(text, guid.high, guid.low) && (guid.high != 0 || guid.low != 0);
+    }
+
+    bool UpdateList::load(const std::string& path, std::string& error) {
+        std::ifstream file(path);
+        if (!file.is_open()) {
+            error = "cannot open " + path;
+            return false;
+        }
+
+        std::vector<uint32_t> kbs;
+        std::vector<Guid> ids;
+        std::string line;
+        size_t lineNumber = 0;
+        while (std::getline(file, line)) {
+            lineNumber++;
+            std::string_view rest(line);
+            rest = rest.substr(0, rest.find('#'));
+
+            while (true) {
+                size_t start = rest.find_first_not_of(" \t\r,");
+                if (start == std::string_view::npos) {
+                    break;
+                }
+                size_t end = rest.find_first_of(" \t\r,", start);
+                std::string_view entry = rest.substr(start, end == std::string_view::npos ? std::string_view::npos : end - start);
+                rest = end == std::string_view::npos ? std::string_view() : rest.substr(end);
+
+                uint32_t kb = 0;
+                Guid guid;
+                if (parseKb(entry, kb)) {
+                    kbs.push_back(kb);
+                } else if (parseGuid(entry, guid)) {
+                    ids.push_back(guid);
+                } else {
+                    error = path + ", line " + std::to_string(lineNumber) + ": '" + std::string(entry) +
+                            "' is neither a KB number nor an UpdateID";
+                    return false;
+                }
+            }
+        }
+
+        build(kbs, ids);
+        return true;
+    }
+
+    void UpdateList::build(const std::vector<uint32_t>& kbs, const std::vector<Guid>& ids) {
+        kbSlots_.assign(tableSize(kbs.size()), 0);
+        kbCount_ = 0;
+        const size_t kbMask = kbSlots_.size() - 1;
+        for (uint32_t kb : kbs) {
+            size_t slot = static_cast<size_t>(mix(kb)) & kbMask;
+            while (kbSlots_[slot] != 0 && kbSlots_[slot] != kb) {
+                slot = (slot + 1) & kbMask;
+            }
+            kbCount_ += kbSlots_[slot] == 0 ? 1 : 0;
+            kbSlots_[slot] = kb;
+        }
+
+        idSlots_.assign(tableSize(ids.size()), Guid{ 0, 0 });
+        idCount_ = 0;
+        const size_t idMask = idSlots_.size() - 1;
+        for (const Guid& id : ids) {
+            size_t slot = static_cast<size_t>(mix(id.high ^ mix(id.low))) & idMask;
+            while ((idSlots_[slot].high != 0 || idSlots_[slot].low != 0) &&
+                   (idSlots_[slot].high != id.high || idSlots_[slot].low != id.low)) {
+                slot = (slot + 1) & idMask;
+            }
+            idCount_ += idSlots_[slot].high == 0 && idSlots_[slot].low == 0 ? 1 : 0;
+            idSlots_[slot] = id;
+        }
+    }
+
+    bool UpdateList::containsKb(uint32_t kb) const {
+        if (kbCount_ == 0 || kb == 0) {
+            return false;
+        }
+        const size_t mask = kbSlots_.size() - 1;
+        for (size_t slot = static_cast<size_t>(mix(kb)) & mask; kbSlots_[slot] != 0; slot = (slot + 1) & mask) {
+            if (kbSlots_[slot] == kb) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool UpdateList::containsUpdateId(std::wstring_view updateId) const {
+        Guid id;
+        if (idCount_ == 0 || !parseGuid(updateId, id)) {
+            return false;
+        }
+        const size_t mask = idSlots_.size() - 1;
+        for (size_t slot = static_cast<size_t>(mix(id.high ^ mix(id.low))) & mask;
+             idSlots_[slot].high != 0 || idSlots_[slot].low != 0; slot = (slot + 1) & mask) {
+            if (idSlots_[slot].high == id.high && idSlots_[slot].low == id.low) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool UpdateList::contains(const UpdateTable& table, size_t row) const {
+        for (size_t i = 0; i < table.kbCount(row); i++) {
+            if (containsKb(table.kbArticleId(row, i))) {
+                return true;
+            }
+        }
+        return containsUpdateId(table.updateId(row));
+    }
+
+} // namespace WUpdater
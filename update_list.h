@@ -0,0 +1,51 @@
+#pragma once
+
+#include "update_table.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace WUpdater {
+
+    /**
+     * @brief Set of KB article numbers and UpdateIDs from an allow-list or deny-list.
+     *
+     * The list file holds entries separated by whitespace, commas or line
+     * breaks: KB numbers with or without the "KB" prefix, and UpdateIDs as
+     * GUIDs; '#' starts a comment. Both kinds are kept in open-addressing hash
+     * tables of fixed-size keys (GUIDs as two 64-bit halves), at most half
+     * full, so a lookup probes a slot or two whatever the list's length and
+     * never allocates.
+     */
+    class UpdateList {
+    public:
+        // Read a list file; error receives the path or line of the first problem
+        bool load(const std::string& path, std::string& error);
+
+        bool empty() const { return kbCount_ == 0 && idCount_ == 0; }
+        size_t size() const { return kbCount_ + idCount_; }
+
+        bool containsKb(uint32_t kb) const;
+        bool containsUpdateId(std::wstring_view updateId) const;
+
+        // True if the row's UpdateID or any of its KB articles is listed
+        bool contains(const UpdateTable& table, size_t row) const;
+
+    private:
+        struct Guid {
+            uint64_t high;
+            uint64_t low;
+        };
+
+        std::vector<uint32_t> kbSlots_;         // 0 marks a free slot; KB 0 does not exist
+        std::vector<Guid> idSlots_;             // The nil GUID marks a free slot
+        size_t kbCount_ = 0;
+        size_t idCount_ = 0;
+
+        static bool parseGuid(std::string_view text, Guid& guid);
+        static bool parseGuid(std::wstring_view text, Guid& guid);
+        void build(const std::vector<uint32_t>& kbs, const std::vector<Guid>& ids);
+    };
+
+} // namespace WUpdater
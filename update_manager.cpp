@@ -0,0 +1,1718 @@
+#include "update_manager.h"
+#include "download_scheduler.h"
+#include "error_messages.h"
+#include "logger.h"
+#include "messages.h"
+#include "metrics.h"
+#include "progress_renderer.h"
+#include "utf8.h"
+#include "snapshot.h"
+#include "worker_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace WUpdater {
+
+    // Check HRESULT and print error if needed
+    int checkHResult(HRESULT hr) {
+        if (FAILED(hr)) {
+            logEvent(LogLevel::ERR, L"Operation failed with {x}", hr);
+            std::wcout << L"[!] Error code: 0x" << std::hex << static_cast<uint32_t>(hr) << std::dec << std::endl;
+            ErrorMessages::ErrorDescription error = ErrorMessages::describeError(hr);
+            std::wcout << L"[!] " << error.message;
+            if (!error.exact && !error.facilityName.empty()) {
+                // Classified by range, so name what was decoded
+                std::wcout << L" (" << error.facilityName << L" code " << error.code << L")";
+            }
+            std::wcout << std::endl;
+            return -1;
+        }
+        return 0;
+    }
+
+    size_t formatDate(double oleDate, wchar_t* buffer, size_t size) {
+        // OLE dates count days from 1899-12-30; convert to days since the Unix epoch
+        long long days = static_cast<long long>(std::floor(oleDate)) - 25569;
+
+        // Civil-from-days conversion (proleptic Gregorian calendar)
+        days += 719468;
+        long long era = (days >= 0 ? days : days - 146096) / 146097;
+        long long dayOfEra = days - era * 146097;
+        long long yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+        long long dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+        long long mp = (5 * dayOfYear + 2) / 153;
+        long long day = dayOfYear - (153 * mp + 2) / 5 + 1;
+        long long month = mp < 10 ? mp + 3 : mp - 9;
+        long long year = yearOfEra + era * 400 + (month <= 2 ? 1 : 0);
+
+        int length = std::swprintf(buffer, size, L"%04lld-%02lld-%02lld", year, month, day);
+        return length > 0 ? static_cast<size_t>(length) : 0;
+    }
+
+    std::wstring formatDate(double oleDate) {
+        wchar_t buffer[16];
+        return std::wstring(buffer, formatDate(oleDate, buffer, sizeof(buffer) / sizeof(buffer[0])));
+    }
+
+    // Default progress callback
+    void updateProgressCallbackDefault(ProgressPhase phase, unsigned int progress, void* /*context*/) {
+        switch (phase) {
+            case ProgressPhase::BEGIN:
+                std::wcout << L"Progress: Begin " << progress << std::endl;
+                break;
+            case ProgressPhase::SEARCHING:
+                std::wcout << L"Progress: Searching " << progress << L"s elapsed" << std::endl;
+                break;
+            case ProgressPhase::DOWNLOADING:
+                std::wcout << L"Progress: Downloading " << progress << L"%" << std::endl;
+                break;
+            case ProgressPhase::INSTALLING:
+                std::wcout << L"Progress: Installing " << progress << std::endl;
+                break;
+            case ProgressPhase::END:
+                std::wcout << L"Progress: End " << progress << std::endl;
+                break;
+            default:
+                std::wcout << L"Progress: Unknown phase" << std::endl;
+                break;
+        }
+    }
+
+    namespace {
+
+        // Shortest gap between two download progress lines
+        const unsigned kProgressIntervalMs = 1000;
+
+        // Lists shorter than this per thread are read on the calling thread
+        const size_t kMinRowsPerReader = 32;
+
+        uint64_t handleKey(const UpdateHandle& handle) {
+            return (static_cast<uint64_t>(handle.resultSet) << 32) | handle.index;
+        }
+
+        // Values of the severity and result fields in machine-readable output
+        const wchar_t* severityName(Severity severity) {
+            switch (severity) {
+                case Severity::LOW: return L"low";
+                case Severity::MODERATE: return L"moderate";
+                case Severity::IMPORTANT: return L"important";
+                case Severity::CRITICAL: return L"critical";
+                default: return L"";
+            }
+        }
+
+        // Wall time of one UpdateManager phase (search, enumerate, download, install)
+        Histogram& phaseDuration(const char* phase) {
+            return MetricsRegistry::instance().histogram("wupdater_phase_duration_seconds",
+                                                         "Duration of each update phase", { { "phase", phase } });
+        }
+
+        const wchar_t* resultName(ResultCode rc) {
+            switch (rc) {
+                case ResultCode::NOT_STARTED: return L"not_started";
+                case ResultCode::IN_PROGRESS: return L"in_progress";
+                case ResultCode::SUCCEEDED: return L"succeeded";
+                case ResultCode::SUCCEEDED_WITH_ERRORS: return L"succeeded_with_errors";
+                case ResultCode::FAILED: return L"failed";
+                case ResultCode::ABORTED: return L"aborted";
+                default: return L"unknown";
+            }
+        }
+
+        // Passes download events on and notes when each update finished, so
+        // per-update times can be told apart within one download job
+        class CompletionClock : public DownloadObserver {
+        public:
+            CompletionClock(DownloadObserver* next, size_t count) : next_(next), finished_(count) {}
+
+            void onProgress(const DownloadProgress& progress) override {
+                if (next_ != nullptr) {
+                    next_->onProgress(progress);
+                }
+            }
+
+            void onUpdateDownloaded(size_t position, const UpdateOutcome& outcome) override {
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    if (position < finished_.size()) {
+                        finished_[position] = std::chrono::steady_clock::now();
+                    }
+                }
+                if (next_ != nullptr) {
+                    next_->onUpdateDownloaded(position, outcome);
+                }
+            }
+
+            bool cancelRequested() override { return next_ != nullptr && next_->cancelRequested(); }
+
+            // Default-constructed if the update was never reported
+            std::chrono::steady_clock::time_point finished(size_t position) const { return finished_[position]; }
+
+        private:
+            DownloadObserver* next_;
+            std::mutex mutex_;
+            std::vector<std::chrono::steady_clock::time_point> finished_;
+        };
+
+        // State shared between the download thread and the installing thread
+        struct PipelineState {
+            std::mutex mutex;
+            std::condition_variable changed;
+            std::vector<UpdateHandle> downloaded;       // Finished downloads not yet reported
+            std::vector<UpdateOutcome> outcomes;        // Outcomes of the downloaded entries
+            std::vector<UpdateHandle> ready;            // Cached updates waiting for install
+            bool downloadsDone = false;
+        };
+
+        // Hands every finished download over to the installing thread. While a
+        // retry round may follow, retryable failures are held back instead, so
+        // only final outcomes are reported.
+        class PipelineObserver : public DownloadObserver {
+        public:
+            PipelineObserver(PipelineState& state, const std::vector<UpdateHandle>& updates,
+                             const std::atomic<bool>* cancel, bool holdRetryable)
+                : state_(state), updates_(updates), cancel_(cancel), positions_(updates.size()),
+                  status_(updates.size(), PENDING), outcomes_(updates.size()), holdRetryable_(holdRetryable) {
+                for (size_t i = 0; i < positions_.size(); i++) {
+                    positions_[i] = i;
+                }
+            }
+
+            void onUpdateDownloaded(size_t position, const UpdateOutcome& outcome) override {
+                std::lock_guard<std::mutex> lock(state_.mutex);
+                if (position < positions_.size()) {
+                    settle(positions_[position], outcome);
+                }
+            }
+
+            bool cancelRequested() override {
+                return cancel_ != nullptr && cancel_->load();
+            }
+
+            // Settle the updates the job never got to with its result and return
+            // the positions (in the update list) held back for another round
+            std::vector<size_t> endRound(HRESULT hr) {
+                std::lock_guard<std::mutex> lock(state_.mutex);
+                for (size_t item : positions_) {
+                    if (status_[item] == PENDING) {
+                        UpdateOutcome outcome;
+                        outcome.result = FAILED(hr) ? ResultCode::FAILED : ResultCode::ABORTED;
+                        outcome.hresult = FAILED(hr) ? hr : WU_E_CALL_CANCELLED;
+                        settle(item, outcome);
+                    }
+                }
+
+                std::vector<size_t> held;
+                for (size_t item : positions_) {
+                    if (status_[item] == HELD) {
+                        held.push_back(item);
+                    }
+                }
+                return held;
+            }
+
+            // Start a retry job over these list positions; the job reports by its own position
+            void beginRound(const std::vector<size_t>& items, bool holdRetryable) {
+                std::lock_guard<std::mutex> lock(state_.mutex);
+                positions_ = items;
+                for (size_t item : items) {
+                    status_[item] = PENDING;
+                }
+                holdRetryable_ = holdRetryable;
+            }
+
+            // Report whatever is still held back with its last outcome, then finish
+            void complete() {
+                std::lock_guard<std::mutex> lock(state_.mutex);
+                for (size_t item = 0; item < updates_.size(); item++) {
+                    if (status_[item] != REPORTED) {
+                        report(item, outcomes_[item]);
+                    }
+                }
+                state_.downloadsDone = true;
+                state_.changed.notify_one();
+            }
+
+        private:
+            enum Status : uint8_t { PENDING, HELD, REPORTED };
+
+            PipelineState& state_;
+            const std::vector<UpdateHandle>& updates_;
+            const std::atomic<bool>* cancel_;
+            std::vector<size_t> positions_;             // Update list position of each entry of the current job
+            std::vector<Status> status_;
+            std::vector<UpdateOutcome> outcomes_;       // Latest outcome of each update
+            bool holdRetryable_;
+
+            // Callers hold state_.mutex
+            void settle(size_t item, const UpdateOutcome& outcome) {
+                if (status_[item] != PENDING) {
+                    return;
+                }
+                outcomes_[item] = outcome;
+                if (holdRetryable_ && outcome.result != ResultCode::SUCCEEDED &&
+                    outcome.result != ResultCode::SUCCEEDED_WITH_ERRORS && isRetryable(outcome.hresult)) {
+                    status_[item] = HELD;
+                    return;
+                }
+                report(item, outcome);
+            }
+
+            void report(size_t item, const UpdateOutcome& outcome) {
+                status_[item] = REPORTED;
+                state_.downloaded.push_back(updates_[item]);
+                state_.outcomes.push_back(outcome);
+                if (outcome.result == ResultCode::SUCCEEDED || outcome.result == ResultCode::SUCCEEDED_WITH_ERRORS) {
+                    state_.ready.push_back(updates_[item]);
+                }
+                state_.changed.notify_one();
+            }
+        };
+
+        // Handles found by one query, with the identity key used for de-duplication
+        struct QueryResult {
+            HRESULT hr = S_OK;
+            std::vector<UpdateHandle> handles;
+            std::vector<std::wstring> keys;
+        };
+
+        // Funnels the heartbeats of concurrent searches into one report per interval
+        struct SharedHeartbeat {
+            UpdateProgressCallback callback;
+            void* context;
+            std::atomic<unsigned> lastReported;
+        };
+
+        void sharedHeartbeatCallback(ProgressPhase phase, unsigned int progress, void* context) {
+            SharedHeartbeat* heartbeat = static_cast<SharedHeartbeat*>(context);
+            unsigned previous = heartbeat->lastReported.load();
+            while (progress > previous) {
+                if (heartbeat->lastReported.compare_exchange_weak(previous, progress)) {
+                    heartbeat->callback(phase, progress, heartbeat->context);
+                    return;
+                }
+            }
+        }
+
+        void runQuery(UpdateBackend& backend, const std::wstring& criteria,
+                      const SearchOptions& options, QueryResult& result, bool identify) {
+            result.hr = backend.search(criteria, options, result.handles);
+            if (FAILED(result.hr) || !identify) {
+                return;
+            }
+
+            // Read identities here so de-duplication work is spread across the workers
+            result.keys.resize(result.handles.size());
+            std::wstring updateId;
+            int32_t revision = 0;
+            for (size_t i = 0; i < result.handles.size(); i++) {
+                if (SUCCEEDED(backend.getIdentity(result.handles[i], updateId, revision))) {
+                    result.keys[i] = updateId + L"#" + std::to_wstring(revision);
+                }
+            }
+        }
+
+    } // namespace
+
+    // UpdateManager implementation
+    UpdateManager::UpdateManager(UpdateBackend& backend)
+        : backend_(backend), initialized_(false), recordsLoaded_(false), cachedOnly_(false),
+          workerThreads_(1), metadataThreads_(1), downloadLanes_(1), cancel_(nullptr), writer_(nullptr),
+          allowList_(nullptr), denyList_(nullptr), contentCache_(nullptr), exportContent_(false),
+          streamChunk_(0), keepStreamedRows_(true), journal_(nullptr), deferredInstalls_(0),
+          windowBudget_(0), estimator_(nullptr), windowDeferred_(0), timings_(nullptr) {}
+
+    UpdateManager::~UpdateManager() {
+        // Handles are plain values; the backend owns the underlying update objects
+    }
+
+    int UpdateManager::searchForUpdates(const std::vector<std::wstring>& criteriaList, const SearchOptions& options) {
+        try {
+            std::wcout << L"\n" << Messages::Progress::searchingUpdates() << std::endl;
+            logEvent(LogLevel::INFO, L"Search started: {} queries, {} threads",
+                     static_cast<int64_t>(criteriaList.size()), workerThreads_);
+            const auto started = std::chrono::steady_clock::now();
+            ScopedTimer timer(phaseDuration("search"));
+
+            // The search sees only the server part of each query; the rest is
+            // applied to the metadata once it is read
+            std::vector<std::wstring> serverCriteria(criteriaList.size());
+            filters_.assign(criteriaList.size(), ClientFilter());
+            bool filtered = false;
+            for (size_t q = 0; q < criteriaList.size(); q++) {
+                CompiledCriteria compiled;
+                CriteriaError error;
+                if (!compileCriteria(criteriaList[q], compiled, error)) {
+                    std::wcout << Messages::Errors::invalidCriteria(static_cast<long>(q), error.position, error.message) << std::endl;
+                    return -1;
+                }
+                serverCriteria[q] = std::move(compiled.server);
+                filters_[q] = std::move(compiled.filter);
+                filtered = filtered || !filters_[q].empty();
+            }
+
+            // One search never returns an update twice; identities are only
+            // read when there are results to merge
+            const bool identify = criteriaList.size() > 1;
+            std::vector<QueryResult> results(criteriaList.size());
+            auto runQueries = [&](const std::vector<size_t>& queries) {
+                if (queries.size() == 1 || !backend_.allowsConcurrentCalls()) {
+                    for (size_t q : queries) {
+                        runQuery(backend_, serverCriteria[q], options, results[q], identify);
+                    }
+                    return;
+                }
+
+                SharedHeartbeat heartbeat;
+                heartbeat.callback = options.callback;
+                heartbeat.context = options.context;
+                heartbeat.lastReported = 0;
+
+                SearchOptions queryOptions = options;
+                if (options.callback) {
+                    queryOptions.callback = sharedHeartbeatCallback;
+                    queryOptions.context = &heartbeat;
+                }
+
+                unsigned threads = std::min<unsigned>(workerThreads_, static_cast<unsigned>(queries.size()));
+                WorkerPool pool(threads);
+                pool.run(queries.size(), [&](size_t i) {
+                    runQuery(backend_, serverCriteria[queries[i]], queryOptions, results[queries[i]], identify);
+                });
+            };
+
+            std::vector<size_t> queries(criteriaList.size());
+            for (size_t q = 0; q < queries.size(); q++) {
+                queries[q] = q;
+            }
+            runQueries(queries);
+
+            // Run only the queries that failed with a retryable error again. A time-out
+            // is final: the search already used all the time it was given.
+            RetryBackoff backoff(retryPolicy_, retryPolicy_.searchBudgetSeconds, started);
+            while (true) {
+                queries.clear();
+                for (size_t q = 0; q < results.size(); q++) {
+                    if (results[q].hr != WU_E_TIME_OUT && isRetryable(results[q].hr)) {
+                        queries.push_back(q);
+                    }
+                }
+
+                std::chrono::milliseconds delay(0);
+                if (queries.empty() || !backoff.next(delay)) {
+                    break;
+                }
+                announceRetry(ProgressPhase::SEARCHING, queries.size(), delay, backoff);
+                if (!RetryBackoff::wait(delay, options.cancel)) {
+                    break;
+                }
+                for (size_t q : queries) {
+                    results[q] = QueryResult();
+                }
+                runQueries(queries);
+            }
+
+            // Merge in query order, keeping the first occurrence of each UpdateID/revision
+            updatesList_.clear();
+            table_.clear();
+            rowByHandle_.clear();
+            recordsLoaded_ = false;
+            cachedOnly_ = false;
+            foundBy_.clear();
+            std::unordered_map<std::wstring, uint64_t> seen;
+            for (size_t q = 0; q < results.size(); q++) {
+                HRESULT hr = results[q].hr;
+                if (FAILED(hr)) {
+                    logEvent(LogLevel::ERR, L"Query {} failed with {x}", static_cast<int64_t>(q), hr);
+                }
+                if (FAILED(hr) && criteriaList.size() > 1) {
+                    std::wcout << Messages::Errors::queryFailed(static_cast<long>(q)) << std::endl;
+                }
+                if (hr == WU_E_TIME_OUT) {
+                    std::wcout << Messages::Errors::searchTimedOut(options.timeoutSeconds) << std::endl;
+                    return -1;
+                }
+                if (hr == WU_E_CALL_CANCELLED) {
+                    std::wcout << Messages::Errors::searchCancelled() << std::endl;
+                    return -1;
+                }
+                if (checkHResult(hr) != 0) {
+                    return -1;
+                }
+
+                const QueryResult& result = results[q];
+                for (size_t i = 0; i < result.handles.size(); i++) {
+                    uint64_t key = handleKey(result.handles[i]);
+                    if (identify && !result.keys[i].empty()) {
+                        auto first = seen.emplace(result.keys[i], key);
+                        key = first.first->second;
+                        if (!first.second) {
+                            if (filtered) {
+                                foundBy_[key].push_back(static_cast<uint32_t>(q));
+                            }
+                            continue;
+                        }
+                    }
+                    updatesList_.push_back(result.handles[i]);
+                    if (filtered) {
+                        foundBy_[key].push_back(static_cast<uint32_t>(q));
+                    }
+                }
+            }
+
+            if (criteriaList.size() > 1) {
+                std::wcout << Messages::Status::updatesFoundCount(static_cast<long>(updatesList_.size())) << std::endl;
+            }
+            MetricsRegistry::instance().gauge("wupdater_updates_found", "Updates found by the last search")
+                .set(static_cast<double>(updatesList_.size()));
+            logEvent(LogLevel::INFO, L"Search finished: {} updates in {} ms",
+                     static_cast<int64_t>(updatesList_.size()),
+                     std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started).count());
+
+            initialized_ = true;
+            return 0;
+
+        } catch (std::exception& e) {
+            std::wcout << L"[!] Exception: " << e.what() << std::endl;
+            return -1;
+        } catch (...) {
+            std::wcout << L"[!] Unknown error during search" << std::endl;
+            return -1;
+        }
+    }
+
+    void UpdateManager::announceRetry(ProgressPhase phase, size_t count, std::chrono::milliseconds delay,
+                                      const RetryBackoff& backoff, std::mutex* output) {
+        const char* name = phase == ProgressPhase::SEARCHING ? "search"
+                         : phase == ProgressPhase::INSTALLING ? "install" : "download";
+        const wchar_t* what = phase == ProgressPhase::SEARCHING ? L"search(es)"
+                            : phase == ProgressPhase::INSTALLING ? L"install(s)" : L"download(s)";
+        {
+            std::unique_lock<std::mutex> lock;
+            if (output != nullptr) {
+                lock = std::unique_lock<std::mutex>(*output);
+            }
+            std::wcout << Messages::Progress::retrying(static_cast<long>(count), what, delay.count() / 1000.0,
+                                                       backoff.round(), backoff.maxRounds()) << std::endl;
+        }
+        logText(LogLevel::WARN, L"Retrying {} failed {s} in {} ms", what, static_cast<int64_t>(count), delay.count());
+        MetricsRegistry::instance().counter("wupdater_retries_total", "Queries and updates submitted again after a retryable failure",
+                                            { { "phase", name } }).add(count);
+    }
+
+    HRESULT UpdateManager::runWithRetries(ProgressPhase phase, std::chrono::steady_clock::time_point started,
+                                          const std::vector<UpdateHandle>& updates, std::vector<UpdateOutcome>& outcomes,
+                                          const UpdateJob& job, std::mutex* output) {
+        const bool installing = phase == ProgressPhase::INSTALLING;
+        RetryBackoff backoff(retryPolicy_, installing ? retryPolicy_.installBudgetSeconds
+                                                      : retryPolicy_.downloadBudgetSeconds, started);
+
+        outcomes.assign(updates.size(), UpdateOutcome());
+        std::vector<size_t> pending(updates.size());
+        for (size_t i = 0; i < pending.size(); i++) {
+            pending[i] = i;
+        }
+
+        std::vector<UpdateHandle> batch(updates);
+        std::vector<UpdateOutcome> batchOutcomes;
+        while (true) {
+            HRESULT hr = job(batch, batchOutcomes);
+
+            // Updates a failed job never reached take the job's error
+            batchOutcomes.resize(batch.size());
+            for (size_t i = 0; i < batch.size(); i++) {
+                if (FAILED(hr) && batchOutcomes[i].result == ResultCode::NOT_STARTED) {
+                    batchOutcomes[i].result = ResultCode::FAILED;
+                    batchOutcomes[i].hresult = hr;
+                }
+                outcomes[pending[i]] = batchOutcomes[i];
+            }
+            if (FAILED(hr) && !isRetryable(hr)) {
+                return hr;
+            }
+
+            std::vector<size_t> failed;
+            for (size_t position : pending) {
+                const UpdateOutcome& outcome = outcomes[position];
+                if (outcome.result != ResultCode::SUCCEEDED && outcome.result != ResultCode::SUCCEEDED_WITH_ERRORS &&
+                    isRetryable(outcome.hresult)) {
+                    failed.push_back(position);
+                }
+            }
+
+            std::chrono::milliseconds delay(0);
+            if (failed.empty() || cancelled() || !backoff.next(delay)) {
+                return hr;
+            }
+            announceRetry(phase, failed.size(), delay, backoff, output);
+            if (!RetryBackoff::wait(delay, cancel_)) {
+                return hr;
+            }
+
+            pending.swap(failed);
+            batch.clear();
+            for (size_t position : pending) {
+                batch.push_back(updates[position]);
+            }
+            batchOutcomes.clear();
+        }
+    }
+
+    HRESULT UpdateManager::downloadJob(const std::vector<UpdateHandle>& updates, std::vector<UpdateOutcome>& outcomes,
+                                       DownloadObserver* observer) {
+        std::vector<DownloadLane> lanes;
+        if (downloadLanes_ > 1 && updates.size() > 1 && backend_.allowsConcurrentCalls()) {
+            std::vector<int64_t> sizes(updates.size(), 0);
+            for (size_t i = 0; i < updates.size(); i++) {
+                auto row = rowByHandle_.find(handleKey(updates[i]));
+                if (row != rowByHandle_.end()) {
+                    sizes[i] = table_.maxDownloadSize(row->second);
+                }
+            }
+
+            lanes = planDownloadLanes(sizes, downloadLanes_);
+            int64_t largest = 0;
+            for (const DownloadLane& lane : lanes) {
+                largest = (std::max)(largest, lane.bytes);
+            }
+            logEvent(LogLevel::INFO, L"Download of {} updates split into {} lanes, largest lane {} bytes",
+                     static_cast<int64_t>(updates.size()), static_cast<int64_t>(lanes.size()), largest);
+            MetricsRegistry::instance().gauge("wupdater_download_lanes", "Concurrent download jobs of the last download")
+                .set(static_cast<double>(lanes.size()));
+        }
+
+        CompletionClock clock(observer, updates.size());
+        DownloadObserver* events = timings_ != nullptr ? &clock : observer;
+        const std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+        HRESULT hr = lanes.empty() ? backend_.download(updates, outcomes, events)
+                                   : downloadInLanes(backend_, updates, lanes, outcomes, events);
+        if (timings_ == nullptr) {
+            return hr;
+        }
+
+        // A job downloads its updates one after another, so each took from
+        // the previous one's completion to its own
+        if (lanes.empty()) {
+            lanes.resize(1);
+            for (size_t i = 0; i < updates.size(); i++) {
+                lanes[0].positions.push_back(i);
+            }
+        }
+        std::vector<double> seconds(updates.size(), -1);
+        for (const DownloadLane& lane : lanes) {
+            std::vector<size_t> reported;
+            for (size_t position : lane.positions) {
+                if (clock.finished(position) != std::chrono::steady_clock::time_point()) {
+                    reported.push_back(position);
+                }
+            }
+            std::sort(reported.begin(), reported.end(), [&clock](size_t a, size_t b) {
+                return clock.finished(a) < clock.finished(b);
+            });
+            std::chrono::steady_clock::time_point previous = started;
+            for (size_t position : reported) {
+                // Updates the agent already had finish at once and would drag the percentiles down
+                auto row = rowByHandle_.find(handleKey(updates[position]));
+                if (row != rowByHandle_.end() && !table_.isDownloaded(row->second)) {
+                    seconds[position] = std::chrono::duration<double>(clock.finished(position) - previous).count();
+                }
+                previous = clock.finished(position);
+            }
+        }
+        recordTimings(TimingPhase::DOWNLOAD, updates, outcomes, seconds);
+        return hr;
+    }
+
+    void UpdateManager::recordInstallTime(const std::vector<UpdateHandle>& updates,
+                                          const std::vector<UpdateOutcome>& outcomes, double seconds) {
+        // One installer call covers the whole batch; each update gets an equal
+        // base share of its time plus a share in proportion to its size
+        std::vector<double> sizes(updates.size(), 0);
+        double total = 0;
+        for (size_t i = 0; i < updates.size(); i++) {
+            auto row = rowByHandle_.find(handleKey(updates[i]));
+            if (row != rowByHandle_.end()) {
+                sizes[i] = static_cast<double>((std::max)(table_.maxDownloadSize(row->second), static_cast<int64_t>(0)));
+                total += sizes[i];
+            }
+        }
+        const double base = updates.empty() || total <= 0 ? 1 : total / updates.size();
+        std::vector<double> shares(updates.size());
+        for (size_t i = 0; i < updates.size(); i++) {
+            shares[i] = seconds * (sizes[i] + base) / (total + base * updates.size());
+        }
+        recordTimings(TimingPhase::INSTALL, updates, outcomes, shares);
+    }
+
+    void UpdateManager::recordTimings(TimingPhase phase, const std::vector<UpdateHandle>& updates,
+                                      const std::vector<UpdateOutcome>& outcomes, const std::vector<double>& seconds) {
+        std::vector<TimingSample> samples;
+        for (size_t i = 0; i < updates.size() && i < outcomes.size() && i < seconds.size(); i++) {
+            auto row = rowByHandle_.find(handleKey(updates[i]));
+            if (seconds[i] < 0 || outcomes[i].result == ResultCode::NOT_STARTED || row == rowByHandle_.end()) {
+                continue;
+            }
+            TimingSample sample;
+            sample.updateId = std::wstring(table_.updateId(row->second));
+            sample.revision = table_.revision(row->second);
+            sample.kb = table_.kbCount(row->second) > 0 ? table_.kbArticleId(row->second, 0) : 0;
+            sample.classification = table_.classification(row->second);
+            sample.phase = phase;
+            sample.size = table_.maxDownloadSize(row->second);
+            sample.durationMs = static_cast<uint32_t>(std::llround(seconds[i] * 1000));
+            sample.result = outcomes[i].result;
+            sample.hresult = outcomes[i].hresult;
+            samples.push_back(sample);
+        }
+        if (!timings_->record(samples)) {
+            logEvent(LogLevel::WARN, L"Timing store: {} samples could not be recorded", static_cast<int64_t>(samples.size()));
+        }
+    }
+
+    double UpdateManager::estimateSeconds(const DurationEstimator& estimator) const {
+        double seconds = 0;
+        for (size_t row = 0; row < table_.size(); row++) {
+            const DurationEstimate estimate = estimator.estimate(table_, row);
+            seconds += (table_.isDownloaded(row) ? 0 : estimate.downloadSeconds) + estimate.installSeconds;
+        }
+        return seconds;
+    }
+
+    void UpdateManager::printResultCode(long index, std::wstring_view name, ResultCode rc, const std::wstring& operation) {
+        std::wcout << index + 1 << L" - " << name << L" | ";
+
+        if (rc == ResultCode::SUCCEEDED) {
+            std::wcout << L"Successfully " << operation << L'\n';
+        } else {
+            std::wcout << Messages::Results::getResultMessage(static_cast<int>(rc)) << L'\n';
+        }
+    }
+
+    void UpdateManager::printResults(const std::vector<UpdateHandle>& updates,
+                                     const std::vector<UpdateOutcome>& outcomes,
+                                     ProgressPhase phase, long firstIndex) {
+        const bool installing = phase == ProgressPhase::INSTALLING;
+        const std::wstring operation = installing ? L"installed" : L"downloaded";
+
+        // Tallied here and added to the registry once per batch
+        const ResultCode kResults[] = { ResultCode::NOT_STARTED, ResultCode::IN_PROGRESS, ResultCode::SUCCEEDED,
+                                        ResultCode::SUCCEEDED_WITH_ERRORS, ResultCode::FAILED, ResultCode::ABORTED };
+        uint64_t resultCounts[sizeof(kResults) / sizeof(kResults[0])] = {};
+        std::map<HRESULT, uint64_t> errorCounts;
+
+        for (size_t i = 0; i < updates.size() && i < outcomes.size(); i++) {
+            auto row = rowByHandle_.find(handleKey(updates[i]));
+            if (row == rowByHandle_.end()) {
+                continue;
+            }
+
+            const long index = firstIndex + static_cast<long>(i);
+            const size_t result = static_cast<size_t>(outcomes[i].result);
+            if (result < sizeof(resultCounts) / sizeof(resultCounts[0])) {
+                resultCounts[result]++;
+            }
+            if (FAILED(outcomes[i].hresult)) {
+                errorCounts[outcomes[i].hresult]++;
+            }
+            if (outcomes[i].result != ResultCode::SUCCEEDED) {
+                logText(LogLevel::WARN, installing ? L"Install of {s} ended with result {} ({x})"
+                                                   : L"Download of {s} ended with result {} ({x})",
+                        table_.updateId(row->second), static_cast<int64_t>(outcomes[i].result), outcomes[i].hresult);
+            }
+            if (writer_ == nullptr) {
+                printResultCode(index, table_.title(row->second), outcomes[i].result, operation);
+                continue;
+            }
+
+            writer_->beginRecord(L"result", installing ? L"install" : L"download");
+            writer_->number(Field::INDEX, index + 1);
+            writer_->text(Field::UPDATE_ID, table_.updateId(row->second));
+            writer_->number(Field::REVISION, table_.revision(row->second));
+            writer_->text(Field::TITLE, table_.title(row->second));
+            writer_->text(Field::RESULT, resultName(outcomes[i].result));
+            writer_->hresult(Field::HRESULT, outcomes[i].hresult);
+            if (installing) {
+                writer_->boolean(Field::REBOOT_REQUIRED, outcomes[i].rebootRequired);
+            }
+            writer_->endRecord();
+        }
+
+        const char* const phaseName = installing ? "install" : "download";
+        MetricsRegistry& metrics = MetricsRegistry::instance();
+        for (size_t i = 0; i < sizeof(kResults) / sizeof(kResults[0]); i++) {
+            if (resultCounts[i] > 0) {
+                metrics.counter("wupdater_update_results_total", "Per-update download and install results", {
+                    { "phase", phaseName }, { "result", toUtf8(resultName(kResults[i])) }
+                }).add(resultCounts[i]);
+            }
+        }
+        for (const auto& error : errorCounts) {
+            metrics.counter("wupdater_update_errors_total", "Failed per-update results by HRESULT", {
+                { "phase", phaseName },
+                { "category", toUtf8(ErrorMessages::getErrorCategory(error.first)) },
+                { "hresult", hresultLabel(error.first) }
+            }).add(error.second);
+        }
+
+        // Install outcomes were journaled as each pass finished
+        if (!installing) {
+            journalOutcomes(updates, outcomes, phase);
+        }
+
+        // Results are flushed once per batch, not per line
+        if (writer_ != nullptr) {
+            writer_->flush();
+        } else {
+            std::wcout.flush();
+        }
+    }
+
+    void UpdateManager::journalOutcomes(const std::vector<UpdateHandle>& updates,
+                                        const std::vector<UpdateOutcome>& outcomes, ProgressPhase phase) {
+        if (journal_ == nullptr) {
+            return;
+        }
+        for (size_t i = 0; i < updates.size() && i < outcomes.size(); i++) {
+            auto row = rowByHandle_.find(handleKey(updates[i]));
+            if (row != rowByHandle_.end()) {
+                journal_->recordOutcome(phase, table_.updateId(row->second), table_.revision(row->second), outcomes[i]);
+            }
+        }
+        journal_->commit();
+    }
+
+    int UpdateManager::loadRecords() {
+        if (!initialized_) {
+            std::wcout << L"[!] No search has been performed" << std::endl;
+            return -1;
+        }
+        if (recordsLoaded_) {
+            return 0;
+        }
+
+        // One pass over the whole list; every later phase reads the table
+        ScopedTimer timer(phaseDuration("enumerate"));
+        table_.clear();
+        table_.reserve(updatesList_.size());
+        if (checkHResult(readRange(0, updatesList_.size(), table_)) != 0) {
+            // A partly read table must not reach the later phases
+            table_.clear();
+            return -1;
+        }
+
+        if (!foundBy_.empty()) {
+            applyClientFilters();
+        }
+        indexTable();
+        recordsLoaded_ = true;
+        return 0;
+    }
+
+    HRESULT UpdateManager::readRange(size_t begin, size_t end, UpdateTable& table) {
+        const size_t count = end - begin;
+        const size_t threads = std::min<size_t>(metadataThreads_, count / kMinRowsPerReader);
+        if (threads <= 1 || !backend_.allowsConcurrentCalls()) {
+            return backend_.readUpdates(updatesList_, begin, end, table);
+        }
+
+        // Each worker reads a contiguous index range into its own table;
+        // the parts are concatenated in order afterwards
+        std::vector<UpdateTable> parts(threads);
+        std::vector<HRESULT> results(threads, S_OK);
+        WorkerPool pool(static_cast<unsigned>(threads));
+        pool.run(threads, [&](size_t part) {
+            size_t partBegin = begin + count * part / threads;
+            size_t partEnd = begin + count * (part + 1) / threads;
+            parts[part].reserve(partEnd - partBegin);
+            results[part] = backend_.readUpdates(updatesList_, partBegin, partEnd, parts[part]);
+        });
+
+        HRESULT hr = S_OK;
+        for (size_t part = 0; part < threads; part++) {
+            table.append(parts[part]);
+            if (FAILED(results[part]) && SUCCEEDED(hr)) {
+                hr = results[part];
+            }
+        }
+        return hr;
+    }
+
+    void UpdateManager::applyClientFilters() {
+        // An update found by several queries stays if any of their filters accepts it
+        std::vector<uint8_t> keep(table_.size(), 0);
+        for (size_t row = 0; row < table_.size(); row++) {
+            keep[row] = acceptedByFilters(table_, row) ? 1 : 0;
+        }
+
+        const size_t found = table_.size();
+        reportClientFilters(retainRows(keep), found);
+    }
+
+    bool UpdateManager::acceptedByFilters(const UpdateTable& table, size_t row) const {
+        auto found = foundBy_.find(handleKey(table.handle(row)));
+        bool accepted = found == foundBy_.end();
+        for (size_t i = 0; !accepted && i < found->second.size(); i++) {
+            const ClientFilter& filter = filters_[found->second[i]];
+            accepted = filter.empty() || filter.matches(table, row);
+        }
+        return accepted;
+    }
+
+    void UpdateManager::reportClientFilters(size_t kept, size_t found) {
+        logEvent(LogLevel::INFO, L"Client-side filters kept {} of {} updates",
+                 static_cast<int64_t>(kept), static_cast<int64_t>(found));
+        std::wcout << Messages::Info::clientFilterApplied(static_cast<long>(kept), static_cast<long>(found)) << std::endl;
+        MetricsRegistry::instance().gauge("wupdater_updates_found", "Updates found by the last search")
+            .set(static_cast<double>(kept));
+        foundBy_.clear();
+    }
+
+    void UpdateManager::applyUpdateLists() {
+        std::vector<uint8_t> keep(table_.size(), 0);
+        size_t notAllowed = 0;
+        size_t denied = 0;
+        for (size_t row = 0; row < table_.size(); row++) {
+            switch (excludedBy(table_, row)) {
+                case Exclusion::DENIED: denied++; break;
+                case Exclusion::NOT_ALLOWED: notAllowed++; break;
+                default: keep[row] = 1; break;
+            }
+        }
+        if (notAllowed + denied == 0) {
+            return;
+        }
+
+        retainRows(keep);
+        if (!cachedOnly_) {
+            indexTable();
+        }
+        reportUpdateLists(notAllowed, denied);
+    }
+
+    UpdateManager::Exclusion UpdateManager::excludedBy(const UpdateTable& table, size_t row) const {
+        // The deny-list wins over the allow-list
+        if (denyList_ != nullptr && denyList_->contains(table, row)) {
+            return Exclusion::DENIED;
+        }
+        if (allowList_ != nullptr && !allowList_->contains(table, row)) {
+            return Exclusion::NOT_ALLOWED;
+        }
+        return Exclusion::NONE;
+    }
+
+    void UpdateManager::reportUpdateLists(size_t notAllowed, size_t denied) {
+        logEvent(LogLevel::INFO, L"Update lists excluded {} updates not on the allow-list and {} on the deny-list",
+                 static_cast<int64_t>(notAllowed), static_cast<int64_t>(denied));
+        std::wcout << Messages::Info::updateListsApplied(static_cast<long>(notAllowed), static_cast<long>(denied)) << std::endl;
+        MetricsRegistry& metrics = MetricsRegistry::instance();
+        const char* const help = "Found updates left out by the allow-list or deny-list";
+        metrics.counter("wupdater_updates_excluded_total", help, { { "list", "allow" } }).add(notAllowed);
+        metrics.counter("wupdater_updates_excluded_total", help, { { "list", "deny" } }).add(denied);
+    }
+
+    size_t UpdateManager::retainRows(const std::vector<uint8_t>& keep) {
+        UpdateTable kept;
+        kept.reserve(table_.size());
+        for (size_t row = 0; row < table_.size(); row++) {
+            if (keep[row] != 0) {
+                kept.append(table_.record(row));
+            }
+        }
+        table_ = std::move(kept);
+        return table_.size();
+    }
+
+    void UpdateManager::indexTable() {
+        updatesList_ = table_.handles();
+        rowByHandle_.clear();
+        rowByHandle_.reserve(table_.size());
+        for (size_t row = 0; row < table_.size(); row++) {
+            rowByHandle_.emplace(handleKey(table_.handle(row)), row);
+        }
+    }
+
+    void UpdateManager::useCachedRecords(const UpdateTable& table) {
+        updatesList_.clear();
+        rowByHandle_.clear();
+        table_ = table;
+        initialized_ = true;
+        recordsLoaded_ = true;
+        cachedOnly_ = true;
+    }
+
+    void UpdateManager::adoptRecords(const UpdateTable& table) {
+        table_ = table;
+        indexTable();
+        initialized_ = true;
+        recordsLoaded_ = true;
+        cachedOnly_ = false;
+    }
+
+    int UpdateManager::resolveCachedRecords(const UpdateTable& table) {
+        std::vector<std::wstring> updateIds;
+        updateIds.reserve(table.size());
+        for (size_t row = 0; row < table.size(); row++) {
+            updateIds.push_back(std::wstring(table.updateId(row)));
+        }
+
+        std::vector<UpdateHandle> found;
+        HRESULT hr = backend_.findByIdentity(updateIds, found);
+        if (FAILED(hr)) {
+            return -1;
+        }
+
+        // Put the handles back in cached order, matching on UpdateID and revision
+        std::unordered_map<std::wstring, UpdateHandle> byKey;
+        std::wstring updateId;
+        int32_t revision = 0;
+        for (const UpdateHandle& handle : found) {
+            if (SUCCEEDED(backend_.getIdentity(handle, updateId, revision))) {
+                byKey.emplace(updateId + L"#" + std::to_wstring(revision), handle);
+            }
+        }
+
+        std::vector<UpdateHandle> resolved;
+        resolved.reserve(table.size());
+        for (size_t row = 0; row < table.size(); row++) {
+            auto it = byKey.find(table.identityKey(row));
+            if (it == byKey.end()) {
+                return -1;
+            }
+            resolved.push_back(it->second);
+        }
+
+        // Download and install state may have changed; read it again from the agent
+        updatesList_.swap(resolved);
+        table_.clear();
+        rowByHandle_.clear();
+        initialized_ = true;
+        recordsLoaded_ = false;
+        cachedOnly_ = false;
+        return 0;
+    }
+
+    int UpdateManager::printUpdateInfo(std::vector<UpdateHandle>& toDownloadList) {
+        if (!initialized_) {
+            std::wcout << L"[!] No search has been performed" << std::endl;
+            return -1;
+        }
+
+        if (getUpdateCount() == 0) {
+            std::wcout << Messages::Status::noUpdatesFound() << std::endl;
+            return -1;
+        }
+
+        try {
+            if (streamChunk_ > 0 && !recordsLoaded_) {
+                return streamUpdateInfo(toDownloadList);
+            }
+            if (loadRecords() != 0) {
+                return -1;
+            }
+            if (allowList_ != nullptr || denyList_ != nullptr) {
+                applyUpdateLists();
+            }
+            if (table_.empty()) {
+                std::wcout << Messages::Status::noUpdatesFound() << std::endl;
+                return -1;
+            }
+
+            std::wcout << Messages::Info::updateListHeader() << std::endl;
+
+            const std::wstring alreadyDownloaded = Messages::Status::alreadyDownloaded();
+            const std::wstring toDownload = Messages::Status::toDownload();
+            for (size_t i = 0; i < table_.size(); i++) {
+                if (!table_.isDownloaded(i) && !cachedOnly_) {
+                    toDownloadList.push_back(updatesList_[i]);
+                }
+                printUpdate(table_, i, static_cast<long>(i) + 1, alreadyDownloaded, toDownload);
+            }
+
+            if (writer_ != nullptr) {
+                writer_->flush();
+            } else {
+                std::wcout.flush();
+            }
+            return 0;
+
+        } catch (std::exception& e) {
+            std::wcout << L"[!] Exception: " << e.what() << std::endl;
+            return -1;
+        } catch (...) {
+            std::wcout << L"[!] Unknown error during update info printing" << std::endl;
+            return -1;
+        }
+    }
+
+    int UpdateManager::streamUpdateInfo(std::vector<UpdateHandle>& toDownloadList) {
+        ScopedTimer timer(phaseDuration("enumerate"));
+        const bool filtered = !foundBy_.empty();
+        const bool listed = allowList_ != nullptr || denyList_ != nullptr;
+        const std::wstring alreadyDownloaded = Messages::Status::alreadyDownloaded();
+        const std::wstring toDownload = Messages::Status::toDownload();
+
+        // One chunk of metadata is alive at a time; only the rows later
+        // phases act on are copied out of it
+        UpdateTable chunk;
+        chunk.reserve(streamChunk_);
+        UpdateTable kept;
+        std::vector<UpdateHandle> keptHandles;
+        size_t found = 0;
+        size_t rejected = 0;
+        size_t notAllowed = 0;
+        size_t denied = 0;
+        HRESULT hr = S_OK;
+        for (size_t begin = 0; begin < updatesList_.size() && !cancelled(); begin += streamChunk_) {
+            const size_t end = (std::min)(begin + streamChunk_, updatesList_.size());
+            chunk.clear();
+            HRESULT chunkHr = readRange(begin, end, chunk);
+            if (FAILED(chunkHr) && SUCCEEDED(hr)) {
+                hr = chunkHr;
+            }
+            found += chunk.size();
+
+            for (size_t row = 0; row < chunk.size(); row++) {
+                if (filtered && !acceptedByFilters(chunk, row)) {
+                    rejected++;
+                    continue;
+                }
+                const Exclusion exclusion = listed ? excludedBy(chunk, row) : Exclusion::NONE;
+                if (exclusion != Exclusion::NONE) {
+                    (exclusion == Exclusion::DENIED ? denied : notAllowed)++;
+                    continue;
+                }
+
+                if (keptHandles.empty()) {
+                    std::wcout << Messages::Info::updateListHeader() << std::endl;
+                }
+                if (!chunk.isDownloaded(row)) {
+                    toDownloadList.push_back(chunk.handle(row));
+                }
+                keptHandles.push_back(chunk.handle(row));
+                printUpdate(chunk, row, static_cast<long>(keptHandles.size()), alreadyDownloaded, toDownload);
+                if (keepStreamedRows_) {
+                    kept.append(chunk.record(row));
+                }
+            }
+
+            if (writer_ != nullptr) {
+                writer_->flush();
+            } else {
+                std::wcout.flush();
+            }
+        }
+        checkHResult(hr);
+        if (cancelled()) {
+            std::wcout << Messages::Info::operationCancelledByUser() << std::endl;
+            return -1;
+        }
+
+        if (filtered) {
+            reportClientFilters(found - rejected, found);
+        }
+        if (notAllowed + denied > 0) {
+            reportUpdateLists(notAllowed, denied);
+        }
+
+        // Later phases see only the updates that were listed. Without their
+        // rows nothing can act on them, so the search is let go right away.
+        table_ = std::move(kept);
+        updatesList_.swap(keptHandles);
+        if (keepStreamedRows_) {
+            indexTable();
+            recordsLoaded_ = true;
+        } else {
+            backend_.releaseSearches();
+        }
+        if (updatesList_.empty()) {
+            std::wcout << Messages::Status::noUpdatesFound() << std::endl;
+            return -1;
+        }
+        return 0;
+    }
+
+    void UpdateManager::printUpdate(const UpdateTable& table, size_t row, long number,
+                                    const std::wstring& alreadyDownloaded, const std::wstring& toDownload) {
+        wchar_t date[16];
+        std::wstring_view released(date, formatDate(table.releaseDate(row), date, sizeof(date) / sizeof(date[0])));
+        if (writer_ == nullptr) {
+            std::wcout << number << L" - " << table.title(row) << L" | Release: " << released
+                       << L" | " << (table.isDownloaded(row) ? alreadyDownloaded : toDownload) << L'\n';
+            return;
+        }
+
+        writer_->beginRecord(L"update", L"search");
+        writer_->number(Field::INDEX, number);
+        writer_->text(Field::UPDATE_ID, table.updateId(row));
+        writer_->number(Field::REVISION, table.revision(row));
+        writer_->text(Field::TITLE, table.title(row));
+        writer_->beginList(Field::KB);
+        for (size_t k = 0; k < table.kbCount(row); k++) {
+            writer_->listItem(L"KB", table.kbArticleId(row, k));
+        }
+        writer_->endList();
+        writer_->number(Field::SIZE, table.maxDownloadSize(row));
+        writer_->text(Field::RELEASE_DATE, released);
+        if (table.severity(row) != Severity::UNSPECIFIED) {
+            writer_->text(Field::SEVERITY, severityName(table.severity(row)));
+        }
+        writer_->boolean(Field::DOWNLOADED, table.isDownloaded(row));
+        writer_->boolean(Field::INSTALLED, table.isInstalled(row));
+        writer_->endRecord();
+    }
+
+    int UpdateManager::printChanges(const std::string& snapshotPath, const std::wstring& scope) {
+        if (loadRecords() != 0) {
+            return -1;
+        }
+
+        Snapshot current = Snapshot::fromTable(scope, table_);
+        Snapshot previous;
+        if (!loadSnapshot(snapshotPath, previous)) {
+            previous = Snapshot();
+            std::wcout << Messages::Info::noPreviousSnapshot() << std::endl;
+        } else if (previous.scope != scope) {
+            previous = Snapshot();
+            std::wcout << Messages::Info::snapshotScopeChanged() << std::endl;
+        } else {
+            std::wcout << Messages::Info::changesSince(formatDate(previous.createdAt / 86400.0 + 25569.0)) << std::endl;
+        }
+
+        static const wchar_t* const kChangeNames[] = { L"added", L"removed", L"revised", L"state" };
+        long counts[4] = { 0, 0, 0, 0 };
+        for (const SnapshotChange& change : diffSnapshots(previous, current)) {
+            counts[static_cast<int>(change.kind)]++;
+            if (writer_ != nullptr) {
+                const bool removed = change.kind == ChangeKind::REMOVED;
+                const SnapshotEntry& entry = removed ? previous.entries[change.previous] : current.entries[change.current];
+                writer_->beginRecord(L"change", L"diff");
+                writer_->text(Field::UPDATE_ID, entry.updateId);
+                writer_->number(Field::REVISION, entry.revision);
+                if (!removed) {
+                    writer_->text(Field::TITLE, table_.title(entry.source));
+                    writer_->boolean(Field::DOWNLOADED, entry.isDownloaded);
+                    writer_->boolean(Field::INSTALLED, entry.isInstalled);
+                }
+                writer_->text(Field::CHANGE, kChangeNames[static_cast<int>(change.kind)]);
+                writer_->endRecord();
+                continue;
+            }
+
+            if (change.kind == ChangeKind::REMOVED) {
+                // Gone from the search, so only the identity is known
+                const SnapshotEntry& before = previous.entries[change.previous];
+                std::wcout << L"[-] " << before.updateId << L" | " << Messages::Status::changeRemoved() << L'\n';
+                continue;
+            }
+
+            const SnapshotEntry& after = current.entries[change.current];
+            std::wstring_view title = table_.title(after.source);
+            if (change.kind == ChangeKind::ADDED) {
+                std::wcout << L"[+] " << title << L" | " << Messages::Status::changeAdded(after.revision) << L'\n';
+            } else if (change.kind == ChangeKind::REVISED) {
+                const SnapshotEntry& before = previous.entries[change.previous];
+                std::wcout << L"[~] " << title << L" | "
+                           << Messages::Status::changeRevised(before.revision, after.revision) << L'\n';
+            } else {
+                std::wcout << L"[~] " << title << L" | "
+                           << Messages::Status::changeState(after.isDownloaded, after.isInstalled) << L'\n';
+            }
+        }
+        if (writer_ != nullptr) {
+            writer_->flush();
+        }
+        std::wcout << Messages::Info::changesSummary(counts[0], counts[1], counts[2], counts[3]) << std::endl;
+
+        if (!saveSnapshot(snapshotPath, current)) {
+            std::wcout << Messages::Errors::snapshotWriteFailed(snapshotPath) << std::endl;
+            return -1;
+        }
+        return 0;
+    }
+
+    int UpdateManager::applyWindow(std::vector<UpdateHandle>& toDownloadList) {
+        windowDeferred_ = 0;
+        if (windowBudget_.count() == 0 || estimator_ == nullptr || table_.empty()) {
+            return 0;
+        }
+
+        // Time already spent, on the search for one, counts against the window
+        const double budget = std::chrono::duration<double>(windowBudget_ - (std::chrono::steady_clock::now() - windowStart_)).count();
+        std::vector<WindowCandidate> candidates(table_.size());
+        for (size_t row = 0; row < table_.size(); row++) {
+            const DurationEstimate estimate = estimator_->estimate(table_, row);
+            candidates[row].seconds = (table_.isDownloaded(row) ? 0 : estimate.downloadSeconds) + estimate.installSeconds;
+            candidates[row].severity = table_.severity(row);
+        }
+        const WindowPlan plan = scheduleWindow(candidates, budget);
+
+        const long budgetMinutes = static_cast<long>(std::ceil((std::max)(budget, 0.0) / 60));
+        const long plannedMinutes = static_cast<long>(std::ceil(plan.plannedSeconds / 60));
+        logEvent(LogLevel::INFO, L"Maintenance window: {} updates planned for {} s, {} deferred",
+                 static_cast<int64_t>(plan.selected.size()), static_cast<int64_t>(plan.plannedSeconds),
+                 static_cast<int64_t>(plan.deferred.size()));
+        std::wcout << L"\n" << Messages::Info::windowPlanned(static_cast<long>(plan.selected.size()), plannedMinutes,
+                                                           budgetMinutes, static_cast<long>(plan.deferred.size())) << std::endl;
+        MetricsRegistry& metrics = MetricsRegistry::instance();
+        const char* const help = "Listed updates by maintenance window decision";
+        metrics.counter("wupdater_window_updates_total", help, { { "decision", "selected" } }).add(plan.selected.size());
+        metrics.counter("wupdater_window_updates_total", help, { { "decision", "deferred" } }).add(plan.deferred.size());
+        if (plan.deferred.empty()) {
+            return 0;
+        }
+
+        // The deferred updates are reported in list order, then left out
+        if (writer_ == nullptr) {
+            std::wcout << Messages::Info::windowDeferredHeader() << std::endl;
+        }
+        std::vector<uint8_t> keep(table_.size(), 1);
+        for (size_t row : plan.deferred) {
+            keep[row] = 0;
+            if (writer_ == nullptr) {
+                const long minutes = static_cast<long>(std::ceil(candidates[row].seconds / 60));
+                std::wcout << row + 1 << L" - " << table_.title(row) << L" | " << Messages::Info::windowEstimate(minutes) << L'\n';
+                continue;
+            }
+            writer_->beginRecord(L"result", L"window");
+            writer_->number(Field::INDEX, static_cast<int64_t>(row) + 1);
+            writer_->text(Field::UPDATE_ID, table_.updateId(row));
+            writer_->number(Field::REVISION, table_.revision(row));
+            writer_->text(Field::TITLE, table_.title(row));
+            writer_->text(Field::RESULT, L"deferred");
+            writer_->endRecord();
+        }
+        if (writer_ != nullptr) {
+            writer_->flush();
+        } else {
+            std::wcout.flush();
+        }
+
+        windowDeferred_ = plan.deferred.size();
+        retainRows(keep);
+        if (cachedOnly_) {
+            return 0;
+        }
+        indexTable();
+        std::vector<UpdateHandle> kept;
+        for (const UpdateHandle& handle : toDownloadList) {
+            if (rowByHandle_.count(handleKey(handle)) != 0) {
+                kept.push_back(handle);
+            }
+        }
+        toDownloadList.swap(kept);
+        return 0;
+    }
+
+    int UpdateManager::prestageContent(std::vector<UpdateHandle>& toDownloadList) {
+        if (contentCache_ == nullptr || toDownloadList.empty()) {
+            return 0;
+        }
+        if (loadRecords() != 0) {
+            return -1;
+        }
+
+        ScopedTimer timer(phaseDuration("prestage"));
+        size_t imported = 0;
+        size_t exported = 0;
+        std::vector<UpdateHandle> remaining;
+        for (size_t i = 0; i < toDownloadList.size(); i++) {
+            const UpdateHandle& handle = toDownloadList[i];
+            auto row = rowByHandle_.find(handleKey(handle));
+            if (cancelled() || row == rowByHandle_.end()) {
+                remaining.push_back(handle);
+                continue;
+            }
+
+            const std::wstring_view updateId = table_.updateId(row->second);
+            const int32_t revision = table_.revision(row->second);
+            if (exportContent_ && !contentCache_->contains(updateId, revision)) {
+                HRESULT hr = contentCache_->exportUpdate(backend_, handle, updateId, revision);
+                if (FAILED(hr)) {
+                    logText(LogLevel::WARN, L"Export of {s} to the content cache failed ({x})", updateId, hr);
+                } else {
+                    exported++;
+                }
+            }
+
+            // Anything that does not come out of the cache is downloaded as usual
+            HRESULT hr = contentCache_->importUpdate(backend_, handle, updateId, revision);
+            if (hr == S_OK) {
+                imported++;
+            } else {
+                if (FAILED(hr)) {
+                    logText(LogLevel::WARN, L"Staging {s} from the content cache failed ({x})", updateId, hr);
+                }
+                remaining.push_back(handle);
+            }
+        }
+
+        const size_t missed = remaining.size();
+        toDownloadList.swap(remaining);
+        logEvent(LogLevel::INFO, L"Content cache staged {} updates, exported {}, {} left to download",
+                 static_cast<int64_t>(imported), static_cast<int64_t>(exported), static_cast<int64_t>(missed));
+        std::wcout << Messages::Info::contentCacheApplied(static_cast<long>(imported), static_cast<long>(exported),
+                                                          static_cast<long>(missed)) << std::endl;
+        MetricsRegistry& metrics = MetricsRegistry::instance();
+        const char* const help = "Updates staged from, exported to or missed in the content cache";
+        metrics.counter("wupdater_content_cache_total", help, { { "result", "imported" } }).add(imported);
+        metrics.counter("wupdater_content_cache_total", help, { { "result", "exported" } }).add(exported);
+        metrics.counter("wupdater_content_cache_total", help, { { "result", "missed" } }).add(missed);
+        return 0;
+    }
+
+    int UpdateManager::downloadUpdates(const std::vector<UpdateHandle>& toDownloadList) {
+        try {
+            if (toDownloadList.empty()) {
+                std::wcout << L"No updates to download" << std::endl;
+                return 0;
+            }
+            if (loadRecords() != 0) {
+                return -1;
+            }
+
+            std::wcout << L"\n" << Messages::Progress::downloadingUpdates() << L" (" << toDownloadList.size() << L" update(s))" << std::endl;
+
+            ScopedTimer timer(phaseDuration("download"));
+            DownloadProgressRenderer renderer(std::wcout, kProgressIntervalMs, nullptr, cancel_);
+            std::vector<UpdateOutcome> outcomes;
+            HRESULT hr = runWithRetries(ProgressPhase::DOWNLOADING, std::chrono::steady_clock::now(), toDownloadList, outcomes,
+                [this, &renderer](const std::vector<UpdateHandle>& updates, std::vector<UpdateOutcome>& results) {
+                    renderer.restart();
+                    HRESULT jobHr = downloadJob(updates, results, &renderer);
+                    renderer.finish();
+                    return jobHr;
+                });
+            if (checkHResult(hr) != 0) {
+                return -1;
+            }
+
+            // Display results
+            std::wcout << Messages::Info::downloadListHeader() << std::endl;
+            printResults(toDownloadList, outcomes, ProgressPhase::DOWNLOADING);
+            return 0;
+
+        } catch (std::exception& e) {
+            std::wcout << L"[!] Exception: " << e.what() << std::endl;
+            return -1;
+        } catch (...) {
+            std::wcout << L"[!] Unknown error during download" << std::endl;
+            return -1;
+        }
+    }
+
+    std::vector<InstallTraits> UpdateManager::installTraits(const std::vector<UpdateHandle>& updates) const {
+        std::vector<InstallTraits> traits(updates.size());
+        for (size_t i = 0; i < updates.size(); i++) {
+            auto row = rowByHandle_.find(handleKey(updates[i]));
+            if (row != rowByHandle_.end()) {
+                traits[i].impact = table_.impact(row->second);
+                traits[i].reboot = table_.rebootBehavior(row->second);
+            }
+        }
+        return traits;
+    }
+
+    HRESULT UpdateManager::installInBatches(const std::vector<UpdateHandle>& updates, std::vector<UpdateOutcome>& outcomes,
+                                            std::chrono::steady_clock::time_point started, size_t& deferred,
+                                            std::mutex* output) {
+        outcomes.assign(updates.size(), UpdateOutcome());
+        const InstallPlan plan = planInstallBatches(installTraits(updates));
+        deferred = plan.deferred.size();
+        MetricsRegistry::instance().counter("wupdater_install_passes_total", "Installer calls planned, retries not counted")
+            .add(plan.batches.size());
+
+        HRESULT result = plan.batches.empty() ? S_OK : E_FAIL;
+        bool anyRan = false;
+        size_t closedOut = 0;
+        for (size_t b = 0; b < plan.batches.size() && !cancelled(); b++) {
+            const InstallBatch& batch = plan.batches[b];
+            if (windowClosed()) {
+                // Not started; left for the next window like the updates applyWindow dropped
+                for (size_t rest = b; rest < plan.batches.size(); rest++) {
+                    closedOut += plan.batches[rest].positions.size();
+                }
+                break;
+            }
+            std::vector<UpdateHandle> handles;
+            handles.reserve(batch.positions.size());
+            for (size_t position : batch.positions) {
+                handles.push_back(updates[position]);
+            }
+
+            if (plan.batches.size() > 1) {
+                std::unique_lock<std::mutex> lock;
+                if (output != nullptr) {
+                    lock = std::unique_lock<std::mutex>(*output);
+                }
+                std::wcout << Messages::Progress::installPass(static_cast<long>(b) + 1, static_cast<long>(plan.batches.size()),
+                                                              static_cast<long>(handles.size()), batch.exclusive,
+                                                              batch.reboot != RebootBehavior::NEVER) << std::endl;
+            }
+            logEvent(LogLevel::INFO, L"Install pass {} of {}: {} updates, exclusive {}",
+                     static_cast<int64_t>(b) + 1, static_cast<int64_t>(plan.batches.size()),
+                     static_cast<int64_t>(handles.size()), batch.exclusive ? 1 : 0);
+
+            std::vector<UpdateOutcome> batchOutcomes;
+            HRESULT hr = runWithRetries(ProgressPhase::INSTALLING, started, handles, batchOutcomes,
+                [this](const std::vector<UpdateHandle>& subset, std::vector<UpdateOutcome>& results) {
+                    const std::chrono::steady_clock::time_point began = std::chrono::steady_clock::now();
+                    HRESULT result = backend_.install(subset, results, nullptr, nullptr);
+                    if (timings_ != nullptr) {
+                        recordInstallTime(subset, results,
+                                          std::chrono::duration<double>(std::chrono::steady_clock::now() - began).count());
+                    }
+                    return result;
+                }, output);
+
+            // A failed call leaves its updates failed; the other batches still run
+            batchOutcomes.resize(handles.size());
+            for (size_t i = 0; i < handles.size(); i++) {
+                UpdateOutcome outcome = batchOutcomes[i];
+                if (FAILED(hr) && outcome.result == ResultCode::NOT_STARTED) {
+                    outcome.result = ResultCode::FAILED;
+                    outcome.hresult = hr;
+                }
+                outcomes[batch.positions[i]] = outcome;
+                batchOutcomes[i] = outcome;
+            }
+            journalOutcomes(handles, batchOutcomes, ProgressPhase::INSTALLING);
+            if (SUCCEEDED(hr)) {
+                anyRan = true;
+            } else if (result == E_FAIL) {
+                result = hr;
+            }
+        }
+
+        if (deferred > 0 || closedOut > 0) {
+            std::unique_lock<std::mutex> lock;
+            if (output != nullptr) {
+                lock = std::unique_lock<std::mutex>(*output);
+            }
+            if (deferred > 0) {
+                logEvent(LogLevel::WARN, L"{} updates deferred until after a restart", static_cast<int64_t>(deferred));
+                std::wcout << Messages::Info::installDeferred(static_cast<long>(deferred)) << std::endl;
+            }
+            if (closedOut > 0) {
+                logEvent(LogLevel::WARN, L"Maintenance window closed with {} updates not started", static_cast<int64_t>(closedOut));
+                std::wcout << Messages::Info::windowClosed(static_cast<long>(closedOut)) << std::endl;
+            }
+        }
+        deferred += closedOut;
+
+        // A window that closed before any batch could run is not an error
+        return anyRan || (closedOut > 0 && result == E_FAIL) ? S_OK : result;
+    }
+
+    int UpdateManager::installUpdates() {
+        if (!initialized_ || updatesList_.empty() || loadRecords() != 0) {
+            std::wcout << L"[!] No updates to install" << std::endl;
+            return -1;
+        }
+
+        try {
+            std::wcout << L"\n" << Messages::Progress::installingUpdates() << std::endl;
+            ScopedTimer timer(phaseDuration("install"));
+
+            // Perform installation
+            std::vector<UpdateOutcome> outcomes;
+            HRESULT hr = installInBatches(updatesList_, outcomes, std::chrono::steady_clock::now(), deferredInstalls_);
+            if (checkHResult(hr) != 0) {
+                return -1;
+            }
+
+            // Display results
+            std::wcout << Messages::Info::installListHeader() << std::endl;
+            printResults(updatesList_, outcomes, ProgressPhase::INSTALLING);
+            return 0;
+
+        } catch (std::exception& e) {
+            std::wcout << L"[!] Exception: " << e.what() << std::endl;
+            return -1;
+        } catch (...) {
+            std::wcout << L"[!] Unknown error during installation" << std::endl;
+            return -1;
+        }
+    }
+
+    int UpdateManager::downloadAndInstallUpdates(const std::vector<UpdateHandle>& toDownloadList) {
+        if (!initialized_ || updatesList_.empty() || loadRecords() != 0) {
+            std::wcout << L"[!] No updates to install" << std::endl;
+            return -1;
+        }
+
+        // The pipeline downloads on a thread of its own, which the backend may not allow
+        if (!backend_.allowsConcurrentCalls()) {
+            std::wcout << Messages::Info::pipelineSerial() << std::endl;
+            if (!toDownloadList.empty() && downloadUpdates(toDownloadList) != 0) {
+                return -1;
+            }
+            if (cancelled()) {
+                std::wcout << Messages::Info::operationCancelledByUser() << std::endl;
+                return -1;
+            }
+            return installUpdates();
+        }
+
+        PipelineState state;
+        deferredInstalls_ = 0;
+
+        // Updates already in the cache can be installed right away
+        std::unordered_set<uint64_t> toDownload;
+        for (const UpdateHandle& handle : toDownloadList) {
+            toDownload.insert(handleKey(handle));
+        }
+        for (const UpdateHandle& handle : updatesList_) {
+            if (toDownload.count(handleKey(handle)) == 0) {
+                state.ready.push_back(handle);
+            }
+        }
+
+        if (!toDownloadList.empty()) {
+            std::wcout << L"\n" << Messages::Progress::downloadingUpdates() << L" (" << toDownloadList.size() << L" update(s))" << std::endl;
+        }
+
+        // One download job for the whole list; the observer hands each update over as soon as it is cached.
+        // Retry rounds then download only the updates that failed with a retryable error.
+        PipelineObserver pipeline(state, toDownloadList, cancel_, retryPolicy_.maxRetries > 0);
+        DownloadProgressRenderer renderer(std::wcout, kProgressIntervalMs, &pipeline);
+        std::thread downloader([this, &toDownloadList, &pipeline, &renderer]() {
+            if (!toDownloadList.empty()) {
+                ScopedTimer timer(phaseDuration("download"));
+                RetryBackoff backoff(retryPolicy_, retryPolicy_.downloadBudgetSeconds);
+                std::vector<UpdateHandle> batch(toDownloadList);
+                while (true) {
+                    std::vector<UpdateOutcome> outcomes;
+                    HRESULT hr = S_OK;
+                    try {
+                        hr = downloadJob(batch, outcomes, &renderer);
+                    } catch (...) {
+                        hr = E_FAIL;
+                    }
+                    renderer.finish();
+
+                    std::vector<size_t> failed = pipeline.endRound(hr);
+                    std::chrono::milliseconds delay(0);
+                    if (failed.empty() || cancelled() || !backoff.next(delay)) {
+                        break;
+                    }
+                    announceRetry(ProgressPhase::DOWNLOADING, failed.size(), delay, backoff, &renderer.outputMutex());
+                    if (!RetryBackoff::wait(delay, cancel_)) {
+                        break;
+                    }
+
+                    batch.clear();
+                    for (size_t item : failed) {
+                        batch.push_back(toDownloadList[item]);
+                    }
+                    pipeline.beginRound(failed, backoff.round() < backoff.maxRounds());
+                    renderer.restart();
+                }
+            }
+            pipeline.complete();
+        });
+
+        // This thread reports download results and runs the installs, one batch at a time
+        std::chrono::steady_clock::time_point installStarted = std::chrono::steady_clock::now();
+        bool installing = false;
+        int exitCode = 0;
+        std::vector<UpdateHandle> held;         // Always reboot; installed after everything else
+        long downloadedCount = 0;
+        long installedCount = 0;
+        try {
+            while (true) {
+                std::vector<UpdateHandle> downloaded;
+                std::vector<UpdateOutcome> downloadOutcomes;
+                std::vector<UpdateHandle> batch;
+                bool downloadsDone = false;
+                {
+                    std::unique_lock<std::mutex> lock(state.mutex);
+                    state.changed.wait(lock, [&state]() {
+                        return state.downloadsDone || !state.downloaded.empty() || !state.ready.empty();
+                    });
+                    downloaded.swap(state.downloaded);
+                    downloadOutcomes.swap(state.outcomes);
+                    batch.swap(state.ready);
+                    downloadsDone = state.downloadsDone;
+                }
+
+                // An update that always reboots blocks every install after it,
+                // so those wait for the last batch
+                std::vector<UpdateHandle> runNow;
+                for (const UpdateHandle& handle : batch) {
+                    auto row = rowByHandle_.find(handleKey(handle));
+                    const bool restarts = row != rowByHandle_.end() &&
+                                          table_.rebootBehavior(row->second) == RebootBehavior::ALWAYS;
+                    (restarts ? held : runNow).push_back(handle);
+                }
+                batch.swap(runNow);
+                if (batch.empty() && downloadsDone && downloaded.empty()) {
+                    batch.swap(held);
+                }
+
+                if (!downloaded.empty()) {
+                    std::lock_guard<std::mutex> output(renderer.outputMutex());
+                    printResults(downloaded, downloadOutcomes, ProgressPhase::DOWNLOADING, downloadedCount);
+                    downloadedCount += static_cast<long>(downloaded.size());
+                }
+
+                if (!batch.empty() && !cancelled()) {
+                    long remaining = static_cast<long>(toDownloadList.size()) - downloadedCount;
+                    {
+                        std::lock_guard<std::mutex> output(renderer.outputMutex());
+                        std::wcout << L"\n" << Messages::Progress::installingBatch(static_cast<long>(batch.size()), remaining) << std::endl;
+                    }
+
+                    // The install retry budget counts from the first batch
+                    if (!installing) {
+                        installStarted = std::chrono::steady_clock::now();
+                        installing = true;
+                    }
+
+                    std::vector<UpdateOutcome> outcomes;
+                    HRESULT hr = S_OK;
+                    {
+                        // Each batch is observed as one install
+                        ScopedTimer timer(phaseDuration("install"));
+                        size_t deferred = 0;
+                        hr = installInBatches(batch, outcomes, installStarted, deferred, &renderer.outputMutex());
+                        deferredInstalls_ += deferred;
+                    }
+                    std::lock_guard<std::mutex> output(renderer.outputMutex());
+                    if (checkHResult(hr) != 0) {
+                        exitCode = -1;
+                    } else {
+                        printResults(batch, outcomes, ProgressPhase::INSTALLING, installedCount);
+                    }
+                    installedCount += static_cast<long>(batch.size());
+                    continue;
+                }
+
+                if (downloadsDone && downloaded.empty() && batch.empty()) {
+                    break;
+                }
+            }
+        } catch (...) {
+            downloader.join();
+            throw;
+        }
+
+        downloader.join();
+
+        if (cancelled()) {
+            std::wcout << Messages::Info::operationCancelledByUser() << std::endl;
+            return -1;
+        }
+        return exitCode;
+    }
+
+} // namespace WUpdater
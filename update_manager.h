@@ -0,0 +1,250 @@
+#pragma once
+
+#include "content_cache.h"
+#include "criteria.h"
+#include "install_planner.h"
+#include "record_writer.h"
+#include "retry_policy.h"
+#include "run_journal.h"
+#include "timing_store.h"
+#include "update_list.h"
+#include "update_backend.h"
+#include "update_table.h"
+#include "window_scheduler.h"
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace WUpdater {
+
+    // Check HRESULT and print error if needed
+    int checkHResult(HRESULT hr);
+
+    // Format an OLE automation DATE as YYYY-MM-DD
+    std::wstring formatDate(double oleDate);
+
+    // Same, into a caller-provided buffer; returns the number of characters written
+    size_t formatDate(double oleDate, wchar_t* buffer, size_t size);
+
+    // Default progress callback
+    void updateProgressCallbackDefault(ProgressPhase phase, unsigned int progress, void* context);
+
+    // Update Manager class
+    class UpdateManager {
+    public:
+        explicit UpdateManager(UpdateBackend& backend);
+        ~UpdateManager();
+
+        // Disable copy
+        UpdateManager(const UpdateManager&) = delete;
+        UpdateManager& operator=(const UpdateManager&) = delete;
+
+        // Number of worker threads used to run several searches at once
+        void setWorkerThreads(unsigned threads) { workerThreads_ = threads > 0 ? threads : 1; }
+
+        // Number of worker threads reading update metadata. Only safe above 1
+        // when the backend's objects may be used from any thread (COM MTA).
+        void setMetadataThreads(unsigned threads) { metadataThreads_ = threads > 0 ? threads : 1; }
+
+        // Flag that stops long-running phases between updates when raised
+        void setCancelFlag(const std::atomic<bool>* cancel) { cancel_ = cancel; }
+
+        // Emit update, result and change lines as records instead of text
+        void setRecordWriter(RecordWriter* writer) { writer_ = writer; }
+
+        // Retry failed searches, downloads and installs; only the failed queries
+        // or updates are submitted again
+        void setRetryPolicy(const RetryPolicy& policy) { retryPolicy_ = policy; }
+
+        // Split downloads into up to this many concurrent jobs, packed by size
+        void setDownloadLanes(unsigned lanes) { downloadLanes_ = lanes > 0 ? lanes : 1; }
+
+        // Only list updates on the allow-list, if one is given, and never those
+        // on the deny-list; either may be null. Applied when the list is printed.
+        void setUpdateLists(const UpdateList* allowList, const UpdateList* denyList) {
+            allowList_ = allowList;
+            denyList_ = denyList;
+        }
+
+        // Stage payloads from a shared content cache before downloading; with
+        // exportMissing, updates not yet in the cache are fetched into it first
+        void setContentCache(ContentCache* cache, bool exportMissing) {
+            contentCache_ = cache;
+            exportContent_ = exportMissing;
+        }
+
+        // List updates by reading their metadata chunkRows at a time instead of
+        // all at once. Only the rows of listed updates are kept, and none at
+        // all without keepRows, so memory stays flat however many are found.
+        void setStreaming(size_t chunkRows, bool keepRows) {
+            streamChunk_ = chunkRows;
+            keepStreamedRows_ = keepRows;
+        }
+
+        // Append download and install outcomes to a run journal, committed
+        // once per batch of download results and once per install pass
+        void setJournal(RunJournal* journal) { journal_ = journal; }
+
+        // Fit the run into a maintenance window of budget, counted from
+        // started: only the updates estimator expects to fit are acted on, and
+        // no install pass starts once the window has closed
+        void setWindow(std::chrono::seconds budget, std::chrono::steady_clock::time_point started,
+                       const DurationEstimator* estimator) {
+            windowBudget_ = budget;
+            windowStart_ = started;
+            estimator_ = estimator;
+        }
+
+        // Record how long each update took to download and install
+        void setTimingStore(TimingStore* store) { timings_ = store; }
+
+        // Main operations
+        int searchForUpdates(const std::vector<std::wstring>& criteriaList, const SearchOptions& options);
+        int printUpdateInfo(std::vector<UpdateHandle>& toDownloadList);
+
+        // Read the metadata of every found update into the table in one pass;
+        // updates whose metadata cannot be read are dropped from the list
+        int loadRecords();
+
+        // Report from cached rows alone; nothing can be downloaded or installed
+        void useCachedRecords(const UpdateTable& table);
+
+        // Take over rows read earlier in this process; their handles must still be live
+        void adoptRecords(const UpdateTable& table);
+
+        // Look cached updates up again by UpdateID so they can be acted on.
+        // Fails if any of them is gone or has a different revision.
+        int resolveCachedRecords(const UpdateTable& table);
+
+        // Print only what changed since the snapshot at snapshotPath, then
+        // replace it with the current state. scope names the backend/criteria.
+        int printChanges(const std::string& snapshotPath, const std::wstring& scope);
+
+        // Drop the listed updates that do not fit in the maintenance window,
+        // if one is set, from the list and from toDownloadList
+        int applyWindow(std::vector<UpdateHandle>& toDownloadList);
+
+        // Expected time to download and install the listed updates
+        double estimateSeconds(const DurationEstimator& estimator) const;
+        // Copy the payloads of listed updates found in the content cache into
+        // the agent's download cache and drop them from the list
+        int prestageContent(std::vector<UpdateHandle>& toDownloadList);
+        int downloadUpdates(const std::vector<UpdateHandle>& toDownloadList);
+        int installUpdates();
+
+        // Download and install in one pipelined pass: each update is queued for
+        // installation as soon as its payload is cached, and installs run one
+        // batch at a time while the remaining downloads continue
+        int downloadAndInstallUpdates(const std::vector<UpdateHandle>& toDownloadList);
+
+        // Getters
+        long getUpdateCount() const { return static_cast<long>(cachedOnly_ ? table_.size() : updatesList_.size()); }
+        const std::vector<UpdateHandle>& getUpdatesList() const { return updatesList_; }
+        const UpdateTable& getTable() const { return table_; }
+        // Updates left for a later run: after a restart or in the next window
+        size_t getDeferredCount() const { return deferredInstalls_ + windowDeferred_; }
+
+    private:
+        UpdateBackend& backend_;
+        std::vector<UpdateHandle> updatesList_;
+        UpdateTable table_;                     // Row i describes updatesList_[i] once loaded
+        std::unordered_map<uint64_t, size_t> rowByHandle_;
+        bool initialized_;
+        bool recordsLoaded_;
+        bool cachedOnly_;                       // table_ came from the cache, no handles
+        unsigned workerThreads_;
+        unsigned metadataThreads_;
+        unsigned downloadLanes_;
+        const std::atomic<bool>* cancel_;
+        RecordWriter* writer_;
+        RetryPolicy retryPolicy_;
+        const UpdateList* allowList_;
+        const UpdateList* denyList_;
+        ContentCache* contentCache_;
+        bool exportContent_;
+        size_t streamChunk_;                    // Rows per chunk when streaming; 0 reads all at once
+        bool keepStreamedRows_;
+        RunJournal* journal_;
+        size_t deferredInstalls_;
+        std::chrono::seconds windowBudget_;     // Zero without a window
+        std::chrono::steady_clock::time_point windowStart_;
+        const DurationEstimator* estimator_;
+        size_t windowDeferred_;                 // Left out by applyWindow
+        TimingStore* timings_;
+        std::vector<ClientFilter> filters_;     // Client-side part of each query of the last search
+        std::unordered_map<uint64_t, std::vector<uint32_t>> foundBy_;  // Queries that found each update; only kept while a filter is set
+
+        // One backend download or install job over a list of updates
+        typedef std::function<HRESULT(const std::vector<UpdateHandle>&, std::vector<UpdateOutcome>&)> UpdateJob;
+
+        bool cancelled() const { return cancel_ != nullptr && cancel_->load(); }
+        bool windowClosed() const {
+            return windowBudget_.count() > 0 && std::chrono::steady_clock::now() - windowStart_ >= windowBudget_;
+        }
+
+        // Run job over updates, then re-run it over the updates whose outcome is
+        // retryable until they succeed or the retry policy gives up. output, if
+        // given, serializes the retry notices with other writers of the console.
+        HRESULT runWithRetries(ProgressPhase phase, std::chrono::steady_clock::time_point started,
+                               const std::vector<UpdateHandle>& updates, std::vector<UpdateOutcome>& outcomes,
+                               const UpdateJob& job, std::mutex* output = nullptr);
+        // One download job over updates, sharded into lanes when more than one is allowed
+        HRESULT downloadJob(const std::vector<UpdateHandle>& updates, std::vector<UpdateOutcome>& outcomes,
+                            DownloadObserver* observer);
+        // Install updates in the batches planInstallBatches() gives, one installer
+        // call (with retries) per batch, until the maintenance window closes.
+        // Returns S_OK if any batch ran, otherwise the first batch's error;
+        // deferred receives how many had to wait.
+        HRESULT installInBatches(const std::vector<UpdateHandle>& updates, std::vector<UpdateOutcome>& outcomes,
+                                 std::chrono::steady_clock::time_point started, size_t& deferred,
+                                 std::mutex* output = nullptr);
+        // Timing samples for one download job or installer call; a negative
+        // time leaves the update out
+        void recordTimings(TimingPhase phase, const std::vector<UpdateHandle>& updates,
+                           const std::vector<UpdateOutcome>& outcomes, const std::vector<double>& seconds);
+        void recordInstallTime(const std::vector<UpdateHandle>& updates,
+                               const std::vector<UpdateOutcome>& outcomes, double seconds);
+        std::vector<InstallTraits> installTraits(const std::vector<UpdateHandle>& updates) const;
+        void announceRetry(ProgressPhase phase, size_t count, std::chrono::milliseconds delay,
+                           const RetryBackoff& backoff, std::mutex* output = nullptr);
+
+        void printResults(const std::vector<UpdateHandle>& updates,
+                          const std::vector<UpdateOutcome>& outcomes,
+                          ProgressPhase phase, long firstIndex = 0);
+        // Append outcomes to the run journal, if any, and commit them
+        void journalOutcomes(const std::vector<UpdateHandle>& updates,
+                             const std::vector<UpdateOutcome>& outcomes, ProgressPhase phase);
+        void printResultCode(long index, std::wstring_view name, ResultCode rc, const std::wstring& operation);
+        void indexTable();
+
+        // Read the metadata of updatesList_[begin, end) into table, on the
+        // metadata threads when the range is large enough
+        HRESULT readRange(size_t begin, size_t end, UpdateTable& table);
+
+        // printUpdateInfo over chunks of the found updates
+        int streamUpdateInfo(std::vector<UpdateHandle>& toDownloadList);
+        void printUpdate(const UpdateTable& table, size_t row, long number,
+                         const std::wstring& alreadyDownloaded, const std::wstring& toDownload);
+
+        enum class Exclusion { NONE, NOT_ALLOWED, DENIED };
+
+        // Drop the rows no query that found them accepts on the client side
+        void applyClientFilters();
+        bool acceptedByFilters(const UpdateTable& table, size_t row) const;
+        void reportClientFilters(size_t kept, size_t found);
+
+        // Drop the rows the allow-list or deny-list excludes
+        void applyUpdateLists();
+        Exclusion excludedBy(const UpdateTable& table, size_t row) const;
+        void reportUpdateLists(size_t notAllowed, size_t denied);
+
+        // Keep only the rows whose flag is set; returns how many remain
+        size_t retainRows(const std::vector<uint8_t>& keep);
+    };
+
+} // namespace WUpdater
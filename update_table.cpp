@@ -0,0 +1,114 @@
+#include "update_table.h"
+
+namespace WUpdater {
+
+    namespace {
+
+        // Rough title + UpdateID length, used to size the character pool up front
+        const size_t kCharsPerRow = 96;
+
+    } // namespace
+
+    void UpdateTable::clear() {
+        handles_.clear();
+        ids_.clear();
+        titles_.clear();
+        kbs_.clear();
+        revisions_.clear();
+        sizes_.clear();
+        releaseDates_.clear();
+        flags_.clear();
+        severities_.clear();
+        classifications_.clear();
+        textPool_.clear();
+        kbPool_.clear();
+    }
+
+    void UpdateTable::reserve(size_t rows) {
+        handles_.reserve(rows);
+        ids_.reserve(rows);
+        titles_.reserve(rows);
+        kbs_.reserve(rows);
+        revisions_.reserve(rows);
+        sizes_.reserve(rows);
+        releaseDates_.reserve(rows);
+        flags_.reserve(rows);
+        severities_.reserve(rows);
+        classifications_.reserve(rows);
+        textPool_.reserve(rows * kCharsPerRow);
+        kbPool_.reserve(rows);
+    }
+
+    UpdateTable::Span UpdateTable::appendText(const wchar_t* text, size_t length) {
+        Span span = { static_cast<uint32_t>(textPool_.size()), static_cast<uint32_t>(length) };
+        textPool_.insert(textPool_.end(), text, text + length);
+        return span;
+    }
+
+    void UpdateTable::append(const UpdateRecord& record) {
+        handles_.push_back(record.handle);
+        ids_.push_back(appendText(record.updateId.data(), record.updateId.size()));
+        titles_.push_back(appendText(record.title.data(), record.title.size()));
+
+        Span kbs = { static_cast<uint32_t>(kbPool_.size()), static_cast<uint32_t>(record.kbArticleIds.size()) };
+        kbPool_.insert(kbPool_.end(), record.kbArticleIds.begin(), record.kbArticleIds.end());
+        kbs_.push_back(kbs);
+
+        revisions_.push_back(record.revision);
+        sizes_.push_back(record.maxDownloadSize);
+        releaseDates_.push_back(record.releaseDate);
+        flags_.push_back(static_cast<uint8_t>((record.isDownloaded ? kDownloaded : 0) |
+                                              (record.isInstalled ? kInstalled : 0) |
+                                              (static_cast<unsigned>(record.impact) << kImpactShift) |
+                                              (static_cast<unsigned>(record.reboot) << kRebootShift)));
+        severities_.push_back(static_cast<uint8_t>(record.severity));
+        classifications_.push_back(static_cast<uint8_t>(record.classification));
+    }
+
+    void UpdateTable::append(const UpdateTable& other) {
+        const uint32_t textBase = static_cast<uint32_t>(textPool_.size());
+        const uint32_t kbBase = static_cast<uint32_t>(kbPool_.size());
+
+        handles_.insert(handles_.end(), other.handles_.begin(), other.handles_.end());
+        for (size_t row = 0; row < other.size(); row++) {
+            ids_.push_back(Span{ other.ids_[row].offset + textBase, other.ids_[row].length });
+            titles_.push_back(Span{ other.titles_[row].offset + textBase, other.titles_[row].length });
+            kbs_.push_back(Span{ other.kbs_[row].offset + kbBase, other.kbs_[row].length });
+        }
+        revisions_.insert(revisions_.end(), other.revisions_.begin(), other.revisions_.end());
+        sizes_.insert(sizes_.end(), other.sizes_.begin(), other.sizes_.end());
+        releaseDates_.insert(releaseDates_.end(), other.releaseDates_.begin(), other.releaseDates_.end());
+        flags_.insert(flags_.end(), other.flags_.begin(), other.flags_.end());
+        severities_.insert(severities_.end(), other.severities_.begin(), other.severities_.end());
+        classifications_.insert(classifications_.end(), other.classifications_.begin(), other.classifications_.end());
+        textPool_.insert(textPool_.end(), other.textPool_.begin(), other.textPool_.end());
+        kbPool_.insert(kbPool_.end(), other.kbPool_.begin(), other.kbPool_.end());
+    }
+
+    UpdateRecord UpdateTable::record(size_t row) const {
+        UpdateRecord record;
+        record.handle = handles_[row];
+        record.updateId = std::wstring(updateId(row));
+        record.revision = revisions_[row];
+        record.title = std::wstring(title(row));
+        record.kbArticleIds.assign(kbPool_.begin() + kbs_[row].offset,
+                                   kbPool_.begin() + kbs_[row].offset + kbs_[row].length);
+        record.maxDownloadSize = sizes_[row];
+        record.releaseDate = releaseDates_[row];
+        record.isDownloaded = isDownloaded(row);
+        record.isInstalled = isInstalled(row);
+        record.severity = severity(row);
+        record.impact = impact(row);
+        record.reboot = rebootBehavior(row);
+        record.classification = classification(row);
+        return record;
+    }
+
+    std::wstring UpdateTable::identityKey(size_t row) const {
+        std::wstring key(updateId(row));
+        key += L'#';
+        key += std::to_wstring(revisions_[row]);
+        return key;
+    }
+
+} // namespace WUpdater
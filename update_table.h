@@ -0,0 +1,90 @@
+#pragma once
+
+#include "update_backend.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace WUpdater {
+
+    /**
+     * @brief Metadata of a list of updates, stored column by column.
+     *
+     * Filled once per run by UpdateBackend::readUpdates and shared by the
+     * listing, result reporting, cache and snapshot code. Each property is a
+     * flat array indexed by row; UpdateIDs and titles live in one character
+     * pool and KB article IDs in one integer pool, so the table costs a
+     * handful of allocations regardless of the number of updates.
+     */
+    class UpdateTable {
+    public:
+        size_t size() const { return handles_.size(); }
+        bool empty() const { return handles_.empty(); }
+
+        void clear();
+        void reserve(size_t rows);
+
+        // Append one update / all rows of another table
+        void append(const UpdateRecord& record);
+        void append(const UpdateTable& other);
+
+        // Copy one row back into a record
+        UpdateRecord record(size_t row) const;
+
+        const std::vector<UpdateHandle>& handles() const { return handles_; }
+        const UpdateHandle& handle(size_t row) const { return handles_[row]; }
+        std::wstring_view updateId(size_t row) const { return text(ids_[row]); }
+        int32_t revision(size_t row) const { return revisions_[row]; }
+        std::wstring_view title(size_t row) const { return text(titles_[row]); }
+        size_t kbCount(size_t row) const { return kbs_[row].length; }
+        uint32_t kbArticleId(size_t row, size_t i) const { return kbPool_[kbs_[row].offset + i]; }
+        int64_t maxDownloadSize(size_t row) const { return sizes_[row]; }
+        double releaseDate(size_t row) const { return releaseDates_[row]; }
+        bool isDownloaded(size_t row) const { return (flags_[row] & kDownloaded) != 0; }
+        bool isInstalled(size_t row) const { return (flags_[row] & kInstalled) != 0; }
+        Severity severity(size_t row) const { return static_cast<Severity>(severities_[row]); }
+        UpdateClassification classification(size_t row) const {
+            return static_cast<UpdateClassification>(classifications_[row]);
+        }
+        InstallImpact impact(size_t row) const {
+            return static_cast<InstallImpact>((flags_[row] >> kImpactShift) & 3u);
+        }
+        RebootBehavior rebootBehavior(size_t row) const {
+            return static_cast<RebootBehavior>((flags_[row] >> kRebootShift) & 3u);
+        }
+
+        // UpdateID and revision joined as "id#rev", the identity used for de-duplication
+        std::wstring identityKey(size_t row) const;
+
+    private:
+        struct Span {
+            uint32_t offset;
+            uint32_t length;
+        };
+
+        static const uint8_t kDownloaded = 1u << 0;
+        static const uint8_t kInstalled = 1u << 1;
+        static const unsigned kImpactShift = 2;     // Bits 2-3 hold the InstallImpact value
+        static const unsigned kRebootShift = 4;     // Bits 4-5 hold the RebootBehavior value
+
+        std::vector<UpdateHandle> handles_;
+        std::vector<Span> ids_;
+        std::vector<Span> titles_;
+        std::vector<Span> kbs_;
+        std::vector<int32_t> revisions_;
+        std::vector<int64_t> sizes_;
+        std::vector<double> releaseDates_;
+        std::vector<uint8_t> flags_;
+        std::vector<uint8_t> severities_;
+        std::vector<uint8_t> classifications_;
+        std::vector<wchar_t> textPool_;
+        std::vector<uint32_t> kbPool_;
+
+        Span appendText(const wchar_t* text, size_t length);
+        std::wstring_view text(const Span& span) const {
+            return std::wstring_view(textPool_.data() + span.offset, span.length);
+        }
+    };
+
+} // namespace WUpdater
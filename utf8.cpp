@@ -0,0 +1,65 @@
+#include "utf8.h"
+#include <cstdint>
+
+namespace WUpdater {
+
+    std::string toUtf8(std::wstring_view text) {
+        std::string out;
+        out.reserve(text.size());
+        for (size_t i = 0; i < text.size(); i++) {
+            uint32_t c = static_cast<uint32_t>(text[i]);
+            // Join UTF-16 surrogate pairs where wchar_t is 16 bits
+            if (sizeof(wchar_t) == 2 && c >= 0xD800 && c <= 0xDBFF && i + 1 < text.size()) {
+                uint32_t low = static_cast<uint32_t>(text[i + 1]);
+                if (low >= 0xDC00 && low <= 0xDFFF) {
+                    c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+                    i++;
+                }
+            }
+
+            if (c < 0x80) {
+                out.push_back(static_cast<char>(c));
+            } else if (c < 0x800) {
+                out.push_back(static_cast<char>(0xC0 | (c >> 6)));
+                out.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+            } else if (c < 0x10000) {
+                out.push_back(static_cast<char>(0xE0 | (c >> 12)));
+                out.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3F)));
+                out.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+            } else {
+                out.push_back(static_cast<char>(0xF0 | (c >> 18)));
+                out.push_back(static_cast<char>(0x80 | ((c >> 12) & 0x3F)));
+                out.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3F)));
+                out.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+            }
+        }
+        return out;
+    }
+
+    std::wstring fromUtf8(std::string_view text) {
+        std::wstring out;
+        out.reserve(text.size());
+        size_t i = 0;
+        while (i < text.size()) {
+            uint32_t c = static_cast<unsigned char>(text[i]);
+            size_t extra = c >= 0xF0 ? 3 : c >= 0xE0 ? 2 : c >= 0xC0 ? 1 : 0;
+            if (extra > 0) {
+                c &= 0x3F >> extra;
+            }
+            i++;
+            for (size_t k = 0; k < extra && i < text.size(); k++, i++) {
+                c = (c << 6) | (static_cast<unsigned char>(text[i]) & 0x3F);
+            }
+
+            if (sizeof(wchar_t) == 2 && c >= 0x10000) {
+                c -= 0x10000;
+                out.push_back(static_cast<wchar_t>(0xD800 + (c >> 10)));
+                out.push_back(static_cast<wchar_t>(0xDC00 + (c & 0x3FF)));
+            } else {
+                out.push_back(static_cast<wchar_t>(c));
+            }
+        }
+        return out;
+    }
+
+} // namespace WUpdater
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+namespace WUpdater {
+
+    // Convert between wide strings (UTF-16 or UTF-32, per wchar_t) and UTF-8
+    std::string toUtf8(std::wstring_view text);
+    std::wstring fromUtf8(std::string_view text);
+
+} // namespace WUpdater
@@ -0,0 +1,64 @@
+#include "window_scheduler.h"
+#include <algorithm>
+
+namespace WUpdater {
+
+    namespace {
+
+        // Used until there is recorded history to go by; on the slow side,
+        // since overrunning a window is worse than leaving time unused
+        const double kDownloadBytesPerSecond = 10.0 * 1000 * 1000;
+        const double kInstallBytesPerSecond = 20.0 * 1000 * 1000;
+        const double kInstallBaseSeconds = 120;
+
+        double severityWeight(Severity severity) {
+            switch (severity) {
+                case Severity::CRITICAL: return 8;
+                case Severity::IMPORTANT: return 4;
+                case Severity::MODERATE: return 2;
+                default: return 1;
+            }
+        }
+
+    } // namespace
+
+    DurationEstimate SizeEstimator::estimate(const UpdateTable& table, size_t row) const {
+        const double size = static_cast<double>((std::max)(table.maxDownloadSize(row), static_cast<int64_t>(0)));
+        DurationEstimate estimate;
+        estimate.downloadSeconds = size / kDownloadBytesPerSecond;
+        estimate.installSeconds = kInstallBaseSeconds + size / kInstallBytesPerSecond;
+        return estimate;
+    }
+
+    WindowPlan scheduleWindow(const std::vector<WindowCandidate>& candidates, double budgetSeconds) {
+        std::vector<size_t> order(candidates.size());
+        for (size_t i = 0; i < order.size(); i++) {
+            order[i] = i;
+        }
+
+        // Weight per minute; a zero estimate counts as one second
+        auto valuePerMinute = [&candidates](size_t i) {
+            return severityWeight(candidates[i].severity) * 60 / (std::max)(candidates[i].seconds, 1.0);
+        };
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            if (candidates[a].severity != candidates[b].severity) {
+                return candidates[a].severity > candidates[b].severity;
+            }
+            return valuePerMinute(a) > valuePerMinute(b);
+        });
+
+        WindowPlan plan;
+        std::vector<uint8_t> taken(candidates.size(), 0);
+        for (size_t i : order) {
+            if (plan.plannedSeconds + candidates[i].seconds <= budgetSeconds) {
+                plan.plannedSeconds += candidates[i].seconds;
+                taken[i] = 1;
+            }
+        }
+        for (size_t i = 0; i < candidates.size(); i++) {
+            (taken[i] != 0 ? plan.selected : plan.deferred).push_back(i);
+        }
+        return plan;
+    }
+
+} // namespace WUpdater
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "update_backend.h"
+#include "update_table.h"
+#include <vector>
+
+namespace WUpdater {
+
+    // Expected time to download and install one update
+    struct DurationEstimate {
+        double downloadSeconds = 0;
+        double installSeconds = 0;
+    };
+
+    /**
+     * @brief Source of the per-update durations the window scheduler plans with.
+     */
+    class DurationEstimator {
+    public:
+        virtual ~DurationEstimator() = default;
+
+        virtual DurationEstimate estimate(const UpdateTable& table, size_t row) const = 0;
+    };
+
+    // Estimates from the payload size alone, at fixed conservative rates
+    class SizeEstimator : public DurationEstimator {
+    public:
+        DurationEstimate estimate(const UpdateTable& table, size_t row) const override;
+    };
+
+    // What the scheduler needs to know about one update
+    struct WindowCandidate {
+        double seconds = 0;                     // Download (if still needed) plus install
+        Severity severity = Severity::UNSPECIFIED;
+    };
+
+    struct WindowPlan {
+        std::vector<size_t> selected;           // Positions in the list being planned, in list order
+        std::vector<size_t> deferred;           // Left for the next window, in list order
+        double plannedSeconds = 0;
+    };
+
+    /**
+     * @brief Choose the updates that fit in a maintenance window.
+     *
+     * Updates are considered most severe first and, at equal severity, by
+     * value per minute, so short updates go before long ones. Each is taken
+     * if it still fits in what is left of the budget; one that does not is
+     * deferred, and shorter updates after it may still be taken.
+     */
+    WindowPlan scheduleWindow(const std::vector<WindowCandidate>& candidates, double budgetSeconds);
+
+} // namespace WUpdater
@@ -0,0 +1,80 @@
+#include "worker_pool.h"
+
+namespace WUpdater {
+
+    WorkerPool::WorkerPool(unsigned threads)
+        : task_(nullptr), next_(0), count_(0), pending_(0), stopping_(false) {
+        if (threads == 0) {
+            threads = 1;
+        }
+        threads_.reserve(threads);
+        for (unsigned i = 0; i < threads; i++) {
+            threads_.emplace_back(&WorkerPool::workerLoop, this);
+        }
+    }
+
+    WorkerPool::~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        for (std::thread& thread : threads_) {
+            thread.join();
+        }
+    }
+
+    void WorkerPool::run(size_t count, const std::function<void(size_t)>& task) {
+        if (count == 0) {
+            return;
+        }
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        task_ = &task;
+        next_ = 0;
+        count_ = count;
+        pending_ = count;
+        error_ = nullptr;
+        wake_.notify_all();
+
+        done_.wait(lock, [this] { return pending_ == 0; });
+        task_ = nullptr;
+        count_ = 0;
+
+        if (error_) {
+            std::exception_ptr error = error_;
+            error_ = nullptr;
+            std::rethrow_exception(error);
+        }
+    }
+
+    void WorkerPool::workerLoop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            wake_.wait(lock, [this] { return stopping_ || next_ < count_; });
+            if (stopping_) {
+                return;
+            }
+
+            size_t index = next_++;
+            const std::function<void(size_t)>* task = task_;
+            lock.unlock();
+
+            std::exception_ptr error;
+            try {
+                (*task)(index);
+            } catch (...) {
+                error = std::current_exception();
+            }
+
+            lock.lock();
+            if (error && !error_) {
+                error_ = error;
+            }
+            if (--pending_ == 0) {
+                done_.notify_all();
+            }
+        }
+    }
+
+} // namespace WUpdater
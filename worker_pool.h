@@ -0,0 +1,49 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace WUpdater {
+
+    /**
+     * @brief Fixed set of worker threads that run indexed batches of tasks.
+     *
+     * run() hands out task indices to the workers and blocks until every task
+     * has finished. The first exception thrown by a task is rethrown from run().
+     * Only one batch runs at a time.
+     */
+    class WorkerPool {
+    public:
+        explicit WorkerPool(unsigned threads);
+        ~WorkerPool();
+
+        // Disable copy
+        WorkerPool(const WorkerPool&) = delete;
+        WorkerPool& operator=(const WorkerPool&) = delete;
+
+        unsigned size() const { return static_cast<unsigned>(threads_.size()); }
+
+        // Run task(i) for every i in [0, count) and wait for all of them
+        void run(size_t count, const std::function<void(size_t)>& task);
+
+    private:
+        std::vector<std::thread> threads_;
+        std::mutex mutex_;
+        std::condition_variable wake_;
+        std::condition_variable done_;
+        const std::function<void(size_t)>* task_;
+        size_t next_;
+        size_t count_;
+        size_t pending_;
+        std::exception_ptr error_;
+        bool stopping_;
+
+        void workerLoop();
+    };
+
+} // namespace WUpdater
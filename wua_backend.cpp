@@ -0,0 +1,993 @@
+#include "wua_backend.h"
+#include "logger.h"
+#include "update_table.h"
+#include "utf8.h"
+#include <urlmon.h>
+#include <algorithm>
+#include <cwchar>
+
+namespace WUpdater {
+
+    namespace {
+
+        // IUpdate::get_MaxDownloadSize reports a DECIMAL; the sizes fit in 64 bits
+        int64_t decimalToInt64(const DECIMAL& value) {
+            LONG64 result = 0;
+            if (FAILED(VarI8FromDec(&value, &result))) {
+                return 0;
+            }
+            return static_cast<int64_t>(result);
+        }
+
+        // UpdateID terms per lookup search; keeps the criteria string short
+        const size_t kIdsPerLookup = 64;
+
+        // WSUS server configured by policy, empty when updates come from Microsoft
+        std::wstring policyUpdateServer() {
+            wchar_t buffer[512];
+            DWORD size = sizeof(buffer);
+            LSTATUS status = RegGetValueW(HKEY_LOCAL_MACHINE, L"SOFTWARE\\Policies\\Microsoft\\Windows\\WindowsUpdate",
+                                          L"WUServer", RRF_RT_REG_SZ, nullptr, buffer, &size);
+            return status == ERROR_SUCCESS ? std::wstring(buffer) : std::wstring();
+        }
+
+        // How long an aborted search may take to wind down before it is abandoned
+        const DWORD kAbortGraceMs = 30000;
+
+        // Wait for an async job's completion event. CoWaitForMultipleHandles pumps
+        // messages, which is how WUA delivers callbacks to an STA thread.
+        HRESULT waitForEvent(HANDLE event, DWORD milliseconds) {
+            DWORD index = 0;
+            return CoWaitForMultipleHandles(0, milliseconds, 1, &event, &index);
+        }
+
+        // Wait for a search to complete in short slices, honouring the
+        // timeout, the cancel flag and the heartbeat interval
+        HRESULT waitForSearch(HANDLE event, const SearchOptions& options) {
+            const ULONGLONG start = GetTickCount64();
+            const ULONGLONG heartbeatMs = options.heartbeatSeconds * 1000ULL;
+            ULONGLONG nextHeartbeat = start + heartbeatMs;
+
+            while (true) {
+                HRESULT hr = waitForEvent(event, 250);
+                if (hr != RPC_S_CALLPENDING) {
+                    return hr;
+                }
+
+                ULONGLONG now = GetTickCount64();
+                if (options.cancel != nullptr && options.cancel->load()) {
+                    return WU_E_CALL_CANCELLED;
+                }
+                if (options.timeoutSeconds > 0 && now - start >= options.timeoutSeconds * 1000ULL) {
+                    return WU_E_TIME_OUT;
+                }
+                if (options.callback && heartbeatMs > 0 && now >= nextHeartbeat) {
+                    options.callback(ProgressPhase::SEARCHING,
+                                     static_cast<unsigned int>((now - start) / 1000), options.context);
+                    nextHeartbeat += heartbeatMs;
+                }
+            }
+        }
+
+        // Joins the multithreaded apartment for the lifetime of a thread that
+        // has not initialized COM itself (worker pool threads)
+        struct ThreadApartment {
+            bool owned;
+            ThreadApartment() : owned(SUCCEEDED(CoInitializeEx(nullptr, COINIT_MULTITHREADED))) {}
+            ~ThreadApartment() {
+                if (owned) {
+                    CoUninitialize();
+                }
+            }
+        };
+
+        void enterApartment() {
+            static thread_local ThreadApartment apartment;
+            (void)apartment;
+        }
+
+        // Interface pointers obtained in the MTA may be used directly by other
+        // MTA threads; STA pointers may only be used on their own thread
+        bool inMultithreadedApartment() {
+            APTTYPE type = APTTYPE_CURRENT;
+            APTTYPEQUALIFIER qualifier = APTTYPEQUALIFIER_NONE;
+            if (FAILED(CoGetApartmentType(&type, &qualifier))) {
+                return false;
+            }
+            return type == APTTYPE_MTA || qualifier == APTTYPEQUALIFIER_IMPLICIT_MTA;
+        }
+
+        // Result lists shorter than this are processed on the calling thread
+        const size_t kMinUpdatesPerWorker = 32;
+
+        UpdateOutcome toOutcome(OperationResultCode resultCode, HRESULT hresult) {
+            UpdateOutcome outcome;
+            outcome.result = static_cast<ResultCode>(resultCode);
+            outcome.hresult = hresult;
+            return outcome;
+        }
+
+        Severity parseSeverity(const wchar_t* rating) {
+            if (rating == nullptr) {
+                return Severity::UNSPECIFIED;
+            }
+            if (_wcsicmp(rating, L"Critical") == 0) {
+                return Severity::CRITICAL;
+            }
+            if (_wcsicmp(rating, L"Important") == 0) {
+                return Severity::IMPORTANT;
+            }
+            if (_wcsicmp(rating, L"Moderate") == 0) {
+                return Severity::MODERATE;
+            }
+            if (_wcsicmp(rating, L"Low") == 0) {
+                return Severity::LOW;
+            }
+            return Severity::UNSPECIFIED;
+        }
+
+        // Well-known CategoryIDs of the UpdateClassification categories
+        UpdateClassification parseClassification(const wchar_t* categoryId) {
+            static const struct {
+                const wchar_t* id;
+                UpdateClassification classification;
+            } kClassifications[] = {
+                { L"0fa1201d-4330-4fa8-8ae9-b877473b6441", UpdateClassification::SECURITY_UPDATES },
+                { L"e6cf1350-c01b-414d-a61f-263d14d133b4", UpdateClassification::CRITICAL_UPDATES },
+                { L"e0789628-ce08-4437-be74-2495b842f43b", UpdateClassification::DEFINITION_UPDATES },
+                { L"ebfc1fc5-71a4-4f7b-9aca-3b9a503104a0", UpdateClassification::DRIVERS },
+                { L"b54e7d24-7add-428f-8b75-90a396fa584f", UpdateClassification::FEATURE_PACKS },
+                { L"68c5b0a3-d1a6-4553-ae49-01d3a7827828", UpdateClassification::SERVICE_PACKS },
+                { L"b4832bd8-e735-4761-8daf-37f882276dab", UpdateClassification::TOOLS },
+                { L"28bc880e-0592-4cbf-8f95-c79b17911d5f", UpdateClassification::UPDATE_ROLLUPS },
+                { L"cd5ffd1e-e932-4e3a-bf74-18bf0b1bbd83", UpdateClassification::UPDATES },
+                { L"3689bdc8-b205-4af4-8d4a-a63924c5e9d5", UpdateClassification::UPGRADES },
+            };
+            if (categoryId != nullptr) {
+                for (const auto& known : kClassifications) {
+                    if (_wcsicmp(categoryId, known.id) == 0) {
+                        return known.classification;
+                    }
+                }
+            }
+            return UpdateClassification::UNSPECIFIED;
+        }
+
+        // Append the download URLs of one update, named after their last path segment
+        HRESULT addContentFiles(IUpdate* update, int32_t bundle, std::vector<ContentFile>& files) {
+            IUpdateDownloadContentCollectionPtr contents;
+            HRESULT hr = update->get_DownloadContents(&contents);
+            if (FAILED(hr)) {
+                return hr;
+            }
+            LONG count = 0;
+            contents->get_Count(&count);
+            for (LONG i = 0; i < count; i++) {
+                IUpdateDownloadContentPtr content;
+                BSTR urlBstr = nullptr;
+                if (FAILED(contents->get_Item(i, &content)) || FAILED(content->get_DownloadUrl(&urlBstr))) {
+                    continue;
+                }
+                _bstr_t url(urlBstr, false);
+                ContentFile file;
+                file.url = static_cast<const wchar_t*>(url) ? static_cast<const wchar_t*>(url) : L"";
+                size_t slash = file.url.find_last_of(L"/\\");
+                file.name = slash == std::wstring::npos ? file.url : file.url.substr(slash + 1);
+                file.bundle = bundle;
+                if (!file.name.empty()) {
+                    files.push_back(file);
+                }
+            }
+            return S_OK;
+        }
+
+        // Read every property the tool uses from one IUpdate
+        HRESULT readRecord(IUpdate* update, const UpdateHandle& handle, UpdateRecord& record) {
+            record.handle = handle;
+
+            BSTR titleBstr = nullptr;
+            HRESULT hr = update->get_Title(&titleBstr);
+            if (FAILED(hr)) {
+                return hr;
+            }
+            _bstr_t title(titleBstr, false);
+            record.title = static_cast<const wchar_t*>(title) ? static_cast<const wchar_t*>(title) : L"";
+
+            IUpdateIdentityPtr identity;
+            hr = update->get_Identity(&identity);
+            if (SUCCEEDED(hr)) {
+                BSTR idBstr = nullptr;
+                if (SUCCEEDED(identity->get_UpdateID(&idBstr))) {
+                    _bstr_t id(idBstr, false);
+                    record.updateId = static_cast<const wchar_t*>(id) ? static_cast<const wchar_t*>(id) : L"";
+                }
+                LONG revision = 0;
+                if (SUCCEEDED(identity->get_RevisionNumber(&revision))) {
+                    record.revision = static_cast<int32_t>(revision);
+                }
+            }
+
+            record.kbArticleIds.clear();
+            IStringCollectionPtr kbs;
+            if (SUCCEEDED(update->get_KBArticleIDs(&kbs))) {
+                LONG kbCount = 0;
+                kbs->get_Count(&kbCount);
+                for (LONG k = 0; k < kbCount; k++) {
+                    BSTR kbBstr = nullptr;
+                    if (SUCCEEDED(kbs->get_Item(k, &kbBstr)) && kbBstr != nullptr) {
+                        record.kbArticleIds.push_back(static_cast<uint32_t>(std::wcstoul(kbBstr, nullptr, 10)));
+                    }
+                    SysFreeString(kbBstr);
+                }
+            }
+
+            DECIMAL maxSize;
+            if (SUCCEEDED(update->get_MaxDownloadSize(&maxSize))) {
+                record.maxDownloadSize = decimalToInt64(maxSize);
+            }
+
+            DATE releaseDate = 0;
+            if (SUCCEEDED(update->get_LastDeploymentChangeTime(&releaseDate))) {
+                record.releaseDate = releaseDate;
+            }
+
+            BSTR severityBstr = nullptr;
+            record.severity = Severity::UNSPECIFIED;
+            if (SUCCEEDED(update->get_MsrcSeverity(&severityBstr))) {
+                record.severity = parseSeverity(severityBstr);
+                SysFreeString(severityBstr);
+            }
+
+            // Exclusive handling is an Impact value; IUpdate5 adds nothing the planner needs
+            IInstallationBehaviorPtr behavior;
+            record.impact = InstallImpact::NORMAL;
+            record.reboot = RebootBehavior::NEVER;
+            if (SUCCEEDED(update->get_InstallationBehavior(&behavior)) && behavior != nullptr) {
+                InstallationImpact impact = iiNormal;
+                InstallationRebootBehavior reboot = irbNeverReboots;
+                if (SUCCEEDED(behavior->get_Impact(&impact))) {
+                    record.impact = static_cast<InstallImpact>(impact);
+                }
+                if (SUCCEEDED(behavior->get_RebootBehavior(&reboot))) {
+                    record.reboot = static_cast<RebootBehavior>(reboot);
+                }
+            }
+
+            // One of the update's categories is its classification
+            ICategoryCollectionPtr categories;
+            record.classification = UpdateClassification::UNSPECIFIED;
+            if (SUCCEEDED(update->get_Categories(&categories)) && categories != nullptr) {
+                LONG categoryCount = 0;
+                categories->get_Count(&categoryCount);
+                for (LONG c = 0; c < categoryCount && record.classification == UpdateClassification::UNSPECIFIED; c++) {
+                    ICategoryPtr category;
+                    BSTR typeBstr = nullptr;
+                    if (FAILED(categories->get_Item(c, &category)) || FAILED(category->get_Type(&typeBstr))) {
+                        continue;
+                    }
+                    _bstr_t type(typeBstr, false);
+                    const wchar_t* typeName = static_cast<const wchar_t*>(type);
+                    BSTR idBstr = nullptr;
+                    if (typeName != nullptr && _wcsicmp(typeName, L"UpdateClassification") == 0 &&
+                        SUCCEEDED(category->get_CategoryID(&idBstr))) {
+                        _bstr_t id(idBstr, false);
+                        record.classification = parseClassification(static_cast<const wchar_t*>(id));
+                    }
+                }
+            }
+
+            VARIANT_BOOL flag = VARIANT_FALSE;
+            hr = update->get_IsDownloaded(&flag);
+            if (FAILED(hr)) {
+                return hr;
+            }
+            record.isDownloaded = flag != VARIANT_FALSE;
+
+            flag = VARIANT_FALSE;
+            if (SUCCEEDED(update->get_IsInstalled(&flag))) {
+                record.isInstalled = flag != VARIANT_FALSE;
+            }
+            return S_OK;
+        }
+
+    } // namespace
+
+    WuaBackend::WuaBackend(unsigned workerThreads)
+        : git_(nullptr), sessionCookie_(0), workerThreads_(workerThreads > 0 ? workerThreads : 1) {}
+
+    void WuaBackend::forEachUpdate(size_t count, const std::function<void(size_t)>& task) {
+        size_t threads = (std::min)(static_cast<size_t>(workerThreads_), count / kMinUpdatesPerWorker);
+        if (threads <= 1 || !inMultithreadedApartment()) {
+            for (size_t i = 0; i < count; i++) {
+                task(i);
+            }
+            return;
+        }
+
+        WorkerPool* pool = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!pool_) {
+                pool_.reset(new WorkerPool(workerThreads_));
+            }
+            pool = pool_.get();
+        }
+
+        // The pool runs one batch at a time, so concurrent callers take turns.
+        // Contiguous index ranges; the pool threads join the MTA before touching COM
+        std::lock_guard<std::mutex> run(poolMutex_);
+        pool->run(threads, [&](size_t part) {
+            enterApartment();
+            size_t end = count * (part + 1) / threads;
+            for (size_t i = count * part / threads; i < end; i++) {
+                task(i);
+            }
+        });
+    }
+
+    WuaBackend::~WuaBackend() {
+        if (git_ != nullptr) {
+            for (DWORD cookie : resultCookies_) {
+                if (cookie != 0) {
+                    git_->RevokeInterfaceFromGlobal(cookie);
+                }
+            }
+            if (sessionCookie_ != 0) {
+                git_->RevokeInterfaceFromGlobal(sessionCookie_);
+            }
+            git_->Release();
+        }
+    }
+
+    HRESULT WuaBackend::getSession(IUpdateSessionPtr& session) {
+        enterApartment();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (git_ == nullptr) {
+            HRESULT hr = CoCreateInstance(CLSID_StdGlobalInterfaceTable, nullptr, CLSCTX_INPROC_SERVER,
+                                          IID_IGlobalInterfaceTable, reinterpret_cast<void**>(&git_));
+            if (FAILED(hr)) {
+                return hr;
+            }
+        }
+
+        if (sessionCookie_ == 0) {
+            HRESULT hr = session.CreateInstance(CLSID_UpdateSession);
+            if (FAILED(hr)) {
+                return hr;
+            }
+            return git_->RegisterInterfaceInGlobal(session, __uuidof(IUpdateSession), &sessionCookie_);
+        }
+
+        session = nullptr;
+        return git_->GetInterfaceFromGlobal(sessionCookie_, __uuidof(IUpdateSession),
+                                            reinterpret_cast<void**>(&session));
+    }
+
+    bool WuaBackend::allowsConcurrentCalls() const {
+        // The session is created in whichever apartment asks first; worker
+        // threads reach STA-owned objects only while the owner pumps messages
+        return inMultithreadedApartment();
+    }
+
+    void WuaBackend::releaseSearches() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (git_ == nullptr) {
+            return;
+        }
+        // Slots stay allocated so a stale handle can never reach a newer result set
+        for (DWORD& cookie : resultCookies_) {
+            if (cookie != 0) {
+                git_->RevokeInterfaceFromGlobal(cookie);
+                cookie = 0;
+            }
+        }
+    }
+
+    HRESULT WuaBackend::getResultSet(uint32_t resultSet, IUpdateCollectionPtr& updates) {
+        enterApartment();
+
+        DWORD cookie = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (git_ == nullptr || resultSet >= resultCookies_.size() || resultCookies_[resultSet] == 0) {
+                return WU_E_INVALIDINDEX;
+            }
+            cookie = resultCookies_[resultSet];
+        }
+
+        updates = nullptr;
+        return git_->GetInterfaceFromGlobal(cookie, __uuidof(IUpdateCollection),
+                                            reinterpret_cast<void**>(&updates));
+    }
+
+    HRESULT WuaBackend::getItem(const UpdateHandle& handle, IUpdatePtr& update) {
+        IUpdateCollectionPtr updates;
+        HRESULT hr = getResultSet(handle.resultSet, updates);
+        if (FAILED(hr)) {
+            return hr;
+        }
+        return updates->get_Item(static_cast<LONG>(handle.index), &update);
+    }
+
+    HRESULT WuaBackend::buildCollection(const std::vector<UpdateHandle>& updates, IUpdateCollectionPtr& collection) {
+        HRESULT hr = collection.CreateInstance(CLSID_UpdateCollection);
+        if (FAILED(hr)) {
+            return hr;
+        }
+
+        // Fetch each result set from the interface table once, not once per update
+        std::vector<IUpdateCollectionPtr> resultSets;
+        for (const UpdateHandle& handle : updates) {
+            if (handle.resultSet >= resultSets.size()) {
+                resultSets.resize(handle.resultSet + 1);
+            }
+            IUpdateCollectionPtr& source = resultSets[handle.resultSet];
+            if (source == nullptr) {
+                hr = getResultSet(handle.resultSet, source);
+                if (FAILED(hr)) {
+                    return hr;
+                }
+            }
+
+            IUpdatePtr update;
+            hr = source->get_Item(static_cast<LONG>(handle.index), &update);
+            if (FAILED(hr)) {
+                return hr;
+            }
+
+            LONG newIndex = 0;
+            hr = collection->Add(update, &newIndex);
+            if (FAILED(hr)) {
+                return hr;
+            }
+        }
+        return S_OK;
+    }
+
+    HRESULT WuaBackend::search(const std::wstring& criteria, const SearchOptions& options,
+                               std::vector<UpdateHandle>& found) {
+        IUpdateSessionPtr session;
+        HRESULT hr = getSession(session);
+        if (FAILED(hr)) {
+            return hr;
+        }
+
+        IUpdateSearcherPtr searcher;
+        hr = session->CreateUpdateSearcher(&searcher);
+        if (FAILED(hr)) {
+            return hr;
+        }
+
+        // The callback starts with one reference, which the smart pointer adopts
+        SearchCompletedCallback* completed = new SearchCompletedCallback(nullptr, nullptr);
+        ISearchCompletedCallbackPtr completedPtr(completed, false);
+
+        ISearchJobPtr job;
+        hr = searcher->BeginSearch(_bstr_t(criteria.c_str()), completedPtr, _variant_t(), &job);
+        if (FAILED(hr)) {
+            return hr;
+        }
+
+        HRESULT waitHr = waitForSearch(completed->GetEvent(), options);
+        bool finished = SUCCEEDED(waitHr);
+        if (!finished) {
+            // Timed out or cancelled: ask WUA to stop and give it a bounded grace period
+            job->RequestAbort();
+            finished = waitForEvent(completed->GetEvent(), kAbortGraceMs) == S_OK;
+        }
+
+        ISearchResultPtr result;
+        if (finished) {
+            hr = searcher->EndSearch(job, &result);
+        }
+        job->CleanUp();
+
+        if (FAILED(waitHr)) {
+            return waitHr;
+        }
+        if (FAILED(hr)) {
+            return hr;
+        }
+
+        IUpdateCollectionPtr updates;
+        hr = result->get_Updates(&updates);
+        if (FAILED(hr)) {
+            return hr;
+        }
+
+        LONG count = 0;
+        hr = updates->get_Count(&count);
+        if (FAILED(hr)) {
+            return hr;
+        }
+
+        DWORD cookie = 0;
+        hr = git_->RegisterInterfaceInGlobal(updates, __uuidof(IUpdateCollection), &cookie);
+        if (FAILED(hr)) {
+            return hr;
+        }
+
+        uint32_t resultSet = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            resultSet = static_cast<uint32_t>(resultCookies_.size());
+            resultCookies_.push_back(cookie);
+        }
+
+        found.reserve(found.size() + static_cast<size_t>(count));
+        for (LONG i = 0; i < count; i++) {
+            UpdateHandle handle;
+            handle.resultSet = resultSet;
+            handle.index = static_cast<uint32_t>(i);
+            found.push_back(handle);
+        }
+        return S_OK;
+    }
+
+    HRESULT WuaBackend::findByIdentity(const std::vector<std::wstring>& updateIds,
+                                       std::vector<UpdateHandle>& found) {
+        SearchOptions options;
+        for (size_t first = 0; first < updateIds.size(); first += kIdsPerLookup) {
+            size_t last = (std::min)(first + kIdsPerLookup, updateIds.size());
+            std::wstring criteria;
+            for (size_t i = first; i < last; i++) {
+                criteria += (i == first ? L"UpdateID='" : L" or UpdateID='") + updateIds[i] + L"'";
+            }
+
+            HRESULT hr = search(criteria, options, found);
+            if (FAILED(hr)) {
+                return hr;
+            }
+        }
+        return S_OK;
+    }
+
+    HRESULT WuaBackend::getSearchContext(SearchContext& context) {
+        IUpdateSessionPtr session;
+        HRESULT hr = getSession(session);
+        if (FAILED(hr)) {
+            return hr;
+        }
+
+        IUpdateSearcherPtr searcher;
+        hr = session->CreateUpdateSearcher(&searcher);
+        if (FAILED(hr)) {
+            return hr;
+        }
+
+        ServerSelection selection = ssDefault;
+        searcher->get_ServerSelection(&selection);
+        switch (selection) {
+            case ssManagedServer:
+                context.serverSelection = L"wsus:" + policyUpdateServer();
+                break;
+            case ssWindowsUpdate:
+                context.serverSelection = L"wu";
+                break;
+            case ssOthers: {
+                BSTR serviceBstr = nullptr;
+                searcher->get_ServiceID(&serviceBstr);
+                _bstr_t service(serviceBstr, false);
+                context.serverSelection = L"service:" +
+                    std::wstring(static_cast<const wchar_t*>(service) ? static_cast<const wchar_t*>(service) : L"");
+                break;
+            }
+            default:
+                context.serverSelection = L"default:" + policyUpdateServer();
+                break;
+        }
+
+        // The detection time is best effort; without it entries simply expire by TTL
+        context.lastDetection = 0;
+        IAutomaticUpdates2Ptr automaticUpdates;
+        IAutomaticUpdatesResultsPtr results;
+        if (SUCCEEDED(automaticUpdates.CreateInstance(CLSID_AutomaticUpdates)) &&
+            SUCCEEDED(automaticUpdates->get_Results(&results))) {
+            _variant_t lastSearch;
+            if (SUCCEEDED(results->get_LastSearchSuccessDate(&lastSearch)) && lastSearch.vt == VT_DATE) {
+                context.lastDetection = lastSearch.date;
+            }
+        }
+        return S_OK;
+    }
+
+    HRESULT WuaBackend::getUpdate(const UpdateHandle& handle, UpdateRecord& record) {
+        IUpdatePtr update;
+        HRESULT hr = getItem(handle, update);
+        if (FAILED(hr)) {
+            return hr;
+        }
+        return readRecord(update, handle, record);
+    }
+
+    HRESULT WuaBackend::readUpdates(const std::vector<UpdateHandle>& handles, size_t begin, size_t end,
+                                    UpdateTable& table) {
+        HRESULT result = S_OK;
+        UpdateRecord record;
+
+        // Fetch each result set from the interface table once for the whole range
+        std::vector<IUpdateCollectionPtr> resultSets;
+        for (size_t i = begin; i < end && i < handles.size(); i++) {
+            const UpdateHandle& handle = handles[i];
+            if (handle.resultSet >= resultSets.size()) {
+                resultSets.resize(handle.resultSet + 1);
+            }
+
+            IUpdateCollectionPtr& source = resultSets[handle.resultSet];
+            HRESULT hr = source == nullptr ? getResultSet(handle.resultSet, source) : S_OK;
+
+            IUpdatePtr update;
+            if (SUCCEEDED(hr)) {
+                hr = source->get_Item(static_cast<LONG>(handle.index), &update);
+            }
+            if (SUCCEEDED(hr)) {
+                hr = readRecord(update, handle, record);
+            }
+            if (FAILED(hr)) {
+                if (SUCCEEDED(result)) {
+                    result = hr;
+                }
+                continue;
+            }
+            table.append(record);
+        }
+        return result;
+    }
+
+    HRESULT WuaBackend::getIdentity(const UpdateHandle& handle, std::wstring& updateId, int32_t& revision) {
+        IUpdatePtr update;
+        HRESULT hr = getItem(handle, update);
+        if (FAILED(hr)) {
+            return hr;
+        }
+
+        IUpdateIdentityPtr identity;
+        hr = update->get_Identity(&identity);
+        if (FAILED(hr)) {
+            return hr;
+        }
+
+        BSTR idBstr = nullptr;
+        hr = identity->get_UpdateID(&idBstr);
+        if (FAILED(hr)) {
+            return hr;
+        }
+        _bstr_t id(idBstr, false);
+        updateId = static_cast<const wchar_t*>(id) ? static_cast<const wchar_t*>(id) : L"";
+
+        LONG revisionNumber = 0;
+        hr = identity->get_RevisionNumber(&revisionNumber);
+        revision = static_cast<int32_t>(revisionNumber);
+        return hr;
+    }
+
+    HRESULT WuaBackend::download(const std::vector<UpdateHandle>& updates,
+                                 std::vector<UpdateOutcome>& outcomes,
+                                 DownloadObserver* observer) {
+        outcomes.assign(updates.size(), UpdateOutcome());
+
+        IUpdateCollectionPtr collection;
+        HRESULT hr = buildCollection(updates, collection);
+        if (FAILED(hr)) {
+            return hr;
+        }
+
+        IUpdateSessionPtr session;
+        hr = getSession(session);
+        if (FAILED(hr)) {
+            return hr;
+        }
+
+        IUpdateDownloaderPtr downloader;
+        hr = session->CreateUpdateDownloader(&downloader);
+        if (FAILED(hr)) {
+            return hr;
+        }
+
+        hr = downloader->put_Updates(collection);
+        if (FAILED(hr)) {
+            return hr;
+        }
+
+        // The callbacks start with one reference, which the smart pointers adopt
+        DownloadProgressCallback* progress = new DownloadProgressCallback(observer, updates.size());
+        IDownloadProgressChangedCallbackPtr progressPtr(progress, false);
+        DownloadCompletedCallback* completed = new DownloadCompletedCallback(nullptr, nullptr);
+        IDownloadCompletedCallbackPtr completedPtr(completed, false);
+
+        IDownloadJobPtr job;
+        hr = downloader->BeginDownload(progressPtr, completedPtr, _variant_t(), &job);
+        if (FAILED(hr)) {
+            return hr;
+        }
+
+        // Wait for the completion event; abort once if the observer asks to
+        bool abortRequested = false;
+        while (waitForEvent(completed->GetEvent(), 250) == RPC_S_CALLPENDING) {
+            if (!abortRequested && observer != nullptr && observer->cancelRequested()) {
+                job->RequestAbort();
+                abortRequested = true;
+            }
+        }
+
+        IDownloadResultPtr downloadResult;
+        hr = downloader->EndDownload(job, &downloadResult);
+        job->CleanUp();
+        if (FAILED(hr)) {
+            return hr;
+        }
+
+        forEachUpdate(updates.size(), [&](size_t i) {
+            IUpdateDownloadResultPtr updateResult;
+            if (FAILED(downloadResult->GetUpdateResult(static_cast<LONG>(i), &updateResult))) {
+                return;
+            }
+
+            OperationResultCode resultCode = orcNotStarted;
+            HRESULT updateHr = S_OK;
+            updateResult->get_ResultCode(&resultCode);
+            updateResult->get_HResult(&updateHr);
+            outcomes[i] = toOutcome(resultCode, updateHr);
+        });
+
+        progress->finish(outcomes);
+        return S_OK;
+    }
+
+    HRESULT WuaBackend::install(const std::vector<UpdateHandle>& updates,
+                                std::vector<UpdateOutcome>& outcomes,
+                                UpdateProgressCallback callback, void* context) {
+        outcomes.assign(updates.size(), UpdateOutcome());
+
+        IUpdateCollectionPtr collection;
+        HRESULT hr = buildCollection(updates, collection);
+        if (FAILED(hr)) {
+            return hr;
+        }
+
+        IUpdateSessionPtr session;
+        hr = getSession(session);
+        if (FAILED(hr)) {
+            return hr;
+        }
+
+        IUpdateInstallerPtr installer;
+        hr = session->CreateUpdateInstaller(&installer);
+        if (FAILED(hr)) {
+            return hr;
+        }
+
+        hr = installer->put_Updates(collection);
+        if (FAILED(hr)) {
+            return hr;
+        }
+
+        // Perform installation
+        IInstallationResultPtr installResult;
+        hr = installer->Install(&installResult);
+        if (FAILED(hr)) {
+            return hr;
+        }
+
+        forEachUpdate(updates.size(), [&](size_t i) {
+            IUpdateInstallationResultPtr updateResult;
+            if (FAILED(installResult->GetUpdateResult(static_cast<LONG>(i), &updateResult))) {
+                return;
+            }
+
+            OperationResultCode resultCode = orcNotStarted;
+            HRESULT updateHr = S_OK;
+            VARIANT_BOOL rebootRequired = VARIANT_FALSE;
+            updateResult->get_ResultCode(&resultCode);
+            updateResult->get_HResult(&updateHr);
+            updateResult->get_RebootRequired(&rebootRequired);
+            outcomes[i] = toOutcome(resultCode, updateHr);
+            outcomes[i].rebootRequired = rebootRequired != VARIANT_FALSE;
+        });
+
+        if (callback) {
+            callback(ProgressPhase::INSTALLING, 100, context);
+        }
+        return S_OK;
+    }
+
+    HRESULT WuaBackend::getContentFiles(const UpdateHandle& handle, std::vector<ContentFile>& files) {
+        files.clear();
+        IUpdatePtr update;
+        HRESULT hr = getItem(handle, update);
+        if (FAILED(hr)) {
+            return hr;
+        }
+
+        // A bundle carries no payload itself; its bundled updates do
+        IUpdateCollectionPtr bundled;
+        LONG bundledCount = 0;
+        if (SUCCEEDED(update->get_BundledUpdates(&bundled)) && bundled != nullptr) {
+            bundled->get_Count(&bundledCount);
+        }
+        if (bundledCount == 0) {
+            hr = addContentFiles(update, -1, files);
+        }
+        for (LONG i = 0; i < bundledCount && SUCCEEDED(hr); i++) {
+            IUpdatePtr child;
+            hr = bundled->get_Item(i, &child);
+            if (SUCCEEDED(hr)) {
+                hr = addContentFiles(child, static_cast<int32_t>(i), files);
+            }
+        }
+        if (SUCCEEDED(hr) && files.empty()) {
+            hr = WU_E_NOT_SUPPORTED;
+        }
+        return hr;
+    }
+
+    HRESULT WuaBackend::fetchContentFile(const ContentFile& file, const std::string& path) {
+        return URLDownloadToFileW(nullptr, file.url.c_str(), fromUtf8(path).c_str(), 0, nullptr);
+    }
+
+    HRESULT WuaBackend::copyToCache(const UpdateHandle& handle, const std::vector<ContentFile>& files,
+                                    const std::vector<std::string>& paths) {
+        IUpdatePtr update;
+        HRESULT hr = getItem(handle, update);
+        if (FAILED(hr)) {
+            return hr;
+        }
+
+        // CopyToCache takes the files of one leaf update, so a bundle is staged
+        // one bundled update at a time
+        int32_t lastBundle = -1;
+        for (const ContentFile& file : files) {
+            lastBundle = (std::max)(lastBundle, file.bundle);
+        }
+        IUpdateCollectionPtr bundled;
+        if (lastBundle >= 0) {
+            hr = update->get_BundledUpdates(&bundled);
+            if (FAILED(hr)) {
+                return hr;
+            }
+        }
+
+        for (int32_t bundle = -1; bundle <= lastBundle; bundle++) {
+            IStringCollectionPtr collection;
+            hr = collection.CreateInstance(CLSID_StringCollection);
+            if (FAILED(hr)) {
+                return hr;
+            }
+            for (size_t i = 0; i < files.size() && i < paths.size(); i++) {
+                if (files[i].bundle != bundle) {
+                    continue;
+                }
+                LONG index = 0;
+                hr = collection->Add(_bstr_t(fromUtf8(paths[i]).c_str()), &index);
+                if (FAILED(hr)) {
+                    return hr;
+                }
+            }
+            LONG count = 0;
+            collection->get_Count(&count);
+            if (count == 0) {
+                continue;
+            }
+
+            IUpdatePtr target = update;
+            if (bundle >= 0) {
+                hr = bundled->get_Item(static_cast<LONG>(bundle), &target);
+                if (FAILED(hr)) {
+                    return hr;
+                }
+            }
+            IUpdate2Ptr target2;
+            hr = target.QueryInterface(__uuidof(IUpdate2), &target2);
+            if (FAILED(hr)) {
+                return hr;
+            }
+            hr = target2->CopyToCache(collection);
+            if (FAILED(hr)) {
+                return hr;
+            }
+        }
+        return S_OK;
+    }
+
+    // Search completed callback implementation
+    STDMETHODIMP SearchCompletedCallback::Invoke(ISearchJob* /*job*/, ISearchCompletedCallbackArgs* /*args*/) {
+        logEvent(LogLevel::DEBUG, L"Search job completed");
+        if (event_) {
+            SetEvent(event_);
+        }
+        return S_OK;
+    }
+
+    // Download progress callback implementation
+    STDMETHODIMP DownloadProgressCallback::Invoke(IDownloadJob* job, IDownloadProgressChangedCallbackArgs* args) {
+        try {
+            if (observer_ == nullptr) {
+                return S_OK;
+            }
+
+            IDownloadProgressPtr progress;
+            HRESULT hr = args->get_Progress(&progress);
+            if (FAILED(hr)) {
+                return hr;
+            }
+
+            DownloadProgress snapshot;
+            snapshot.updateCount = updateCount_;
+
+            LONG currentIndex = 0;
+            LONG percent = 0;
+            DECIMAL bytes;
+            progress->get_CurrentUpdateIndex(&currentIndex);
+            progress->get_PercentComplete(&percent);
+            snapshot.currentUpdate = static_cast<size_t>(currentIndex);
+            snapshot.percentComplete = static_cast<unsigned>(percent);
+            if (SUCCEEDED(progress->get_CurrentUpdateBytesDownloaded(&bytes))) {
+                snapshot.currentBytesDone = decimalToInt64(bytes);
+            }
+            if (SUCCEEDED(progress->get_CurrentUpdateBytesToDownload(&bytes))) {
+                snapshot.currentBytesTotal = decimalToInt64(bytes);
+            }
+            if (SUCCEEDED(progress->get_TotalBytesDownloaded(&bytes))) {
+                snapshot.totalBytesDone = decimalToInt64(bytes);
+            }
+            if (SUCCEEDED(progress->get_TotalBytesToDownload(&bytes))) {
+                snapshot.totalBytesTotal = decimalToInt64(bytes);
+            }
+
+            logEvent(LogLevel::DEBUG, L"Download progress: update {} of {}, {} of {} bytes",
+                     static_cast<int64_t>(snapshot.currentUpdate) + 1, static_cast<int64_t>(updateCount_),
+                     snapshot.totalBytesDone, snapshot.totalBytesTotal);
+            observer_->onProgress(snapshot);
+
+            // Updates before the current index are finished; report them once
+            std::lock_guard<std::mutex> lock(mutex_);
+            while (nextToReport_ < snapshot.currentUpdate && nextToReport_ < updateCount_) {
+                IUpdateDownloadResultPtr updateResult;
+                UpdateOutcome outcome;
+                if (SUCCEEDED(progress->GetUpdateResult(static_cast<LONG>(nextToReport_), &updateResult))) {
+                    OperationResultCode resultCode = orcNotStarted;
+                    HRESULT updateHr = S_OK;
+                    updateResult->get_ResultCode(&resultCode);
+                    updateResult->get_HResult(&updateHr);
+                    outcome = toOutcome(resultCode, updateHr);
+                }
+                observer_->onUpdateDownloaded(nextToReport_, outcome);
+                nextToReport_++;
+            }
+
+            return S_OK;
+        } catch (...) {
+            return E_FAIL;
+        }
+    }
+
+    void DownloadProgressCallback::finish(const std::vector<UpdateOutcome>& outcomes) {
+        if (observer_ == nullptr) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        while (nextToReport_ < outcomes.size()) {
+            observer_->onUpdateDownloaded(nextToReport_, outcomes[nextToReport_]);
+            nextToReport_++;
+        }
+    }
+
+    // Download completed callback implementation
+    STDMETHODIMP DownloadCompletedCallback::Invoke(IDownloadJob* /*job*/, IDownloadCompletedCallbackArgs* /*args*/) {
+        logEvent(LogLevel::DEBUG, L"Download job completed");
+        try {
+            if (callback_) {
+                callback_(ProgressPhase::DOWNLOADING, 100, context_);
+            }
+            if (event_) {
+                SetEvent(event_);
+            }
+            return S_OK;
+        } catch (...) {
+            return E_FAIL;
+        }
+    }
+
+} // namespace WUpdater
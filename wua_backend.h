@@ -0,0 +1,220 @@
+#pragma once
+
+#include "update_backend.h"
+#include "worker_pool.h"
+#include <wuapi.h>
+#include <comutil.h>
+#include <comdef.h>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// COM smart pointer types for Windows Update API
+_COM_SMARTPTR_TYPEDEF(IUpdateSession, __uuidof(IUpdateSession));
+_COM_SMARTPTR_TYPEDEF(IUpdateSearcher, __uuidof(IUpdateSearcher));
+_COM_SMARTPTR_TYPEDEF(ISearchResult, __uuidof(ISearchResult));
+_COM_SMARTPTR_TYPEDEF(ISearchJob, __uuidof(ISearchJob));
+_COM_SMARTPTR_TYPEDEF(ISearchCompletedCallback, __uuidof(ISearchCompletedCallback));
+_COM_SMARTPTR_TYPEDEF(ISearchCompletedCallbackArgs, __uuidof(ISearchCompletedCallbackArgs));
+_COM_SMARTPTR_TYPEDEF(IUpdateCollection, __uuidof(IUpdateCollection));
+_COM_SMARTPTR_TYPEDEF(IUpdate, __uuidof(IUpdate));
+_COM_SMARTPTR_TYPEDEF(IUpdate2, __uuidof(IUpdate2));
+_COM_SMARTPTR_TYPEDEF(IUpdateDownloadContent, __uuidof(IUpdateDownloadContent));
+_COM_SMARTPTR_TYPEDEF(IUpdateDownloadContentCollection, __uuidof(IUpdateDownloadContentCollection));
+_COM_SMARTPTR_TYPEDEF(IUpdateIdentity, __uuidof(IUpdateIdentity));
+_COM_SMARTPTR_TYPEDEF(IInstallationBehavior, __uuidof(IInstallationBehavior));
+_COM_SMARTPTR_TYPEDEF(IStringCollection, __uuidof(IStringCollection));
+_COM_SMARTPTR_TYPEDEF(ICategoryCollection, __uuidof(ICategoryCollection));
+_COM_SMARTPTR_TYPEDEF(ICategory, __uuidof(ICategory));
+_COM_SMARTPTR_TYPEDEF(IUpdateDownloader, __uuidof(IUpdateDownloader));
+_COM_SMARTPTR_TYPEDEF(IDownloadResult, __uuidof(IDownloadResult));
+_COM_SMARTPTR_TYPEDEF(IUpdateDownloadResult, __uuidof(IUpdateDownloadResult));
+_COM_SMARTPTR_TYPEDEF(IUpdateInstaller, __uuidof(IUpdateInstaller));
+_COM_SMARTPTR_TYPEDEF(IInstallationResult, __uuidof(IInstallationResult));
+_COM_SMARTPTR_TYPEDEF(IUpdateInstallationResult, __uuidof(IUpdateInstallationResult));
+_COM_SMARTPTR_TYPEDEF(IDownloadJob, __uuidof(IDownloadJob));
+_COM_SMARTPTR_TYPEDEF(IDownloadProgressChangedCallback, __uuidof(IDownloadProgressChangedCallback));
+_COM_SMARTPTR_TYPEDEF(IDownloadCompletedCallback, __uuidof(IDownloadCompletedCallback));
+_COM_SMARTPTR_TYPEDEF(IDownloadProgressChangedCallbackArgs, __uuidof(IDownloadProgressChangedCallbackArgs));
+_COM_SMARTPTR_TYPEDEF(IDownloadCompletedCallbackArgs, __uuidof(IDownloadCompletedCallbackArgs));
+_COM_SMARTPTR_TYPEDEF(IDownloadProgress, __uuidof(IDownloadProgress));
+_COM_SMARTPTR_TYPEDEF(IAutomaticUpdates2, __uuidof(IAutomaticUpdates2));
+_COM_SMARTPTR_TYPEDEF(IAutomaticUpdatesResults, __uuidof(IAutomaticUpdatesResults));
+
+namespace WUpdater {
+
+    /**
+     * @brief Backend driving the Windows Update Agent through its COM API.
+     *
+     * Each search keeps its IUpdateCollection alive; handles index into those
+     * collections. The session and the collections are registered in the
+     * global interface table, so every call obtains pointers marshaled for
+     * the caller's apartment. Threads that have not initialized COM join the
+     * multithreaded apartment on first use.
+     *
+     * When the caller lives in the MTA, per-update result processing after a
+     * download or install is split across workerThreads pool threads, which
+     * share the result objects directly since they are in the same apartment.
+     *
+     * Content files are the download URLs of the update, or of each bundled
+     * update for a bundle; fetched copies are handed back to the agent per
+     * bundled update with IUpdate2::CopyToCache.
+     */
+    class WuaBackend : public UpdateBackend {
+    public:
+        explicit WuaBackend(unsigned workerThreads = 1);
+        ~WuaBackend() override;
+
+        // Disable copy
+        WuaBackend(const WuaBackend&) = delete;
+        WuaBackend& operator=(const WuaBackend&) = delete;
+
+        std::wstring name() const override { return L"wua"; }
+
+        HRESULT search(const std::wstring& criteria, const SearchOptions& options,
+                       std::vector<UpdateHandle>& found) override;
+        HRESULT findByIdentity(const std::vector<std::wstring>& updateIds,
+                               std::vector<UpdateHandle>& found) override;
+        HRESULT getSearchContext(SearchContext& context) override;
+        void releaseSearches() override;
+        bool allowsConcurrentCalls() const override;
+        HRESULT getUpdate(const UpdateHandle& handle, UpdateRecord& record) override;
+        HRESULT readUpdates(const std::vector<UpdateHandle>& handles, size_t begin, size_t end,
+                            UpdateTable& table) override;
+        HRESULT getIdentity(const UpdateHandle& handle, std::wstring& updateId, int32_t& revision) override;
+        HRESULT download(const std::vector<UpdateHandle>& updates,
+                         std::vector<UpdateOutcome>& outcomes,
+                         DownloadObserver* observer) override;
+        HRESULT install(const std::vector<UpdateHandle>& updates,
+                        std::vector<UpdateOutcome>& outcomes,
+                        UpdateProgressCallback callback, void* context) override;
+        HRESULT getContentFiles(const UpdateHandle& handle, std::vector<ContentFile>& files) override;
+        HRESULT fetchContentFile(const ContentFile& file, const std::string& path) override;
+        HRESULT copyToCache(const UpdateHandle& handle, const std::vector<ContentFile>& files,
+                            const std::vector<std::string>& paths) override;
+
+    private:
+        IGlobalInterfaceTable* git_;
+        DWORD sessionCookie_;
+        std::vector<DWORD> resultCookies_;
+        std::mutex mutex_;
+        unsigned workerThreads_;
+        std::unique_ptr<WorkerPool> pool_;
+        std::mutex poolMutex_;                  // Held across a pool batch; pipelined phases and download lanes share the pool
+
+        HRESULT getSession(IUpdateSessionPtr& session);
+        HRESULT getResultSet(uint32_t resultSet, IUpdateCollectionPtr& updates);
+        HRESULT getItem(const UpdateHandle& handle, IUpdatePtr& update);
+        HRESULT buildCollection(const std::vector<UpdateHandle>& updates, IUpdateCollectionPtr& collection);
+
+        // Run task(i) for i in [0, count), on the pool when the caller is in the MTA
+        void forEachUpdate(size_t count, const std::function<void(size_t)>& task);
+    };
+
+    // COM callback base class template
+    template <class InterfaceType>
+    class ComCallbackBase : public InterfaceType {
+    public:
+        ComCallbackBase(UpdateProgressCallback callback, void* context)
+            : callback_(callback), context_(context), refCount_(1) {}
+
+        virtual ~ComCallbackBase() = default;
+
+        // IUnknown implementation
+        STDMETHODIMP QueryInterface(REFIID riid, void** ppvObject) override {
+            if (ppvObject == nullptr)
+                return E_POINTER;
+
+            if (riid == __uuidof(IUnknown) || riid == __uuidof(InterfaceType)) {
+                *ppvObject = this;
+                AddRef();
+                return S_OK;
+            }
+
+            return E_NOINTERFACE;
+        }
+
+        STDMETHODIMP_(ULONG) AddRef() override {
+            return InterlockedIncrement(&refCount_);
+        }
+
+        STDMETHODIMP_(ULONG) Release() override {
+            ULONG count = InterlockedDecrement(&refCount_);
+            if (count == 0) {
+                delete this;
+            }
+            return count;
+        }
+
+    protected:
+        UpdateProgressCallback callback_;
+        void* context_;
+        LONG refCount_;
+    };
+
+    // Search completed callback implementation
+    class SearchCompletedCallback : public ComCallbackBase<ISearchCompletedCallback> {
+    public:
+        SearchCompletedCallback(UpdateProgressCallback callback, void* context)
+            : ComCallbackBase(callback, context) {
+            event_ = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+        }
+
+        ~SearchCompletedCallback() override {
+            if (event_) {
+                CloseHandle(event_);
+            }
+        }
+
+        STDMETHODIMP Invoke(ISearchJob* job, ISearchCompletedCallbackArgs* args) override;
+
+        HANDLE GetEvent() const { return event_; }
+
+    private:
+        HANDLE event_;
+    };
+
+    // Download progress callback implementation. Forwards byte counts to the
+    // observer and reports each update as soon as the job moves past it.
+    class DownloadProgressCallback : public ComCallbackBase<IDownloadProgressChangedCallback> {
+    public:
+        DownloadProgressCallback(DownloadObserver* observer, size_t updateCount)
+            : ComCallbackBase(nullptr, nullptr), observer_(observer),
+              updateCount_(updateCount), nextToReport_(0) {}
+
+        STDMETHODIMP Invoke(IDownloadJob* job, IDownloadProgressChangedCallbackArgs* args) override;
+
+        // Report the updates the progress callbacks have not covered yet
+        void finish(const std::vector<UpdateOutcome>& outcomes);
+
+    private:
+        DownloadObserver* observer_;
+        size_t updateCount_;
+        size_t nextToReport_;
+        std::mutex mutex_;
+    };
+
+    // Download completed callback implementation
+    class DownloadCompletedCallback : public ComCallbackBase<IDownloadCompletedCallback> {
+    public:
+        DownloadCompletedCallback(UpdateProgressCallback callback, void* context)
+            : ComCallbackBase(callback, context) {
+            event_ = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+        }
+
+        ~DownloadCompletedCallback() override {
+            if (event_) {
+                CloseHandle(event_);
+            }
+        }
+
+        STDMETHODIMP Invoke(IDownloadJob* job, IDownloadCompletedCallbackArgs* args) override;
+
+        HANDLE GetEvent() const { return event_; }
+
+    private:
+        HANDLE event_;
+    };
+
+} // namespace WUpdater
@@ -0,0 +1,408 @@
+// Micro-benchmarks for the update pipeline hot paths, run against the
+// simulated backend so they work on any platform:
+//
+//   wupdater_bench [--sizes 10,1000,50000] [--filter NAME] [--min-time-ms MS]
+//                  [--out PATH] [--baseline PATH] [--threshold PCT]
+//
+// Results are written as JSON (one benchmark per line). With --baseline the
+// medians are compared against an earlier result file and the exit code is 1
+// if any benchmark got slower by more than --threshold percent.
+
+#include "criteria.h"
+#include "error_messages.h"
+#include "messages.h"
+#include "record_writer.h"
+#include "search_cache.h"
+#include "simulated_backend.h"
+#include "update_manager.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+using namespace WUpdater;
+
+namespace {
+
+    struct BenchOptions {
+        std::vector<long> sizes = { 10, 1000, 50000 };
+        std::string filter;
+        unsigned minTimeMs = 200;
+        std::string outputPath;
+        std::string baselinePath;
+        double thresholdPercent = 10.0;
+    };
+
+    struct BenchResult {
+        std::string name;
+        long updates = 0;
+        size_t iterations = 0;
+        int64_t medianNs = 0;
+        int64_t minNs = 0;
+        int64_t meanNs = 0;
+    };
+
+    // One timed iteration: does its own untimed setup and returns the nanoseconds measured
+    typedef std::function<int64_t(long updates)> Iteration;
+
+    struct Benchmark {
+        const char* name;
+        Iteration run;
+    };
+
+    // Iterations run until this much time has passed, within these bounds
+    const size_t kMinIterations = 3;
+    const size_t kMaxIterations = 10000;
+
+    // Swallows console output so the benchmarks measure formatting, not the terminal
+    class NullBuffer : public std::wstreambuf {
+    protected:
+        int_type overflow(int_type c) override { return traits_type::not_eof(c); }
+        std::streamsize xsputn(const wchar_t*, std::streamsize count) override { return count; }
+    };
+
+    NullBuffer g_nullBuffer;
+    std::wostream g_null(&g_nullBuffer);
+
+    typedef std::chrono::steady_clock Clock;
+
+    int64_t elapsedNs(Clock::time_point started) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - started).count();
+    }
+
+    SimulationConfig catalog(long updates) {
+        SimulationConfig config;
+        config.updateCount = updates;
+        config.failureRate = 0.02;
+        return config;
+    }
+
+    // A manager whose search has run and whose metadata is loaded
+    struct LoadedManager {
+        SimulatedBackend backend;
+        UpdateManager manager;
+
+        explicit LoadedManager(long updates) : backend(catalog(updates)), manager(backend) {
+            manager.searchForUpdates(std::vector<std::wstring>(1, L"IsInstalled=0"), SearchOptions());
+            manager.loadRecords();
+        }
+    };
+
+    int64_t benchCriteriaLoading(long updates) {
+        // One query per update, with the comments and blank lines real files have
+        static std::map<long, std::string> files;
+        std::string& path = files[updates];
+        if (path.empty()) {
+            std::error_code error;
+            std::filesystem::path directory = std::filesystem::temp_directory_path(error);
+            path = (directory / ("wupdater_bench_criteria_" + std::to_string(updates) + ".txt")).string();
+            std::ofstream file(path);
+            for (long i = 0; i < updates; i++) {
+                if (i % 10 == 0) {
+                    file << "# group " << i / 10 << "\n\n";
+                }
+                file << "  IsInstalled=0 AND Type='Software' AND CategoryIDs contains '" << i << "'\r\n";
+            }
+        }
+
+        Clock::time_point started = Clock::now();
+        std::vector<std::wstring> criteria = getCriteriaFromFile(path);
+        std::wstring key;
+        for (const std::wstring& query : criteria) {
+            key += SearchCache::normalizeCriteria(query);
+        }
+        return elapsedNs(started);
+    }
+
+    int64_t benchEnumeration(long updates) {
+        SimulatedBackend backend(catalog(updates));
+        UpdateManager manager(backend);
+        manager.searchForUpdates(std::vector<std::wstring>(1, L"IsInstalled=0"), SearchOptions());
+
+        Clock::time_point started = Clock::now();
+        manager.loadRecords();
+        return elapsedNs(started);
+    }
+
+    int64_t benchErrorLookup(long updates) {
+        static const HRESULT kCodes[] = {
+            WU_E_DOWNLOAD_FAILED, WU_E_NO_SERVICE, WU_E_INSTALL_NOT_ALLOWED, WU_E_NOT_APPLICABLE,
+            WU_E_CALL_CANCELLED, E_ACCESSDENIED, E_FAIL, static_cast<HRESULT>(0x8024FFFF),
+            static_cast<HRESULT>(0x80072EE2), static_cast<HRESULT>(0x80070BC9)
+        };
+        const size_t codeCount = sizeof(kCodes) / sizeof(kCodes[0]);
+
+        Clock::time_point started = Clock::now();
+        size_t characters = 0;
+        for (long i = 0; i < updates; i++) {
+            HRESULT hr = kCodes[static_cast<size_t>(i) % codeCount];
+            characters += ErrorMessages::getErrorMessage(hr).size();
+            characters += ErrorMessages::getErrorCategory(hr).size();
+            characters += ErrorMessages::isRecoverableError(hr) ? 1 : 0;
+        }
+        int64_t ns = elapsedNs(started);
+        g_null << characters;
+        return ns;
+    }
+
+    int64_t benchMessageFormatting(long updates) {
+        Clock::time_point started = Clock::now();
+        size_t characters = 0;
+        wchar_t date[16];
+        for (long i = 0; i < updates; i++) {
+            characters += formatDate(40000.0 + i % 9000, date, sizeof(date) / sizeof(date[0]));
+            characters += Messages::Results::getResultMessage(static_cast<int>(i % 6)).size();
+            characters += Messages::Status::changeRevised(static_cast<int32_t>(i), static_cast<int32_t>(i + 1)).size();
+            characters += Messages::Status::updatesFoundCount(i).size();
+        }
+        int64_t ns = elapsedNs(started);
+        g_null << characters;
+        return ns;
+    }
+
+    int64_t benchOutput(long updates, OutputFormat format) {
+        LoadedManager loaded(updates);
+        RecordWriter writer(g_null, format);
+        if (format != OutputFormat::TEXT) {
+            loaded.manager.setRecordWriter(&writer);
+        }
+
+        std::vector<UpdateHandle> toDownload;
+        Clock::time_point started = Clock::now();
+        loaded.manager.printUpdateInfo(toDownload);
+        writer.flush();
+        return elapsedNs(started);
+    }
+
+    // Search, enumerate, list, download and install, as a quiet run does
+    int64_t benchOrchestration(long updates) {
+        SimulatedBackend backend(catalog(updates));
+
+        Clock::time_point started = Clock::now();
+        UpdateManager manager(backend);
+        manager.setWorkerThreads(4);
+        manager.searchForUpdates(std::vector<std::wstring>(1, L"IsInstalled=0"), SearchOptions());
+        std::vector<UpdateHandle> toDownload;
+        manager.printUpdateInfo(toDownload);
+        manager.downloadUpdates(toDownload);
+        manager.installUpdates();
+        return elapsedNs(started);
+    }
+
+    const Benchmark kBenchmarks[] = {
+        { "criteria_loading", benchCriteriaLoading },
+        { "enumeration", benchEnumeration },
+        { "error_lookup", benchErrorLookup },
+        { "message_formatting", benchMessageFormatting },
+        { "output_text", [](long updates) { return benchOutput(updates, OutputFormat::TEXT); } },
+        { "output_jsonl", [](long updates) { return benchOutput(updates, OutputFormat::JSONL); } },
+        { "output_csv", [](long updates) { return benchOutput(updates, OutputFormat::CSV); } },
+        { "orchestration", benchOrchestration },
+    };
+
+    BenchResult measure(const Benchmark& benchmark, long updates, unsigned minTimeMs) {
+        std::vector<int64_t> samples;
+        const int64_t budgetNs = static_cast<int64_t>(minTimeMs) * 1000000;
+        int64_t totalNs = 0;
+        while (samples.size() < kMaxIterations && (samples.size() < kMinIterations || totalNs < budgetNs)) {
+            int64_t ns = benchmark.run(updates);
+            samples.push_back(ns);
+            totalNs += ns;
+        }
+
+        BenchResult result;
+        result.name = benchmark.name;
+        result.updates = updates;
+        result.iterations = samples.size();
+        result.meanNs = totalNs / static_cast<int64_t>(samples.size());
+        std::sort(samples.begin(), samples.end());
+        result.minNs = samples.front();
+        result.medianNs = samples[samples.size() / 2];
+        return result;
+    }
+
+    std::string resultKey(const std::string& name, long updates) {
+        return name + "/" + std::to_string(updates);
+    }
+
+    // Value of "field": in one line written by writeResults
+    bool findField(const std::string& line, const std::string& field, std::string& value) {
+        std::string marker = "\"" + field + "\":";
+        size_t start = line.find(marker);
+        if (start == std::string::npos) {
+            return false;
+        }
+        start += marker.size();
+        if (start < line.size() && line[start] == '"') {
+            size_t end = line.find('"', start + 1);
+            if (end == std::string::npos) {
+                return false;
+            }
+            value = line.substr(start + 1, end - start - 1);
+            return true;
+        }
+        size_t end = line.find_first_of(",}", start);
+        value = line.substr(start, end == std::string::npos ? std::string::npos : end - start);
+        return true;
+    }
+
+    // Medians by name/size from a file written by an earlier run
+    bool loadBaseline(const std::string& path, std::map<std::string, int64_t>& medians) {
+        std::ifstream file(path);
+        if (!file.is_open()) {
+            return false;
+        }
+        std::string line;
+        std::string name;
+        std::string updates;
+        std::string median;
+        while (std::getline(file, line)) {
+            if (findField(line, "name", name) && findField(line, "updates", updates) &&
+                findField(line, "median_ns", median)) {
+                medians[resultKey(name, std::atol(updates.c_str()))] = std::atoll(median.c_str());
+            }
+        }
+        return true;
+    }
+
+    std::string formatResults(const std::vector<BenchResult>& results,
+                              const std::map<std::string, int64_t>& baseline) {
+        std::ostringstream out;
+        out << "{\"schema\":1,\"benchmarks\":[";
+        for (size_t i = 0; i < results.size(); i++) {
+            const BenchResult& result = results[i];
+            out << (i > 0 ? ",\n" : "\n")
+                << "{\"name\":\"" << result.name << "\",\"updates\":" << result.updates
+                << ",\"iterations\":" << result.iterations << ",\"median_ns\":" << result.medianNs
+                << ",\"min_ns\":" << result.minNs << ",\"mean_ns\":" << result.meanNs
+                << ",\"ns_per_update\":" << result.medianNs / (result.updates > 0 ? result.updates : 1);
+            auto previous = baseline.find(resultKey(result.name, result.updates));
+            if (previous != baseline.end() && previous->second > 0) {
+                char change[32];
+                std::snprintf(change, sizeof(change), "%.1f",
+                              100.0 * (result.medianNs - previous->second) / previous->second);
+                out << ",\"baseline_median_ns\":" << previous->second << ",\"change_pct\":" << change;
+            }
+            out << "}";
+        }
+        out << "\n]}\n";
+        return out.str();
+    }
+
+    bool parseSizes(const std::string& text, std::vector<long>& sizes) {
+        sizes.clear();
+        std::istringstream in(text);
+        std::string item;
+        while (std::getline(in, item, ',')) {
+            char* end = nullptr;
+            long value = std::strtol(item.c_str(), &end, 10);
+            if (item.empty() || *end != '\0' || value < 10 || value > 50000) {
+                return false;
+            }
+            sizes.push_back(value);
+        }
+        return !sizes.empty();
+    }
+
+    int parseBenchArguments(int argc, char* argv[], BenchOptions& options) {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            bool hasValue = i + 1 < argc;
+            if (arg == "--sizes" && hasValue) {
+                if (!parseSizes(argv[++i], options.sizes)) {
+                    std::cerr << "[!] --sizes expects a comma separated list of counts from 10 to 50000." << std::endl;
+                    return -1;
+                }
+            } else if (arg == "--filter" && hasValue) {
+                options.filter = argv[++i];
+            } else if (arg == "--min-time-ms" && hasValue) {
+                options.minTimeMs = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+            } else if (arg == "--out" && hasValue) {
+                options.outputPath = argv[++i];
+            } else if (arg == "--baseline" && hasValue) {
+                options.baselinePath = argv[++i];
+            } else if (arg == "--threshold" && hasValue) {
+                options.thresholdPercent = std::strtod(argv[++i], nullptr);
+            } else {
+                std::cerr << "Usage: " << argv[0] << " [--sizes 10,1000,50000] [--filter NAME] [--min-time-ms MS]\n"
+                          << "\t[--out PATH] [--baseline PATH] [--threshold PCT]" << std::endl;
+                return -1;
+            }
+        }
+        return 0;
+    }
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::ios::sync_with_stdio(false);
+
+    BenchOptions options;
+    if (parseBenchArguments(argc, argv, options) != 0) {
+        return 2;
+    }
+
+    std::map<std::string, int64_t> baseline;
+    if (!options.baselinePath.empty() && !loadBaseline(options.baselinePath, baseline)) {
+        std::cerr << "[!] Unable to read baseline: " << options.baselinePath << std::endl;
+        return 2;
+    }
+
+    // The engine reports to std::wcout; keep it out of the measurements
+    std::wstreambuf* console = std::wcout.rdbuf(&g_nullBuffer);
+
+    std::vector<BenchResult> results;
+    for (const Benchmark& benchmark : kBenchmarks) {
+        if (!options.filter.empty() && std::string(benchmark.name).find(options.filter) == std::string::npos) {
+            continue;
+        }
+        for (long updates : options.sizes) {
+            results.push_back(measure(benchmark, updates, options.minTimeMs));
+            const BenchResult& result = results.back();
+            std::fprintf(stderr, "%-20s %6ld updates  %12.3f ms  (%zu iterations)\n", result.name.c_str(),
+                         result.updates, result.medianNs / 1e6, result.iterations);
+        }
+    }
+
+    std::wcout.rdbuf(console);
+
+    std::string json = formatResults(results, baseline);
+    if (options.outputPath.empty()) {
+        std::cout << json << std::flush;
+    } else {
+        std::ofstream file(options.outputPath, std::ios::binary);
+        file << json;
+        if (!file) {
+            std::cerr << "[!] Unable to write results: " << options.outputPath << std::endl;
+            return 2;
+        }
+    }
+
+    // Compare against the baseline; noise below the threshold is ignored
+    int regressions = 0;
+    for (const BenchResult& result : results) {
+        auto previous = baseline.find(resultKey(result.name, result.updates));
+        if (previous == baseline.end() || previous->second <= 0) {
+            continue;
+        }
+        double change = 100.0 * (result.medianNs - previous->second) / previous->second;
+        if (change > options.thresholdPercent) {
+            std::fprintf(stderr, "[!] Regression: %s at %ld updates is %.1f%% slower (%.3f ms -> %.3f ms)\n",
+                         result.name.c_str(), result.updates, change, previous->second / 1e6, result.medianNs / 1e6);
+            regressions++;
+        }
+    }
+    if (!baseline.empty()) {
+        std::fprintf(stderr, "%d regression(s) above %.1f%%\n", regressions, options.thresholdPercent);
+    }
+    return regressions > 0 ? 1 : 0;
+}
@@ -0,0 +1,708 @@
+// Unit tests for the portable core, run against synthetic inputs and the
+// simulated backend so they work on any platform:
+//
+//   wupdater_tests [SUITE]
+//
+// Without SUITE every test runs. The exit code is 1 if any check failed.
+
+#include "content_cache.h"
+#include "install_planner.h"
+#include "run_journal.h"
+#include "simulated_backend.h"
+#include "window_scheduler.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace WUpdater;
+
+namespace {
+
+    struct Test {
+        const char* suite;
+        const char* name;
+        void (*run)();
+    };
+
+    int g_failures = 0;
+
+    void check(bool condition, const char* expression, const char* file, int line) {
+        if (!condition) {
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expression);
+            g_failures++;
+        }
+    }
+
+#define CHECK(condition) check((condition), #condition, __FILE__, __LINE__)
+
+    typedef std::vector<size_t> Positions;
+
+    // --- window_scheduler ---------------------------------------------------
+
+    WindowCandidate candidate(double seconds, Severity severity = Severity::UNSPECIFIED) {
+        WindowCandidate result;
+        result.seconds = seconds;
+        result.severity = severity;
+        return result;
+    }
+
+    void windowAllFit() {
+        const std::vector<WindowCandidate> candidates = { candidate(600), candidate(900), candidate(300) };
+        const WindowPlan plan = scheduleWindow(candidates, 3600);
+        CHECK((plan.selected == Positions{ 0, 1, 2 }));
+        CHECK(plan.deferred.empty());
+        CHECK(plan.plannedSeconds == 1800);
+    }
+
+    void windowExactFit() {
+        const std::vector<WindowCandidate> candidates = { candidate(1800), candidate(1800) };
+        const WindowPlan plan = scheduleWindow(candidates, 3600);
+        CHECK((plan.selected == Positions{ 0, 1 }));
+        CHECK(plan.plannedSeconds == 3600);
+    }
+
+    void windowSeverityFirst() {
+        // Only two fit; the low-severity update loses even though it comes first
+        const std::vector<WindowCandidate> candidates = {
+            candidate(1800, Severity::LOW), candidate(1800, Severity::CRITICAL), candidate(1800, Severity::IMPORTANT)
+        };
+        const WindowPlan plan = scheduleWindow(candidates, 3600);
+        CHECK((plan.selected == Positions{ 1, 2 }));
+        CHECK((plan.deferred == Positions{ 0 }));
+    }
+
+    void windowShortFirstAtEqualSeverity() {
+        const std::vector<WindowCandidate> candidates = {
+            candidate(3000, Severity::IMPORTANT), candidate(1000, Severity::IMPORTANT), candidate(1000, Severity::IMPORTANT)
+        };
+        const WindowPlan plan = scheduleWindow(candidates, 2500);
+        CHECK((plan.selected == Positions{ 1, 2 }));
+        CHECK((plan.deferred == Positions{ 0 }));
+        CHECK(plan.plannedSeconds == 2000);
+    }
+
+    void windowSkipsWhatDoesNotFit() {
+        // A severe update that does not fit leaves room for less severe ones
+        const std::vector<WindowCandidate> candidates = {
+            candidate(2000, Severity::CRITICAL), candidate(2000, Severity::CRITICAL), candidate(500, Severity::LOW)
+        };
+        const WindowPlan plan = scheduleWindow(candidates, 3000);
+        CHECK((plan.selected == Positions{ 0, 2 }));
+        CHECK((plan.deferred == Positions{ 1 }));
+        CHECK(plan.plannedSeconds == 2500);
+    }
+
+    void windowZeroBudget() {
+        const std::vector<WindowCandidate> candidates = { candidate(1), candidate(600, Severity::CRITICAL) };
+        const WindowPlan plan = scheduleWindow(candidates, 0);
+        CHECK(plan.selected.empty());
+        CHECK((plan.deferred == Positions{ 0, 1 }));
+        CHECK(plan.plannedSeconds == 0);
+    }
+
+    void windowNegativeBudget() {
+        // Even an update estimated at nothing does not fit a window already over
+        const std::vector<WindowCandidate> candidates = { candidate(0), candidate(60) };
+        const WindowPlan plan = scheduleWindow(candidates, -60);
+        CHECK(plan.selected.empty());
+        CHECK((plan.deferred == Positions{ 0, 1 }));
+    }
+
+    void windowLargerThanWindow() {
+        const std::vector<WindowCandidate> candidates = {
+            candidate(7200, Severity::CRITICAL), candidate(600, Severity::MODERATE)
+        };
+        const WindowPlan plan = scheduleWindow(candidates, 3600);
+        CHECK((plan.selected == Positions{ 1 }));
+        CHECK((plan.deferred == Positions{ 0 }));
+        CHECK(plan.plannedSeconds == 600);
+
+        const WindowPlan alone = scheduleWindow({ candidate(7200) }, 3600);
+        CHECK(alone.selected.empty());
+        CHECK((alone.deferred == Positions{ 0 }));
+    }
+
+    void windowNoCandidates() {
+        const WindowPlan plan = scheduleWindow({}, 3600);
+        CHECK(plan.selected.empty());
+        CHECK(plan.deferred.empty());
+        CHECK(plan.plannedSeconds == 0);
+    }
+
+    // --- install_planner ----------------------------------------------------
+
+    InstallTraits traits(InstallImpact impact, RebootBehavior reboot = RebootBehavior::NEVER) {
+        InstallTraits result;
+        result.impact = impact;
+        result.reboot = reboot;
+        return result;
+    }
+
+    size_t alwaysRebootBatches(const InstallPlan& plan) {
+        size_t count = 0;
+        for (const InstallBatch& batch : plan.batches) {
+            count += batch.reboot == RebootBehavior::ALWAYS ? 1 : 0;
+        }
+        return count;
+    }
+
+    void plannerNothingToInstall() {
+        const InstallPlan plan = planInstallBatches({});
+        CHECK(plan.batches.empty());
+        CHECK(plan.deferred.empty());
+    }
+
+    void plannerSharedBatch() {
+        const InstallPlan plan = planInstallBatches({
+            traits(InstallImpact::NORMAL), traits(InstallImpact::MINOR), traits(InstallImpact::NORMAL)
+        });
+        CHECK(plan.batches.size() == 1);
+        CHECK(!plan.batches.empty() && (plan.batches[0].positions == Positions{ 0, 1, 2 }));
+        CHECK(!plan.batches.empty() && !plan.batches[0].exclusive);
+        CHECK(plan.deferred.empty());
+    }
+
+    void plannerExclusiveAlone() {
+        const InstallPlan plan = planInstallBatches({
+            traits(InstallImpact::EXCLUSIVE), traits(InstallImpact::NORMAL),
+            traits(InstallImpact::EXCLUSIVE), traits(InstallImpact::NORMAL)
+        });
+        CHECK(plan.batches.size() == 3);
+        if (plan.batches.size() == 3) {
+            // Exclusive updates go before the shared batch at equal reboot behavior
+            CHECK((plan.batches[0].positions == Positions{ 0 }) && plan.batches[0].exclusive);
+            CHECK((plan.batches[1].positions == Positions{ 2 }) && plan.batches[1].exclusive);
+            CHECK((plan.batches[2].positions == Positions{ 1, 3 }) && !plan.batches[2].exclusive);
+        }
+        CHECK(plan.deferred.empty());
+    }
+
+    void plannerOneAlwaysRebootBatchLast() {
+        const InstallPlan plan = planInstallBatches({
+            traits(InstallImpact::NORMAL, RebootBehavior::ALWAYS),
+            traits(InstallImpact::EXCLUSIVE, RebootBehavior::CAN_REQUEST),
+            traits(InstallImpact::NORMAL, RebootBehavior::NEVER),
+            traits(InstallImpact::EXCLUSIVE, RebootBehavior::NEVER)
+        });
+        CHECK(alwaysRebootBatches(plan) == 1);
+        CHECK(plan.batches.size() == 3);
+        if (plan.batches.size() == 3) {
+            // Never before can-request; the shared batch that always reboots runs last
+            CHECK((plan.batches[0].positions == Positions{ 3 }));
+            CHECK((plan.batches[1].positions == Positions{ 1 }));
+            CHECK((plan.batches[2].positions == Positions{ 0, 2 }));
+            CHECK(plan.batches[2].reboot == RebootBehavior::ALWAYS);
+        }
+        CHECK(plan.deferred.empty());
+    }
+
+    void plannerExclusiveAlwaysRebootDeferred() {
+        // The shared batch takes the one restart slot
+        InstallPlan plan = planInstallBatches({
+            traits(InstallImpact::EXCLUSIVE, RebootBehavior::ALWAYS),
+            traits(InstallImpact::NORMAL, RebootBehavior::ALWAYS),
+            traits(InstallImpact::EXCLUSIVE, RebootBehavior::ALWAYS)
+        });
+        CHECK(alwaysRebootBatches(plan) == 1);
+        CHECK(plan.batches.size() == 1);
+        CHECK(!plan.batches.empty() && (plan.batches.back().positions == Positions{ 1 }));
+        CHECK((plan.deferred == Positions{ 0, 2 }));
+
+        // Without one, the first exclusive update that always reboots gets the slot
+        plan = planInstallBatches({
+            traits(InstallImpact::EXCLUSIVE, RebootBehavior::ALWAYS),
+            traits(InstallImpact::EXCLUSIVE, RebootBehavior::ALWAYS),
+            traits(InstallImpact::NORMAL, RebootBehavior::NEVER)
+        });
+        CHECK(alwaysRebootBatches(plan) == 1);
+        CHECK(plan.batches.size() == 2);
+        if (plan.batches.size() == 2) {
+            CHECK((plan.batches[0].positions == Positions{ 2 }));
+            CHECK((plan.batches[1].positions == Positions{ 0 }) && plan.batches[1].exclusive);
+        }
+        CHECK((plan.deferred == Positions{ 1 }));
+    }
+
+    void plannerKeepsListOrder() {
+        const InstallPlan plan = planInstallBatches({
+            traits(InstallImpact::NORMAL, RebootBehavior::CAN_REQUEST),
+            traits(InstallImpact::EXCLUSIVE),
+            traits(InstallImpact::NORMAL, RebootBehavior::NEVER),
+            traits(InstallImpact::MINOR, RebootBehavior::ALWAYS),
+            traits(InstallImpact::NORMAL, RebootBehavior::NEVER)
+        });
+        CHECK(plan.batches.size() == 2);
+        if (plan.batches.size() == 2) {
+            CHECK((plan.batches[1].positions == Positions{ 0, 2, 3, 4 }));
+            CHECK(plan.batches[1].reboot == RebootBehavior::ALWAYS);
+        }
+    }
+
+    // --- search -------------------------------------------------------------
+
+    typedef std::chrono::steady_clock Clock;
+
+    double secondsSince(Clock::time_point started) {
+        return std::chrono::duration<double>(Clock::now() - started).count();
+    }
+
+    SimulationConfig searchConfig(unsigned searchMs) {
+        SimulationConfig config;
+        config.updateCount = 10;
+        config.searchLatencyMs = searchMs;
+        return config;
+    }
+
+    void searchCompletesWithinTimeout() {
+        SimulatedBackend backend(searchConfig(100));
+        SearchOptions options;
+        options.timeoutSeconds = 5;
+        std::vector<UpdateHandle> found;
+        CHECK(backend.search(L"IsInstalled=0", options, found) == S_OK);
+        CHECK(!found.empty());
+    }
+
+    void searchTimesOut() {
+        SimulatedBackend backend(searchConfig(30000));
+        SearchOptions options;
+        options.timeoutSeconds = 1;
+        std::vector<UpdateHandle> found;
+        const Clock::time_point started = Clock::now();
+        CHECK(backend.search(L"IsInstalled=0", options, found) == WU_E_TIME_OUT);
+        const double elapsed = secondsSince(started);
+        CHECK(elapsed >= 0.9 && elapsed < 5);
+        CHECK(found.empty());
+    }
+
+    void searchCancelled() {
+        SimulatedBackend backend(searchConfig(30000));
+        std::atomic<bool> cancel(false);
+        SearchOptions options;
+        options.timeoutSeconds = 60;
+        options.cancel = &cancel;
+        std::vector<UpdateHandle> found;
+
+        std::thread canceller([&cancel]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            cancel = true;
+        });
+        const Clock::time_point started = Clock::now();
+        const HRESULT hr = backend.search(L"IsInstalled=0", options, found);
+        const double elapsed = secondsSince(started);
+        canceller.join();
+
+        CHECK(hr == WU_E_CALL_CANCELLED);
+        CHECK(elapsed < 5);
+        CHECK(found.empty());
+    }
+
+    void searchCancelledBeforeStart() {
+        SimulatedBackend backend(searchConfig(30000));
+        std::atomic<bool> cancel(true);
+        SearchOptions options;
+        options.cancel = &cancel;
+        std::vector<UpdateHandle> found;
+        const Clock::time_point started = Clock::now();
+        CHECK(backend.search(L"IsInstalled=0", options, found) == WU_E_CALL_CANCELLED);
+        CHECK(secondsSince(started) < 1);
+    }
+
+    // --- journal ------------------------------------------------------------
+
+    // A file in the temp directory, removed again when the test is done
+    class TempFile {
+    public:
+        explicit TempFile(const char* name)
+            : path_((std::filesystem::temp_directory_path() / name).string()) {
+            std::filesystem::remove(path_);
+        }
+        ~TempFile() { std::filesystem::remove(path_); }
+
+        const std::string& path() const { return path_; }
+
+        std::string read() const {
+            std::ifstream in(path_, std::ios::binary);
+            return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        }
+
+        void write(const std::string& data) const {
+            std::ofstream out(path_, std::ios::binary | std::ios::trunc);
+            out.write(data.data(), static_cast<std::streamsize>(data.size()));
+        }
+
+    private:
+        std::string path_;
+    };
+
+    const wchar_t kScope[] = L"simulated|IsInstalled=0";
+
+    UpdateTable journalTable() {
+        UpdateTable table;
+        const wchar_t* const ids[] = {
+            L"2a9c3b3e-0001-4f2e-9d6a-000000000001", L"2a9c3b3e-0002-4f2e-9d6a-000000000002",
+            L"2a9c3b3e-0003-4f2e-9d6a-000000000003", L"2a9c3b3e-0004-4f2e-9d6a-000000000004"
+        };
+        for (int32_t i = 0; i < 4; i++) {
+            UpdateRecord record;
+            record.updateId = ids[i];
+            record.revision = 200 + i;
+            table.append(record);
+        }
+        return table;
+    }
+
+    // A journal with a started run over journalTable() that reached DOWNLOAD_CONFIRMED
+    void beginRun(const TempFile& file) {
+        RunJournal journal(file.path());
+        std::string error;
+        CHECK(journal.open(error));
+        CHECK(journal.begin(kScope, journalTable()));
+        journal.record(JournalPhase::DOWNLOAD_CONFIRMED);
+    }
+
+    void journalReopen() {
+        TempFile file("wupdater_tests_reopen.wjr");
+        beginRun(file);
+        {
+            RunJournal journal(file.path());
+            std::string error;
+            CHECK(journal.open(error));
+            CHECK(journal.pending(kScope));
+            CHECK(!journal.pending(L"simulated|IsInstalled=1"));
+            CHECK(journal.lastPhase() == JournalPhase::DOWNLOAD_CONFIRMED);
+            CHECK(journal.reached(JournalPhase::STARTED) && !journal.reached(JournalPhase::DOWNLOADED));
+            CHECK(journal.updates().size() == 4);
+            if (journal.updates().size() == 4) {
+                CHECK(journal.updates()[2].updateId == L"2a9c3b3e-0003-4f2e-9d6a-000000000003");
+                CHECK(journal.updates()[2].revision == 202);
+            }
+
+            // Appends go after what was replayed
+            journal.record(JournalPhase::DOWNLOADED);
+        }
+        {
+            RunJournal journal(file.path());
+            std::string error;
+            CHECK(journal.open(error));
+            CHECK(journal.lastPhase() == JournalPhase::DOWNLOADED);
+            CHECK(journal.updates().size() == 4);
+            journal.record(JournalPhase::COMPLETE);
+        }
+        RunJournal journal(file.path());
+        std::string error;
+        CHECK(journal.open(error));
+        CHECK(!journal.pending(kScope));
+    }
+
+    void journalTruncatedRecord() {
+        TempFile file("wupdater_tests_torn.wjr");
+        beginRun(file);
+        const std::string intact = file.read();
+        {
+            RunJournal journal(file.path());
+            std::string error;
+            CHECK(journal.open(error));
+            journal.record(JournalPhase::DOWNLOADED);
+        }
+
+        // Cut the last record short, as a crash mid-write would
+        const std::string full = file.read();
+        CHECK(full.size() > intact.size());
+        file.write(full.substr(0, full.size() - 3));
+        {
+            RunJournal journal(file.path());
+            std::string error;
+            CHECK(journal.open(error));
+            CHECK(journal.pending(kScope));
+            CHECK(journal.lastPhase() == JournalPhase::DOWNLOAD_CONFIRMED);
+            CHECK(journal.updates().size() == 4);
+            CHECK(file.read() == intact);
+
+            journal.record(JournalPhase::INSTALL_CONFIRMED);
+        }
+        RunJournal journal(file.path());
+        std::string error;
+        CHECK(journal.open(error));
+        CHECK(journal.lastPhase() == JournalPhase::INSTALL_CONFIRMED);
+    }
+
+    void journalCorruptedCrc() {
+        TempFile file("wupdater_tests_crc.wjr");
+        beginRun(file);
+        const std::string intact = file.read();
+        {
+            RunJournal journal(file.path());
+            std::string error;
+            CHECK(journal.open(error));
+            journal.record(JournalPhase::DOWNLOADED);
+        }
+
+        // Same length, wrong content: only the CRC can tell
+        std::string damaged = file.read();
+        damaged.back() = static_cast<char>(damaged.back() ^ 0x01);
+        file.write(damaged);
+
+        RunJournal journal(file.path());
+        std::string error;
+        CHECK(journal.open(error));
+        CHECK(journal.lastPhase() == JournalPhase::DOWNLOAD_CONFIRMED);
+        CHECK(journal.updates().size() == 4);
+        CHECK(file.read() == intact);
+    }
+
+    void journalNotAJournal() {
+        TempFile file("wupdater_tests_foreign.wjr");
+        file.write("this is not a run journal at all");
+        RunJournal journal(file.path());
+        std::string error;
+        CHECK(!journal.open(error));
+        CHECK(!error.empty());
+    }
+
+    void journalResumeSkipsInstalled() {
+        TempFile file("wupdater_tests_resume.wjr");
+        beginRun(file);
+        {
+            RunJournal journal(file.path());
+            std::string error;
+            CHECK(journal.open(error));
+            const UpdateTable table = journalTable();
+            UpdateOutcome outcome;
+            outcome.result = ResultCode::SUCCEEDED;
+            for (size_t row = 0; row < table.size(); row++) {
+                journal.recordOutcome(ProgressPhase::DOWNLOADING, table.updateId(row), table.revision(row), outcome);
+            }
+            journal.record(JournalPhase::DOWNLOADED);
+
+            // Installed, installed with errors, failed; the last update never got that far
+            journal.recordOutcome(ProgressPhase::INSTALLING, table.updateId(0), table.revision(0), outcome);
+            outcome.result = ResultCode::SUCCEEDED_WITH_ERRORS;
+            journal.recordOutcome(ProgressPhase::INSTALLING, table.updateId(1), table.revision(1), outcome);
+            outcome.result = ResultCode::FAILED;
+            outcome.hresult = WU_E_INSTALL_NOT_ALLOWED;
+            journal.recordOutcome(ProgressPhase::INSTALLING, table.updateId(2), table.revision(2), outcome);
+            CHECK(journal.commit());
+        }
+
+        RunJournal journal(file.path());
+        std::string error;
+        CHECK(journal.open(error));
+        CHECK(journal.pending(kScope));
+        std::vector<int32_t> remaining;
+        for (const JournalUpdate& update : journal.updates()) {
+            if (!update.installed) {
+                remaining.push_back(update.revision);
+            }
+        }
+        CHECK((remaining == std::vector<int32_t>{ 202, 203 }));
+    }
+
+    // --- content_cache ------------------------------------------------------
+
+    // A directory in the temp directory, removed with its content when the test is done
+    class TempDirectory {
+    public:
+        explicit TempDirectory(const char* name)
+            : path_((std::filesystem::temp_directory_path() / name).string()) {
+            std::filesystem::remove_all(path_);
+        }
+        ~TempDirectory() { std::filesystem::remove_all(path_); }
+
+        const std::string& path() const { return path_; }
+
+        // Payload files stored under content/, and fetches left behind
+        size_t payloadFiles() const {
+            size_t count = 0;
+            for (const auto& entry : std::filesystem::recursive_directory_iterator(std::filesystem::path(path_) / "content")) {
+                count += entry.is_regular_file() ? 1 : 0;
+            }
+            return count;
+        }
+
+    private:
+        std::string path_;
+    };
+
+    // One update of a simulated catalog, with the identity the cache files it under
+    struct CachedUpdate {
+        UpdateHandle handle;
+        std::wstring updateId;
+        int32_t revision = 0;
+    };
+
+    SimulationConfig cacheConfig() {
+        SimulationConfig config;
+        config.updateCount = 10;
+        config.downloadedRatio = 0;
+        config.maxSize = 1024 * 1024;
+        return config;
+    }
+
+    CachedUpdate findUpdate(SimulatedBackend& backend, size_t position) {
+        CachedUpdate update;
+        std::vector<UpdateHandle> found;
+        CHECK(backend.search(L"IsInstalled=0", SearchOptions(), found) == S_OK);
+        CHECK(found.size() > position);
+        if (found.size() > position) {
+            update.handle = found[position];
+            CHECK(backend.getIdentity(update.handle, update.updateId, update.revision) == S_OK);
+        }
+        return update;
+    }
+
+    bool isDownloaded(SimulatedBackend& backend, const CachedUpdate& update) {
+        UpdateRecord record;
+        return backend.getUpdate(update.handle, record) == S_OK && record.isDownloaded;
+    }
+
+    std::filesystem::path onlyPayload(const TempDirectory& directory) {
+        for (const auto& entry : std::filesystem::recursive_directory_iterator(std::filesystem::path(directory.path()) / "content")) {
+            if (entry.is_regular_file()) {
+                return entry.path();
+            }
+        }
+        return std::filesystem::path();
+    }
+
+    void cacheManifestRoundTrip() {
+        TempDirectory directory("wupdater_tests_cache_roundtrip");
+        SimulatedBackend exporter(cacheConfig());
+        const CachedUpdate update = findUpdate(exporter, 0);
+        {
+            ContentCache cache(directory.path());
+            std::string error;
+            CHECK(cache.open(error));
+            CHECK(!cache.contains(update.updateId, update.revision));
+            CHECK(cache.exportUpdate(exporter, update.handle, update.updateId, update.revision) == S_OK);
+            CHECK(cache.contains(update.updateId, update.revision));
+        }
+
+        // Another host opens the same directory and stages the update from it
+        SimulatedBackend importer(cacheConfig());
+        const CachedUpdate same = findUpdate(importer, 0);
+        ContentCache cache(directory.path());
+        std::string error;
+        CHECK(cache.open(error));
+        CHECK(cache.contains(same.updateId, same.revision));
+        CHECK(!cache.contains(same.updateId, same.revision + 1));
+        CHECK(cache.importUpdate(importer, same.handle, same.updateId, same.revision) == S_OK);
+        CHECK(isDownloaded(importer, same));
+
+        // An update nobody exported is left to the download
+        const CachedUpdate other = findUpdate(importer, 1);
+        CHECK(cache.importUpdate(importer, other.handle, other.updateId, other.revision) == S_FALSE);
+        CHECK(!isDownloaded(importer, other));
+    }
+
+    void cacheRejectsDigestMismatch() {
+        TempDirectory directory("wupdater_tests_cache_digest");
+        SimulatedBackend backend(cacheConfig());
+        const CachedUpdate update = findUpdate(backend, 0);
+        ContentCache cache(directory.path());
+        std::string error;
+        CHECK(cache.open(error));
+        CHECK(cache.exportUpdate(backend, update.handle, update.updateId, update.revision) == S_OK);
+
+        // Same size, one byte changed on the share
+        const std::filesystem::path payload = onlyPayload(directory);
+        CHECK(!payload.empty());
+        std::string bytes;
+        {
+            std::ifstream in(payload, std::ios::binary);
+            bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        }
+        CHECK(!bytes.empty());
+        if (!bytes.empty()) {
+            bytes[bytes.size() / 2] = static_cast<char>(bytes[bytes.size() / 2] ^ 0x20);
+            std::ofstream out(payload, std::ios::binary | std::ios::trunc);
+            out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+        }
+
+        // Turned away before the agent sees it, not failed by the agent
+        CHECK(cache.importUpdate(backend, update.handle, update.updateId, update.revision) == S_FALSE);
+        CHECK(!isDownloaded(backend, update));
+    }
+
+    void cacheReusesStagedFile() {
+        TempDirectory directory("wupdater_tests_cache_reuse");
+        SimulatedBackend backend(cacheConfig());
+        const CachedUpdate update = findUpdate(backend, 0);
+        ContentCache cache(directory.path());
+        std::string error;
+        CHECK(cache.open(error));
+        CHECK(cache.exportUpdate(backend, update.handle, update.updateId, update.revision) == S_OK);
+        const std::filesystem::path payload = onlyPayload(directory);
+        CHECK(!payload.empty());
+        if (payload.empty()) {
+            return;
+        }
+
+        // A second export, as by another host, keeps the file already at the content address
+        const auto staged = std::filesystem::last_write_time(payload) - std::chrono::hours(1);
+        std::filesystem::last_write_time(payload, staged);
+        CHECK(cache.exportUpdate(backend, update.handle, update.updateId, update.revision) == S_OK);
+        CHECK(directory.payloadFiles() == 1);
+        CHECK(std::filesystem::last_write_time(payload) == staged);
+
+        CHECK(cache.importUpdate(backend, update.handle, update.updateId, update.revision) == S_OK);
+        CHECK(isDownloaded(backend, update));
+    }
+
+    const Test kTests[] = {
+        { "window_scheduler", "all fit", windowAllFit },
+        { "window_scheduler", "exact fit", windowExactFit },
+        { "window_scheduler", "severity first", windowSeverityFirst },
+        { "window_scheduler", "short first at equal severity", windowShortFirstAtEqualSeverity },
+        { "window_scheduler", "skips what does not fit", windowSkipsWhatDoesNotFit },
+        { "window_scheduler", "zero budget", windowZeroBudget },
+        { "window_scheduler", "negative budget", windowNegativeBudget },
+        { "window_scheduler", "larger than the window", windowLargerThanWindow },
+        { "window_scheduler", "no candidates", windowNoCandidates },
+        { "install_planner", "nothing to install", plannerNothingToInstall },
+        { "install_planner", "shared batch", plannerSharedBatch },
+        { "install_planner", "exclusive updates alone", plannerExclusiveAlone },
+        { "install_planner", "one always-reboot batch, last", plannerOneAlwaysRebootBatchLast },
+        { "install_planner", "exclusive always-reboot deferred", plannerExclusiveAlwaysRebootDeferred },
+        { "install_planner", "keeps list order", plannerKeepsListOrder },
+        { "search", "completes within the timeout", searchCompletesWithinTimeout },
+        { "search", "times out", searchTimesOut },
+        { "search", "cancelled", searchCancelled },
+        { "search", "cancelled before it starts", searchCancelledBeforeStart },
+        { "journal", "begin, append and reopen", journalReopen },
+        { "journal", "truncated last record", journalTruncatedRecord },
+        { "journal", "corrupted CRC", journalCorruptedCrc },
+        { "journal", "not a journal", journalNotAJournal },
+        { "journal", "resume skips installed updates", journalResumeSkipsInstalled },
+        { "content_cache", "manifest round trip", cacheManifestRoundTrip },
+        { "content_cache", "rejects a digest mismatch", cacheRejectsDigestMismatch },
+        { "content_cache", "reuses a staged file", cacheReusesStagedFile },
+    };
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    const std::string suite = argc > 1 ? argv[1] : "";
+    size_t ran = 0;
+    for (const Test& test : kTests) {
+        if (!suite.empty() && suite != test.suite) {
+            continue;
+        }
+        const int before = g_failures;
+        test.run();
+        ran++;
+        std::printf("%s %s: %s\n", g_failures == before ? "[ OK ]" : "[FAIL]", test.suite, test.name);
+    }
+
+    if (ran == 0) {
+        std::fprintf(stderr, "No tests in suite '%s'\n", suite.c_str());
+        return 1;
+    }
+    std::printf("%zu tests, %d failed checks\n", ran, g_failures);
+    return g_failures == 0 ? 0 : 1;
+}